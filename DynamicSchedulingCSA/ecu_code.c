@@ -33,7 +33,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "CanBasicDemo-v1.h"
+#include "ecu_rings.h"
+#include "ecu_snapshot.h"
+#include "ecu_kernels.h"
 #include <Cpu/Irq/IfxCpu_Irq.h>
+#include <Src/Std/IfxSrc.h>
 #include "IfxCpu.h"
 #include <Math.h>
 #include "time.h"
@@ -46,6 +50,23 @@
 #define ISR_PRIORITY_TOM      3                       /* Interrupt priority number                                    */
 #define ISR_PRIORITY_TOM1     2                       /* Interrupt1 priority number                                   */
 #define ISR_PRIORITY_TOM2     1                       /* Interrupt2 priority number                                   */
+#define ISR_PRIORITY_MODE     1                       /* mode switch task, below every ISR (TOM2 is not used)        */
+#define MODE_SWITCH_SRC       (&SRC_GPSR00)           /* software service request of the mode switch task             */
+#ifndef ECU_PARTITIONED
+#define ECU_PARTITIONED       0                       /* 1: CAN and TOM on core 0, controllers and updateutil on core 1 */
+#endif
+#if ECU_PARTITIONED
+#define MODE_SWITCH_TOS       IfxSrc_Tos_cpu1
+#else
+#define MODE_SWITCH_TOS       IfxSrc_Tos_cpu0
+#endif
+#define ISR_PRIORITY_CORE1_TX 4                       /* core 0, sends the actuator commands of core 1                */
+#define CORE1_TX_SRC          (&SRC_GPSR01)           /* raised by core 1 after pushing on act_ring                   */
+#if defined(__tricore__)
+#define ECU_LMU_BSS           __attribute__((section(".lmubss")))  /* LMU RAM, shared by both cores               */
+#else
+#define ECU_LMU_BSS
+#endif
 #define TOM_FREQ              100.0f                  /* TOM frequency                                                */
 #define TOM_FREQ_1            120.0f                  /* TOM frequency                                                */
 #define LED1                  &MODULE_P20, 12         /* LED which will be toggled in Interrupt Service Routine (ISR) */
@@ -53,6 +74,14 @@
 #define IFX_INTTOS_CAN_TXRX   0
 #define MAX_TICKS             20
 #define WAIT_TIME             3
+#define SLOT_MS               ((int)(1000 / TOM_FREQ))  /* TOM tick = slot of the dispatch table, in ms               */
+#define MAX_SLOTS_HP          120                     /* longest hyperperiod of the dispatch table, in slots          */
+#define MAX_JOBS_HP           (2 * MAX_SLOTS_HP)      /* jobs of both tasks in one hyperperiod                        */
+#define QC_RX_PERIOD_MS       10                      /* period of the quadcopter sensor frames                       */
+#define RX_ID_COUNT           0x800                   /* standard identifiers, index of rx_id_map                     */
+#define RX_DRAIN_MAX          16                      /* messages read per RX interrupt at most, twice RX FIFO 0      */
+#define QC_GAIN_SETS          4                       /* sampling periods with gains in qc_gain_table                 */
+#define TX_QUEUE_BUFFERS      20                      /* dedicated TX buffers of CAN1 node 0, one queue entry each    */
 /*********************************************************************************************************************/
 /*-------------------------------------------------Global variables--------------------------------------------------*/
 /*********************************************************************************************************************/
@@ -61,12 +90,65 @@ IfxGtm_Tom_Timer g_timerDriver1;                     /* TOM driver 1
 IfxGtm_Tom_Timer g_timerDriver2;                     /* TOM driver 2                                                 */
 App_CanBasic g_CanBasic;
 Ifx_TickTime g_tickFor3ms;
+typedef struct {
+    uint8 task;                                       /* 0: qc alt, 1: qc                                             */
+    uint8 exec;                                       /* css bit of this instance, 0 = skipped                        */
+    uint8 tx_u01;                                     /* also sends u_QC[0..1] on qc_tx_id[1]                         */
+} dispatch_job;
+typedef struct {
+    uint16 first;                                     /* first job of the slot in dispatch_table.jobs                 */
+    uint8 count;
+} dispatch_slot;
+typedef struct {
+    int len;                                          /* slots in one hyperperiod, 0 = not built                      */
+    int n_jobs;
+    dispatch_slot slots[MAX_SLOTS_HP];
+    dispatch_job jobs[MAX_JOBS_HP];
+} dispatch_table;
+typedef struct {
+    int h;                                            /* sampling period in ms                                        */
+    float a[12][12];
+    float b[12][4];
+    float K[4][12];
+} qc_gains;
+typedef struct {
+    int h;
+    float a[4][4];
+    float b[4][2];
+    float K[2][4];
+} qc_alt_gains;
+typedef struct {
+    uint8 task_per[2];                                /* periodicity of each task as index in h_list                  */
+    uint32 hp;                                        /* hyperperiod in ms                                            */
+    const qc_alt_gains *qc_alt;                       /* gains of task_per[0]                                         */
+    const qc_gains *qc;                               /* gains of task_per[1]                                         */
+    dispatch_table table;
+} mode_desc;
 typedef struct {
     float util;
     int len;
     int h;
     int acess[];
 } acess;
+typedef struct {
+    void (*handler)(uint8 arg, const uint32 *data, uint64 stamp);
+    uint8 arg;                                        /* passed to handler, e.g. the sensor pair                      */
+    Ifx_TickTime period;                              /* nominal STM ticks between two frames, 0 = not periodic       */
+    uint64 last_stamp;                                /* STM time of the last frame                                   */
+    uint32 frames;
+    uint32 lost;                                      /* frames missing from the gaps between arrivals                */
+} rx_handler;
+typedef struct {
+    uint32 id;
+    uint32 data[2];
+    uint64 stamp;                                     /* STM time of the enqueue                                      */
+    uint8 used;                                       /* in tx_order                                                  */
+    uint8 queued;                                     /* waits for its buffer                                         */
+    uint32 sent;
+    uint32 replaced;                                  /* overwritten by a newer message before their buffer was free  */
+    uint64 wait_total;                                /* STM ticks from enqueue to transmit request, over sent        */
+    uint64 wait_max;
+} tx_queue_entry;
 
 /*-------------------------------------------control/detection task-related variables--------------------------------------------------*/
 
@@ -77,6 +159,13 @@ IfxCan_Message txQc1;
 IfxCan_Message txQc2;
 IfxCan_Message txQc3;
 IfxCan_Message txQc4;
+IfxCan_Message *const qc_tx_msg[3] = {&txQc1, &txQc2, &txQc3};
+/* CAN1 TX queue: one entry per dedicated TX buffer, requested as soon as the buffer is free, by the sender or else by
+ * the transmission completed ISR. tx_order lists the buffers in use by ascending ID, i.e. CAN priority. */
+tx_queue_entry tx_queue[TX_QUEUE_BUFFERS];
+uint8 tx_order[TX_QUEUE_BUFFERS];
+uint8 tx_order_len = 0;
+uint8 tx_queued = 0;                                  /* entries waiting for their buffer                             */
 uint32 txDataQC_alt[2];
 uint32 txDataQC1[2];
 uint32 txDataQC2[2];
@@ -93,6 +182,12 @@ const uint32 qc_rx_id[6] = {0x11, 0x21, 0x31, 0x41, 0x51, 0x61};//17;
 const unsigned int QC_X_OFFSET[12] = {200, 200, 20, 20, 200, 200, 20, 20, 200, 200, 20, 20};
 const unsigned int QC_X_FACTOR[12] = {1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000};
 uint8 sensed_qc[2] = {0,0};
+/* RX FIFO 0 dispatch: rx_handlers[rx_id_map[id]] handles the frames of standard identifier id; entry 0 counts the
+ * frames nobody handles. Filled by rx_dispatch_init. */
+uint8 rx_id_map[RX_ID_COUNT];
+rx_handler rx_handlers[7];
+volatile uint32 rx_fifo_overflows = 0;                /* interrupts that found RF0L set: FIFO 0 overwrote messages    */
+volatile uint32 rx_batch_max = 0;                     /* most messages read in one interrupt                          */
 extern volatile __far int curIdx_qc_alt = 0;
 extern volatile __far int curIdx_qc = 0;
 
@@ -101,9 +196,155 @@ extern volatile __far float xhat_QC[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 extern volatile __far uint32 y_QC[12] = {200000, 200000, 20000, 20000, 200000, 200000, 20000, 20000, 200000, 200000, 20000, 20000};//{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 extern volatile __far float u_QC_alt[2] = {0, 0};
 extern volatile __far float u_QC[4] = {0, 0, 0, 0};
+/* The RX ISR writes the sensor outputs into qc_sensors; every control job runs on a consistent copy of it in y_QC,
+ * taken at its release (time stamp in qc_y_stamp). The controllers publish u_QC/u_QC_alt in qc_actuators; with
+ * ECU_PARTITIONED core 0 does it for them, as modeSwitchTask reads them on core 1 and must not preempt the writer. */
+typedef struct { uint32 y[12]; } qc_sensor_vec;
+typedef struct { float u[4]; float u_alt[2]; } qc_actuator_vec;
+SEQLOCK(qc_sensor_vec) qc_sensors = {0, 0, {{200000, 200000, 20000, 20000, 200000, 200000, 20000, 20000, 200000, 200000, 20000, 20000}}};
+SEQLOCK(qc_actuator_vec) qc_actuators;
+uint64 qc_y_stamp = 0;                                /* STM time of the newest frame in y_QC                         */
+volatile uint32 qc_snapshot_retries = 0;              /* copies started over as the writer preempted them             */
+#if ECU_PARTITIONED
+ecu_job_ring job_ring ECU_LMU_BSS;                    /* core 0 -> core 1: released jobs with their sensor snapshot   */
+ecu_act_ring act_ring ECU_LMU_BSS;                    /* core 1 -> core 0: actuator commands                          */
+volatile uint32 job_ring_full = 0;                    /* jobs dropped as core 1 was behind                            */
+volatile uint32 act_ring_full = 0;                    /* commands dropped as core 0 was behind                        */
+qc_actuator_vec qc_actuator_out;                      /* core 1: last outputs of the controllers, sent with commands  */
+#endif
 
 float QC_REF_alt[] = {10, 0, 0, 0};
 float QC_REF[] = {10, 0, 0, 0, 10, 0, 0, 0, 10, 0, 0, 0};
+/* Discretised model and LQR gains of the quadcopter for every sampling period (no model for 40 ms). The controllers
+ * use qc_gain/qc_alt_gain, which follow task_per: selected by modeSwitchTask with the next mode and installed with it,
+ * or by core1_control when the period of a job changes. */
+const qc_gains qc_gain_table[QC_GAIN_SETS] = {
+    {10,
+     {{1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    0,    1, 0.01,     0.00049,   1.633e-06,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    1,       0.098,     0.00049,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    1, 0.01,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01,    -0.00049,  -1.633e-06},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,      -0.098,    -0.00049},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}},
+     {{0.00001, 0, 0, 0},
+      {0.002, 0, 0, 0},
+      {0, 0.000005, 0, 0},
+      {0, 0.001, 0, 0},
+      {0, 0, 0, 0},
+      {0, 0, 0, 0},
+      {0, 0, 0.000005, 0},
+      {0, 0, 0.001, 0},
+      {0, 0, 0, 0},
+      {0, 0, 0, -0.0000001633},
+      {0, 0, 0, 0.000005},
+      {0, 0, 0, 0.001}},
+     {{3.14451685869324, 5.61640885706677, -2.24815378560498e-13, -9.35040910781222e-13, -2.00084615486558e-12, -3.19864871177971e-12, -2.42906164884875e-11, -9.12993173689396e-12, 7.77479339632901e-13, 1.32462155507943e-12, -1.13920607077515e-11, -5.28889409924540e-12},
+      {-2.40306241803692e-13, -4.72815380478954e-13,   0.315827253270447,   2.53304005481979,    7.84605220808760e-13,    1.16425694772151e-12,    8.43874185194031e-12,    3.06879093499489e-12,    -5.31262238867872e-13,   -8.59004682947821e-13,   6.52030942425330e-12,    3.26154527538293e-12},
+      {-3.67448507775373e-12, -4.52413546402716e-12,   -2.93728431368812e-13,   3.14130884398491e-12,    3.10787674690884,    6.15027001575052,    59.4853828724422,    34.4066362896555,    -1.18482368586491e-10,   -2.08120109148284e-10,   1.68577401900408e-09,    6.47292755594409e-10},
+      {-2.45653038076514e-12, -2.62953318968014e-12,   -1.22285655546061e-13,   3.40902909601388e-12,    9.27267520204066e-11,    1.69084002031452e-10,    1.47075073708627e-09,    6.46413943908671e-10,    -3.10787674687785,   -6.15027001566358,   59.4853828713107,    34.4066362889244}}},
+    {20,
+     {{1, 0.02,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    1, 0.02,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    0,    1, 0.02,     0.00196,   0.00001307,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    1,       0.196,     0.00196,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    1, 0.02,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.02,    -0.00196,  -0.00001307},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,      -0.196,    -0.00196},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.02},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}},
+     {{0.00004,           0,           0,           0},
+      {0.004,           0,           0,           0},
+      {0,       0.00002,           0,           0},
+      {0,       0.002,            0,           0},
+      {0,           0,            0,           0},
+      {0,           0,   0.000001307,           0},
+      {0,           0,       0.00002,           0},
+      {0,           0,       0.002,           0},
+      {0,           0,           0,           0},
+      {0,           0,           0,  -0.000001307},
+      {0,           0,           0,       0.00002},
+      {0,           0,           0,       0.002}},
+     {{3.12685594967393, 5.60056530879117, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+      {0, 0, 0.315427247946649, 2.53141053716782, 0, 0, 0, 0, 0, 0, 0, 0},
+      {0, 0, 0, 0, 3.05441194111679, 6.05997082436238, 58.7631166321155, 34.1120666564246, 0, 0, 0, 0},
+      {0, 0, 0, 0, 0, 0, 0, 0, -3.05441194117077, -6.05997082447233, 58.7631166330827, 34.1120666568239}}},
+    {30,
+     {{1, 0.03,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    1, 0.03,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
+      {0,    0,    0,    0,    1, 0.03,    0.00441,   0.0000441,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    1,      0.294,    0.00441,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    1, 0.03,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
+      {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.03,   -0.00441,  -0.0000441},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,     -0.294,   -0.00441},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.03},
+      {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}},
+     {{0, 0, 0, 0},
+      {0.006, 0, 0, 0},
+      {0,     0.000045, 0, 0},
+      {0,      0.003, 0, 0},
+      {0, 0,      0, 0},
+      {0, 0,    0.00000441, 0},
+      {0, 0,     0.000045, 0},
+      {0, 0,       0.003, 0},
+      {0, 0, 0,       0},
+      {0, 0, 0,   -0.00000441},
+      {0, 0, 0,     0.000045},
+      {0, 0, 0,       0.003}},
+     {{3.10929450940453, 5.58476697969132, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+      {0, 0, 0.315027749563069, 2.52978210015362, 0, 0, 0, 0, 0, 0, 0, 0},
+      {0, 0, 0, 0, 3.00186737100001, 5.97111120050923, 58.0518248251535, 33.8217758502374, 0, 0, 0, 0},
+      {0, 0, 0, 0, 0, 0, 0, 0, -3.00186737091428, -5.97111120037752, 58.0518248241734, 33.8217758498679}}},
+    {40,
+     {{0}},
+     {{0}},
+     {{3.14806101403323, 5.61958299359191,    -1.06574271596490e-13,   -3.51167300129546e-13,   1.41342271329799e-12,    2.01062101868168e-12,    1.01336113292644e-11,    2.21595181457621e-11,    -6.09240741105249e-14,   5.22728093268344e-16,    -2.29214005150142e-13,   -1.63828525072864e-14},
+      {-1.40612070043267e-13, -1.55665450866325e-13,   0.315907315209643,   2.53336608803131,    6.85283776603311e-13,    8.93097231937326e-13,    5.64678083994045e-12,    1.85029586289379e-12,    2.38846862222207e-13,    3.94653870911855e-13,    -2.69539769628066e-12,   -1.50278419750555e-12},
+      {6.06951163104689e-12,  1.09751533138976e-11,    1.16215441377720e-13,    1.84009321132151e-12,    3.11868152834707,    6.16850483139175,    59.6311710091072,    34.4660711180138,    4.69926930228626e-11,    7.26917658867268e-11,    -5.24662404659150e-10,   -1.89171664196777e-10},
+      {4.93997661255683e-13,  -7.79648124187351e-15,   -3.11282929182986e-13,   -1.50718804881790e-12,   -5.37309119167142e-11,   -7.78148637957717e-11,   -5.41596347348106e-10,   -1.89400019326547e-10,   -3.11868152830212,   -6.16850483132701,   59.6311710086223,    34.4660711178274}}}};
+const qc_alt_gains qc_alt_gain_table[QC_GAIN_SETS] = {
+    {10,
+     {{1,   0.01,  0,  0},
+      {0,    1,   0,   0},
+      {0,   0,    1,   0.01},
+      {0,    0,    0,   1}},
+     {{0, 0}, {0.002, 0}, {0, 0}, {0, 0.001}},
+     {{3.14451685869324,          5.61640885706677,     -2.24815378560498e-13,     -9.35040910781222e-13},
+      {-2.40306241803692e-13,     -4.72815380478954e-13,         0.315827253270447,          2.53304005481979}}},
+    {20,
+     {{1,   0.02,  0,  0},
+      {0,    1,   0,   0},
+      {0,   0,    1,   0.02},
+      {0,    0,    0,   1}},
+     {{0, 0}, {0.004, 0},  {0, 0}, {0, 0.002}},
+     {{3.12685594967393,          5.60056530879117,     -8.20209119000962e-15,     -1.04128354000384e-13},
+      {-2.27958236698399e-15,     -5.25758397334492e-14,         0.315427247946649,          2.53141053716782}}},
+    {30,
+     {{1,   0.03,  0,  0},
+      {0,    1,   0,   0},
+      {0,   0,    1,   0.03},
+      {0,    0,    0,   1}},
+     {{0, 0}, {0.006, 0},  {0, 0}, {0, 0.003}},
+     {{3.10929450940453,          5.58476697969132,      1.63721429561644e-14,     -3.56030803834745e-15},
+      {-9.08613371101948e-16,     -1.52517184180782e-15,         0.315027749563069,          2.52978210015362}}},
+    {40,
+     {{0}},
+     {{0}},
+     {{3.14806101403323, 5.61958299359191,    -1.06574271596490e-13,   -3.51167300129546e-13},
+      {-1.40612070043267e-13, -1.55665450866325e-13,   0.315907315209643,   2.53336608803131}}}};
+const qc_gains *qc_gain = &qc_gain_table[0];
+const qc_alt_gains *qc_alt_gain = &qc_alt_gain_table[0];
 
 
 /////*ttc Tx*/
@@ -286,18 +527,26 @@ extern volatile int allinst = 0;
 void t120_tx();
 void t100_tx();
 void t50_tx();
-void t40_tx();
 void t80_tx();
-void t20_tx();
-void t10_tx();
-void t8_tx();
+void dispatch_build(mode_desc *mode);
+void dispatch_run_job(const dispatch_job *job);
+int timeline_tick(const dispatch_table *table, void (*run)(const dispatch_job *));
+void mode_init(void);
+int timeline_verify(void);
 void dummy_comp1(void);
 void sba_dtc(int);
 int gcd(int, int);
 int lcm(int, int);
-int hp();
+int hp(mode_desc *mode);
 float calcUtil(int h, int acess, int HP, float wcet);
 void updateutil(void);
+void qc_sensor_read(volatile uint32 *y, uint64 *stamp);
+const qc_gains *qc_gains_of(int h);
+const qc_alt_gains *qc_alt_gains_of(int h);
+void mode_gains(mode_desc *mode);
+void qc_actuator_read(qc_actuator_vec *u);
+void qc_actuator_publish(void);
+void qc_actuator_write(const qc_actuator_vec *u);
 
 static volatile uint32 numTxmsgs[IFXCAN_NUM_MODULES];
 static volatile uint32 numRxmsgs[IFXCAN_NUM_MODULES];
@@ -313,6 +562,12 @@ typedef enum
 }IfxCan_MsgMode;
 
 static void ProcessFifo0Interrupt(uint32 , IfxCan_MsgMode);
+static void qc_sensor_rx(uint8 pair, const uint32 *data, uint64 stamp);
+void rx_dispatch_init(void);
+void rx_dispatch_stats(int entry, uint32 *frames, uint32 *lost);
+void tx_enqueue(uint32 id, uint8 buf, const uint32 *data);
+void tx_queue_drain(void);
+void tx_queue_stats(uint8 buf, uint32 *sent, uint32 *replaced, float *wait_mean_us, float *wait_max_us);
 
 /*********************************************************************************************************************/
 /*--------------------------------------------Function Implementations-----------------------------------------------*/
@@ -327,6 +582,7 @@ IFX_INTERRUPT(Tx_Interrput1_ISR, IFX_INTTOS_CAN_TXRX, ISR_PRIORITY_CAN1_TX)
         Ifx_CAN_N *nodeSfr = IfxCan_getNodePointer(canSfr,(IfxCan_NodeId)0);
         IfxCan_Node_clearInterruptFlag(nodeSfr,IfxCan_Interrupt_transmissionCompleted);
         numTxmsgs[1]++;
+        tx_queue_drain();
 //        printf("Tx \n");
     }
 }
@@ -338,27 +594,55 @@ IFX_INTERRUPT(Rx_Interrput0_ISR, IFX_INTTOS_CAN_TXRX, ISR_PRIORITY_CAN0_RX)// ve
     {
         Ifx_CAN_N *nodeSfr = IfxCan_getNodePointer(canSfr,(IfxCan_NodeId)0);
         IfxCan_Node_clearInterruptFlag(nodeSfr,IfxCan_Interrupt_rxFifo0NewMessage);
+        if(CAN0_IR0.B.RF0L == 1)
+        {
+            IfxCan_Node_clearInterruptFlag(nodeSfr,IfxCan_Interrupt_rxFifo0MessageLost);
+            rx_fifo_overflows++;
+        }
 //        printf("int rx at %d\n",i);
         ProcessFifo0Interrupt (0 , IfxCan_fifo0);
         numRxmsgs[1]++;
     }
 }
 
+/* Empties RX FIFO 0: a burst that arrived while the interrupt was pending is read in one go instead of one message
+ * per interrupt, before the FIFO overwrites it. Every message goes to its handler through rx_id_map; a gap of more
+ * than 1.5 periods since the last frame of the same ID counts the missing frames as lost, as the overwritten
+ * messages themselves cannot be seen. At most RX_DRAIN_MAX messages: under a flood RF0N is set again and the rest
+ * waits for the next interrupt, so lower priority ISRs still run. */
 static void ProcessFifo0Interrupt (uint32 canNode , IfxCan_MsgMode rxMsgType)
 {
     IfxCan_Message rxMsg;
     uint32 rxData[2];
-    IfxCan_Can_initMessage(&rxMsg);
-
-    rxData[0] = 0x00000000;
-    rxData[1] = 0x00000000;
-
-    rxMsg.readFromRxFifo1 = FALSE;
-    rxMsg.readFromRxFifo0 = TRUE;
-    IfxCan_Can_readMessage(&g_CanBasic.drivers.canNode[canNode], &rxMsg, rxData);
-//    printf("rx %x at %d\n",rxMsg.messageId,i);
-    /* test wcet hns */
-    allinst++;
+    Ifx_CAN_N *nodeSfr = g_CanBasic.drivers.canNode[canNode].node;
+    uint64 now = IfxStm_get(BSP_DEFAULT_TIMER);
+    uint32 n = 0;
+
+    while (n < RX_DRAIN_MAX && IfxCan_Node_getRxFifo0FillLevel(nodeSfr) > 0){
+        rx_handler *h;
+        IfxCan_Can_initMessage(&rxMsg);
+        rxData[0] = 0x00000000;
+        rxData[1] = 0x00000000;
+        rxMsg.readFromRxFifo1 = FALSE;
+        rxMsg.readFromRxFifo0 = TRUE;
+        IfxCan_Can_readMessage(&g_CanBasic.drivers.canNode[canNode], &rxMsg, rxData);
+//        printf("rx %x at %d\n",rxMsg.messageId,i);
+        /* test wcet hns */
+        allinst++;
+        h = &rx_handlers[rxMsg.messageId < RX_ID_COUNT ? rx_id_map[rxMsg.messageId] : 0];
+        if (h->period > 0 && h->frames > 0 && now - h->last_stamp > (uint64)(h->period + h->period / 2)){
+            h->lost += (uint32)((now - h->last_stamp + (uint64)h->period / 2) / (uint64)h->period) - 1;
+        }
+        h->last_stamp = now;
+        h->frames++;
+        if (h->handler != NULL){
+            h->handler(h->arg, rxData, now);
+        }
+        n++;
+    }
+    if (n > rx_batch_max){
+        rx_batch_max = n;
+    }
 /*
 //    vm msg;
 //    traffic[allinst] = rxMsg.messageId;
@@ -383,28 +667,6 @@ static void ProcessFifo0Interrupt (uint32 canNode , IfxCan_MsgMode rxMsgType)
         *rxmsg_atkwin = (uint32*)calloc(1,sizeof(uint32));
     }
     */
-    int ii = 0;
-    while (ii < 6){
-        int jj = 2*ii;
-        if (rxMsg.messageId == qc_rx_id[ii])
-        {
-           y_QC[jj]= rxData[0];
-           y_QC[jj+1]= rxData[1];
-           if (ii < 2){
-//               y_QC_alt[j]= rxData[0];
-               sensed_qc[0] = 1;
-           }
-           sensed_qc[1] = 1;
-//           printf("rx qc sensor data %x = %u  at %d\n", rxMsg.messageId, y_QC, i);
-    //       clock_t start = clock();
-    //       CanBasicDemo_run2();
-    //       clock_t end = clock();
-    //       unsigned long dur = (end-start);
-    //       printf("wcet ttc: %ld s\n",dur);
-        }
-        ii = ii+1;
-    }
-
 //    printf("sba_ct = %d at %d\n",sba_ct,i);
     /* for sba dtc */
 //    if (rxMsg.messageId == ttc_tx_id)
@@ -445,6 +707,46 @@ static void ProcessFifo0Interrupt (uint32 canNode , IfxCan_MsgMode rxMsgType)
     */
 }
 
+/* Handler of qc_rx_id[pair]: outputs 2*pair and 2*pair+1 of the quadcopter */
+static void qc_sensor_rx(uint8 pair, const uint32 *data, uint64 stamp)
+{
+    int jj = 2*pair;
+
+    SEQLOCK_WRITE_BEGIN(&qc_sensors);
+    qc_sensors.v.y[jj]= data[0];
+    qc_sensors.v.y[jj+1]= data[1];
+    qc_sensors.stamp = stamp;
+    SEQLOCK_WRITE_END(&qc_sensors);
+    if (pair < 2){
+//        y_QC_alt[j]= data[0];
+        sensed_qc[0] = 1;
+    }
+    sensed_qc[1] = 1;
+//    printf("rx qc sensor data %x = %u  at %d\n", qc_rx_id[pair], y_QC, i);
+}
+
+/* Maps the six sensor frames of the quadcopter to qc_sensor_rx; every other identifier stays on entry 0 */
+void rx_dispatch_init(void)
+{
+    int k = 0;
+
+    while (k < 6){
+        rx_handler *h = &rx_handlers[k + 1];
+        h->handler = qc_sensor_rx;
+        h->arg = (uint8)k;
+        h->period = IfxStm_getTicksFromMilliseconds(BSP_DEFAULT_TIMER, QC_RX_PERIOD_MS);
+        rx_id_map[qc_rx_id[k]] = (uint8)(k + 1);
+        k++;
+    }
+}
+
+/* Counters of rx_handlers[entry]: 0 for the unhandled identifiers, k + 1 for qc_rx_id[k] */
+void rx_dispatch_stats(int entry, uint32 *frames, uint32 *lost)
+{
+    *frames = rx_handlers[entry].frames;
+    *lost = rx_handlers[entry].lost;
+}
+
 
 /* transmission strategy for non-premtive schedule */
 int gcd(int a, int b){
@@ -462,17 +764,20 @@ int lcm(int a, int b){
 }
 
 
-int hp(){
+/* Prepares mode: job counts, css lengths and dispatch table of the periods in mode->task_per */
+int hp(mode_desc *mode){
 //    updateutil();
     printf("hyperperiod calc= %d\n", HP);
-    int a = h_list[0][task_per[0]];
-    int b = h_list[1][task_per[1]];
+    int a = h_list[0][mode->task_per[0]];
+    int b = h_list[1][mode->task_per[1]];
     int H = lcm(a, b);
 //    a = h_list[task_per[2]];
 //    b = h_list[task_per[3]];
 //    H = lcm(H, a);
 //    H = lcm(H, b);
-    ct_qc = HP / h_list[1][task_per[1]];
+    /* one css instance per job of the hyperperiod */
+    task_jobct[1] = (uint8)(H / b);
+    ct_qc = (task_jobct[1] < 20) ? task_jobct[1] : 20;
     /*
     int j = ct_qc_alt;
     while (j--> 0){
@@ -481,7 +786,8 @@ int hp(){
         css_qc_alt[j] = 1;//qc_subsys[per][k];
     }
     */
-    ct_qc_alt = HP / h_list[0][task_per[0]];
+    task_jobct[0] = (uint8)(H / a);
+    ct_qc_alt = (task_jobct[0] < 20) ? task_jobct[0] : 20;
     /*
     j = ct_qc;
     while (j--> 0){
@@ -508,6 +814,8 @@ int hp(){
         css_sc[j] = 1;//qc_subsys[per][k];
     }
     */
+    mode->hp = H;
+    dispatch_build(mode);
     return H;
 }
 
@@ -526,21 +834,16 @@ int hp(){
 void updateutil(){
     int jj = 0;
     int kk = 0;
+    uint32 y_snap[12];
+    qc_actuator_vec u_snap;
+
+    qc_sensor_read(y_snap, NULL);
+    qc_actuator_read(&u_snap);
     while(jj < 2){
        if (jj == 0){
-           float Q[4][4] = {{100,0,0,0}, {0,0,0,0}, {0,0,0,0}, {0,0,0,0}};
-           float R[2][2] = {{10,0},{0,0}};
            J[jj] = 0;
-           int ii = 0;
-           while (ii < 4){
-               J[jj]  = J[jj] + Q[ii][ii]*y_QC[ii]*y_QC[ii];
-               ii = ii+1;
-           }
-           ii = 0;
-           while (ii < 2){
-              J[jj]  = J[jj] + R[ii][ii]*u_QC_alt[ii]*u_QC_alt[ii];
-              ii = ii+1;
-          }
+           SPARSE_QF_DIAG_ADD(J[jj], y_snap, QC_ALT_Q_PATTERN);
+           SPARSE_QF_DIAG_ADD(J[jj], u_snap.u_alt, QC_ALT_R_PATTERN);
            printf("current cost of qc task = %f at i = %d\n",J[0], i);
            if (J[0] > J_ub[jj]){
                    if (task_acess[0] > 0){
@@ -561,40 +864,18 @@ void updateutil(){
            }
 
 //           css_qc_alt[20] =  altlist[task_acess[0]];
-           task_per[0] = task_acess[0];
            ct_qc_alt = lens_alt_list[task_acess[0]];
            int kk = 0;
            while ( kk< ct_qc_alt){
                css_qc_alt[kk] = altlist[task_acess[0]][kk];
                kk++;
            }
-           printf("new periodicity of esp task = %d at i = %d\n",task_per[jj], i);
+           printf("new periodicity of esp task = %d at i = %d\n",task_acess[jj], i);
        }
        if (jj == 1){
-          float Q[12][12] = {{10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 100, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 100, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                              {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
-          float R[4][4] = {{1, 0, 0, 0},{0, 10, 0, 0},{0, 0, 10, 0},{0, 0, 0, 10}};
           J[jj] = 0;
-          int ii = 0;
-          while (ii < 12){
-              J[jj]  = J[jj] + Q[ii][ii]*y_QC[ii]*y_QC[ii];
-              ii = ii+1;
-          }
-          ii = 0;
-          while (ii < 4){
-             J[jj]  = J[jj] + R[ii][ii]*u_QC[ii]*u_QC[ii];
-             ii = ii+1;
-         }
+          SPARSE_QF_DIAG_ADD(J[jj], y_snap, QC_Q_PATTERN);
+          SPARSE_QF_DIAG_ADD(J[jj], u_snap.u, QC_R_PATTERN);
           printf("current cost of esp task = %f at i = %d\n",J[0], i);
           if (J[0] > J_ub[jj]){
 //                   if (task_per[jj] > 0)
@@ -609,247 +890,477 @@ void updateutil(){
               printf("ok cost : task 2\n");
           }
 //          css_qc =  trajlist[task_acess[1]];
-          task_per[1] = task_acess[1];
           ct_qc = lens_traj_list[task_acess[1]];
           int kk = 0;
           while ( kk< ct_qc){
               css_qc_alt[kk] = trajlist[task_acess[0]][kk];
               kk++;
           }
-          printf("new periodicity of qc task = %d at i = %d\n",task_per[jj], i);
+          printf("new periodicity of qc task = %d at i = %d\n",task_acess[jj], i);
       }
        jj++;
     }
 }
 //*/
 
-void t8_tx()/* h = 10ms*/
+/*----------- sensor and actuator snapshots -----------*/
+/* Consistent copy of the sensor outputs received so far and, if stamp is not NULL, the STM time of the newest frame */
+void qc_sensor_read(volatile uint32 *y, uint64 *stamp)
 {
-    int i = 0;
-//    printf("task with per = 10ms tx started\n");
-
-    while(i < 2){//for (int i = 0; i++; i < task_ct){
-
-       if (i == 0 && h_list[i][task_per[i]]==8){
-
-           if (css_qc_alt[(curIdx_qc_alt)  % ct_qc_alt]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc_alt();
-                   sensed_qc[0] = 0;
-//               }
-               CanBasicDemo_tx(txQc1, txDataQC_alt, qc_tx_id[0], qc_tx_buf[0]);
-//               CanBasicDemo_tx(txQc2, txDataQC_alt, qc_tx_id[1], qc_tx_buf[1]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txEsp, txDataEsp) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
+    qc_sensor_vec v;
+    uint64 t;
+    uint32 seq;
+    int k = 0;
+
+    seq = SEQLOCK_READ_BEGIN(&qc_sensors);
+    v = qc_sensors.v;
+    t = qc_sensors.stamp;
+    while (SEQLOCK_READ_RETRY(&qc_sensors, seq)){
+        qc_snapshot_retries++;
+        seq = SEQLOCK_READ_BEGIN(&qc_sensors);
+        v = qc_sensors.v;
+        t = qc_sensors.stamp;
+    }
+    while (k < 12){
+        y[k] = v.y[k];
+        k++;
+    }
+    if (stamp != NULL)
+        *stamp = t;
+}
 
-       }else if (i == 1 && h_list[i][task_per[i]]==8){
-           if (css_qc[(curIdx_qc)  % ct_qc]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc();
-                   sensed_qc[1] = 0;
-//               }
-//               CanBasicDemo_tx(txQc2, txDataQC1, qc_tx_id[1], qc_tx_buf[1]);
-               CanBasicDemo_tx(txQc3, txDataQC2, qc_tx_id[2], qc_tx_buf[2]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txTtc, txDataTtc) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
-       }else {
 
-       }
-//       IfxCan_Message txMsg1;
-//       uint32 txData1[2];
-//       IfxCan_Can_initMessage(&txMsg1);
-//       txMsg1.messageId = qc_tx_id;
-//       txMsg1.bufferNumber = qc_tx_buf;
-//       while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
-//       printf("tx id %x\n",txMsg1.messageId);
-       i++;
-   }
+/* Consistent copy of the last outputs of both controllers */
+void qc_actuator_read(qc_actuator_vec *u)
+{
+    uint32 seq;
+
+    seq = SEQLOCK_READ_BEGIN(&qc_actuators);
+    *u = qc_actuators.v;
+    while (SEQLOCK_READ_RETRY(&qc_actuators, seq)){
+        qc_snapshot_retries++;
+        seq = SEQLOCK_READ_BEGIN(&qc_actuators);
+        *u = qc_actuators.v;
+    }
 }
 
 
-void t10_tx()/* h = 10ms*/
+/* Called by the controllers once u_QC or u_QC_alt is computed. With ECU_PARTITIONED the outputs go with the next
+ * command to core 0, which writes them in core1TxIsr: modeSwitchTask would spin on core 1 if it preempted the write. */
+void qc_actuator_publish(void)
 {
-    int i = 0;
-//    printf("task with per = 10ms tx started\n");
-
-    while(i < 2){//for (int i = 0; i++; i < task_ct){
-
-       if (i == 0 && h_list[i][task_per[i]]==10){
-
-           if (css_qc_alt[(curIdx_qc_alt)  % ct_qc_alt]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc_alt();
-                   sensed_qc[0] = 0;
-//               }
-               CanBasicDemo_tx(txQc1, txDataQC_alt, qc_tx_id[0], qc_tx_buf[0]);
-//               CanBasicDemo_tx(txQc2, txDataQC_alt, qc_tx_id[1], qc_tx_buf[1]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txEsp, txDataEsp) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
+    qc_actuator_vec v;
+
+    v.u[0] = u_QC[0];
+    v.u[1] = u_QC[1];
+    v.u[2] = u_QC[2];
+    v.u[3] = u_QC[3];
+    v.u_alt[0] = u_QC_alt[0];
+    v.u_alt[1] = u_QC_alt[1];
+#if ECU_PARTITIONED
+    qc_actuator_out = v;
+#else
+    qc_actuator_write(&v);
+#endif
+}
 
-       }else if (i == 1 && h_list[i][task_per[i]]==10){
-           if (css_qc[(curIdx_qc)  % ct_qc]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc();
-                   sensed_qc[1] = 0;
-//               }
-//               CanBasicDemo_tx(txQc2, txDataQC1, qc_tx_id[1], qc_tx_buf[1]);
-               CanBasicDemo_tx(txQc3, txDataQC2, qc_tx_id[2], qc_tx_buf[2]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txTtc, txDataTtc) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
-       }else {
 
-       }
-//       IfxCan_Message txMsg1;
-//       uint32 txData1[2];
-//       IfxCan_Can_initMessage(&txMsg1);
-//       txMsg1.messageId = qc_tx_id;
-//       txMsg1.bufferNumber = qc_tx_buf;
-//       while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
-//       printf("tx id %x\n",txMsg1.messageId);
-       i++;
-   }
+/* Writer of qc_actuators; runs where no reader can preempt it */
+void qc_actuator_write(const qc_actuator_vec *u)
+{
+    SEQLOCK_WRITE_BEGIN(&qc_actuators);
+    qc_actuators.v = *u;
+    qc_actuators.stamp = IfxStm_get(BSP_DEFAULT_TIMER);
+    SEQLOCK_WRITE_END(&qc_actuators);
 }
 
 
-void t20_tx()/* h = 20ms*/
+/*----------- hyperperiod timeline -----------*/
+/* Built by hp() for every mode. The hyperperiod H = lcm(h of each task, SLOT_MS) is table.len TOM ticks (slots); slot
+ * s lists the jobs released at the s-th tick, in rate monotonic order, with the css bit of each job, so the TOM ISR
+ * only walks the jobs of the current slot instead of comparing the period of every task at every tick. A job whose
+ * release instant falls between two ticks is released at the next tick. The ISR switches mode when the table wraps,
+ * so a mode switch always lands on a hyperperiod boundary. */
+mode_desc g_modes[2];
+mode_desc *volatile mode_cur = NULL;                  /* mode dispatched by the TOM ISR                               */
+mode_desc *volatile mode_next = NULL;                 /* prepared by modeSwitchTask, installed at the next boundary   */
+volatile uint32 mode_overruns = 0;                    /* boundaries reached before the next mode was ready            */
+int dispatch_pos = 0;
+
+void dispatch_build(mode_desc *mode)
 {
-    int i = 0;
-//    printf("task with per = 10ms tx started\n");
-
-    while(i < 2){//for (int i = 0; i++; i < task_ct){
-
-       if (i == 0 && h_list[i][task_per[i]]==20){
-
-           if (css_qc_alt[(curIdx_qc_alt)  % ct_qc_alt]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc_alt();
-                   sensed_qc[0] = 0;
-//               }
-               CanBasicDemo_tx(txQc1, txDataQC_alt, qc_tx_id[0], qc_tx_buf[0]);
-//               CanBasicDemo_tx(txQc2, txDataQC_alt, qc_tx_id[1], qc_tx_buf[1]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txEsp, txDataEsp) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
+    dispatch_table *table = &mode->table;
+    int per[2], next[2], order[2];
+    int len_ms, s, n = 0;
+
+    per[0] = h_list[0][mode->task_per[0]];
+    per[1] = h_list[1][mode->task_per[1]];
+    order[0] = (per[1] < per[0]) ? 1 : 0;
+    order[1] = 1 - order[0];
+    len_ms = lcm(lcm(per[0], per[1]), SLOT_MS);
+    if (len_ms / SLOT_MS > MAX_SLOTS_HP){
+        printf("dispatch: hyperperiod of %d ms does not fit in %d slots\n", len_ms, MAX_SLOTS_HP);
+        len_ms = MAX_SLOTS_HP * SLOT_MS;
+    }
+    next[0] = 0;
+    next[1] = 0;
+    s = 0;
+    while (s < len_ms / SLOT_MS){
+        int o = 0;
+        table->slots[s].first = (uint16)n;
+        while (o < 2){
+            int t = order[o];
+            while (next[t] <= s * SLOT_MS && next[t] < len_ms && n < MAX_JOBS_HP){
+                int k = next[t] / per[t];
+                table->jobs[n].task = (uint8)t;
+                table->jobs[n].exec = (uint8)((t == 0) ? css_qc_alt[k % ct_qc_alt] != 0 : css_qc[k % ct_qc] != 0);
+                table->jobs[n].tx_u01 = (uint8)(t == 1 && per[t] == 40);  /* 40 ms qc jobs also send u_QC[0..1] */
+                n++;
+                next[t] += per[t];
+            }
+            o++;
+        }
+        table->slots[s].count = (uint8)(n - table->slots[s].first);
+        s++;
+    }
+    table->len = len_ms / SLOT_MS;
+    table->n_jobs = n;
+    printf("dispatch: %d slots of %d ms, %d jobs, h = {%d, %d}\n", table->len, SLOT_MS, n, per[0], per[1]);
+}
 
-       }else if (i == 1 && h_list[i][task_per[i]]==20){
-           if (css_qc[(curIdx_qc)  % ct_qc]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc();
-                   sensed_qc[1] = 0;
-//               }
-//               CanBasicDemo_tx(txQc2, txDataQC1, qc_tx_id[1], qc_tx_buf[1]);
-               CanBasicDemo_tx(txQc3, txDataQC2, qc_tx_id[2], qc_tx_buf[2]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txTtc, txDataTtc) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
-       }else {
 
-       }
-//       IfxCan_Message txMsg1;
-//       uint32 txData1[2];
-//       IfxCan_Can_initMessage(&txMsg1);
-//       txMsg1.messageId = qc_tx_id;
-//       txMsg1.bufferNumber = qc_tx_buf;
-//       while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
-//       printf("tx id %x\n",txMsg1.messageId);
-       i++;
-   }
+/* Sends the command of a job on qc_tx_id[tx]: directly, or through core 0 in the partitioned build */
+static void job_tx(uint8 tx, uint32 *data)
+{
+#if ECU_PARTITIONED
+    ecu_act_msg *m = SPSC_WRITE_SLOT(&act_ring);
+
+    if (m == NULL){
+        act_ring_full++;
+        return;
+    }
+    m->data[0] = data[0];
+    m->data[1] = data[1];
+    m->u[0] = qc_actuator_out.u[0];
+    m->u[1] = qc_actuator_out.u[1];
+    m->u[2] = qc_actuator_out.u[2];
+    m->u[3] = qc_actuator_out.u[3];
+    m->u_alt[0] = qc_actuator_out.u_alt[0];
+    m->u_alt[1] = qc_actuator_out.u_alt[1];
+    m->tx = tx;
+    SPSC_PUSH(&act_ring);
+    IfxSrc_setRequest(CORE1_TX_SRC);
+#else
+    CanBasicDemo_tx(*qc_tx_msg[tx], data, qc_tx_id[tx], qc_tx_buf[tx]);
+#endif
 }
 
 
-void t30_tx()/* h = 30ms*/
+/* Runs one job. A skipped job (css bit 0) still consumes its css instance. */
+void dispatch_run_job(const dispatch_job *job)
 {
-    int i = 0;
-//    printf("task with per = 10ms tx started\n");
-
-    while(i < 2){//for (int i = 0; i++; i < task_ct){
-
-       if (i == 0 && h_list[i][task_per[i]]==30){
-
-           if (css_qc_alt[(curIdx_qc_alt)  % ct_qc_alt]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc_alt();
-                   sensed_qc[0] = 0;
-//               }
-               CanBasicDemo_tx(txQc1, txDataQC_alt, qc_tx_id[0], qc_tx_buf[0]);
-//               CanBasicDemo_tx(txQc2, txDataQC_alt, qc_tx_id[1], qc_tx_buf[1]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txEsp, txDataEsp) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
+#if !ECU_PARTITIONED
+    if (job->exec)
+        qc_sensor_read(y_QC, &qc_y_stamp);            /* core 1 gets the copy with the job */
+#endif
+    if (job->task == 0){
+        if (job->exec){
+            CanBasicDemo_run_qc_alt();
+            sensed_qc[0] = 0;
+            job_tx(0, txDataQC_alt);
+        }else{
+            curIdx_qc_alt = curIdx_qc_alt + 1;
+        }
+    }else{
+        if (job->exec){
+            CanBasicDemo_run_qc();
+            sensed_qc[1] = 0;
+            if (job->tx_u01)
+                job_tx(1, txDataQC1);
+            job_tx(2, txDataQC2);
+        }else{
+            curIdx_qc = curIdx_qc + 1;
+        }
+    }
+}
 
-       }else if (i == 1 && h_list[i][task_per[i]]==30){
-           if (css_qc[(curIdx_qc)  % ct_qc]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc();
-                   sensed_qc[1] = 0;
-//               }
-//               CanBasicDemo_tx(txQc2, txDataQC1, qc_tx_id[1], qc_tx_buf[1]);
-               CanBasicDemo_tx(txQc3, txDataQC2, qc_tx_id[2], qc_tx_buf[2]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txTtc, txDataTtc) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
-       }else {
 
-       }
-//       IfxCan_Message txMsg1;
-//       uint32 txData1[2];
-//       IfxCan_Can_initMessage(&txMsg1);
-//       txMsg1.messageId = qc_tx_id;
-//       txMsg1.bufferNumber = qc_tx_buf;
-//       while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
-//       printf("tx id %x\n",txMsg1.messageId);
-       i++;
-   }
+/* Releases the jobs of the current slot of table through run, returns 1 at the end of the hyperperiod */
+int timeline_tick(const dispatch_table *table, void (*run)(const dispatch_job *))
+{
+    int n = table->slots[dispatch_pos].first;
+    int end = n + table->slots[dispatch_pos].count;
+
+    while (n < end){
+        run(&table->jobs[n]);
+        n++;
+    }
+    dispatch_pos++;
+    return dispatch_pos >= table->len;
 }
 
 
-void t40_tx()/* h = 40ms*/
+#if ECU_PARTITIONED
+/*----------- core 0 / core 1 partition -----------*/
+/* Core 0: releases a job to core 1 with a consistent copy of the sensor outputs */
+static void job_release(const dispatch_job *job)
 {
-    int i = 0;
-//    printf("task with per = 10ms tx started\n");
-
-    while(i < 2){//for (int i = 0; i++; i < task_ct){
-
-       if (i == 0 && h_list[i][task_per[i]]==40){
-
-           if (css_qc_alt[(curIdx_qc_alt)  % ct_qc_alt]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc_alt();
-                   sensed_qc[0] = 0;
-//               }
-               CanBasicDemo_tx(txQc1, txDataQC_alt, qc_tx_id[0], qc_tx_buf[0]);
-//               CanBasicDemo_tx(txQc2, txDataQC_alt, qc_tx_id[1], qc_tx_buf[1]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txEsp, txDataEsp) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
+    ecu_job_msg *m = SPSC_WRITE_SLOT(&job_ring);
 
-       }else if (i == 1 && h_list[i][task_per[i]]==40){
-           if (css_qc[(curIdx_qc)  % ct_qc]){
-//               if (sensed_qc[i]){
-                   CanBasicDemo_run_qc();
-                   sensed_qc[1] = 0;
-//               }
-               CanBasicDemo_tx(txQc2, txDataQC1, qc_tx_id[1], qc_tx_buf[1]);
-               CanBasicDemo_tx(txQc3, txDataQC2, qc_tx_id[2], qc_tx_buf[2]);
-    //           while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txTtc, txDataTtc) == IfxCan_Status_notSentBusy);
-    //           printf("%d th task with per = 10ms successfully completed\n",i);
-           }
-       }else {
+    if (m == NULL){
+        job_ring_full++;
+        return;
+    }
+    qc_sensor_read(m->y, &m->stamp);
+    m->task = job->task;
+    m->exec = job->exec;
+    m->tx_u01 = job->tx_u01;
+    m->per = mode_cur->task_per[job->task];
+    SPSC_PUSH(&job_ring);
+}
 
-       }
-//       IfxCan_Message txMsg1;
-//       uint32 txData1[2];
-//       IfxCan_Can_initMessage(&txMsg1);
-//       txMsg1.messageId = qc_tx_id;
-//       txMsg1.bufferNumber = qc_tx_buf;
-//       while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
-//       printf("tx id %x\n",txMsg1.messageId);
-       i++;
-   }
+
+/* Macro to define the Interrupt Service Routine. */
+IFX_INTERRUPT(core1TxIsr, 0, ISR_PRIORITY_CORE1_TX);
+
+/* Core 0: sends the actuator commands pushed by core 1 and publishes the controller outputs they carry */
+void core1TxIsr(void)
+{
+    ecu_act_msg *m;
+    qc_actuator_vec u;
+
+    while ((m = SPSC_READ_SLOT(&act_ring)) != NULL){
+        u.u[0] = m->u[0];
+        u.u[1] = m->u[1];
+        u.u[2] = m->u[2];
+        u.u[3] = m->u[3];
+        u.u_alt[0] = m->u_alt[0];
+        u.u_alt[1] = m->u_alt[1];
+        qc_actuator_write(&u);
+        CanBasicDemo_tx(*qc_tx_msg[m->tx], m->data, qc_tx_id[m->tx], qc_tx_buf[m->tx]);
+        SPSC_POP(&act_ring);
+    }
+}
+
+
+/* Core 1: runs the released jobs; call it from the loop of core1_main */
+void core1_control(void)
+{
+    ecu_job_msg *m;
+
+    while ((m = SPSC_READ_SLOT(&job_ring)) != NULL){
+        dispatch_job job;
+        int k = 0;
+        while (k < 12){
+            y_QC[k] = m->y[k];
+            k++;
+        }
+        qc_y_stamp = m->stamp;
+        if (task_per[m->task] != m->per){             /* first job of a new mode */
+            task_per[m->task] = m->per;
+            if (m->task == 0)
+                qc_alt_gain = qc_alt_gains_of(h_list[0][m->per]);
+            else
+                qc_gain = qc_gains_of(h_list[1][m->per]);
+        }
+        job.task = m->task;
+        job.exec = m->exec;
+        job.tx_u01 = m->tx_u01;
+        SPSC_POP(&job_ring);
+        dispatch_run_job(&job);
+    }
+}
+#endif
+
+
+/* Installs the prepared mode at a hyperperiod boundary, called by the TOM ISR. Only swaps the descriptor and asks
+ * modeSwitchTask for the next one; if it is not ready yet, the current mode runs one more hyperperiod. */
+static void mode_swap(void)
+{
+    mode_desc *next = mode_next;
+
+    dispatch_pos = 0;
+    if (next == NULL){
+        mode_overruns++;
+        return;
+    }
+    mode_next = NULL;
+    mode_cur = next;
+#if !ECU_PARTITIONED
+    task_per[0] = next->task_per[0];                  /* with ECU_PARTITIONED, core 1 takes it from the jobs */
+    task_per[1] = next->task_per[1];
+    qc_alt_gain = next->qc_alt;
+    qc_gain = next->qc;
+#endif
+    HP = next->hp;
+    curIdx_qc_alt = 0;
+    curIdx_qc = 0;
+    SPSC_FENCE();
+    IfxSrc_setRequest(MODE_SWITCH_SRC);
+}
+
+
+/* Gains for a sampling period of h ms, the 10 ms ones if there are none */
+const qc_gains *qc_gains_of(int h)
+{
+    int k = 0;
+
+    while (k < QC_GAIN_SETS){
+        if (qc_gain_table[k].h == h)
+            return &qc_gain_table[k];
+        k++;
+    }
+    return &qc_gain_table[0];
+}
+
+const qc_alt_gains *qc_alt_gains_of(int h)
+{
+    int k = 0;
+
+    while (k < QC_GAIN_SETS){
+        if (qc_alt_gain_table[k].h == h)
+            return &qc_alt_gain_table[k];
+        k++;
+    }
+    return &qc_alt_gain_table[0];
+}
+
+
+/* Selects the gains of the periods of mode */
+void mode_gains(mode_desc *mode)
+{
+    mode->qc_alt = qc_alt_gains_of(h_list[0][mode->task_per[0]]);
+    mode->qc = qc_gains_of(h_list[1][mode->task_per[1]]);
+    printf("Acquiring system matrices for task qc alt, periodicity %d\n", mode->qc_alt->h);
+    printf("Acquiring system matrices for task qc, periodicity %d\n", mode->qc->h);
+}
+
+
+/* Macro to define the Interrupt Service Routine. */
+IFX_INTERRUPT(modeSwitchTask, 0, ISR_PRIORITY_MODE);
+
+/* Mode switch task: below the TOM and CAN ISRs (on core 1 with ECU_PARTITIONED), requested by mode_swap at the
+ * start of every hyperperiod. Evaluates the cost of the tasks (updateutil) and prepares the next mode in the
+ * descriptor that is not in use. */
+void modeSwitchTask(void)
+{
+    mode_desc *mode = (mode_cur == &g_modes[0]) ? &g_modes[1] : &g_modes[0];
+
+    updateutil();
+    mode->task_per[0] = task_acess[0];
+    mode->task_per[1] = task_acess[1];
+    mode_gains(mode);
+    hp(mode);
+    SPSC_FENCE();                                     /* the table before the pointer */
+    mode_next = mode;
+}
+
+
+/* First mode, from task_per; called before the TOM starts */
+void mode_init(void)
+{
+    g_modes[0].task_per[0] = task_per[0];
+    g_modes[0].task_per[1] = task_per[1];
+    mode_gains(&g_modes[0]);
+    qc_alt_gain = g_modes[0].qc_alt;
+    qc_gain = g_modes[0].qc;
+    HP = hp(&g_modes[0]);
+    mode_cur = &g_modes[0];
+    mode_next = NULL;
+    dispatch_pos = 0;
+#if ECU_PARTITIONED
+    IfxSrc_init(CORE1_TX_SRC, IfxSrc_Tos_cpu0, ISR_PRIORITY_CORE1_TX);
+    IfxSrc_enable(CORE1_TX_SRC);
+#endif
+    IfxSrc_init(MODE_SWITCH_SRC, MODE_SWITCH_TOS, ISR_PRIORITY_MODE);
+    IfxSrc_enable(MODE_SWITCH_SRC);
+    IfxSrc_setRequest(MODE_SWITCH_SRC);
+}
+
+
+/* Timeline check: for every ordered pair of period sets of h_list, runs one hyperperiod of the first and one of the
+ * second through timeline_tick and compares the releases with the ideal ones (k*h from the start of each hyperperiod,
+ * at the next tick). Returns the number of pairs with a dropped, duplicated or displaced job. */
+static mode_desc verify_mode;
+static int verify_ct;
+static int verify_task[2 * MAX_JOBS_HP];
+static int verify_ms[2 * MAX_JOBS_HP];
+static int verify_now;
+
+static void verify_record(const dispatch_job *job)
+{
+    if (verify_ct < 2 * MAX_JOBS_HP){
+        verify_task[verify_ct] = job->task;
+        verify_ms[verify_ct] = verify_now;
+    }
+    verify_ct++;
+}
+
+int timeline_verify(void)
+{
+    int a, b, bad = 0, pairs = 0;
+
+    a = 0;
+    while (a < 49){
+        b = 0;
+        while (b < 49){
+            int mode[2], start = 0, m = 0, t, ok = 1;
+            mode[0] = a;
+            mode[1] = b;
+            verify_ct = 0;
+            verify_now = 0;
+            while (m < 2){
+                verify_mode.task_per[0] = (uint8)(mode[m] / 7);
+                verify_mode.task_per[1] = (uint8)(mode[m] % 7);
+                hp(&verify_mode);
+                if (verify_mode.table.len * SLOT_MS != lcm(verify_mode.hp, SLOT_MS))
+                    ok = 0;
+                dispatch_pos = 0;
+                while (!timeline_tick(&verify_mode.table, verify_record))
+                    verify_now += SLOT_MS;
+                verify_now += SLOT_MS;
+                m++;
+            }
+            /* the releases of each task must be exactly the ideal ones, in order */
+            t = 0;
+            while (t < 2){
+                int n = 0, k;
+                start = 0;
+                m = 0;
+                while (m < 2){
+                    int per = h_list[t][(t == 0) ? mode[m] / 7 : mode[m] % 7];
+                    int len = lcm(lcm(h_list[0][mode[m] / 7], h_list[1][mode[m] % 7]), SLOT_MS);
+                    k = 0;
+                    while (k * per < len){
+                        int ms = start + (k * per + SLOT_MS - 1) / SLOT_MS * SLOT_MS;
+                        while (n < verify_ct && verify_task[n] != t)
+                            n++;
+                        if (n >= verify_ct || verify_ms[n] != ms)
+                            ok = 0;
+                        n++;
+                        k++;
+                    }
+                    start += len;
+                    m++;
+                }
+                while (n < verify_ct && verify_task[n] != t)
+                    n++;
+                if (n < verify_ct)
+                    ok = 0;                           /* extra release */
+                t++;
+            }
+            if (!ok){
+                printf("timeline: jobs dropped or duplicated switching from h = {%d, %d} to h = {%d, %d}\n",
+                       h_list[0][a / 7], h_list[1][a % 7], h_list[0][b / 7], h_list[1][b % 7]);
+                bad++;
+            }
+            pairs++;
+            b++;
+        }
+        a++;
+    }
+    printf("timeline: %d of %d mode switches ok\n", pairs - bad, pairs);
+    return bad;
 }
 
 
@@ -1147,25 +1658,25 @@ void t7_busload(int a)
              txData1[1] = txData2[1] = txData3[1] = txData4[1] = txData5[1] = 0;
 
              if (a == 1)
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg1.messageId, (uint8)txMsg1.bufferNumber, txData1);
              else if(a == 2)
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg2, txData2) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg2.messageId, (uint8)txMsg2.bufferNumber, txData2);
              else if(a == 3)
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg3, txData3) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg3.messageId, (uint8)txMsg3.bufferNumber, txData3);
              else if(a == 4)
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg4, txData4) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg4.messageId, (uint8)txMsg4.bufferNumber, txData4);
              else if(a == 5)
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg5, txData5) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg5.messageId, (uint8)txMsg5.bufferNumber, txData5);
              else {
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg1, txData1) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg1.messageId, (uint8)txMsg1.bufferNumber, txData1);
                  dummy_comp1();
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg2, txData2) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg2.messageId, (uint8)txMsg2.bufferNumber, txData2);
                  dummy_comp1();
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg3, txData3) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg3.messageId, (uint8)txMsg3.bufferNumber, txData3);
                  dummy_comp1();
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg4, txData4) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg4.messageId, (uint8)txMsg4.bufferNumber, txData4);
                  dummy_comp1();
-                 while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg5, txData5) == IfxCan_Status_notSentBusy);
+                 tx_enqueue(txMsg5.messageId, (uint8)txMsg5.bufferNumber, txData5);
              }
 
 
@@ -1220,212 +1731,15 @@ void interruptGtmTom(void)
 //    printf("At %d clock pulse spent  %ld \n", i,dur1);
 //    BO_ISR();
     i = i+1;
-//    t10_tx();
-    if (slot_id % 2 == 0)//0.003--100freq,clk1
-    {
-            t8_tx();
-//            t7_busload(5);
-    }
-    if (slot_id % 3 == 0)//0.01--100freq,clk1
-    {
-
-//        t12_5_tx();//---
-//        int ii = 20;
-//        while(ii>0){
-//            dummy_comp1();
-//            ii--;
-//        }
-        t10_tx();
-//        t7_busload(1);
-//        ii = 70;
-//        while(ii>0){
-//            dummy_comp1();
-//            ii--;
-//        }
-    }
-    if (slot_id % 6 == 0)//0.02--100freq,clk1
-    {
-//        int ii = 20;
-//        while(ii>0){
-//            dummy_comp1();
-//            ii--;
-//        }
-            t20_tx();
-//            t3_transmission();
-//            t7_busload(1);
-//            ii = 70;
-//            while(ii>0){
-//                dummy_comp1();
-//                ii--;
-//            }
-    }
-    if (slot_id % 8 == 0)/* < 0.025 */
-    {
-//        t25_tx();
-    }
-    if (slot_id % 10 == 0)/* < 0.025 */
-    {
-        t30_tx();
-    }
-    if (slot_id % 12 == 0)//0.04--100freq,clk1
-    {
-//        dummy_comp1();
-            t40_tx();
-//            t3_transmission();
-//            t7_busload(2);
-//            int ii = 50;
-//            while(ii>0){
-//                dummy_comp1();
-//                ii--;
-//            }
-    }
-    if (slot_id % 15 == 0)//0.05--100freq,clk1
-    {
-//        t2_brakes();//task_scheduler(200);/* brakes */
-//        t4_qc();//task_scheduler(100);/* ttc */
-//        int ii = 50;
-//        while(ii>0){
-//            dummy_comp1();
-//            ii--;
-//        }
-//        t50_tx();
-//        ii = 50;
-//        while(ii>0){
-//            dummy_comp1();
-//            ii--;
-//        }
-//        t80_tx();
-//        dummy_comp1();
-    }
-    if (slot_id % 24 == 0){//0.08--100freq,clk1
-
-//        t80_tx();
-//        printf("80 ms task\n");
-    }
-    if (slot_id % 40 == 0){/* 0.1 */
-//            task_scheduler(200);/* brakes */
-//            task_scheduler(100);/* ttc */
-//        dummy_comp1();
-//        t100_tx();
-//        printf("hp = %d\n",hp());
-//        t7_busload(3);
-    }
-    if (slot_id % 43 == 0){/* 0.12 */
-
-//        t120_tx();
-//        t7_busload(4);
-//        printf("120 ms task\n");
-    }
-    if (slot_id % 75 == 0){/* 0.25 */
-//            task_scheduler(200);/* brakes */
-//            task_scheduler(100);/* ttc */
-//        t250_tx();//----
-    }
-    if (slot_id % 160 == 0){/* 0.5 */
-//            task_scheduler(200);/* brakes */
-//            task_scheduler(100);/* ttc */
-//        t500_tx();//----
-    }
-    if (slot_id % 303 == 0){/* 1 */
-//            task_scheduler(200);/* brakes */
-//            task_scheduler(100);/* ttc */
-//        t1000_tx();
-//        t1000_tx2();//----
-//        t7_busload(5);
-    }
-//    if (slot_id % 24 == 0){/* 0.08 */
-//        task_scheduler(200);/* brakes */
-//        task_scheduler(100);/* ttc */
-//    }
-    /* reset at hyper period */
+    /* mode switch at hyper period */
     slot_id=slot_id+1;
-    if (slot_id % 7 == 0){/* 0.02 *///
-        if(HP==20){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-            slot_id = 1;
-            updateutil();
-            HP =hp();
-        }
-
-    }else if (slot_id % 13 == 0){/* 0.04 *///
-        if(HP==40){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-            slot_id = 1;
-            updateutil();
-            HP = hp();
-        }
-
-    }else if (slot_id % 15 == 0){/* 0.05*/
-        if(HP==50){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
-
-    }else if (slot_id % 27 == 0){/* 0.08 */
-        if(HP==80){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
-
-    }else if (slot_id % 30 == 0){/* 0.1 */
-        if(HP==100){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
-
-    }else if (slot_id % 40 == 0){/* 0.12 */
-        if(HP==120){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
-
-    }else if (slot_id % 61 == 0){/* 0.2 */
-        if(HP==200){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
-
-    }else if (slot_id % 71 == 0){/* 0.24 */
-        if(HP==240){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-        }
-
-    }else if (slot_id % 120 == 0){/* 0.4 */
-        if(HP==400){
-           printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP = hp();
-       }
-    }
-    else if (slot_id % 304 == 0){/* 1 */
-        if(HP==1000){
-            printf("resetting slot_id=%d at i=%d\n",slot_id,i);
-            slot_id = 1;
-            updateutil();
-            HP = hp();
-        }
-//        task_scheduler(200);
-    }else if (slot_id % 356 == 0){/* 1.2 */
-        if(HP==1200){
-            printf("here at slot = %d HP = %d\n",slot_id,HP);
-           slot_id = 1;
-           updateutil();
-           HP =hp();
-       }
+#if ECU_PARTITIONED
+    if (timeline_tick(&mode_cur->table, job_release)){
+#else
+    if (timeline_tick(&mode_cur->table, dispatch_run_job)){
+#endif
+        slot_id = 0;
+        mode_swap();
     }
 //    if (slot_id % 290){/* 1s */
 //        t1000_tx();
@@ -1475,6 +1789,7 @@ void initGtmTom(void)
     //IfxPort_setPinModeOutput(LED1, IfxPort_OutputMode_pushPull, IfxPort_OutputIdx_general);  /* Set pin mode         */
     //IfxPort_setPinModeOutput(LED2, IfxPort_OutputMode_pushPull, IfxPort_OutputIdx_general);
 
+    mode_init();                                                                /* First mode, mode switch task     */
     IfxGtm_Tom_Timer_run(&g_timerDriver);                                       /* Start the TOM                    */
     last = clock();
 }
@@ -1568,11 +1883,113 @@ void BO_ISR(void)
 /* ----- for tx --------*/
 void CanBasicDemo_tx(IfxCan_Message txMsg, uint32 *txDataMsg, uint32 msg_tx_id, uint8 msg_tx_buf)
 {
+    printf("--tx id= %u at %d\n", msg_tx_id, i);
+    tx_enqueue(msg_tx_id, msg_tx_buf, txDataMsg);
+}
+
+
+/* Requests the transmission of a queued entry; its buffer must be free */
+static void tx_submit(tx_queue_entry *e, uint8 buf, uint64 now)
+{
+    IfxCan_Message txMsg;
+    uint64 wait = now - e->stamp;
+
     IfxCan_Can_initMessage(&txMsg);
-    txMsg.messageId = msg_tx_id;
-    txMsg.bufferNumber = msg_tx_buf;
-    printf("--tx id= %u at %d\n", txMsg.messageId, i);
-    while (IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg, txDataMsg) == IfxCan_Status_notSentBusy);
+    txMsg.messageId = e->id;
+    txMsg.bufferNumber = buf;
+    IfxCan_Can_sendMessage(&g_CanBasic.drivers.canNode[1], &txMsg, e->data);
+    e->queued = 0;
+    tx_queued--;
+    e->sent++;
+    e->wait_total += wait;
+    if (wait > e->wait_max)
+        e->wait_max = wait;
+}
+
+
+/* Puts buf into tx_order by the ID of its entry */
+static void tx_order_insert(uint8 buf)
+{
+    int k = 0, n;
+
+    while (k < tx_order_len && tx_order[k] != buf)
+        k++;
+    while (k + 1 < tx_order_len){                     /* removes it if the ID of the buffer changed */
+        tx_order[k] = tx_order[k + 1];
+        k++;
+    }
+    if (k < tx_order_len)
+        tx_order_len--;
+    n = tx_order_len;
+    while (n > 0 && tx_queue[tx_order[n - 1]].id > tx_queue[buf].id){
+        tx_order[n] = tx_order[n - 1];
+        n--;
+    }
+    tx_order[n] = buf;
+    tx_order_len++;
+}
+
+
+/* Queues id with data on dedicated TX buffer buf without waiting for the bus: the message is requested right away if
+ * the buffer is free, else by tx_queue_drain when it frees up. A message still queued on buf is replaced (the newer
+ * command wins). Constant time, except on the first message of a buffer or when its ID changes. */
+void tx_enqueue(uint32 id, uint8 buf, const uint32 *data)
+{
+    tx_queue_entry *e = &tx_queue[buf];
+    uint64 now = IfxStm_get(BSP_DEFAULT_TIMER);
+    boolean interruptState = IfxCpu_disableInterrupts();
+
+    if (!e->used || e->id != id){
+        e->id = id;
+        e->used = 1;
+        tx_order_insert(buf);
+    }
+    if (e->queued)
+        e->replaced++;
+    else
+        tx_queued++;
+    e->data[0] = data[0];
+    e->data[1] = data[1];
+    e->stamp = now;
+    e->queued = 1;
+    if (!IfxCan_Node_isTxBufferRequestPending(g_CanBasic.drivers.canNode[1].node, (IfxCan_TxBufferId)buf))
+        tx_submit(e, buf, now);
+    IfxCpu_restoreInterrupts(interruptState);
+}
+
+
+/* Requests every queued message whose buffer is free, highest priority first; called on transmission completed */
+void tx_queue_drain(void)
+{
+    Ifx_CAN_N *nodeSfr = g_CanBasic.drivers.canNode[1].node;
+    uint64 now;
+    boolean interruptState;
+    int k = 0;
+
+    if (tx_queued == 0)
+        return;
+    now = IfxStm_get(BSP_DEFAULT_TIMER);
+    interruptState = IfxCpu_disableInterrupts();
+    while (k < tx_order_len && tx_queued > 0){
+        uint8 buf = tx_order[k];
+        if (tx_queue[buf].queued && !IfxCan_Node_isTxBufferRequestPending(nodeSfr, (IfxCan_TxBufferId)buf))
+            tx_submit(&tx_queue[buf], buf, now);
+        k++;
+    }
+    IfxCpu_restoreInterrupts(interruptState);
+}
+
+
+/* Counters of the entry of TX buffer buf; the waits are from enqueue to transmit request */
+void tx_queue_stats(uint8 buf, uint32 *sent, uint32 *replaced, float *wait_mean_us, float *wait_max_us)
+{
+    const tx_queue_entry *e = &tx_queue[buf];
+    float tick_us = 1e6f / IfxStm_getFrequency(BSP_DEFAULT_TIMER);
+
+    *sent = e->sent;
+    *replaced = e->replaced;
+    *wait_mean_us = e->sent ? e->wait_total * tick_us / e->sent : 0;
+    *wait_max_us = e->wait_max * tick_us;
 }
 
 
@@ -1654,6 +2071,7 @@ void CanBasicDemo_init(void)
 
         Ifx_CAN_N *nodeSfr = IfxCan_getNodePointer(g_CanBasic.drivers.canNode[0].can, nodeConfig.nodeId);
 
+        rx_dispatch_init();
         IfxCan_Node_enableConfigurationChange(nodeSfr);
         /* Enable interrupts in CAN */
         IfxCan_Node_enableInterrupt(nodeSfr, IfxCan_Interrupt_rxFifo0NewMessage);
@@ -1753,175 +2171,10 @@ void CanBasicDemo_init(void)
 void CanBasicDemo_run_qc(void)  /*     This is the code of QC     */
 {
 //    uint32 txData2[2];
-    float a[12][12] = {{1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                        {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                        {0,    0,    1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0},
-                        {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
-                        {0,    0,    0,    0,    1, 0.01,     0.00049,   1.633e-06,    0,    0,    0,    0},
-                        {0,    0,    0,    0,    0,    1,       0.098,     0.00049,    0,    0,    0,    0},
-                        {0,    0,    0,    0,    0,    0,    1, 0.01,    0,    0,    0,    0},
-                        {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
-                        {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01    -0.00049,  -1.633e-06},
-                        {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,      -0.098,    -0.00049},
-                        {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01},
-                        {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}};
-
-    float b[12][4] = {{0.00001, 0, 0, 0},
-                        {0.002, 0, 0, 0},
-                        {0, 0.000005, 0, 0},
-                        {0, 0.001, 0, 0},
-                        {0, 0, 0, 0},
-                        {0, 0, 0, 0},
-                        {0, 0, 0.000005, 0},
-                        {0, 0, 0.001, 0},
-                        {0, 0, 0, 0},
-                        {0, 0, 0, -0.0000001633},
-                        {0, 0, 0, 0.000005},
-                        {0, 0, 0, 0.001}};
-
-//    float c[12][12] = {{1,0,0,0,0,0,0,0,0,0,0,0},
-//                        {0,1,0,0,0,0,0,0,0,0,0,0}
-//
-//
-//    };
-
-//    float d[4][2] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-    float K[4][16] = {{3.14451685869324, 5.61640885706677, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                        {0, 0, 0.315827253270447, 2.53304005481979, 0, 0, 0, 0, 0, 0, 0, 0},
-                        {0, 0, 0, 0, 3.10787674690884, 6.15027001575052, 59.4853828724422, 34.4066362896555, 0, 0, 0, 0},
-                        {0, 0, 0, 0, 0, 0, 0, 0, -3.10787674687785, -6.15027001566358, 59.4853828713107, 34.4066362889244}};
-
-//    float L[4][1] = {{0.627216669816835}, {0.0776672166534822}, {0.0335031868276192}, {0.804439585315085}};
-    if (h_list[task_per[1]]==8 || h_list[1][task_per[1]]==40){/*  qc altitude control code  0.008s */
-        printf("Acquiring system matrices for task qc alt, periodicity 40\n");
-        float K[4][16] = {{3.14806101403323, 5.61958299359191,    -1.06574271596490e-13,   -3.51167300129546e-13,   1.41342271329799e-12,    2.01062101868168e-12,    1.01336113292644e-11,    2.21595181457621e-11,    -6.09240741105249e-14,   5.22728093268344e-16,    -2.29214005150142e-13,   -1.63828525072864e-14},
-                         {-1.40612070043267e-13, -1.55665450866325e-13,   0.315907315209643,   2.53336608803131,    6.85283776603311e-13,    8.93097231937326e-13,    5.64678083994045e-12,    1.85029586289379e-12,    2.38846862222207e-13,    3.94653870911855e-13,    -2.69539769628066e-12,   -1.50278419750555e-12},
-                         {6.06951163104689e-12,  1.09751533138976e-11,    1.16215441377720e-13,    1.84009321132151e-12,    3.11868152834707,    6.16850483139175,    59.6311710091072,    34.4660711180138,    4.69926930228626e-11,    7.26917658867268e-11,    -5.24662404659150e-10,   -1.89171664196777e-10},
-                         {4.93997661255683e-13,  -7.79648124187351e-15,   -3.11282929182986e-13,   -1.50718804881790e-12,   -5.37309119167142e-11,   -7.78148637957717e-11,   -5.41596347348106e-10,   -1.89400019326547e-10,   -3.11868152830212,   -6.16850483132701,   59.6311710086223,    34.4660711178274}};
-    }
-    else if (h_list[1][task_per[1]]==10){/*  qc altitude control code  0.01s */
-        printf("Acquiring system matrices for task qc, periodicity 10\n");
-        float a[12][12] =  {{1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    1, 0.01,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    1, 0.01,     0.00049,   1.633e-06,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    1,       0.098,     0.00049,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    1, 0.01,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01    -0.00049,  -1.633e-06},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,      -0.098,    -0.00049},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.01},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}};
-
-        float b[12][4] =   {{0.00001, 0, 0, 0},
-                            {0.002, 0, 0, 0},
-                            {0, 0.000005, 0, 0},
-                            {0, 0.001, 0, 0},
-                            {0, 0, 0, 0},
-                            {0, 0, 0, 0},
-                            {0, 0, 0.000005, 0},
-                            {0, 0, 0.001, 0},
-                            {0, 0, 0, 0},
-                            {0, 0, 0, -0.0000001633},
-                            {0, 0, 0, 0.000005},
-                            {0, 0, 0, 0.001}};
-
-//             float c[][] = {{1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-//        float K[4][16] = {{3.14451685869324, 5.61640885706677, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-//                            {0, 0, 0.315827253270447, 2.53304005481979, 0, 0, 0, 0, 0, 0, 0, 0},
-//                            {0, 0, 0, 0, 3.10787674690884, 6.15027001575052, 59.4853828724422, 34.4066362896555, 0, 0, 0, 0},
-//                            {0, 0, 0, 0, 0, 0, 0, 0, -3.10787674687785, -6.15027001566358, 59.4853828713107, 34.4066362889244}};
-        float K[4][16] = {{3.14451685869324, 5.61640885706677, -2.24815378560498e-13, -9.35040910781222e-13, -2.00084615486558e-12, -3.19864871177971e-12, -2.42906164884875e-11, -9.12993173689396e-12, 7.77479339632901e-13, 1.32462155507943e-12, -1.13920607077515e-11, -5.28889409924540e-12},
-                          {-2.40306241803692e-13, -4.72815380478954e-13,   0.315827253270447,   2.53304005481979,    7.84605220808760e-13,    1.16425694772151e-12,    8.43874185194031e-12,    3.06879093499489e-12,    -5.31262238867872e-13,   -8.59004682947821e-13,   6.52030942425330e-12,    3.26154527538293e-12},
-                          {-3.67448507775373e-12, -4.52413546402716e-12,   -2.93728431368812e-13,   3.14130884398491e-12,    3.10787674690884,    6.15027001575052,    59.4853828724422,    34.4066362896555,    -1.18482368586491e-10,   -2.08120109148284e-10,   1.68577401900408e-09,    6.47292755594409e-10},
-                          {-2.45653038076514e-12, -2.62953318968014e-12,   -1.22285655546061e-13,   3.40902909601388e-12,    9.27267520204066e-11,    1.69084002031452e-10,    1.47075073708627e-09,    6.46413943908671e-10,    -3.10787674687785,   -6.15027001566358,   59.4853828713107,    34.4066362889244}};
-
-
-//           float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }else  if (h_list[1][task_per[1]]==20){/*  qc altitude control code  0.02s */
-        printf("Acquiring system matrices for task qc, periodicity 20\n");
-        float a[12][12] =  {{1, 0.02,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    1, 0.02,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    1, 0.02,     0.00196,   0.00001307,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    1,       0.196,     0.00196,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    1, 0.02,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.02,    -0.00196,  -0.00001307},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,      -0.196,    -0.00196},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.02},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}};
-
-        float b[12][4] = {{0.00004,           0,           0,           0},
-                            {0.004,           0,           0,           0},
-                            {0,       0.00002,           0,           0},
-                            {0,       0.002,            0,           0},
-                            {0,           0,            0,           0},
-                            {0,           0,   0.000001307,           0},
-                            {0,           0,       0.00002,           0},
-                            {0,           0,       0.002,           0},
-                            {0,           0,           0,           0},
-                            {0,           0,           0,  -0.000001307},
-                            {0,           0,           0,       0.00002},
-                            {0,           0,           0,       0.002}};
-
-//             float c[][] = {{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-        float K[4][16] = {{3.12685594967393, 5.60056530879117, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                        {0, 0, 0.315427247946649, 2.53141053716782, 0, 0, 0, 0, 0, 0, 0, 0},
-                        {0, 0, 0, 0, 3.05441194111679, 6.05997082436238, 58.7631166321155, 34.1120666564246, 0, 0, 0, 0},
-                        {0, 0, 0, 0, 0, 0, 0, 0, -3.05441194117077, -6.05997082447233, 58.7631166330827, 34.1120666568239}};
-
-//       float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }else if (h_list[1][task_per[1]]==30){/*  qc altitude control code  0.03s */
-        printf("Acquiring system matrices for task qc, periodicity 30\n");
-        float a[12][12] =  {{0,    1,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    1, 0.03,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    1,    0,    0,    0,    0,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    1, 0.03,    0.00441,   0.0000441,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    1,      0.294,    0.00441,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    1, 0.03,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    1,    0,    0,    0,    0},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    1, 0.03,   -0.00441,  -0.0000441},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    1,     -0.294,   -0.00441},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1, 0.03},
-                            {0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1}};
-        float b[12][4] =   {{0, 0, 0, 0},
-                            {0.006, 0, 0, 0},
-                            {0,     0.000045, 0, 0},
-                            {0,      0.003, 0, 0},
-                            {0, 0,      0, 0},
-                            {0, 0,    0.00000441, 0},
-                            {0, 0,     0.000045, 0},
-                            {0, 0,       0.003, 0},
-                            {0, 0, 0,       0},
-                            {0, 0, 0,   -0.00000441},
-                            {0, 0, 0,     0.000045},
-                            {0, 0, 0,       0.003}};
-
-//             float c[][] = {{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-        float K[4][16] = {{3.10929450940453, 5.58476697969132, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                          {0, 0, 0.315027749563069, 2.52978210015362, 0, 0, 0, 0, 0, 0, 0, 0},
-                          {0, 0, 0, 0, 3.00186737100001, 5.97111120050923, 58.0518248251535, 33.8217758502374, 0, 0, 0, 0},
-                          {0, 0, 0, 0, 0, 0, 0, 0, -3.00186737091428, -5.97111120037752, 58.0518248241734, 33.8217758498679}};
+    const qc_gains *g = qc_gain;                      /* selected with task_per, see mode_gains */
+    float e[12];
+    float u[4];
 
-
-//       float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }
     //
 
 //       float check = xA - xhatA;
@@ -1930,6 +2183,7 @@ void CanBasicDemo_run_qc(void)  /*     This is the code of QC     */
             int ii =0;
             while (ii < 12){
                 xhat_QC[ii]= ((float)y_QC[ii]/(float)QC_X_FACTOR[ii])-(float)QC_X_OFFSET[ii];//xhat_QC_alt[0];
+                e[ii] = xhat_QC[ii] - QC_REF[ii];
                 ii = ii +1;
             }
 //          float y = ((float)y1_QC_alt/(float)QC_XA_factor)-(float)QC_XA_offset;
@@ -1960,24 +2214,18 @@ void CanBasicDemo_run_qc(void)  /*     This is the code of QC     */
 //                }
 //                ii = ii+1;
 //            }
-            u_QC[0] = -(K[0][0]*(xhat_QC[0]-QC_REF[0]) + K[0][1]*xhat_QC[1] + K[0][2]*xhat_QC[2] + K[0][3]*xhat_QC[3]
-                                  + K[0][4]*(xhat_QC[4]-QC_REF[4]) + K[0][5]*xhat_QC[5] + K[0][6]*xhat_QC[6] + K[0][7]*xhat_QC[7]
-                                     + K[0][8]*(xhat_QC[8]-QC_REF[8]) + K[0][9]*xhat_QC[9] + K[0][10]*xhat_QC[10] + K[0][11]*xhat_QC[11]);
-            u_QC[1] = -(K[1][0]*(xhat_QC[0]-QC_REF[0]) + K[1][1]*xhat_QC[1] + K[1][2]*xhat_QC[2] + K[1][3]*xhat_QC[3]
-                                              + K[1][4]*(xhat_QC[4]-QC_REF[4]) + K[1][5]*xhat_QC[5] + K[1][6]*xhat_QC[6] + K[1][7]*xhat_QC[7]
-                                                 + K[1][8]*(xhat_QC[8]-QC_REF[8]) + K[1][9]*xhat_QC[9] + K[1][10]*xhat_QC[10] + K[1][11]*xhat_QC[11]);
-            u_QC[2] = -(K[2][0]*(xhat_QC[0]-QC_REF[0]) + K[2][1]*xhat_QC[1] + K[2][2]*xhat_QC[2] + K[2][3]*xhat_QC[3]
-                                              + K[2][4]*(xhat_QC[4]-QC_REF[4]) + K[2][5]*xhat_QC[5] + K[2][6]*xhat_QC[6] + K[2][7]*xhat_QC[7]
-                                                 + K[2][8]*(xhat_QC[8]-QC_REF[8]) + K[2][9]*xhat_QC[9] + K[2][10]*xhat_QC[10] + K[2][11]*xhat_QC[11]);
-            u_QC[3] = -(K[3][0]*(xhat_QC[0]-QC_REF[0]) + K[3][1]*xhat_QC[1] + K[3][2]*xhat_QC[2] + K[3][3]*xhat_QC[3]
-                                              + K[3][4]*(xhat_QC[4]-QC_REF[4]) + K[3][5]*xhat_QC[5] + K[3][6]*xhat_QC[6] + K[3][7]*xhat_QC[7]
-                                                 + K[3][8]*(xhat_QC[8]-QC_REF[8]) + K[3][9]*xhat_QC[9] + K[3][10]*xhat_QC[10] + K[3][11]*xhat_QC[11]);
+            SPARSE_MV(u, g->K, e, QC_K_PATTERN);
+            u_QC[0] = -u[0];
+            u_QC[1] = -u[1];
+            u_QC[2] = -u[2];
+            u_QC[3] = -u[3];
 
 //            u_QC_alt = u;
             txDataQC1[0] = (u_QC[0]+QC_U_OFFSET[0])*QC_U_FACTOR[0];
             txDataQC1[1] = (u_QC[1]+QC_U_OFFSET[1])*QC_U_FACTOR[1];
             txDataQC2[0] = (u_QC[2]+QC_U_OFFSET[2])*QC_U_FACTOR[2];
             txDataQC2[1] = (u_QC[3]+QC_U_OFFSET[3])*QC_U_FACTOR[3];
+            qc_actuator_publish();
 
             printf("calculated qc data 2 %f data 3 %f, tx data %u, %u for sensor data %f and estimated states [%f; %f; %f; %f] at %d\n", u_QC[2], u_QC[3], txDataQC2[0], txDataQC2[1], y_QC, xhat_QC[0], xhat_QC[1], xhat_QC[2], xhat_QC[3], i);//stopped for testing
             /* doing the rest periodically */
@@ -2001,83 +2249,10 @@ void CanBasicDemo_run_qc(void)  /*     This is the code of QC     */
 void CanBasicDemo_run_qc_alt(void)  /*     This is the code of QC     */
 {
 //    uint32 txData2[2];
-    float a[4][4] = {{1,   0.01,  0,  0},
-                     {0,    1,   0,   0},
-                     {0,   0,    1,   0.01},
-                     {0,    0,    0,   1}};
-
-    float b[4][2] = {{0, 0}, {0.002, 0},  {0, 0}, {0, 0.001}};
-
-    float c[4][4] = {{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}};
-
-    float d[4][2] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-    float K[2][4] = {{3.14451685869324,          5.61640885706677,     -2.24815378560498e-13,     -9.35040910781222e-13},
-                                {-2.40306241803692e-13,     -4.72815380478954e-13,         0.315827253270447,          2.53304005481979}};
-
-//    float L[4][1] = {{0.627216669816835}, {0.0776672166534822}, {0.0335031868276192}, {0.804439585315085}};
-    if (h_list[task_per[0]]==8 || h_list[task_per[0]]==40){/*  qc altitude control code  0.008s */
-        printf("Acquiring system matrices for task qc alt, periodicity 40\n");
-        float K[2][4] =  {{3.14806101403323, 5.61958299359191,    -1.06574271596490e-13,   -3.51167300129546e-13},
-         {-1.40612070043267e-13, -1.55665450866325e-13,   0.315907315209643,   2.53336608803131}};
-    }
-    if (h_list[0][task_per[0]]==10){/*  qc altitude control code  0.01s */
-        printf("Acquiring system matrices for task qc alt, periodicity 10\n");
-             float  a[4][4] = {{1,   0.01,  0,  0},
-                              {0,    1,   0,   0},
-                              {0,   0,    1,   0.01},
-                              {0,    0,    0,   1}};
-
-             float b[4][2] = {{0, 0}, {0.002, 0}, {0, 0}, {0, 0.001}};
-
-//             float c[][] = {{1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
+    const qc_alt_gains *g = qc_alt_gain;              /* selected with task_per, see mode_gains */
+    float e[4];
+    float u[2];
 
-           float K[2][4] = {{3.14451685869324,          5.61640885706677,     -2.24815378560498e-13,     -9.35040910781222e-13},
-                            {-2.40306241803692e-13,     -4.72815380478954e-13,         0.315827253270447,          2.53304005481979}};
-
-//           float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }else  if (h_list[0][task_per[0]]==20){/*  qc altitude control code  0.02s */
-        printf("Acquiring system matrices for task qc alt, periodicity 20\n");
-             float a[4][4] = {{1,   0.02,  0,  0},
-                         {0,    1,   0,   0},
-                         {0,   0,    1,   0.02},
-                         {0,    0,    0,   1}};
-
-             float b[4][2] = {{0, 0}, {0.004, 0},  {0, 0}, {0, 0.002}};
-
-//             float c[][] = {{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-             float K[2][4] = {{3.12685594967393,          5.60056530879117,     -8.20209119000962e-15,     -1.04128354000384e-13},
-                               {-2.27958236698399e-15,     -5.25758397334492e-14,         0.315427247946649,          2.53141053716782}};
-;
-
-//       float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }else if (h_list[0][task_per[0]]==30){/*  qc altitude control code  0.03s */
-        printf("Acquiring system matrices for task qc alt, periodicity 30\n");
-             float a[4][4] = {{1,   0.03,  0,  0},
-                         {0,    1,   0,   0},
-                         {0,   0,    1,   0.03},
-                         {0,    0,    0,   1}};
-
-             float b[4][2] = {{0, 0}, {0.006, 0},  {0, 0}, {0, 0.003}};
-
-//             float c[][] = {{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}};
-//
-//             float d[][] = {{0, 0},{0, 0},{0, 0},{0, 0}};
-
-             float K[2][4] = {{3.10929450940453,          5.58476697969132,      1.63721429561644e-14,     -3.56030803834745e-15},
-                               {-9.08613371101948e-16,     -1.52517184180782e-15,         0.315027749563069,          2.52978210015362}};
-
-
-//       float L[4][1] = {{0.620320155088737}, {-0.138221228206519}, {0.107979746965025}, {0.490620372256037}};
-
-    }
     //
 
 //       float check = xA - xhatA;
@@ -2113,12 +2288,18 @@ void CanBasicDemo_run_qc_alt(void)  /*     This is the code of QC     */
 //            if (i > 100000 && i < 200000)
 //                xhat_QC_alt[0] = xhat_QC_alt[0] + rand()% 2;
 
-            u_QC_alt[0] = -(K[0][0]*(xhat_QC_alt[0]-QC_REF_alt[0]) + K[0][1]*xhat_QC_alt[1] + K[0][2]*xhat_QC_alt[2] + K[0][3]*xhat_QC_alt[3]);
-            u_QC_alt[1] = -(K[1][0]*(xhat_QC_alt[0]-QC_REF_alt[0]) + K[1][1]*xhat_QC_alt[1] + K[1][2]*xhat_QC_alt[2] + K[1][3]*xhat_QC_alt[3]);
+            e[0] = xhat_QC_alt[0] - QC_REF_alt[0];
+            e[1] = xhat_QC_alt[1];
+            e[2] = xhat_QC_alt[2];
+            e[3] = xhat_QC_alt[3];
+            SPARSE_MV(u, g->K, e, QC_ALT_K_PATTERN);
+            u_QC_alt[0] = -u[0];
+            u_QC_alt[1] = -u[1];
 //            printf("multiplying K[%d][%d]=%f with xhat[%d]=%f minum %f in u[%d]= %f\n ", ii, jj, K[ii][jj], jj, xhat_QC[jj], QC_REF[jj], ii,  u_QC[ii]);
 //            u_QC_alt = u;
             txDataQC_alt[0] = (u_QC_alt[0]+QC_U_OFFSET[0])*QC_U_FACTOR[0];
             txDataQC_alt[1] = (u_QC_alt[1]+QC_U_OFFSET[1])*QC_U_FACTOR[1];
+            qc_actuator_publish();
             printf("calculated qc alt data %f tx data %u for sensor data %f and estimated states [%f; %f; %f; %f] at %d\n", u_QC_alt[0], txDataQC_alt[0], y_QC[5], xhat_QC_alt[0], xhat_QC_alt[1], xhat_QC_alt[2], xhat_QC_alt[3], i);//stopped for testing
             /* doing the rest periodically */
 //            txData2[0] = ((u1_P5 + C5_U1_offset)*C5_U1_factor);
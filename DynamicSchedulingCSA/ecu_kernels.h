@@ -0,0 +1,61 @@
+/**********************************************************************************************************************
+ * \file ecu_kernels.h
+ * \brief Fixed-size sparse matrix-vector kernels, generated at compile time from the sparsity pattern of the matrix
+ *
+ * A pattern is a macro listing the runs of nonzeros of a matrix, X(y, M, x, row, col, n, op) for columns
+ * col..col+n-1 of row. SPARSE_MV expands every run into its n multiply-adds with constant indices: no loop, no
+ * branch, nothing spent on the zeros. op is = for the first run of a row and += for the next ones; rows without a
+ * run are not written. The terms of a run are added left to right, so the result is bit for bit that of the dense
+ * product when the skipped entries are exactly zero. The gains of the other controllers (ESP, TTC, CC, SC, ABS) get
+ * their own pattern next to the QC ones; a dense K is one run per row.
+ *
+ *     #define QC_ALT_K_PATTERN(X, y, M, x)  X(y, M, x, 0, 0, 2, =) X(y, M, x, 1, 2, 2, =)
+ *     SPARSE_MV(u, g->K, e, QC_ALT_K_PATTERN);      u[0] = K[0][0]*e[0] + K[0][1]*e[1]; u[1] = K[1][2]*e[2] + ...
+ *
+ * SPARSE_QF_DIAG_ADD adds the quadratic form v'Wv of a diagonal weight W, given as X(s, v, i, w) per nonzero w.
+ *********************************************************************************************************************/
+#ifndef ECU_KERNELS_H
+#define ECU_KERNELS_H
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+/* y = M x over the runs of pattern; M is a 2-D array (or a pointer to its rows) */
+#define SPARSE_MV(y, M, x, pattern)           do { pattern(SPARSE_MV_RUN, y, M, x) } while (0)
+#define SPARSE_MV_RUN(y, M, x, row, col, n, op)  (y)[row] op SPARSE_DOT##n((M)[row], x, col);
+
+/* s += v'Wv over the diagonal weights of pattern */
+#define SPARSE_QF_DIAG_ADD(s, v, pattern)     do { pattern(SPARSE_QF_TERM, s, v) } while (0)
+#define SPARSE_QF_TERM(s, v, i, w)            (s) = (s) + (w) * (v)[i] * (v)[i];
+
+/* m[c]*x[c] + ... + m[c+n-1]*x[c+n-1], added left to right */
+#define SPARSE_DOT1(m, x, c)    ((m)[c] * (x)[c])
+#define SPARSE_DOT2(m, x, c)    (SPARSE_DOT1(m, x, c) + (m)[(c) + 1] * (x)[(c) + 1])
+#define SPARSE_DOT3(m, x, c)    (SPARSE_DOT2(m, x, c) + (m)[(c) + 2] * (x)[(c) + 2])
+#define SPARSE_DOT4(m, x, c)    (SPARSE_DOT3(m, x, c) + (m)[(c) + 3] * (x)[(c) + 3])
+#define SPARSE_DOT5(m, x, c)    (SPARSE_DOT4(m, x, c) + (m)[(c) + 4] * (x)[(c) + 4])
+#define SPARSE_DOT6(m, x, c)    (SPARSE_DOT5(m, x, c) + (m)[(c) + 5] * (x)[(c) + 5])
+#define SPARSE_DOT7(m, x, c)    (SPARSE_DOT6(m, x, c) + (m)[(c) + 6] * (x)[(c) + 6])
+#define SPARSE_DOT8(m, x, c)    (SPARSE_DOT7(m, x, c) + (m)[(c) + 7] * (x)[(c) + 7])
+#define SPARSE_DOT9(m, x, c)    (SPARSE_DOT8(m, x, c) + (m)[(c) + 8] * (x)[(c) + 8])
+#define SPARSE_DOT10(m, x, c)   (SPARSE_DOT9(m, x, c) + (m)[(c) + 9] * (x)[(c) + 9])
+#define SPARSE_DOT11(m, x, c)   (SPARSE_DOT10(m, x, c) + (m)[(c) + 10] * (x)[(c) + 10])
+#define SPARSE_DOT12(m, x, c)   (SPARSE_DOT11(m, x, c) + (m)[(c) + 11] * (x)[(c) + 11])
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Patterns------------------------------------------------------*/
+/*********************************************************************************************************************/
+/* LQR gains of the quadcopter (qc_gain_table): x/y position, attitude pair and its mirror, 2 + 2 + 4 + 4 nonzeros.
+ * The off-block entries of the 10 and 40 ms gains are below 2e-9 and are left out. */
+#define QC_K_PATTERN(X, y, M, x) \
+    X(y, M, x, 0, 0, 2, =) X(y, M, x, 1, 2, 2, =) X(y, M, x, 2, 4, 4, =) X(y, M, x, 3, 8, 4, =)
+#define QC_ALT_K_PATTERN(X, y, M, x) \
+    X(y, M, x, 0, 0, 2, =) X(y, M, x, 1, 2, 2, =)
+
+/* Cost weights of updateutil: Q on the sensor outputs, R on the commands */
+#define QC_Q_PATTERN(X, s, v)       X(s, v, 0, 10.0f) X(s, v, 4, 100.0f) X(s, v, 8, 100.0f)
+#define QC_R_PATTERN(X, s, v)       X(s, v, 0, 1.0f) X(s, v, 1, 10.0f) X(s, v, 2, 10.0f) X(s, v, 3, 10.0f)
+#define QC_ALT_Q_PATTERN(X, s, v)   X(s, v, 0, 100.0f)
+#define QC_ALT_R_PATTERN(X, s, v)   X(s, v, 0, 10.0f)
+
+#endif /* ECU_KERNELS_H */
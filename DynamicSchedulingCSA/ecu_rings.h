@@ -0,0 +1,108 @@
+/**********************************************************************************************************************
+ * \file ecu_rings.h
+ * \brief Lock-free single-producer/single-consumer rings between core 0 and core 1
+ *
+ * Core 0 (CAN, TOM) releases the control jobs with a snapshot of the sensor outputs on an ecu_job_ring; core 1 runs
+ * them and returns the actuator commands on an ecu_act_ring. Only the producer writes head and only the consumer
+ * writes tail, each on its own line, so no lock and no read-modify-write is needed: the producer fills the slot and
+ * then publishes head (release), the consumer reads head (acquire) and then the slot. On the TriCore both barriers
+ * are a dsync; on the host (ring_bench.c) they are the gcc __atomic acquire/release operations.
+ *
+ *     ecu_job_msg *m = SPSC_WRITE_SLOT(&ring);       ecu_job_msg *m = SPSC_READ_SLOT(&ring);
+ *     if (m != NULL) { ...fill *m...;                if (m != NULL) { ...use *m...;
+ *                      SPSC_PUSH(&ring); }                            SPSC_POP(&ring); }
+ *********************************************************************************************************************/
+#ifndef ECU_RINGS_H
+#define ECU_RINGS_H
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#include "Ifx_types.h"
+#if defined(__TASKING__) || defined(__tricore__)
+#include "IfxCpu_Intrinsics.h"
+#endif
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define SPSC_SLOTS            16                      /* slots per ring, power of two                                 */
+#define SPSC_LINE             64                      /* head and tail on separate lines (LMU: 32, x86: 64 bytes)     */
+
+#if defined(__TASKING__) || defined(__tricore__)
+#define SPSC_LOAD_ACQUIRE(p)      spsc_loadAcquire(p)
+#define SPSC_STORE_RELEASE(p, v)  spsc_storeRelease((p), (v))
+#define SPSC_FENCE()              __dsync()           /* orders the writes before it with those after it              */
+#else
+#define SPSC_LOAD_ACQUIRE(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SPSC_STORE_RELEASE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define SPSC_FENCE()              __atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+/* A ring of SPSC_SLOTS elements of type */
+#define SPSC_RING(type)                                                                     \
+    struct                                                                                  \
+    {                                                                                       \
+        volatile uint32 head;                         /* written by the producer only */    \
+        uint8 pad0[SPSC_LINE - sizeof(uint32)];                                             \
+        volatile uint32 tail;                         /* written by the consumer only */    \
+        uint8 pad1[SPSC_LINE - sizeof(uint32)];                                             \
+        type slot[SPSC_SLOTS];                                                              \
+    }
+
+/* Producer: slot to fill, NULL if the ring is full */
+#define SPSC_WRITE_SLOT(r) \
+    (((r)->head - SPSC_LOAD_ACQUIRE(&(r)->tail)) < SPSC_SLOTS ? &(r)->slot[(r)->head & (SPSC_SLOTS - 1)] : NULL)
+/* Producer: publishes the slot returned by SPSC_WRITE_SLOT */
+#define SPSC_PUSH(r)       SPSC_STORE_RELEASE(&(r)->head, (r)->head + 1)
+/* Consumer: oldest slot, NULL if the ring is empty */
+#define SPSC_READ_SLOT(r) \
+    (SPSC_LOAD_ACQUIRE(&(r)->head) != (r)->tail ? &(r)->slot[(r)->tail & (SPSC_SLOTS - 1)] : NULL)
+/* Consumer: frees the slot returned by SPSC_READ_SLOT */
+#define SPSC_POP(r)        SPSC_STORE_RELEASE(&(r)->tail, (r)->tail + 1)
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Data Structures---------------------------------------------------*/
+/*********************************************************************************************************************/
+/* Control job released by core 0 */
+typedef struct
+{
+    uint32 y[12];                                     /* sensor outputs when the job was released                     */
+    uint64 stamp;                                     /* STM time of the newest frame in y                            */
+    uint8  task;                                      /* 0: qc alt, 1: qc                                             */
+    uint8  exec;                                      /* css bit, 0 = skipped                                         */
+    uint8  tx_u01;                                    /* also send u_QC[0..1]                                         */
+    uint8  per;                                       /* periodicity of the task as index in h_list                   */
+} ecu_job_msg;
+
+/* Actuator command computed by core 1 */
+typedef struct
+{
+    uint32 data[2];
+    float  u[4];                                      /* outputs of both controllers, published by core 0             */
+    float  u_alt[2];
+    uint8  tx;                                        /* index in qc_tx_id                                            */
+} ecu_act_msg;
+
+typedef SPSC_RING(ecu_job_msg) ecu_job_ring;
+typedef SPSC_RING(ecu_act_msg) ecu_act_ring;
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+#if defined(__TASKING__) || defined(__tricore__)
+static inline uint32 spsc_loadAcquire(volatile uint32 *p)
+{
+    uint32 v = *p;
+    __dsync();
+    return v;
+}
+
+static inline void spsc_storeRelease(volatile uint32 *p, uint32 v)
+{
+    __dsync();
+    *p = v;
+}
+#endif
+
+#endif /* ECU_RINGS_H */
@@ -0,0 +1,65 @@
+/**********************************************************************************************************************
+ * \file ecu_snapshot.h
+ * \brief Sequence-locked vectors: consistent snapshots between a writer ISR and lower priority readers
+ *
+ * The writer makes seq odd, updates the vector and its time stamp, and makes seq even again; it never waits. A reader
+ * copies the vector between two reads of seq and starts over if seq was odd or has changed, i.e. only when the writer
+ * ran in between, so a copy takes constant time unless it was preempted by the writer. Interrupts stay enabled on
+ * both sides. A reader must not preempt the writer on the same core (it would retry forever): readers run at a lower
+ * priority than the writer, or on the other core.
+ *
+ *     SEQLOCK_WRITE_BEGIN(&s);                        do {
+ *     s.v.y[k] = ...; s.stamp = now;                      seq = SEQLOCK_READ_BEGIN(&s);
+ *     SEQLOCK_WRITE_END(&s);                              copy = s.v; stamp = s.stamp;
+ *                                                     } while (SEQLOCK_READ_RETRY(&s, seq));
+ *********************************************************************************************************************/
+#ifndef ECU_SNAPSHOT_H
+#define ECU_SNAPSHOT_H
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#include "Ifx_types.h"
+#if defined(__TASKING__) || defined(__tricore__)
+#include "IfxCpu_Intrinsics.h"
+#endif
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#if defined(__TASKING__) || defined(__tricore__)
+#define SEQLOCK_WRITE_FENCE()     __dsync()
+#define SEQLOCK_READ_FENCE()      __dsync()
+#else
+#define SEQLOCK_WRITE_FENCE()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define SEQLOCK_READ_FENCE()      __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+/* A vector of type, with its sequence counter and the STM time of its last update */
+#define SEQLOCK(type)                                                                       \
+    struct                                                                                  \
+    {                                                                                       \
+        volatile uint32 seq;                          /* odd while the writer updates v */  \
+        volatile uint64 stamp;                                                              \
+        volatile type v;                                                                    \
+    }
+
+#define SEQLOCK_WRITE_BEGIN(s)    do { (s)->seq = (s)->seq + 1; SEQLOCK_WRITE_FENCE(); } while (0)
+#define SEQLOCK_WRITE_END(s)      do { SEQLOCK_WRITE_FENCE(); (s)->seq = (s)->seq + 1; } while (0)
+/* Sequence at the start of a copy; odd makes SEQLOCK_READ_RETRY fail */
+#define SEQLOCK_READ_BEGIN(s)     seqlock_readBegin(&(s)->seq)
+/* Non-zero if the copy made since SEQLOCK_READ_BEGIN returned seq may be torn */
+#define SEQLOCK_READ_RETRY(s, seq) (SEQLOCK_READ_FENCE(), ((seq) & 1u) || (s)->seq != (seq))
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+static inline uint32 seqlock_readBegin(volatile uint32 *seq)
+{
+    uint32 s = *seq;
+
+    SEQLOCK_READ_FENCE();
+    return s;
+}
+
+#endif /* ECU_SNAPSHOT_H */
@@ -0,0 +1,45 @@
+/**********************************************************************************************************************
+ * \file CanBasicDemo-v1.h
+ * \brief Host version of the CAN demo header of the TC397 project: driver handles, interrupt priorities and the
+ *        functions of ecu_code.c
+ *********************************************************************************************************************/
+#ifndef CANBASICDEMO_V1_H
+#define CANBASICDEMO_V1_H
+
+#include "ifx_host.h"
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define ISR_PRIORITY_CAN0_RX  10                      /* CAN0 node 0 RX FIFO 0 new message, preempts the TOM ISR      */
+#define ISR_PRIORITY_CAN1_TX  11                      /* CAN1 node 0 transmission completed                           */
+#define ISR_PRIORITY_CAN1_BO  12                      /* CAN1 node 0 bus off                                          */
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Data Structures---------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef struct
+{
+    struct
+    {
+        IfxCan_Can      can[2];                       /* CAN module handles: CAN0 (receive), CAN1 (transmit)           */
+        IfxCan_Can_Node canNode[2];                   /* node 0 of each module                                        */
+    } drivers;
+} App_CanBasic;
+
+/*********************************************************************************************************************/
+/*------------------------------------------------Function Prototypes------------------------------------------------*/
+/*********************************************************************************************************************/
+void CanBasicDemo_init(void);
+void CanBasicDemo_run_qc(void);
+void CanBasicDemo_run_qc_alt(void);
+void CanBasicDemo_tx(IfxCan_Message txMsg, uint32 *txDataMsg, uint32 msg_tx_id, uint8 msg_tx_buf);
+void initGtmTom(void);
+void interruptGtmTom(void);
+void BO_ISR(void);
+int timeline_verify(void);
+void rx_dispatch_stats(int entry, uint32 *frames, uint32 *lost);
+void tx_queue_stats(uint8 buf, uint32 *sent, uint32 *replaced, float *wait_mean_us, float *wait_max_us);
+void core1_control(void);                            /* ECU_PARTITIONED builds only                                  */
+
+#endif /* CANBASICDEMO_V1_H */
@@ -0,0 +1,5 @@
+/* Host stand-in for the iLLD header of the same name, see ifx_host.h */
+#ifndef HOST_IFXPORT_H
+#define HOST_IFXPORT_H
+#include "ifx_host.h"
+#endif
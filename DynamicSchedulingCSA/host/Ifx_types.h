@@ -0,0 +1,5 @@
+/* Host stand-in for the iLLD header of the same name, see ifx_host.h */
+#ifndef HOST_IFX_TYPES_H
+#define HOST_IFX_TYPES_H
+#include "ifx_host.h"
+#endif
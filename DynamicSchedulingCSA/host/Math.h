@@ -0,0 +1,2 @@
+/* ecu_code.c includes <Math.h>, which only resolves on a case-insensitive file system */
+#include <math.h>
@@ -0,0 +1,176 @@
+/**********************************************************************************************************************
+ * \file ecu_host.c
+ * \brief Runs ecu_code.c on Linux against the host HAL (ifx_host.c)
+ *
+ *     ecu_host [-ms 2000] [-sensor-ms 10] [-amp 1] [-rx-latency-us 0] [-vcan vcan0] [-q]
+ *     ecu_host -check-timeline [-q]
+ *
+ * Does what Cpu0_Main does on the TC397 (CanBasicDemo_init, initGtmTom), adds a sensor node that sends the twelve
+ * quadcopter outputs on qc_rx_id every -sensor-ms, and lets the virtual clock run for -ms. The sensors report the
+ * operating point, with a sine of amplitude -amp on the altitude. The TOM ISR, the CAN RX/TX ISRs, updateutil and
+ * the controllers run unmodified; at the end the host time per ISR and the bus statistics are printed on stderr.
+ * -q sends the firmware's printf output to /dev/null (profile with perf record ./ecu_host -q). -vcan bridges the
+ * bus to a SocketCAN interface and paces the virtual clock with the wall clock. Built with -DECU_PARTITIONED=1, the
+ * controllers run in core1_control, the loop of core 1, which the HAL runs after every event. -check-timeline runs timeline_verify,
+ * which switches between every pair of period sets of h_list and checks that no job is dropped or duplicated; the
+ * exit status is 1 if a switch fails. -rx-latency-us delays the RX interrupt after a new message (HostHal_setRxLatency),
+ * so that frames pile up in RX FIFO 0; the per-ID frame and loss counters of the firmware are printed at the end
+ * (losses assume the sensors send every QC_RX_PERIOD_MS, the default -sensor-ms), and the waits of the CAN1 TX queue.
+ *********************************************************************************************************************/
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "CanBasicDemo-v1.h"
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Global variables--------------------------------------------------*/
+/*********************************************************************************************************************/
+extern const uint32 qc_rx_id[6];
+extern const uint32 qc_tx_id[6];
+extern const uint8 qc_tx_buf[6];
+extern const unsigned int QC_X_OFFSET[12];
+extern const unsigned int QC_X_FACTOR[12];
+extern volatile uint32 rx_fifo_overflows;
+extern volatile uint32 rx_batch_max;
+
+static double g_sensorAmp = 1.0;
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+/* Encodes two of the twelve outputs into the frame of qc_rx_id[pair], the way ProcessFifo0Interrupt decodes them */
+static void sensorUpdate(HostHal_Frame *frame, uint64 nowNs)
+{
+    uint32 y[2];
+    int pair = 0, k;
+
+    while (pair < 5 && qc_rx_id[pair] != frame->id)
+    {
+        pair++;
+    }
+    for (k = 0; k < 2; k++)
+    {
+        int s = 2 * pair + k;
+        double x = (s == 0) ? g_sensorAmp * sin(2 * M_PI * 0.5 * nowNs * 1e-9) : 0;
+        y[k] = (uint32)((x + QC_X_OFFSET[s]) * QC_X_FACTOR[s]);
+    }
+    memcpy(frame->data, y, 8);
+}
+
+static double hostSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    double ms = 2000, sensorMs = 10, rxLatencyUs = 0, t0, t1;
+    const char *vcan = NULL;
+    boolean quiet = FALSE, checkTimeline = FALSE;
+    int a, k;
+
+    for (a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-q") == 0)
+        {
+            quiet = TRUE;
+        }
+        else if (strcmp(argv[a], "-check-timeline") == 0)
+        {
+            checkTimeline = TRUE;
+        }
+        else if (a + 1 >= argc)
+        {
+            break;
+        }
+        else if (strcmp(argv[a], "-ms") == 0)
+        {
+            ms = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-sensor-ms") == 0)
+        {
+            sensorMs = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-rx-latency-us") == 0)
+        {
+            rxLatencyUs = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-amp") == 0)
+        {
+            g_sensorAmp = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-vcan") == 0)
+        {
+            vcan = argv[++a];
+        }
+    }
+    if (quiet && freopen("/dev/null", "w", stdout) == NULL)
+    {
+        perror("/dev/null");
+    }
+    if (checkTimeline)
+    {
+        int bad = timeline_verify();
+
+        fprintf(stderr, "timeline: %s\n", bad ? "FAILED" : "ok");
+        return bad ? 1 : 0;
+    }
+
+    HostHal_setRxLatency((uint64)(rxLatencyUs * 1e3));
+    CanBasicDemo_init();
+    initGtmTom();
+#if defined(ECU_PARTITIONED) && ECU_PARTITIONED
+    HostHal_setCore1(core1_control);
+#endif
+    for (k = 0; k < 6; k++)
+    {
+        HostHal_Frame frame = { qc_rx_id[k], 8, {0} };
+        sensorUpdate(&frame, 0);
+        HostHal_canAddPeriodic(&frame, (uint64)(sensorMs * 1e6), (uint64)(k * 200000), sensorUpdate);
+    }
+    if (vcan != NULL)
+    {
+        if (HostHal_canAttachSocket(vcan) != 0)
+        {
+            return 1;
+        }
+        HostHal_setRealTime(TRUE);
+    }
+
+    t0 = hostSeconds();
+    HostHal_runUntil((uint64)(ms * 1e6));
+    t1 = hostSeconds();
+    fflush(stdout);
+    HostHal_report(stderr);
+    {
+        uint32 frames, lost;
+        rx_dispatch_stats(0, &frames, &lost);
+        fprintf(stderr, "rx FIFO 0: %u overflow interrupts, up to %u messages per interrupt, %u frames of other IDs\n",
+                (unsigned)rx_fifo_overflows, (unsigned)rx_batch_max, (unsigned)frames);
+        for (k = 0; k < 6; k++)
+        {
+            rx_dispatch_stats(k + 1, &frames, &lost);
+            fprintf(stderr, "  id 0x%03x: %u frames, %u lost\n", (unsigned)qc_rx_id[k], (unsigned)frames, (unsigned)lost);
+        }
+        fprintf(stderr, "tx queue (enqueue to transmit request):\n");
+        for (k = 0; k < 3; k++)
+        {
+            float mean, max;
+            tx_queue_stats(qc_tx_buf[k], &frames, &lost, &mean, &max);
+            fprintf(stderr, "  id 0x%03x: %u sent, %u replaced, wait mean %.1f us, max %.1f us\n",
+                    (unsigned)qc_tx_id[k], (unsigned)frames, (unsigned)lost, mean, max);
+        }
+    }
+    fprintf(stderr, "host time %.3f s for %.3f s of ECU time (%.0fx real time)\n", t1 - t0, ms * 1e-3,
+            ms * 1e-3 / (t1 - t0));
+    return 0;
+}
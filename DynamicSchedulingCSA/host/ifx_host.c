@@ -0,0 +1,1183 @@
+/**********************************************************************************************************************
+ * \file ifx_host.c
+ * \brief Simulation behind ifx_host.h: interrupt controller, TOM timers and CAN bus in virtual time
+ *********************************************************************************************************************/
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "ifx_host.h"
+#ifdef __linux__
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#endif
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define HOST_NEVER         UINT64_MAX
+#define HOST_EXT_QUEUE     256                        /* frames of external nodes waiting for the bus                  */
+#define HOST_RX_BUFFERS    4                          /* dedicated RX buffers per node                                */
+#define HOST_DEFAULT_BAUD  500000
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Global variables--------------------------------------------------*/
+/*********************************************************************************************************************/
+Ifx_CAN MODULE_CAN0;
+Ifx_CAN MODULE_CAN1;
+Ifx_GTM MODULE_GTM;
+Ifx_P   MODULE_P20;
+Ifx_P   MODULE_P23;
+Ifx_STM MODULE_STM0;
+Ifx_SRC_SRCR SRC_GPSR00;
+Ifx_SRC_SRCR SRC_GPSR01;
+
+const IfxCan_Rxd_In  IfxCan_RXD00B_P20_7_IN = {7};
+const IfxCan_Txd_Out IfxCan_TXD00_P20_8_OUT = {8};
+const IfxCan_Rxd_In  IfxCan_RXD10C_P23_0_IN = {0};
+const IfxCan_Txd_Out IfxCan_TXD10_P23_1_OUT = {1};
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Data Structures---------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef struct
+{
+    IfxGtm_Tom_Timer *driver;
+    uint64 periodNs;
+    uint64 nextNs;
+    uint16 priority;
+    boolean running;
+} HostHal_Timer;
+
+typedef struct
+{
+    HostHal_Frame frame;
+    uint64 readyNs;
+    boolean pending;                                  /* like TXBRP: requested and not yet on the bus                 */
+} HostHal_TxBuffer;
+
+typedef struct
+{
+    Ifx_CAN_N *sfr;
+    IfxCan_FrameType type;
+    uint32 baudrate;
+    uint16 rxPriority;                                /* RX FIFO 0 new message                                        */
+    uint16 txPriority;                                /* transmission completed                                       */
+    HostHal_Frame fifo[HOST_RX_FIFO_MAX];
+    uint32 fifoSize;
+    uint32 fifoHead;
+    uint32 fifoCount;
+    IfxCan_RxFifoMode fifoMode;
+    IfxCan_Filter filters[8];
+    uint32 filterCount;
+    HostHal_Frame rxBuffers[HOST_RX_BUFFERS];
+    HostHal_TxBuffer tx[HOST_TX_BUFFERS];
+    uint64 txFrames;
+    uint64 rxFrames;
+    uint64 rxLost;                                    /* overwritten (overwrite mode) or refused (blocking mode)       */
+    uint64 rxIrqNs;                                   /* RX interrupt delayed by HostHal_setRxLatency, HOST_NEVER: none */
+    uint64 busyWaits;                                 /* sendMessage calls that found the buffer still pending         */
+    uint64 busyWaitNs;                                /* virtual time spent in those calls                            */
+} HostHal_Node;
+
+typedef struct
+{
+    HostHal_Frame frame;
+    uint64 periodNs;
+    uint64 nextNs;
+    void (*update)(HostHal_Frame *frame, uint64 nowNs);
+} HostHal_Source;
+
+typedef struct
+{
+    boolean active;
+    sint32 node;                                      /* sending node, -1 for an external frame                       */
+    sint32 slot;                                      /* TX buffer of the node                                        */
+    boolean fromSocket;
+    HostHal_Frame frame;
+    uint64 startNs;
+    uint64 endNs;
+} HostHal_Transfer;
+
+typedef struct
+{
+    HostHal_Frame frame;
+    uint64 readyNs;
+    boolean fromSocket;
+} HostHal_ExtFrame;
+
+/* Whole simulation state */
+static struct
+{
+    uint64 nowNs;
+    /* interrupt controller */
+    HostHal_IsrStats isrs[HOST_MAX_ISRS];
+    int isrCount;
+    uint8 pending[256];
+    boolean enabled;
+    uint16 currentPriority;
+    uint64 nestedNs;                                  /* host time of ISRs nested in the running one                  */
+    uint64 unhandled;
+    uint64 rxLatencyNs;                               /* from a new RX FIFO 0 message to its interrupt                */
+    /* timers */
+    HostHal_Timer timers[HOST_MAX_TIMERS];
+    int timerCount;
+    /* bus */
+    HostHal_Node nodes[HOST_MAX_NODES];
+    int nodeCount;
+    HostHal_ExtFrame ext[HOST_EXT_QUEUE];
+    uint32 extHead;
+    uint32 extCount;
+    uint64 extLost;
+    HostHal_Source sources[HOST_MAX_SOURCES];
+    int sourceCount;
+    HostHal_Transfer transfer;
+    uint64 busFreeNs;
+    uint64 busBusyNs;
+    uint64 busFrames;
+    /* SocketCAN bridge and pacing */
+    int socket;
+    boolean realTime;
+    uint64 wallStartNs;
+    uint64 virtStartNs;
+    /* core 1 */
+    void (*core1)(void);
+    uint64 core1Calls;
+    uint64 core1Ns;
+} hal = { .enabled = TRUE, .socket = -1 };
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+static uint64 HostHal_hostNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*---------------------------------------------Interrupt controller--------------------------------------------------*/
+void HostHal_registerIsr(uint16 priority, void (*isr)(void), const char *name)
+{
+    HostHal_IsrStats *s;
+
+    if (hal.isrCount >= HOST_MAX_ISRS)
+    {
+        fprintf(stderr, "host: too many ISRs, %s not registered\n", name);
+        return;
+    }
+    s = &hal.isrs[hal.isrCount++];
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->priority = priority;
+    s->isr = isr;
+}
+
+static HostHal_IsrStats *HostHal_findIsr(uint16 priority)
+{
+    int n;
+
+    for (n = 0; n < hal.isrCount; n++)
+    {
+        if (hal.isrs[n].priority == priority)
+        {
+            return &hal.isrs[n];
+        }
+    }
+    return NULL;
+}
+
+/* Runs pending ISRs above the current priority, highest first. The time recorded for an ISR excludes the ISRs
+ * nested in it. */
+static void HostHal_dispatch(void)
+{
+    int p;
+
+    while (hal.enabled)
+    {
+        HostHal_IsrStats *s;
+        uint16 saved = hal.currentPriority;
+        uint64 outerNested = hal.nestedNs, t0, dt, own;
+        int bucket = 0;
+
+        for (p = 255; p > hal.currentPriority && !hal.pending[p]; p--)
+        {}
+        if (p <= hal.currentPriority)
+        {
+            return;
+        }
+        hal.pending[p] = 0;
+        s = HostHal_findIsr((uint16)p);
+        if (s == NULL)
+        {
+            hal.unhandled++;
+            continue;
+        }
+        hal.currentPriority = (uint16)p;
+        hal.nestedNs = 0;
+        t0 = HostHal_hostNs();
+        s->isr();
+        dt = HostHal_hostNs() - t0;
+        own = dt > hal.nestedNs ? dt - hal.nestedNs : 0;
+        hal.nestedNs = outerNested + dt;
+        hal.currentPriority = saved;
+
+        s->count++;
+        s->totalNs += own;
+        if (own > s->maxNs)
+        {
+            s->maxNs = own;
+        }
+        while (bucket < 39 && (1ull << (bucket + 1)) <= own)
+        {
+            bucket++;
+        }
+        s->histogram[bucket]++;
+    }
+}
+
+void HostHal_raise(uint16 priority)
+{
+    hal.pending[priority & 0xFF] = 1;
+    HostHal_dispatch();
+}
+
+boolean IfxCpu_disableInterrupts(void)
+{
+    boolean enabled = hal.enabled;
+
+    hal.enabled = FALSE;
+    return enabled;
+}
+
+void IfxCpu_restoreInterrupts(boolean enabled)
+{
+    hal.enabled = enabled;
+    if (enabled)
+    {
+        HostHal_dispatch();
+    }
+}
+
+void IfxCpu_enableInterrupts(void)
+{
+    IfxCpu_restoreInterrupts(TRUE);
+}
+
+IfxCpu_ResourceCpu IfxCpu_getCoreIndex(void)
+{
+    return IfxCpu_ResourceCpu_0;
+}
+
+IfxSrc_Tos IfxCpu_Irq_getTos(IfxCpu_ResourceCpu coreId)
+{
+    return (IfxSrc_Tos)(coreId == IfxCpu_ResourceCpu_0 ? IfxSrc_Tos_cpu0 : IfxSrc_Tos_cpu1);
+}
+
+void IfxScuCcu_initConfig(IfxScuCcu_Config *cfg)
+{
+    cfg->fPll = 300000000;
+}
+
+boolean IfxScuCcu_init(const IfxScuCcu_Config *cfg)
+{
+    (void)cfg;
+    return FALSE;                                     /* iLLD returns TRUE on error */
+}
+
+void IfxSrc_init(volatile Ifx_SRC_SRCR *src, IfxSrc_Tos typOfService, Ifx_Priority priority)
+{
+    src->U = (priority & 0xFFu) | ((uint32)typOfService << 11);
+}
+
+void IfxSrc_enable(volatile Ifx_SRC_SRCR *src)
+{
+    src->U |= 1u << 10;
+}
+
+void IfxSrc_setRequest(volatile Ifx_SRC_SRCR *src)
+{
+    if (src->U & (1u << 10))
+    {
+        HostHal_raise((uint16)(src->U & 0xFFu));
+    }
+}
+
+/*-------------------------------------------------Port and STM------------------------------------------------------*/
+void IfxPort_setPinModeOutput(Ifx_P *port, uint8 pinIndex, IfxPort_OutputMode mode, IfxPort_OutputIdx index)
+{
+    (void)port; (void)pinIndex; (void)mode; (void)index;
+}
+
+void IfxPort_setPinState(Ifx_P *port, uint8 pinIndex, IfxPort_State action)
+{
+    if (action == IfxPort_State_high)
+    {
+        port->OUT |= 1u << pinIndex;
+    }
+    else if (action == IfxPort_State_low)
+    {
+        port->OUT &= ~(1u << pinIndex);
+    }
+    else if (action == IfxPort_State_toggled)
+    {
+        port->OUT ^= 1u << pinIndex;
+    }
+}
+
+void IfxPort_togglePin(Ifx_P *port, uint8 pinIndex)
+{
+    IfxPort_setPinState(port, pinIndex, IfxPort_State_toggled);
+}
+
+void IfxPort_setPinHigh(Ifx_P *port, uint8 pinIndex)
+{
+    IfxPort_setPinState(port, pinIndex, IfxPort_State_high);
+}
+
+void IfxPort_setPinLow(Ifx_P *port, uint8 pinIndex)
+{
+    IfxPort_setPinState(port, pinIndex, IfxPort_State_low);
+}
+
+Ifx_TickTime IfxStm_getTicksFromMilliseconds(Ifx_STM *stm, uint32 milliSeconds)
+{
+    (void)stm;
+    return (Ifx_TickTime)milliSeconds * (HOST_STM_FREQ / 1000);
+}
+
+Ifx_TickTime IfxStm_getTicksFromMicroseconds(Ifx_STM *stm, uint32 microSeconds)
+{
+    (void)stm;
+    return (Ifx_TickTime)microSeconds * (HOST_STM_FREQ / 1000000);
+}
+
+uint64 IfxStm_get(Ifx_STM *stm)
+{
+    (void)stm;
+    return hal.nowNs / (1000000000u / HOST_STM_FREQ);
+}
+
+float32 IfxStm_getFrequency(Ifx_STM *stm)
+{
+    (void)stm;
+    return (float32)HOST_STM_FREQ;
+}
+
+/* Busy wait of the Bsp: lets the bus and the timers run for the time */
+void waitTime(Ifx_TickTime timeout)
+{
+    HostHal_runUntil(hal.nowNs + (uint64)timeout * (1000000000u / HOST_STM_FREQ));
+}
+
+/*------------------------------------------------------GTM TOM------------------------------------------------------*/
+void IfxGtm_enable(Ifx_GTM *gtm)
+{
+    (void)gtm;
+}
+
+void IfxGtm_Cmu_enableClocks(Ifx_GTM *gtm, uint32 clkMask)
+{
+    gtm->CLK_EN |= clkMask;
+}
+
+void IfxGtm_Tom_Timer_initConfig(IfxGtm_Tom_Timer_Config *config, Ifx_GTM *gtm)
+{
+    (void)gtm;
+    memset(config, 0, sizeof(*config));
+    config->base.frequency = 1000;
+    config->base.isrProvider = IfxSrc_Tos_cpu0;
+}
+
+boolean IfxGtm_Tom_Timer_init(IfxGtm_Tom_Timer *driver, const IfxGtm_Tom_Timer_Config *config)
+{
+    driver->frequency = config->base.frequency;
+    driver->isrPriority = config->base.isrPriority;
+    driver->hostTimer = -1;
+    driver->acknowledged = 0;
+    return TRUE;
+}
+
+void IfxGtm_Tom_Timer_run(IfxGtm_Tom_Timer *driver)
+{
+    HostHal_Timer *t;
+
+    if (driver->hostTimer < 0)
+    {
+        if (hal.timerCount >= HOST_MAX_TIMERS)
+        {
+            fprintf(stderr, "host: too many TOM timers\n");
+            return;
+        }
+        driver->hostTimer = hal.timerCount++;
+    }
+    t = &hal.timers[driver->hostTimer];
+    t->driver = driver;
+    t->periodNs = (uint64)(1e9 / driver->frequency + 0.5);
+    t->nextNs = hal.nowNs + t->periodNs;
+    t->priority = driver->isrPriority;
+    t->running = TRUE;
+}
+
+void IfxGtm_Tom_Timer_stop(IfxGtm_Tom_Timer *driver)
+{
+    if (driver->hostTimer >= 0)
+    {
+        hal.timers[driver->hostTimer].running = FALSE;
+    }
+}
+
+void IfxGtm_Tom_Timer_acknowledgeTimerIrq(IfxGtm_Tom_Timer *driver)
+{
+    driver->acknowledged++;
+}
+
+/*--------------------------------------------------------CAN--------------------------------------------------------*/
+static HostHal_Node *HostHal_nodeOf(Ifx_CAN_N *sfr)
+{
+    int n;
+
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        if (hal.nodes[n].sfr == sfr)
+        {
+            return &hal.nodes[n];
+        }
+    }
+    return NULL;
+}
+
+void IfxCan_Can_initModuleConfig(IfxCan_Can_Config *config, Ifx_CAN *can)
+{
+    config->can = can;
+}
+
+IfxCan_Status IfxCan_Can_initModule(IfxCan_Can *can, IfxCan_Can_Config *config)
+{
+    can->can = config->can;
+    return IfxCan_Status_ok;
+}
+
+void IfxCan_Can_initNodeConfig(IfxCan_Can_NodeConfig *config, IfxCan_Can *can)
+{
+    memset(config, 0, sizeof(*config));
+    config->module = can;
+    config->baudRate.baudrate = HOST_DEFAULT_BAUD;
+    config->frame.type = IfxCan_FrameType_receive;
+    config->rxConfig.rxMode = IfxCan_RxMode_dedicatedBuffers;
+    config->rxConfig.rxFifo0OperatingMode = IfxCan_RxFifoMode_blocking;
+}
+
+IfxCan_Status IfxCan_Can_initNode(IfxCan_Can_Node *node, const IfxCan_Can_NodeConfig *config)
+{
+    HostHal_Node *hn;
+
+    node->can = config->module->can;
+    node->node = IfxCan_getNodePointer(node->can, config->nodeId);
+    node->nodeId = config->nodeId;
+    node->frameType = config->frame.type;
+    hn = HostHal_nodeOf(node->node);
+    if (hn == NULL)
+    {
+        if (hal.nodeCount >= HOST_MAX_NODES)
+        {
+            return IfxCan_Status_wrongParam;
+        }
+        hn = &hal.nodes[hal.nodeCount++];
+    }
+    memset(hn, 0, sizeof(*hn));
+    hn->sfr = node->node;
+    hn->type = config->frame.type;
+    hn->baudrate = config->baudRate.baudrate ? config->baudRate.baudrate : HOST_DEFAULT_BAUD;
+    hn->rxPriority = config->interruptConfig.rxf0n.priority;
+    hn->txPriority = config->interruptConfig.traco.priority;
+    hn->fifoSize = config->rxConfig.rxFifo0Size < HOST_RX_FIFO_MAX ? config->rxConfig.rxFifo0Size : HOST_RX_FIFO_MAX;
+    hn->fifoMode = config->rxConfig.rxFifo0OperatingMode;
+    hn->rxIrqNs = HOST_NEVER;
+    memset(node->node, 0, sizeof(*node->node));
+    node->hostNode = (sint32)(hn - hal.nodes);
+    return IfxCan_Status_ok;
+}
+
+void IfxCan_Can_initMessage(IfxCan_Message *message)
+{
+    memset(message, 0, sizeof(*message));
+    message->messageIdLength = IfxCan_MessageIdLength_standard;
+    message->dataLengthCode = IfxCan_DataLengthCode_8;
+}
+
+void IfxCan_Can_setStandardFilter(IfxCan_Can_Node *node, IfxCan_Filter *filter)
+{
+    HostHal_Node *hn = &hal.nodes[node->hostNode];
+
+    if (hn->filterCount < sizeof(hn->filters) / sizeof(hn->filters[0]))
+    {
+        hn->filters[hn->filterCount++] = *filter;
+    }
+}
+
+Ifx_CAN_N *IfxCan_getNodePointer(Ifx_CAN *can, IfxCan_NodeId nodeId)
+{
+    return &can->N[nodeId];
+}
+
+static void HostHal_setFlag(Ifx_CAN_N_IR *r, IfxCan_Interrupt flag, uint32 value)
+{
+    switch (flag)
+    {
+        case IfxCan_Interrupt_rxFifo0NewMessage: r->B.RF0N = value; break;
+        case IfxCan_Interrupt_rxFifo0Full: r->B.RF0F = value; break;
+        case IfxCan_Interrupt_rxFifo0MessageLost: r->B.RF0L = value; break;
+        case IfxCan_Interrupt_transmissionCompleted: r->B.TC = value; break;
+        case IfxCan_Interrupt_errorWarningStatus: r->B.EW = value; break;
+        case IfxCan_Interrupt_busOffStatus: r->B.BO = value; break;
+    }
+}
+
+void IfxCan_Node_clearInterruptFlag(Ifx_CAN_N *node, IfxCan_Interrupt interruptFlag)
+{
+    HostHal_setFlag(&node->IR, interruptFlag, 0);
+}
+
+void IfxCan_Node_enableInterrupt(Ifx_CAN_N *node, IfxCan_Interrupt interrupt)
+{
+    HostHal_setFlag(&node->IE, interrupt, 1);
+}
+
+void IfxCan_Node_enableConfigurationChange(Ifx_CAN_N *node)
+{
+    node->CCCR.B.INIT = 1;
+    node->CCCR.B.CCE = 1;
+}
+
+void IfxCan_Node_disableConfigurationChange(Ifx_CAN_N *node)
+{
+    node->CCCR.B.CCE = 0;
+    node->CCCR.B.INIT = 0;
+}
+
+/* Like RXF0S.F0FL: messages waiting in RX FIFO 0 */
+uint8 IfxCan_Node_getRxFifo0FillLevel(Ifx_CAN_N *node)
+{
+    HostHal_Node *hn = HostHal_nodeOf(node);
+
+    return hn != NULL ? (uint8)hn->fifoCount : 0;
+}
+
+/* Like TXBRP: the transmission requested in txBufferId has not completed yet */
+boolean IfxCan_Node_isTxBufferRequestPending(Ifx_CAN_N *node, IfxCan_TxBufferId txBufferId)
+{
+    HostHal_Node *hn = HostHal_nodeOf(node);
+
+    return hn != NULL && (uint32)txBufferId < HOST_TX_BUFFERS && hn->tx[txBufferId].pending;
+}
+
+/* The simulated bus never produces errors, so neither warning nor bus off is ever set */
+boolean IfxCan_Node_getBusOffStatus(Ifx_CAN_N *node)
+{
+    return node->PSR.B.BO;
+}
+
+boolean IfxCan_Node_getWarningStatus(Ifx_CAN_N *node)
+{
+    return node->PSR.B.EW;
+}
+
+/* Nominal length of a standard data frame in bits, without stuff bits */
+static uint32 HostHal_frameBits(const HostHal_Frame *frame)
+{
+    return 47 + 8u * frame->dlc;
+}
+
+static uint32 HostHal_dlcBytes(IfxCan_DataLengthCode dlc)
+{
+    return dlc > IfxCan_DataLengthCode_8 ? 8 : (uint32)dlc;
+}
+
+static uint32 HostHal_bitNs(void)
+{
+    uint32 baud = hal.nodeCount > 0 ? hal.nodes[0].baudrate : HOST_DEFAULT_BAUD;
+
+    return 1000000000u / baud;
+}
+
+/* Earliest time something happens on the bus: the end of the frame in flight, or the next arbitration */
+static uint64 HostHal_nextBusEvent(void)
+{
+    uint64 ready = HOST_NEVER;
+    uint32 k;
+    int n;
+
+    if (hal.transfer.active)
+    {
+        return hal.transfer.endNs;
+    }
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        for (k = 0; k < HOST_TX_BUFFERS; k++)
+        {
+            if (hal.nodes[n].tx[k].pending && hal.nodes[n].tx[k].readyNs < ready)
+            {
+                ready = hal.nodes[n].tx[k].readyNs;
+            }
+        }
+    }
+    for (k = 0; k < hal.extCount; k++)
+    {
+        const HostHal_ExtFrame *e = &hal.ext[(hal.extHead + k) % HOST_EXT_QUEUE];
+        if (e->readyNs < ready)
+        {
+            ready = e->readyNs;
+        }
+    }
+    if (ready == HOST_NEVER)
+    {
+        return HOST_NEVER;
+    }
+    return ready > hal.busFreeNs ? ready : hal.busFreeNs;
+}
+
+/* Arbitration at time t: the lowest ID among the frames ready by then wins the bus */
+static void HostHal_arbitrate(uint64 t)
+{
+    HostHal_Transfer best;
+    uint32 k;
+    int n;
+
+    memset(&best, 0, sizeof(best));
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        for (k = 0; k < HOST_TX_BUFFERS; k++)
+        {
+            const HostHal_TxBuffer *b = &hal.nodes[n].tx[k];
+            if (b->pending && b->readyNs <= t && (!best.active || b->frame.id < best.frame.id))
+            {
+                best.active = TRUE;
+                best.node = n;
+                best.slot = (sint32)k;
+                best.frame = b->frame;
+                best.fromSocket = FALSE;
+            }
+        }
+    }
+    for (k = 0; k < hal.extCount; k++)
+    {
+        const HostHal_ExtFrame *e = &hal.ext[(hal.extHead + k) % HOST_EXT_QUEUE];
+        if (e->readyNs <= t && (!best.active || e->frame.id < best.frame.id))
+        {
+            best.active = TRUE;
+            best.node = -1;
+            best.slot = (sint32)k;
+            best.frame = e->frame;
+            best.fromSocket = e->fromSocket;
+        }
+    }
+    if (!best.active)
+    {
+        return;
+    }
+    if (best.node < 0)
+    {
+        /* take the frame out of the queue, keeping the order of the others */
+        for (k = (uint32)best.slot; k + 1 < hal.extCount; k++)
+        {
+            hal.ext[(hal.extHead + k) % HOST_EXT_QUEUE] = hal.ext[(hal.extHead + k + 1) % HOST_EXT_QUEUE];
+        }
+        hal.extCount--;
+    }
+    best.startNs = t;
+    best.endNs = t + (uint64)HostHal_frameBits(&best.frame) * HostHal_bitNs();
+    hal.transfer = best;
+}
+
+static void HostHal_deliver(HostHal_Node *hn, const HostHal_Frame *frame)
+{
+    uint32 f;
+
+    for (f = 0; f < hn->filterCount; f++)
+    {
+        const IfxCan_Filter *flt = &hn->filters[f];
+        if (flt->elementConfiguration == IfxCan_FilterElementConfiguration_storeInRxBuffer && flt->id1 == frame->id)
+        {
+            hn->rxBuffers[flt->rxBufferOffset % HOST_RX_BUFFERS] = *frame;
+            hn->rxFrames++;
+            return;
+        }
+    }
+    if (hn->fifoSize == 0)
+    {
+        return;
+    }
+    if (hn->fifoCount == hn->fifoSize)
+    {
+        hn->rxLost++;
+        hn->sfr->IR.B.RF0L = 1;
+        if (hn->fifoMode == IfxCan_RxFifoMode_blocking)
+        {
+            return;
+        }
+        hn->fifoHead = (hn->fifoHead + 1) % hn->fifoSize;
+        hn->fifoCount--;
+    }
+    hn->fifo[(hn->fifoHead + hn->fifoCount) % hn->fifoSize] = *frame;
+    hn->fifoCount++;
+    hn->rxFrames++;
+    hn->sfr->IR.B.RF0N = 1;
+    if (hn->fifoCount == hn->fifoSize)
+    {
+        hn->sfr->IR.B.RF0F = 1;
+    }
+    if (hn->sfr->IE.B.RF0N)
+    {
+        if (hal.rxLatencyNs == 0)
+        {
+            HostHal_raise(hn->rxPriority);
+        }
+        else if (hn->rxIrqNs == HOST_NEVER)
+        {
+            hn->rxIrqNs = hal.nowNs + hal.rxLatencyNs;
+        }
+    }
+}
+
+static void HostHal_inject(const HostHal_Frame *frame, boolean fromSocket)
+{
+    HostHal_ExtFrame *e;
+
+    if (hal.extCount == HOST_EXT_QUEUE)
+    {
+        hal.extLost++;
+        return;
+    }
+    e = &hal.ext[(hal.extHead + hal.extCount) % HOST_EXT_QUEUE];
+    e->frame = *frame;
+    e->readyNs = hal.nowNs;
+    e->fromSocket = fromSocket;
+    hal.extCount++;
+}
+
+#ifdef __linux__
+static void HostHal_socketWrite(const HostHal_Frame *frame)
+{
+    struct can_frame cf;
+
+    memset(&cf, 0, sizeof(cf));
+    cf.can_id = frame->id;
+    cf.can_dlc = frame->dlc;
+    memcpy(cf.data, frame->data, 8);
+    if (write(hal.socket, &cf, sizeof(cf)) != sizeof(cf) && errno != EAGAIN && errno != ENOBUFS)
+    {
+        perror("host: CAN socket write");
+    }
+}
+
+static void HostHal_socketPoll(void)
+{
+    struct can_frame cf;
+
+    while (read(hal.socket, &cf, sizeof(cf)) == sizeof(cf))
+    {
+        HostHal_Frame frame;
+        if (cf.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))
+        {
+            continue;
+        }
+        frame.id = cf.can_id & CAN_SFF_MASK;
+        frame.dlc = cf.can_dlc > 8 ? 8 : cf.can_dlc;
+        memcpy(frame.data, cf.data, 8);
+        HostHal_inject(&frame, TRUE);
+    }
+}
+#endif
+
+/* End of the frame in flight: TX complete at the sender, the frame in every other node that receives */
+static void HostHal_complete(void)
+{
+    HostHal_Transfer t = hal.transfer;
+    int n;
+
+    hal.transfer.active = FALSE;
+    hal.busFreeNs = t.endNs;
+    hal.busBusyNs += t.endNs - t.startNs;
+    hal.busFrames++;
+#ifdef __linux__
+    if (hal.socket >= 0 && !t.fromSocket)
+    {
+        HostHal_socketWrite(&t.frame);
+    }
+#endif
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        if (n != t.node && hal.nodes[n].type != IfxCan_FrameType_transmit)
+        {
+            HostHal_deliver(&hal.nodes[n], &t.frame);
+        }
+    }
+    if (t.node >= 0)
+    {
+        HostHal_Node *hn = &hal.nodes[t.node];
+        hn->tx[t.slot].pending = FALSE;
+        hn->txFrames++;
+        hn->sfr->IR.B.TC = 1;
+        if (hn->sfr->IE.B.TC)
+        {
+            HostHal_raise(hn->txPriority);
+        }
+    }
+}
+
+/* Handles the earliest event due by limit. Returns FALSE if there is none. */
+static boolean HostHal_step(uint64 limit)
+{
+    uint64 tBus = HostHal_nextBusEvent(), t = tBus;
+    int n;
+
+#ifdef __linux__
+    if (hal.socket >= 0)
+    {
+        HostHal_socketPoll();
+        t = tBus = HostHal_nextBusEvent();
+    }
+#endif
+    for (n = 0; n < hal.timerCount; n++)
+    {
+        if (hal.timers[n].running && hal.timers[n].nextNs < t)
+        {
+            t = hal.timers[n].nextNs;
+        }
+    }
+    for (n = 0; n < hal.sourceCount; n++)
+    {
+        if (hal.sources[n].nextNs < t)
+        {
+            t = hal.sources[n].nextNs;
+        }
+    }
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        if (hal.nodes[n].rxIrqNs < t)
+        {
+            t = hal.nodes[n].rxIrqNs;
+        }
+    }
+    if (t == HOST_NEVER || t > limit)
+    {
+        return FALSE;
+    }
+    if (hal.realTime)
+    {
+        uint64 wall = hal.wallStartNs + (t - hal.virtStartNs), nowWall = HostHal_hostNs();
+        if (wall > nowWall)
+        {
+#ifdef __linux__
+            if (hal.socket >= 0)
+            {
+                struct pollfd pfd = { hal.socket, POLLIN, 0 };
+                if (poll(&pfd, 1, (int)((wall - nowWall) / 1000000)) > 0)
+                {
+                    /* a frame arrived before the event: take it in at the current time and start over */
+                    hal.nowNs = hal.virtStartNs + (HostHal_hostNs() - hal.wallStartNs);
+                    return TRUE;
+                }
+                nowWall = HostHal_hostNs();
+            }
+#endif
+            if (wall > nowWall)
+            {
+                struct timespec ts = { (time_t)((wall - nowWall) / 1000000000u), (long)((wall - nowWall) % 1000000000u) };
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
+    if (t > hal.nowNs)
+    {
+        hal.nowNs = t;
+    }
+    for (n = 0; n < hal.sourceCount; n++)
+    {
+        HostHal_Source *s = &hal.sources[n];
+        if (s->nextNs == t)
+        {
+            if (s->update)
+            {
+                s->update(&s->frame, t);
+            }
+            HostHal_inject(&s->frame, FALSE);
+            s->nextNs += s->periodNs;
+        }
+    }
+    if (tBus == t)
+    {
+        if (hal.transfer.active)
+        {
+            HostHal_complete();
+        }
+        else
+        {
+            HostHal_arbitrate(t);
+        }
+    }
+    for (n = 0; n < hal.timerCount; n++)
+    {
+        HostHal_Timer *tm = &hal.timers[n];
+        if (tm->running && tm->nextNs == t)
+        {
+            tm->nextNs += tm->periodNs;
+            HostHal_raise(tm->priority);
+        }
+    }
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        HostHal_Node *hn = &hal.nodes[n];
+        if (hn->rxIrqNs == t)
+        {
+            hn->rxIrqNs = HOST_NEVER;
+            if (hn->sfr->IR.B.RF0N && hn->sfr->IE.B.RF0N)
+            {
+                HostHal_raise(hn->rxPriority);
+            }
+        }
+    }
+    return TRUE;
+}
+
+IfxCan_Status IfxCan_Can_sendMessage(IfxCan_Can_Node *node, IfxCan_Message *message, uint32 *data)
+{
+    HostHal_Node *hn;
+    HostHal_TxBuffer *b;
+
+    if (node->hostNode < 0 || message->bufferNumber >= HOST_TX_BUFFERS)
+    {
+        return IfxCan_Status_wrongParam;
+    }
+    hn = &hal.nodes[node->hostNode];
+    b = &hn->tx[message->bufferNumber];
+    if (b->pending)
+    {
+        /* The caller spins on notSentBusy; let the bus move on meanwhile so the buffer frees up */
+        uint64 t0 = hal.nowNs;
+        hn->busyWaits++;
+        HostHal_step(HOST_NEVER);
+        hn->busyWaitNs += hal.nowNs - t0;
+        return IfxCan_Status_notSentBusy;
+    }
+    b->frame.id = message->messageId;
+    b->frame.dlc = (uint8)HostHal_dlcBytes(message->dataLengthCode);
+    memset(b->frame.data, 0, 8);
+    memcpy(b->frame.data, data, b->frame.dlc);
+    b->readyNs = hal.nowNs;
+    b->pending = TRUE;
+    return IfxCan_Status_ok;
+}
+
+IfxCan_Status IfxCan_Can_readMessage(IfxCan_Can_Node *node, IfxCan_Message *message, uint32 *data)
+{
+    HostHal_Node *hn;
+    const HostHal_Frame *frame;
+
+    if (node->hostNode < 0)
+    {
+        return IfxCan_Status_notInitialised;
+    }
+    hn = &hal.nodes[node->hostNode];
+    if (message->readFromRxFifo0)
+    {
+        if (hn->fifoCount == 0)
+        {
+            return IfxCan_Status_receiveEmpty;
+        }
+        frame = &hn->fifo[hn->fifoHead];
+        hn->fifoHead = (hn->fifoHead + 1) % hn->fifoSize;
+        hn->fifoCount--;
+    }
+    else
+    {
+        frame = &hn->rxBuffers[message->bufferNumber % HOST_RX_BUFFERS];
+    }
+    message->messageId = frame->id;
+    message->dataLengthCode = (IfxCan_DataLengthCode)frame->dlc;
+    memcpy(data, frame->data, 8);
+    return IfxCan_Status_ok;
+}
+
+/*-------------------------------------------------------Host API----------------------------------------------------*/
+uint64 HostHal_now(void)
+{
+    return hal.nowNs;
+}
+
+/* Advances virtual time to ns, handling every timer, source and bus event on the way */
+void HostHal_runUntil(uint64 ns)
+{
+    if (hal.realTime && hal.wallStartNs == 0)
+    {
+        hal.wallStartNs = HostHal_hostNs();
+        hal.virtStartNs = hal.nowNs;
+    }
+    while (HostHal_step(ns))
+    {
+        if (hal.core1 != NULL)
+        {
+            uint64 t0 = HostHal_hostNs();
+            hal.core1();
+            hal.core1Ns += HostHal_hostNs() - t0;
+            hal.core1Calls++;
+        }
+    }
+    if (ns > hal.nowNs)
+    {
+        hal.nowNs = ns;
+    }
+}
+
+/* Queues a frame of an external node (sensor, other ECU) for the bus at the current time */
+void HostHal_canInject(const HostHal_Frame *frame)
+{
+    HostHal_inject(frame, FALSE);
+}
+
+/* An external node sending frame every periodNs from offsetNs on; update, if given, refreshes it before each send */
+int HostHal_canAddPeriodic(const HostHal_Frame *frame, uint64 periodNs, uint64 offsetNs,
+                           void (*update)(HostHal_Frame *frame, uint64 nowNs))
+{
+    HostHal_Source *s;
+
+    if (hal.sourceCount >= HOST_MAX_SOURCES || periodNs == 0)
+    {
+        return -1;
+    }
+    s = &hal.sources[hal.sourceCount];
+    s->frame = *frame;
+    s->periodNs = periodNs;
+    s->nextNs = hal.nowNs + offsetNs;
+    s->update = update;
+    return hal.sourceCount++;
+}
+
+/* Bridges the simulated bus to a SocketCAN interface: frames sent by the ECU are written to it and frames read
+ * from it are injected like those of an external node. Returns 0, or -1 if the interface cannot be opened. */
+int HostHal_canAttachSocket(const char *ifname)
+{
+#ifdef __linux__
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int s = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+
+    if (s < 0)
+    {
+        perror("host: CAN socket");
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0)
+    {
+        perror(ifname);
+        close(s);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror(ifname);
+        close(s);
+        return -1;
+    }
+    hal.socket = s;
+    return 0;
+#else
+    fprintf(stderr, "host: SocketCAN is only available on Linux (%s)\n", ifname);
+    return -1;
+#endif
+}
+
+/* Paces virtual time with the wall clock, needed when other processes share the bus through the socket */
+void HostHal_setRealTime(boolean on)
+{
+    hal.realTime = on;
+    hal.wallStartNs = 0;
+}
+
+/* Takes the RX FIFO 0 interrupt ns after the message that requested it instead of right away, as if the CPU were
+ * busy that long; messages arriving in the meantime wait in the FIFO, which may overflow. 0 (default): no delay. */
+void HostHal_setRxLatency(uint64 ns)
+{
+    hal.rxLatencyNs = ns;
+}
+
+/* Runs loop, one pass of the main loop of core 1, after every event in virtual time, so that core 1 sees what
+ * core 0 did right away. Its host time includes the ISRs it triggers on the shared interrupt controller. */
+void HostHal_setCore1(void (*loop)(void))
+{
+    hal.core1 = loop;
+}
+
+const HostHal_IsrStats *HostHal_isrStats(int *count)
+{
+    *count = hal.isrCount;
+    return hal.isrs;
+}
+
+static uint64 HostHal_percentile(const HostHal_IsrStats *s, double q)
+{
+    uint64 seen = 0;
+    int b;
+
+    for (b = 0; b < 40; b++)
+    {
+        seen += s->histogram[b];
+        if (seen >= q * s->count)
+        {
+            return 2ull << b;                         /* upper edge of the bucket */
+        }
+    }
+    return s->maxNs;
+}
+
+void HostHal_report(FILE *out)
+{
+    int n;
+
+    fprintf(out, "virtual time %.3f s, bus load %.1f%% (%llu frames), %llu interrupts without ISR\n",
+            hal.nowNs * 1e-9, hal.nowNs ? 100.0 * hal.busBusyNs / hal.nowNs : 0,
+            (unsigned long long)hal.busFrames, (unsigned long long)hal.unhandled);
+    fprintf(out, "%-22s %4s %10s %10s %10s %10s %10s   (host ns, nested ISRs excluded)\n",
+            "ISR", "prio", "count", "mean", "p50<=", "p99<=", "max");
+    for (n = 0; n < hal.isrCount; n++)
+    {
+        const HostHal_IsrStats *s = &hal.isrs[n];
+        fprintf(out, "%-22s %4u %10llu %10.0f %10llu %10llu %10llu\n", s->name, s->priority,
+                (unsigned long long)s->count, s->count ? (double)s->totalNs / s->count : 0,
+                (unsigned long long)(s->count ? HostHal_percentile(s, 0.5) : 0),
+                (unsigned long long)(s->count ? HostHal_percentile(s, 0.99) : 0), (unsigned long long)s->maxNs);
+    }
+    for (n = 0; n < hal.nodeCount; n++)
+    {
+        const HostHal_Node *hn = &hal.nodes[n];
+        fprintf(out, "node %d: %llu sent, %llu received, %llu lost, %llu busy waits (%.3f ms)\n", n,
+                (unsigned long long)hn->txFrames, (unsigned long long)hn->rxFrames, (unsigned long long)hn->rxLost,
+                (unsigned long long)hn->busyWaits, hn->busyWaitNs * 1e-6);
+    }
+    if (hal.extLost)
+    {
+        fprintf(out, "%llu external frames dropped, queue full\n", (unsigned long long)hal.extLost);
+    }
+    if (hal.core1 != NULL)
+    {
+        fprintf(out, "core 1: %llu loop passes, %.3f ms host time\n", (unsigned long long)hal.core1Calls,
+                hal.core1Ns * 1e-6);
+    }
+}
@@ -0,0 +1,412 @@
+/**********************************************************************************************************************
+ * \file ifx_host.h
+ * \brief Host (Linux) stand-in for the parts of iLLD used by ecu_code.c
+ *
+ * ecu_code.c is compiled unmodified against this header instead of the TC397 iLLD. The include directory host/
+ * provides headers with the iLLD names (IfxPort.h, IfxGtm_Tom_Timer.h, IfxCpu.h, Cpu/Irq/IfxCpu_Irq.h, Bsp.h,
+ * Ifx_types.h, CanBasicDemo-v1.h, Math.h) which all include this file. ifx_host.c simulates:
+ *  - the CAN nodes on an in-process bus (arbitration by ID, nominal frame lengths at the configured baud rate),
+ *    optionally bridged to a SocketCAN interface such as vcan0,
+ *  - the GTM TOM timers as periodic interrupts of their configured frequency,
+ *  - the interrupt controller: ISRs defined with IFX_INTERRUPT are dispatched by priority, nest like BISR does on
+ *    TriCore, and IfxCpu_disableInterrupts/IfxCpu_restoreInterrupts hold them back,
+ *  - core 1, as a loop (HostHal_setCore1) run after every event; interrupts of both cores share one controller.
+ * Time is virtual: HostHal_runUntil advances it from event to event, and code runs in zero virtual time. The host
+ * time spent in every ISR is measured, see HostHal_report.
+ *********************************************************************************************************************/
+#ifndef IFX_HOST_H
+#define IFX_HOST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*********************************************************************************************************************/
+/*------------------------------------------------Types and compiler-------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef int64_t  sint64;
+typedef float    float32;
+typedef double   float64;
+typedef uint8    boolean;
+typedef sint64   Ifx_TickTime;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+/* TASKING memory qualifiers have no meaning on the host */
+#define __far
+#define __near
+#define __align32
+
+/* The ISR is an ordinary function; a constructor registers it with the interrupt controller under its priority */
+#define IFX_INTERRUPT(isr, vectabNum, priority)                                            \
+    void isr(void);                                                                        \
+    static void __attribute__((constructor)) isr##_hostRegister(void)                     \
+    {                                                                                      \
+        HostHal_registerIsr((priority), isr, #isr);                                        \
+    }                                                                                      \
+    void isr(void)
+
+#define IFXCAN_NUM_MODULES 2
+#define IFXCAN_NUM_NODES   4
+
+/*********************************************************************************************************************/
+/*----------------------------------------------------SFR models-----------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef struct
+{
+    struct { uint32 INIT : 1; uint32 CCE : 1; } B;
+} Ifx_CAN_N_CCCR;
+
+typedef struct
+{
+    struct { uint32 RF0N : 1; uint32 RF0F : 1; uint32 RF0L : 1; uint32 TC : 1; uint32 EW : 1; uint32 BO : 1; } B;
+} Ifx_CAN_N_IR;
+
+typedef struct
+{
+    struct { uint32 EW : 1; uint32 BO : 1; } B;
+} Ifx_CAN_N_PSR;
+
+typedef struct
+{
+    struct { uint32 TEC : 8; uint32 REC : 7; uint32 CEL : 8; } B;
+} Ifx_CAN_N_ECR;
+
+typedef struct
+{
+    Ifx_CAN_N_CCCR CCCR;
+    Ifx_CAN_N_IR   IR;
+    Ifx_CAN_N_IR   IE; /* interrupt enables, same layout as IR */
+    Ifx_CAN_N_PSR  PSR;
+    Ifx_CAN_N_ECR  ECR;
+} Ifx_CAN_N;
+
+typedef struct
+{
+    Ifx_CAN_N N[IFXCAN_NUM_NODES];
+} Ifx_CAN;
+
+typedef struct { uint32 CLK_EN; } Ifx_GTM;
+typedef struct { uint32 OUT; } Ifx_P;
+typedef struct { uint32 U; } Ifx_SRC_SRCR;
+typedef struct { uint32 TIM0; } Ifx_STM;
+
+extern Ifx_CAN MODULE_CAN0;
+extern Ifx_CAN MODULE_CAN1;
+extern Ifx_GTM MODULE_GTM;
+extern Ifx_P   MODULE_P20;
+extern Ifx_P   MODULE_P23;
+extern Ifx_STM MODULE_STM0;
+
+#define CAN0_IR0 (MODULE_CAN0.N[0].IR)
+#define CAN1_IR0 (MODULE_CAN1.N[0].IR)
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Port---------------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef enum { IfxPort_InputMode_undefined, IfxPort_InputMode_noPullDevice, IfxPort_InputMode_pullDown,
+               IfxPort_InputMode_pullUp } IfxPort_InputMode;
+typedef enum { IfxPort_OutputMode_pushPull, IfxPort_OutputMode_openDrain } IfxPort_OutputMode;
+typedef enum { IfxPort_OutputIdx_general } IfxPort_OutputIdx;
+typedef enum { IfxPort_PadDriver_cmosAutomotiveSpeed1, IfxPort_PadDriver_cmosAutomotiveSpeed2,
+               IfxPort_PadDriver_cmosAutomotiveSpeed3, IfxPort_PadDriver_cmosAutomotiveSpeed4 } IfxPort_PadDriver;
+typedef enum { IfxPort_State_notChanged, IfxPort_State_high, IfxPort_State_low, IfxPort_State_toggled } IfxPort_State;
+
+void IfxPort_setPinModeOutput(Ifx_P *port, uint8 pinIndex, IfxPort_OutputMode mode, IfxPort_OutputIdx index);
+void IfxPort_setPinState(Ifx_P *port, uint8 pinIndex, IfxPort_State action);
+void IfxPort_togglePin(Ifx_P *port, uint8 pinIndex);
+void IfxPort_setPinHigh(Ifx_P *port, uint8 pinIndex);
+void IfxPort_setPinLow(Ifx_P *port, uint8 pinIndex);
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------CPU----------------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef enum { IfxSrc_Tos_cpu0, IfxSrc_Tos_dma, IfxSrc_Tos_cpu1, IfxSrc_Tos_cpu2 } IfxSrc_Tos;
+typedef enum { IfxCpu_ResourceCpu_0, IfxCpu_ResourceCpu_1 } IfxCpu_ResourceCpu;
+
+boolean IfxCpu_disableInterrupts(void);
+void IfxCpu_restoreInterrupts(boolean enabled);
+void IfxCpu_enableInterrupts(void);
+IfxCpu_ResourceCpu IfxCpu_getCoreIndex(void);
+IfxSrc_Tos IfxCpu_Irq_getTos(IfxCpu_ResourceCpu coreId);
+
+typedef struct { uint32 fPll; } IfxScuCcu_Config;
+void IfxScuCcu_initConfig(IfxScuCcu_Config *cfg);
+boolean IfxScuCcu_init(const IfxScuCcu_Config *cfg);
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------SRC----------------------------------------------------------*/
+/*********************************************************************************************************************/
+/* Software service requests: SRPN in bits 0..7 and SRE in bit 10 of SRCR like on the TC397, setRequest raises the
+ * priority when the request is enabled */
+typedef uint16 Ifx_Priority;
+
+extern Ifx_SRC_SRCR SRC_GPSR00;                      /* general purpose service request 0                            */
+extern Ifx_SRC_SRCR SRC_GPSR01;                      /* general purpose service request 1                            */
+
+void IfxSrc_init(volatile Ifx_SRC_SRCR *src, IfxSrc_Tos typOfService, Ifx_Priority priority);
+void IfxSrc_enable(volatile Ifx_SRC_SRCR *src);
+void IfxSrc_setRequest(volatile Ifx_SRC_SRCR *src);
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------STM----------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define BSP_DEFAULT_TIMER (&MODULE_STM0)
+#define HOST_STM_FREQ     100000000 /* STM0 runs at 100 MHz on the TC397 */
+
+Ifx_TickTime IfxStm_getTicksFromMilliseconds(Ifx_STM *stm, uint32 milliSeconds);
+Ifx_TickTime IfxStm_getTicksFromMicroseconds(Ifx_STM *stm, uint32 microSeconds);
+uint64 IfxStm_get(Ifx_STM *stm);
+float32 IfxStm_getFrequency(Ifx_STM *stm);
+void waitTime(Ifx_TickTime timeout);
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------GTM TOM------------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef enum { IfxGtm_Tom_0, IfxGtm_Tom_1, IfxGtm_Tom_2, IfxGtm_Tom_3 } IfxGtm_Tom;
+typedef enum { IfxGtm_Tom_Ch_0, IfxGtm_Tom_Ch_1, IfxGtm_Tom_Ch_2, IfxGtm_Tom_Ch_3 } IfxGtm_Tom_Ch;
+typedef enum { IfxGtm_Tom_Ch_ClkSrc_cmuFxclk0, IfxGtm_Tom_Ch_ClkSrc_cmuFxclk1, IfxGtm_Tom_Ch_ClkSrc_cmuFxclk2,
+               IfxGtm_Tom_Ch_ClkSrc_cmuFxclk3, IfxGtm_Tom_Ch_ClkSrc_cmuFxclk4 } IfxGtm_Tom_Ch_ClkSrc;
+#define IFXGTM_CMU_CLKEN_FXCLK 0x00400000
+
+typedef struct
+{
+    struct
+    {
+        float32 frequency;
+        uint16 isrPriority;
+        IfxSrc_Tos isrProvider;
+    } base;
+    IfxGtm_Tom tom;
+    IfxGtm_Tom_Ch timerChannel;
+    IfxGtm_Tom_Ch_ClkSrc clock;
+} IfxGtm_Tom_Timer_Config;
+
+typedef struct
+{
+    float32 frequency;
+    uint16 isrPriority;
+    sint32 hostTimer; /* index of the HAL timer, -1 before IfxGtm_Tom_Timer_run */
+    uint32 acknowledged;
+} IfxGtm_Tom_Timer;
+
+void IfxGtm_enable(Ifx_GTM *gtm);
+void IfxGtm_Cmu_enableClocks(Ifx_GTM *gtm, uint32 clkMask);
+void IfxGtm_Tom_Timer_initConfig(IfxGtm_Tom_Timer_Config *config, Ifx_GTM *gtm);
+boolean IfxGtm_Tom_Timer_init(IfxGtm_Tom_Timer *driver, const IfxGtm_Tom_Timer_Config *config);
+void IfxGtm_Tom_Timer_run(IfxGtm_Tom_Timer *driver);
+void IfxGtm_Tom_Timer_stop(IfxGtm_Tom_Timer *driver);
+void IfxGtm_Tom_Timer_acknowledgeTimerIrq(IfxGtm_Tom_Timer *driver);
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------CAN----------------------------------------------------------*/
+/*********************************************************************************************************************/
+typedef enum { IfxCan_NodeId_0, IfxCan_NodeId_1, IfxCan_NodeId_2, IfxCan_NodeId_3 } IfxCan_NodeId;
+typedef enum { IfxCan_Status_ok, IfxCan_Status_notInitialised, IfxCan_Status_wrongParam,
+               IfxCan_Status_notSentBusy, IfxCan_Status_receiveEmpty } IfxCan_Status;
+typedef enum { IfxCan_FrameType_receive, IfxCan_FrameType_transmit, IfxCan_FrameType_transmitAndReceive,
+               IfxCan_FrameType_remoteRequest, IfxCan_FrameType_remoteAnswer } IfxCan_FrameType;
+typedef enum { IfxCan_RxMode_dedicatedBuffers, IfxCan_RxMode_fifo0, IfxCan_RxMode_fifo1,
+               IfxCan_RxMode_sharedFifo0, IfxCan_RxMode_sharedFifo1, IfxCan_RxMode_sharedAll } IfxCan_RxMode;
+typedef enum { IfxCan_RxFifoMode_blocking, IfxCan_RxFifoMode_overwrite } IfxCan_RxFifoMode;
+typedef enum { IfxCan_Interrupt_rxFifo0NewMessage, IfxCan_Interrupt_rxFifo0Full, IfxCan_Interrupt_rxFifo0MessageLost,
+               IfxCan_Interrupt_transmissionCompleted, IfxCan_Interrupt_errorWarningStatus,
+               IfxCan_Interrupt_busOffStatus } IfxCan_Interrupt;
+typedef enum { IfxCan_InterruptLine_0, IfxCan_InterruptLine_1, IfxCan_InterruptLine_2, IfxCan_InterruptLine_3,
+               IfxCan_InterruptLine_4, IfxCan_InterruptLine_5, IfxCan_InterruptLine_6, IfxCan_InterruptLine_7,
+               IfxCan_InterruptLine_8, IfxCan_InterruptLine_9, IfxCan_InterruptLine_10, IfxCan_InterruptLine_11,
+               IfxCan_InterruptLine_12, IfxCan_InterruptLine_13, IfxCan_InterruptLine_14,
+               IfxCan_InterruptLine_15 } IfxCan_InterruptLine;
+typedef enum { IfxCan_FilterElementConfiguration_disable, IfxCan_FilterElementConfiguration_storeInRxFifo0,
+               IfxCan_FilterElementConfiguration_storeInRxFifo1, IfxCan_FilterElementConfiguration_rejectId,
+               IfxCan_FilterElementConfiguration_setPriority, IfxCan_FilterElementConfiguration_setPriorityAndStoreInFifo0,
+               IfxCan_FilterElementConfiguration_setPriorityAndStoreInFifo1,
+               IfxCan_FilterElementConfiguration_storeInRxBuffer } IfxCan_FilterElementConfiguration;
+typedef enum { IfxCan_FilterType_range, IfxCan_FilterType_dualId, IfxCan_FilterType_classic,
+               IfxCan_FilterType_none } IfxCan_FilterType;
+typedef enum { IfxCan_RxBufferId_0, IfxCan_RxBufferId_1, IfxCan_RxBufferId_2, IfxCan_RxBufferId_3 } IfxCan_RxBufferId;
+typedef enum { IfxCan_TxBufferId_0, IfxCan_TxBufferId_1, IfxCan_TxBufferId_2, IfxCan_TxBufferId_3,
+               IfxCan_TxBufferId_4, IfxCan_TxBufferId_5, IfxCan_TxBufferId_6, IfxCan_TxBufferId_7,
+               IfxCan_TxBufferId_8, IfxCan_TxBufferId_9, IfxCan_TxBufferId_10, IfxCan_TxBufferId_11,
+               IfxCan_TxBufferId_12, IfxCan_TxBufferId_13, IfxCan_TxBufferId_14, IfxCan_TxBufferId_15,
+               IfxCan_TxBufferId_16, IfxCan_TxBufferId_17, IfxCan_TxBufferId_18, IfxCan_TxBufferId_19,
+               IfxCan_TxBufferId_20, IfxCan_TxBufferId_21, IfxCan_TxBufferId_22, IfxCan_TxBufferId_23,
+               IfxCan_TxBufferId_24, IfxCan_TxBufferId_25, IfxCan_TxBufferId_26, IfxCan_TxBufferId_27,
+               IfxCan_TxBufferId_28, IfxCan_TxBufferId_29, IfxCan_TxBufferId_30, IfxCan_TxBufferId_31 } IfxCan_TxBufferId;
+typedef enum { IfxCan_DataLengthCode_0, IfxCan_DataLengthCode_1, IfxCan_DataLengthCode_2, IfxCan_DataLengthCode_3,
+               IfxCan_DataLengthCode_4, IfxCan_DataLengthCode_5, IfxCan_DataLengthCode_6, IfxCan_DataLengthCode_7,
+               IfxCan_DataLengthCode_8 } IfxCan_DataLengthCode;
+typedef enum { IfxCan_MessageIdLength_standard, IfxCan_MessageIdLength_extended } IfxCan_MessageIdLength;
+
+typedef struct { uint8 pin; } IfxCan_Rxd_In;
+typedef struct { uint8 pin; } IfxCan_Txd_Out;
+extern const IfxCan_Rxd_In  IfxCan_RXD00B_P20_7_IN;
+extern const IfxCan_Txd_Out IfxCan_TXD00_P20_8_OUT;
+extern const IfxCan_Rxd_In  IfxCan_RXD10C_P23_0_IN;
+extern const IfxCan_Txd_Out IfxCan_TXD10_P23_1_OUT;
+
+typedef struct
+{
+    uint32 bufferNumber;
+    uint32 messageId;
+    boolean remoteTransmitRequest;
+    IfxCan_MessageIdLength messageIdLength;
+    boolean errorStateIndicator;
+    IfxCan_DataLengthCode dataLengthCode;
+    boolean readFromRxFifo0;
+    boolean readFromRxFifo1;
+} IfxCan_Message;
+
+typedef struct
+{
+    uint8 number;
+    IfxCan_FilterElementConfiguration elementConfiguration;
+    IfxCan_FilterType type;
+    uint32 id1;
+    uint32 id2;
+    IfxCan_RxBufferId rxBufferOffset;
+} IfxCan_Filter;
+
+typedef struct
+{
+    uint16 priority;
+    IfxCan_InterruptLine interruptLine;
+    IfxSrc_Tos typeOfService;
+} IfxCan_Can_InterruptConfig;
+
+typedef struct
+{
+    const IfxCan_Rxd_In *rxPin;
+    IfxPort_InputMode rxPinMode;
+    const IfxCan_Txd_Out *txPin;
+    IfxPort_OutputMode txPinMode;
+    IfxPort_PadDriver padDriver;
+} IfxCan_Can_Pins;
+
+typedef struct
+{
+    Ifx_CAN *can;
+} IfxCan_Can_Config;
+
+typedef struct
+{
+    Ifx_CAN *can;
+} IfxCan_Can;
+
+typedef struct
+{
+    IfxCan_Can *module;
+    IfxCan_NodeId nodeId;
+    struct { uint32 baudrate; } baudRate;
+    struct { IfxCan_FrameType type; } frame;
+    struct
+    {
+        uint32 baseAddress;
+        uint16 standardFilterListStartAddress;
+        uint16 extendedFilterListStartAddress;
+        uint16 rxFifo0StartAddress;
+        uint16 rxFifo1StartAddress;
+        uint16 rxBuffersStartAddress;
+        uint16 txBuffersStartAddress;
+    } messageRAM;
+    struct
+    {
+        IfxCan_RxMode rxMode;
+        uint8 rxFifo0Size;
+        IfxCan_RxFifoMode rxFifo0OperatingMode;
+    } rxConfig;
+    struct
+    {
+        uint8 dedicatedTxBuffersNumber;
+    } txConfig;
+    struct
+    {
+        IfxCan_Can_InterruptConfig rxf0n, rxf0f, rxf0l, traco, boff, reint;
+        boolean busOffStatusEnabled;
+        boolean protocolErrorArbitrationEnabled;
+        boolean protocolErrorDataEnabled;
+        boolean watchdogEnabled;
+    } interruptConfig;
+    const IfxCan_Can_Pins *pins;
+} IfxCan_Can_NodeConfig;
+
+typedef struct
+{
+    Ifx_CAN *can;
+    Ifx_CAN_N *node;
+    IfxCan_NodeId nodeId;
+    IfxCan_FrameType frameType;
+    sint32 hostNode; /* index of the node on the HAL bus, -1 before IfxCan_Can_initNode */
+} IfxCan_Can_Node;
+
+void IfxCan_Can_initModuleConfig(IfxCan_Can_Config *config, Ifx_CAN *can);
+IfxCan_Status IfxCan_Can_initModule(IfxCan_Can *can, IfxCan_Can_Config *config);
+void IfxCan_Can_initNodeConfig(IfxCan_Can_NodeConfig *config, IfxCan_Can *can);
+IfxCan_Status IfxCan_Can_initNode(IfxCan_Can_Node *node, const IfxCan_Can_NodeConfig *config);
+void IfxCan_Can_initMessage(IfxCan_Message *message);
+IfxCan_Status IfxCan_Can_sendMessage(IfxCan_Can_Node *node, IfxCan_Message *message, uint32 *data);
+IfxCan_Status IfxCan_Can_readMessage(IfxCan_Can_Node *node, IfxCan_Message *message, uint32 *data);
+void IfxCan_Can_setStandardFilter(IfxCan_Can_Node *node, IfxCan_Filter *filter);
+Ifx_CAN_N *IfxCan_getNodePointer(Ifx_CAN *can, IfxCan_NodeId nodeId);
+void IfxCan_Node_clearInterruptFlag(Ifx_CAN_N *node, IfxCan_Interrupt interruptFlag);
+void IfxCan_Node_enableInterrupt(Ifx_CAN_N *node, IfxCan_Interrupt interrupt);
+void IfxCan_Node_enableConfigurationChange(Ifx_CAN_N *node);
+void IfxCan_Node_disableConfigurationChange(Ifx_CAN_N *node);
+uint8 IfxCan_Node_getRxFifo0FillLevel(Ifx_CAN_N *node);
+boolean IfxCan_Node_isTxBufferRequestPending(Ifx_CAN_N *node, IfxCan_TxBufferId txBufferId);
+boolean IfxCan_Node_getBusOffStatus(Ifx_CAN_N *node);
+boolean IfxCan_Node_getWarningStatus(Ifx_CAN_N *node);
+
+/*********************************************************************************************************************/
+/*--------------------------------------------------Host simulation--------------------------------------------------*/
+/*********************************************************************************************************************/
+#define HOST_MAX_ISRS    32
+#define HOST_MAX_TIMERS  4
+#define HOST_MAX_NODES   4
+#define HOST_MAX_SOURCES 32
+#define HOST_RX_FIFO_MAX 64
+#define HOST_TX_BUFFERS  32
+
+typedef struct
+{
+    uint32 id;
+    uint8 dlc;
+    uint8 data[8];
+} HostHal_Frame;
+
+/* Per ISR host time statistics; histogram buckets are powers of two of nanoseconds */
+typedef struct
+{
+    const char *name;
+    uint16 priority;
+    void (*isr)(void);
+    uint64 count;
+    uint64 totalNs;
+    uint64 maxNs;
+    uint64 histogram[40];
+} HostHal_IsrStats;
+
+void HostHal_registerIsr(uint16 priority, void (*isr)(void), const char *name);
+void HostHal_raise(uint16 priority);
+uint64 HostHal_now(void);
+void HostHal_runUntil(uint64 ns);
+void HostHal_canInject(const HostHal_Frame *frame);
+int HostHal_canAddPeriodic(const HostHal_Frame *frame, uint64 periodNs, uint64 offsetNs,
+                           void (*update)(HostHal_Frame *frame, uint64 nowNs));
+int HostHal_canAttachSocket(const char *ifname);
+void HostHal_setRealTime(boolean on);
+void HostHal_setRxLatency(uint64 ns);
+void HostHal_setCore1(void (*loop)(void));
+const HostHal_IsrStats *HostHal_isrStats(int *count);
+void HostHal_report(FILE *out);
+
+#endif /* IFX_HOST_H */
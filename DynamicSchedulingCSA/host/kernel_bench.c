@@ -0,0 +1,253 @@
+/**********************************************************************************************************************
+ * \file kernel_bench.c
+ * \brief Benchmark of the sparse kernels of ecu_kernels.h against the dense code they replace in ecu_code.c
+ *
+ *     kernel_bench [-n 10000000]
+ *
+ * Runs, -n times each on a changing state, the QC control law u = -K (xhat - ref) as the dense 4 x 12 expression of
+ * CanBasicDemo_run_qc and as SPARSE_MV with QC_K_PATTERN, the same for the 2 x 4 law of CanBasicDemo_run_qc_alt, and
+ * the cost of updateutil with the Q/R matrices built on the stack and looped over their diagonal, and with
+ * SPARSE_QF_DIAG_ADD. Prints the time per call and the largest difference between the two results: 0 with the 20 ms
+ * gains, whose off-block entries are exactly zero, rounding of the ~1e-9 entries left out with the 10 ms gains.
+ *********************************************************************************************************************/
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Ifx_types.h"
+#include "../ecu_kernels.h"
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define NOINLINE __attribute__((noinline))
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Data Structures---------------------------------------------------*/
+/*********************************************************************************************************************/
+/* Control law on the gain matrix gains */
+typedef void (*Law)(const void *gains, const float *x, float *u);
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Global variables--------------------------------------------------*/
+/*********************************************************************************************************************/
+static const float g_ref[12] = {10, 0, 0, 0, 10, 0, 0, 0, 10, 0, 0, 0};
+
+/* qc_gain_table: 20 ms (block diagonal) and 10 ms (with the ~1e-9 off-block entries) */
+static const float g_k20[4][12] = {
+    {3.12685594967393, 5.60056530879117, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0.315427247946649, 2.53141053716782, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 3.05441194111679, 6.05997082436238, 58.7631166321155, 34.1120666564246, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, -3.05441194117077, -6.05997082447233, 58.7631166330827, 34.1120666568239}};
+static const float g_k10[4][12] = {
+    {3.14451685869324, 5.61640885706677, -2.24815378560498e-13, -9.35040910781222e-13, -2.00084615486558e-12,
+     -3.19864871177971e-12, -2.42906164884875e-11, -9.12993173689396e-12, 7.77479339632901e-13, 1.32462155507943e-12,
+     -1.13920607077515e-11, -5.28889409924540e-12},
+    {-2.40306241803692e-13, -4.72815380478954e-13, 0.315827253270447, 2.53304005481979, 7.84605220808760e-13,
+     1.16425694772151e-12, 8.43874185194031e-12, 3.06879093499489e-12, -5.31262238867872e-13, -8.59004682947821e-13,
+     6.52030942425330e-12, 3.26154527538293e-12},
+    {-3.67448507775373e-12, -4.52413546402716e-12, -2.93728431368812e-13, 3.14130884398491e-12, 3.10787674690884,
+     6.15027001575052, 59.4853828724422, 34.4066362896555, -1.18482368586491e-10, -2.08120109148284e-10,
+     1.68577401900408e-09, 6.47292755594409e-10},
+    {-2.45653038076514e-12, -2.62953318968014e-12, -1.22285655546061e-13, 3.40902909601388e-12, 9.27267520204066e-11,
+     1.69084002031452e-10, 1.47075073708627e-09, 6.46413943908671e-10, -3.10787674687785, -6.15027001566358,
+     59.4853828713107, 34.4066362889244}};
+static const float g_kAlt20[2][4] = {
+    {3.12685594967393, 5.60056530879117, -8.20209119000962e-15, -1.04128354000384e-13},
+    {-2.27958236698399e-15, -5.25758397334492e-14, 0.315427247946649, 2.53141053716782}};
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+static double nowS(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* As CanBasicDemo_run_qc before ecu_kernels.h */
+static NOINLINE void qcDense(const void *gains, const float *x, float *u)
+{
+    const float (*K)[12] = gains;
+    int r;
+
+    for (r = 0; r < 4; r++)
+    {
+        u[r] = -(K[r][0]*(x[0]-g_ref[0]) + K[r][1]*x[1] + K[r][2]*x[2] + K[r][3]*x[3]
+                 + K[r][4]*(x[4]-g_ref[4]) + K[r][5]*x[5] + K[r][6]*x[6] + K[r][7]*x[7]
+                 + K[r][8]*(x[8]-g_ref[8]) + K[r][9]*x[9] + K[r][10]*x[10] + K[r][11]*x[11]);
+    }
+}
+
+static NOINLINE void qcSparse(const void *gains, const float *x, float *u)
+{
+    const float (*K)[12] = gains;
+    float e[12], v[4];
+    int k;
+
+    for (k = 0; k < 12; k++)
+    {
+        e[k] = x[k] - g_ref[k];
+    }
+    SPARSE_MV(v, K, e, QC_K_PATTERN);
+    for (k = 0; k < 4; k++)
+    {
+        u[k] = -v[k];
+    }
+}
+
+static NOINLINE void qcAltDense(const void *gains, const float *x, float *u)
+{
+    const float (*K)[4] = gains;
+
+    u[0] = -(K[0][0]*(x[0]-g_ref[0]) + K[0][1]*x[1] + K[0][2]*x[2] + K[0][3]*x[3]);
+    u[1] = -(K[1][0]*(x[0]-g_ref[0]) + K[1][1]*x[1] + K[1][2]*x[2] + K[1][3]*x[3]);
+}
+
+static NOINLINE void qcAltSparse(const void *gains, const float *x, float *u)
+{
+    const float (*K)[4] = gains;
+    float e[4], v[2];
+
+    e[0] = x[0] - g_ref[0];
+    e[1] = x[1];
+    e[2] = x[2];
+    e[3] = x[3];
+    SPARSE_MV(v, K, e, QC_ALT_K_PATTERN);
+    u[0] = -v[0];
+    u[1] = -v[1];
+}
+
+/* As updateutil (jj == 1) before ecu_kernels.h */
+static NOINLINE float costDense(const uint32 *y, const float *u)
+{
+    float Q[12][12] = {{10, 0}, {0}, {0}, {0}, {0, 0, 0, 0, 100}, {0}, {0}, {0}, {0, 0, 0, 0, 0, 0, 0, 0, 100}};
+    float R[4][4] = {{1, 0, 0, 0}, {0, 10, 0, 0}, {0, 0, 10, 0}, {0, 0, 0, 10}};
+    float J = 0;
+    int ii;
+
+    for (ii = 0; ii < 12; ii++)
+    {
+        J = J + Q[ii][ii]*y[ii]*y[ii];
+    }
+    for (ii = 0; ii < 4; ii++)
+    {
+        J = J + R[ii][ii]*u[ii]*u[ii];
+    }
+    return J;
+}
+
+static NOINLINE float costSparse(const uint32 *y, const float *u)
+{
+    float J = 0;
+
+    SPARSE_QF_DIAG_ADD(J, y, QC_Q_PATTERN);
+    SPARSE_QF_DIAG_ADD(J, u, QC_R_PATTERN);
+    return J;
+}
+
+/* Runs law -n times on a state moving with k; returns ns per call, the largest |u| difference to ref in *diff */
+static double runLaw(Law law, Law ref, const void *K, int rows, uint32 n, double *diff)
+{
+    float x[12], u[4], w[4], sink = 0;
+    double t0, t1;
+    uint32 k;
+    int r;
+
+    *diff = 0;
+    t0 = nowS();
+    for (k = 0; k < n; k++)
+    {
+        for (r = 0; r < 12; r++)
+        {
+            x[r] = (float)((k * (r + 3)) & 1023) * 0.01f;
+        }
+        law(K, x, u);
+        sink += u[0];
+    }
+    t1 = nowS();
+    for (k = 0; k < 1000; k++)
+    {
+        for (r = 0; r < 12; r++)
+        {
+            x[r] = (float)((k * (r + 3)) & 1023) * 0.01f;
+        }
+        law(K, x, u);
+        ref(K, x, w);
+        for (r = 0; r < rows; r++)
+        {
+            double d = fabs((double)u[r] - w[r]);
+            *diff = d > *diff ? d : *diff;
+        }
+    }
+    if (sink == 12345.0f)
+    {
+        printf(" ");
+    }
+    return n ? (t1 - t0) * 1e9 / n : 0;
+}
+
+static double runCost(float (*cost)(const uint32 *, const float *), uint32 n, float *last)
+{
+    uint32 y[12];
+    float u[4], sink = 0;
+    double t0, t1;
+    uint32 k;
+    int r;
+
+    t0 = nowS();
+    for (k = 0; k < n; k++)
+    {
+        for (r = 0; r < 12; r++)
+        {
+            y[r] = 200000 + ((k * (r + 1)) & 4095);
+        }
+        for (r = 0; r < 4; r++)
+        {
+            u[r] = (float)((k + r) & 255) * 0.5f;
+        }
+        sink += cost(y, u);
+    }
+    t1 = nowS();
+    *last = sink;
+    return n ? (t1 - t0) * 1e9 / n : 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32 n = 10000000;
+    double diff, tDense, tSparse;
+    float sumDense, sumSparse;
+    int a;
+
+    for (a = 1; a + 1 < argc; a += 2)
+    {
+        if (strcmp(argv[a], "-n") == 0)
+        {
+            n = (uint32)strtoul(argv[a + 1], NULL, 0);
+        }
+    }
+
+    tDense = runLaw(qcDense, qcDense, g_k20, 4, n, &diff);
+    tSparse = runLaw(qcSparse, qcDense, g_k20, 4, n, &diff);
+    printf("qc 4x12, 20 ms gains: dense %.2f ns, sparse %.2f ns per call, max difference %g\n", tDense, tSparse, diff);
+    tDense = runLaw(qcDense, qcDense, g_k10, 4, n, &diff);
+    tSparse = runLaw(qcSparse, qcDense, g_k10, 4, n, &diff);
+    printf("qc 4x12, 10 ms gains: dense %.2f ns, sparse %.2f ns per call, max difference %g\n", tDense, tSparse, diff);
+    tDense = runLaw(qcAltDense, qcAltDense, g_kAlt20, 2, n, &diff);
+    tSparse = runLaw(qcAltSparse, qcAltDense, g_kAlt20, 2, n, &diff);
+    printf("qc alt 2x4, 20 ms gains: dense %.2f ns, sparse %.2f ns per call, max difference %g\n", tDense, tSparse,
+           diff);
+    tDense = runCost(costDense, n, &sumDense);
+    tSparse = runCost(costSparse, n, &sumSparse);
+    printf("cost 12+4: dense %.2f ns, sparse %.2f ns per call, %s\n", tDense, tSparse,
+           sumDense == sumSparse ? "same sums" : "DIFFERENT sums");
+    return sumDense == sumSparse ? 0 : 1;
+}
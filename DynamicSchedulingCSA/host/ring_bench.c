@@ -0,0 +1,302 @@
+/**********************************************************************************************************************
+ * \file ring_bench.c
+ * \brief Benchmark of the core 0 / core 1 rings of ecu_rings.h and the snapshots of ecu_snapshot.h on two pthreads
+ *
+ *     ring_bench [-n 10000000] [-rtt 1000000] [-snap 10000000] [-cpu0 0] [-cpu1 1]
+ *
+ * Uses the same ecu_job_ring/ecu_act_ring and SPSC_* macros as the ECU_PARTITIONED build of ecu_code.c, with the
+ * "core 0" thread as producer of jobs and the "core 1" thread as producer of commands:
+ *  - throughput: core 0 pushes -n jobs carrying a sequence number, core 1 pops them and checks the order,
+ *  - round trip: core 0 pushes one job and spins until core 1 has answered with a command, -rtt times; the latency
+ *    of a job release to its command, without the control law, is printed as percentiles,
+ *  - snapshots: core 1 rewrites a 12-element sensor vector (all elements equal) as fast as it can while core 0
+ *    takes -snap copies; a copy with unequal elements would be torn.
+ * -cpu0/-cpu1 pin the threads (default: 0 and 1, -1 leaves them to the scheduler). A thread that waits spins, and
+ * yields after SPIN_LIMIT tries so that the benchmark still ends on a single CPU (where it measures the scheduler).
+ *********************************************************************************************************************/
+
+/*********************************************************************************************************************/
+/*-----------------------------------------------------Includes------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../ecu_rings.h"
+#include "../ecu_snapshot.h"
+
+/*********************************************************************************************************************/
+/*------------------------------------------------------Macros-------------------------------------------------------*/
+/*********************************************************************************************************************/
+#define SPIN_LIMIT 4096
+
+/*********************************************************************************************************************/
+/*-------------------------------------------------Global variables--------------------------------------------------*/
+/*********************************************************************************************************************/
+static ecu_job_ring g_jobRing __attribute__((aligned(SPSC_LINE)));
+static ecu_act_ring g_actRing __attribute__((aligned(SPSC_LINE)));
+typedef struct { uint32 y[12]; } SensorVec;
+static SEQLOCK(SensorVec) g_sensors;
+static volatile int g_stop;
+static uint32 g_count;
+static int g_cpu1 = 1;
+static volatile int g_errors;
+
+/*********************************************************************************************************************/
+/*--------------------------------------------Function Implementations-----------------------------------------------*/
+/*********************************************************************************************************************/
+static uint64 nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+    {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fprintf(stderr, "cannot pin to cpu %d\n", cpu);
+    }
+}
+
+/* Called on every failed try of a wait loop */
+static void spin(uint32 *tries)
+{
+    if (++*tries >= SPIN_LIMIT)
+    {
+        *tries = 0;
+        sched_yield();
+    }
+}
+
+static int compareU64(const void *a, const void *b)
+{
+    uint64 x = *(const uint64 *)a, y = *(const uint64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Core 1 of the throughput run: pops g_count jobs and checks their sequence */
+static void *throughputConsumer(void *arg)
+{
+    uint32 expect = 0, tries = 0;
+
+    (void)arg;
+    pin(g_cpu1);
+    while (expect < g_count)
+    {
+        ecu_job_msg *m = SPSC_READ_SLOT(&g_jobRing);
+        if (m == NULL)
+        {
+            spin(&tries);
+            continue;
+        }
+        if (m->y[0] != expect || m->y[11] != ~expect)
+        {
+            g_errors++;
+        }
+        SPSC_POP(&g_jobRing);
+        expect++;
+    }
+    return NULL;
+}
+
+/* Core 1 of the round trip run: answers every job with a command */
+static void *rttResponder(void *arg)
+{
+    uint32 done = 0, tries = 0;
+
+    (void)arg;
+    pin(g_cpu1);
+    while (done < g_count)
+    {
+        ecu_job_msg *m = SPSC_READ_SLOT(&g_jobRing);
+        ecu_act_msg *a;
+        if (m == NULL)
+        {
+            spin(&tries);
+            continue;
+        }
+        while ((a = SPSC_WRITE_SLOT(&g_actRing)) == NULL)
+        {
+            spin(&tries);
+        }
+        a->data[0] = m->y[0];
+        a->data[1] = m->y[1];
+        a->tx = m->task;
+        SPSC_POP(&g_jobRing);
+        SPSC_PUSH(&g_actRing);
+        done++;
+    }
+    return NULL;
+}
+
+/* Core 1 of the snapshot run: the writer, like the CAN RX ISR */
+static void *snapshotWriter(void *arg)
+{
+    uint32 v = 0;
+    int k;
+
+    (void)arg;
+    pin(g_cpu1);
+    while (!g_stop)
+    {
+        v++;
+        SEQLOCK_WRITE_BEGIN(&g_sensors);
+        for (k = 0; k < 12; k++)
+        {
+            g_sensors.v.y[k] = v;
+        }
+        g_sensors.stamp = v;
+        SEQLOCK_WRITE_END(&g_sensors);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    uint32 n = 10000000, rtt = 1000000, snap = 10000000, k, tries = 0;
+    uint64 retries = 0, torn = 0;
+    int cpu0 = 0, a;
+    pthread_t thread;
+    uint64 t0, t1, *lat;
+
+    for (a = 1; a + 1 < argc; a += 2)
+    {
+        if (strcmp(argv[a], "-n") == 0)
+        {
+            n = (uint32)strtoul(argv[a + 1], NULL, 0);
+        }
+        else if (strcmp(argv[a], "-rtt") == 0)
+        {
+            rtt = (uint32)strtoul(argv[a + 1], NULL, 0);
+        }
+        else if (strcmp(argv[a], "-snap") == 0)
+        {
+            snap = (uint32)strtoul(argv[a + 1], NULL, 0);
+        }
+        else if (strcmp(argv[a], "-cpu0") == 0)
+        {
+            cpu0 = atoi(argv[a + 1]);
+        }
+        else if (strcmp(argv[a], "-cpu1") == 0)
+        {
+            g_cpu1 = atoi(argv[a + 1]);
+        }
+    }
+    pin(cpu0);
+
+    /* throughput */
+    g_count = n;
+    pthread_create(&thread, NULL, throughputConsumer, NULL);
+    t0 = nowNs();
+    for (k = 0; k < n; k++)
+    {
+        ecu_job_msg *m;
+        while ((m = SPSC_WRITE_SLOT(&g_jobRing)) == NULL)
+        {
+            spin(&tries);
+        }
+        m->y[0] = k;
+        m->y[11] = ~k;
+        m->task = (uint8)(k & 1);
+        SPSC_PUSH(&g_jobRing);
+    }
+    pthread_join(thread, NULL);
+    t1 = nowNs();
+    printf("throughput: %u jobs of %u bytes in %.3f s, %.1f Mjobs/s, %d out of order\n", n,
+           (unsigned)sizeof(ecu_job_msg), (t1 - t0) * 1e-9, n / ((t1 - t0) * 1e-3), g_errors);
+
+    /* round trip */
+    lat = (uint64 *)malloc(sizeof(uint64) * (rtt ? rtt : 1));
+    if (lat == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+    g_count = rtt;
+    pthread_create(&thread, NULL, rttResponder, NULL);
+    for (k = 0; k < rtt; k++)
+    {
+        ecu_job_msg *m;
+        ecu_act_msg *r;
+        t0 = nowNs();
+        while ((m = SPSC_WRITE_SLOT(&g_jobRing)) == NULL)
+        {
+            spin(&tries);
+        }
+        m->y[0] = k;
+        m->task = 1;
+        SPSC_PUSH(&g_jobRing);
+        while ((r = SPSC_READ_SLOT(&g_actRing)) == NULL)
+        {
+            spin(&tries);
+        }
+        if (r->data[0] != k)
+        {
+            g_errors++;
+        }
+        SPSC_POP(&g_actRing);
+        lat[k] = nowNs() - t0;
+    }
+    pthread_join(thread, NULL);
+    if (rtt > 0)
+    {
+        qsort(lat, rtt, sizeof(uint64), compareU64);
+        printf("round trip: %u jobs, p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns, %d errors\n", rtt,
+               (unsigned long long)lat[rtt / 2], (unsigned long long)lat[(uint64)rtt * 99 / 100],
+               (unsigned long long)lat[(uint64)rtt * 999 / 1000], (unsigned long long)lat[rtt - 1], g_errors);
+    }
+    free(lat);
+
+    /* snapshots */
+    pthread_create(&thread, NULL, snapshotWriter, NULL);
+    t0 = nowNs();
+    for (k = 0; k < snap; k++)
+    {
+        SensorVec copy;
+        uint64 stamp;
+        uint32 seq;
+        int e;
+        seq = SEQLOCK_READ_BEGIN(&g_sensors);
+        copy = g_sensors.v;
+        stamp = g_sensors.stamp;
+        while (SEQLOCK_READ_RETRY(&g_sensors, seq))
+        {
+            retries++;
+            seq = SEQLOCK_READ_BEGIN(&g_sensors);
+            copy = g_sensors.v;
+            stamp = g_sensors.stamp;
+        }
+        for (e = 1; e < 12; e++)
+        {
+            if (copy.y[e] != copy.y[0])
+            {
+                break;
+            }
+        }
+        if (e < 12 || stamp != copy.y[0])
+        {
+            torn++;
+        }
+    }
+    t1 = nowNs();
+    g_stop = 1;
+    pthread_join(thread, NULL);
+    printf("snapshots: %u copies in %.3f s, %.0f ns per copy, %llu retries, %llu torn\n", snap, (t1 - t0) * 1e-9,
+           snap ? (double)(t1 - t0) / snap : 0, (unsigned long long)retries, (unsigned long long)torn);
+    return (g_errors || torn) ? 1 : 0;
+}
@@ -0,0 +1,529 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include "obfuscation.h"
+#include "can_trace.h"
+#include "can_frame.h"
+#include "event_ring.h"
+
+/** Benchmark of the analyzer on synthetic traces
+    obfuscation -bench [-frames 1e4,1e5,1e6] [-cands 4,16,64,256] [-skip 0,0.2]
+                           [-passes 3] [-seed 1] [-csv] [-events <list>] [-dir bench_work] [-json bench.json]
+For every combination of frame count, candidate count and skip density a
+trace is generated from the seed alone: the candidate IDs of a 1 s hyper
+period plus background IDs up to ~55% bus load, scheduled by CAN priority with
+release jitter. Skip density is the share of candidate instances skipped by
+their pattern; skipped instances are not sent. The phases of obfuscation's
+main loop are timed separately:
+    parse    InitializeCANTrafficBinary of the .hnst trace
+    parse_csv  InitializeCANTraffic of the same trace as SampleTwo.csv (-csv)
+    index    BuildBusyPeriodIndex
+    analyze  ArbitrateTrace and AnalyzeCANTraffic, summed over the passes
+    sort     MarkAttackable and SortInstances, summed over the passes
+    policy   ApplyObfuscationPolicies, summed over the passes
+    output   SaveFinalCandidatesCSV
+Rates are trace frames per second of the phase, and bytes per second of its
+input (the trace file for parsing, 24 bytes per frame for the analysis, the
+CSV written for output). The work files go to -dir; -json writes all runs
+for regression tracking. Frame times are float in struct Message, so traces
+longer than ~1e6 frames (~4 min at 500 kbps) lose sub-frame resolution.
+**/
+
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_IDS 1024
+#define BENCH_HP_MS 1000
+
+enum { PH_PARSE, PH_PARSE_CSV, PH_INDEX, PH_ANALYZE, PH_SORT, PH_POLICY, PH_OUTPUT, PH_COUNT };
+static const char *phaseNames[PH_COUNT] = {"parse", "parse_csv", "index", "analyze", "sort", "policy", "output"};
+
+static const int benchPeriods[] = {10, 20, 25, 50, 100, 200, 250, 500, 1000}; // ms, divide the hyper period
+#define BENCH_PERIOD_COUNT (int)(sizeof(benchPeriods) / sizeof(int))
+
+struct BenchID
+{
+    int ID;
+    int periodMs;
+    int DLC;
+    int cand; // index in the candidates, -1 for background traffic
+    double offset;
+    double release;
+    long k;
+};
+
+struct BenchRun
+{
+    long frames;
+    int cands;
+    float skip;
+    int ids;
+    long instances, attackable, swaps;
+    double traceBytes, csvBytes, outBytes;
+    double seconds[PH_COUNT];
+    double bytes[PH_COUNT];
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// splitmix64, like dataset_gen.c
+static uint64_t BenchNext(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double BenchUniform(uint64_t *s)
+{
+    return (BenchNext(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int BenchPick(uint64_t *s, int n)
+{
+    return (int)(BenchUniform(s) * n);
+}
+
+static int ParseList(const char *arg, double *list)
+{
+    char buf[256], *tok;
+    int n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok(buf, ","); tok && n < BENCH_MAX_LIST; tok = strtok(NULL, ","))
+        list[n++] = atof(tok);
+    return n;
+}
+
+// Binary heap of message indices, ordered by key[]
+struct BenchHeap
+{
+    int *item;
+    int n;
+};
+
+static int HeapLess(const double *key, const struct BenchID *ids, int a, int b)
+{
+    if (key)
+        return key[a] < key[b] || (key[a] == key[b] && a < b);
+    return ids[a].ID < ids[b].ID;
+}
+
+static void HeapPush(struct BenchHeap *hp, const double *key, const struct BenchID *ids, int v)
+{
+    int i = hp->n++, parent = 0;
+
+    hp->item[i] = v;
+    while (i > 0 && HeapLess(key, ids, hp->item[i], hp->item[parent = (i - 1) / 2]))
+    {
+        hp->item[i] = hp->item[parent];
+        hp->item[parent] = v;
+        i = parent;
+    }
+}
+
+static int HeapPop(struct BenchHeap *hp, const double *key, const struct BenchID *ids)
+{
+    int top = hp->item[0], i = 0, c = 0, v = hp->item[--hp->n];
+
+    while ((c = 2 * i + 1) < hp->n)
+    {
+        if (c + 1 < hp->n && HeapLess(key, ids, hp->item[c + 1], hp->item[c]))
+            c++;
+        if (!HeapLess(key, ids, hp->item[c], v))
+            break;
+        hp->item[i] = hp->item[c];
+        i = c;
+    }
+    hp->item[i] = v;
+    return top;
+}
+
+static int CompareBenchID(const void *a, const void *b)
+{
+    const struct BenchID *x = (const struct BenchID *)a, *y = (const struct BenchID *)b;
+
+    if (x->periodMs != y->periodMs)
+        return x->periodMs - y->periodMs;
+    return x->ID - y->ID;
+}
+
+static int AddID(uint64_t *s, struct BenchID *ids, int n, int minPeriodMs, int DLC)
+{
+    int j = 0, ID = 0, p = 0;
+
+    do {
+        ID = 0x10 + BenchPick(s, 0x7F0 - 0x10);
+        for (j = 0; j < n && ids[j].ID != ID; j++)
+            ;
+    } while (j < n);
+    do
+        p = benchPeriods[BenchPick(s, BENCH_PERIOD_COUNT)];
+    while (p < minPeriodMs);
+    ids[n].ID = ID;
+    ids[n].periodMs = p;
+    ids[n].DLC = DLC;
+    ids[n].cand = -1;
+    ids[n].offset = BenchUniform(s) * p * 1e-3;
+    ids[n].release = ids[n].offset;
+    ids[n].k = 0;
+    return n + 1;
+}
+
+/** Builds the candidates and writes a trace of run->frames frames to trace.hnst
+(and SampleTwo.csv with writeCsv). Returns the number of candidates, -1 on error.
+**/
+static int GenerateBenchTrace(struct BenchRun *run, uint64_t seed, int writeCsv, struct Message **candidates,
+                              int **skipLimits)
+{
+    uint64_t s = seed ^ ((uint64_t)run->frames * 0x100000001B3ULL) ^ ((uint64_t)run->cands << 40)
+                 ^ (uint64_t)(run->skip * 1e6);
+    struct BenchID ids[BENCH_MAX_IDS];
+    struct BenchHeap releases, pending;
+    struct TraceRecord r;
+    struct Message *c;
+    double *relKey, now = 0, load = 0, bitTime = 1.0 / (busSpeed * 1000), minPeriod = 0;
+    int n = 0, i = 0, j = 0, b = 0, m = 0, last = 0;
+    long f = 0;
+    FILE *fp, *csv = NULL;
+
+    BenchNext(&s);
+    // Candidates: all DLC 8, together at most 40% of the bus
+    minPeriod = run->cands * 111 * bitTime / 0.4 * 1e3;
+    for (i = 0; i < run->cands && n < BENCH_MAX_IDS; i++)
+        n = AddID(&s, ids, n, (int)ceil(minPeriod), 8);
+    qsort(ids, n, sizeof(struct BenchID), CompareBenchID);
+    for (i = 0; i < n; i++)
+        load += 111 * bitTime / (ids[i].periodMs * 1e-3);
+    while (load < 0.55 && n < BENCH_MAX_IDS)
+    {
+        n = AddID(&s, ids, n, 10, BenchPick(&s, 9));
+        load += (ids[n-1].DLC * 8 + 47) * bitTime / (ids[n-1].periodMs * 1e-3);
+    }
+    run->ids = n;
+
+    // Candidates ordered by period like ECUIDs, with a skip pattern that never skips twice in a row
+    c = (struct Message *)calloc(run->cands, sizeof(struct Message));
+    *skipLimits = (int *)calloc(run->cands, sizeof(int));
+    for (i = 0; i < run->cands; i++)
+    {
+        ids[i].cand = i;
+        c[i].ID = ids[i].ID;
+        c[i].periodicity = ids[i].periodMs * 1e-3;
+        c[i].count = BENCH_HP_MS / ids[i].periodMs;
+        c[i].instances = (struct Instance *)calloc(c[i].count, sizeof(struct Instance));
+        c[i].sortedASP = (int *)calloc(c[i].count, sizeof(int));
+        c[i].pattern = (int *)calloc(c[i].count, sizeof(int));
+        c[i].skipLimit = 1 + BenchPick(&s, 3);
+        (*skipLimits)[i] = c[i].skipLimit;
+        for (j = 0, last = 1; j < c[i].count; j++)
+        {
+            c[i].instances[j].index = j;
+            c[i].pattern[j] = !(last && BenchUniform(&s) < run->skip);
+            last = c[i].pattern[j];
+        }
+        run->instances += c[i].count;
+    }
+    *candidates = c;
+
+    fp = TraceCreate("trace.hnst", (uint32_t)busSpeed, 0);
+    if (!fp)
+        return -1;
+    if (writeCsv && !(csv = fopen("SampleTwo.csv", "w"))) {
+        perror("SampleTwo.csv");
+        fclose(fp);
+        return -1;
+    }
+    if (csv)
+        fprintf(csv, "Chn,Identifier,DLC,D0,D1,D2,D3,D4,D5,D6,D7,Time,Dir\n");
+    relKey = (double *)malloc(sizeof(double) * n);
+    releases.item = (int *)malloc(sizeof(int) * n);
+    pending.item = (int *)malloc(sizeof(int) * n * 4);
+    releases.n = pending.n = 0;
+    for (i = 0; i < n; i++)
+    {
+        relKey[i] = ids[i].release;
+        HeapPush(&releases, relKey, ids, i);
+    }
+    while (f < run->frames)
+    {
+        if (pending.n == 0 && relKey[releases.item[0]] > now)
+            now = relKey[releases.item[0]];
+        // Everything released by now competes for the bus
+        while (releases.n > 0 && relKey[releases.item[0]] <= now)
+        {
+            m = HeapPop(&releases, relKey, ids);
+            if ((ids[m].cand < 0 || c[ids[m].cand].pattern[ids[m].k % c[ids[m].cand].count])
+                && pending.n < n * 4)
+                HeapPush(&pending, NULL, ids, m);
+            ids[m].k++;
+            relKey[m] = ids[m].offset + ids[m].k * ids[m].periodMs * 1e-3
+                        + BenchUniform(&s) * 0.02 * ids[m].periodMs * 1e-3;
+            HeapPush(&releases, relKey, ids, m);
+        }
+        if (pending.n == 0)
+            continue;
+        m = HeapPop(&pending, NULL, ids);
+        memset(&r, 0, sizeof(r));
+        r.tNs = (uint64_t)llround(now * 1e9);
+        r.ID = ids[m].ID;
+        r.DLC = ids[m].DLC;
+        for (b = 0; b < r.DLC; b++)
+            r.data[b] = (uint8_t)BenchNext(&s);
+        fwrite(&r, sizeof(r), 1, fp);
+        if (csv)
+            fprintf(csv, "0,%X,%d,%X,%X,%X,%X,%X,%X,%X,%X,%.6f,R\n", r.ID, r.DLC, r.data[0], r.data[1], r.data[2],
+                    r.data[3], r.data[4], r.data[5], r.data[6], r.data[7], now);
+        now += CANFrameBits(r.ID, 0, r.DLC, r.data) * bitTime;
+        f++;
+    }
+    TraceFinish(fp, 0, f, 0, 0);
+    if (csv)
+        fclose(csv);
+    free(relKey);
+    free(releases.item);
+    free(pending.item);
+    return run->cands;
+}
+
+static double FileBytes(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 ? (double)st.st_size : 0;
+}
+
+static void FreeCandidates(struct Message *c, int count)
+{
+    int i = 0, j = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < c[i].count; j++)
+        {
+            free(c[i].instances[j].atkWin);
+            free(c[i].instances[j].insWin);
+        }
+        free(c[i].instances);
+        free(c[i].sortedASP);
+        free(c[i].pattern);
+    }
+    free(c);
+}
+
+static int RunBench(struct BenchRun *run, uint64_t seed, int passes, int withCsv)
+{
+    struct Message *candidates = NULL, *traffic = NULL, *arb = NULL;
+    struct BusyPeriodIndex idx;
+    int *skipLimits = NULL, *prio = NULL, count = 0, p = 0, i = 0, j = 0;
+    double t = 0;
+
+    if (GenerateBenchTrace(run, seed, withCsv, &candidates, &skipLimits) < 0)
+        return -1;
+    // The analysis reads the ECU configuration from globals
+    ECUCount = run->cands;
+    h = BENCH_HP_MS / 1000;
+    testID = -1;
+    run->traceBytes = FileBytes("trace.hnst");
+
+    t = NowSec();
+    count = InitializeCANTrafficBinary("trace.hnst", &traffic);
+    run->seconds[PH_PARSE] = NowSec() - t;
+    run->bytes[PH_PARSE] = run->traceBytes;
+    if (withCsv)
+    {
+        struct Message *csvTraffic = NULL;
+        run->csvBytes = FileBytes("SampleTwo.csv");
+        t = NowSec();
+        InitializeCANTraffic(&csvTraffic);
+        run->seconds[PH_PARSE_CSV] = NowSec() - t;
+        run->bytes[PH_PARSE_CSV] = run->csvBytes;
+        free(csvTraffic);
+    }
+
+    t = NowSec();
+    if (BuildBusyPeriodIndex(traffic, count, &idx) != 0)
+        return -1;
+    run->seconds[PH_INDEX] = NowSec() - t;
+    prio = (int *)calloc(idx.idCount + 1, sizeof(int));
+    arb = (struct Message *)calloc(count + 1, sizeof(struct Message));
+    if (!prio || !arb)
+        return -1;
+    IdentityPriority(&idx, prio);
+    SetAnalysisPriority(&idx, prio);
+
+    for (p = 0; p < passes; p++)
+    {
+        t = NowSec();
+        ArbitrateTrace(traffic, count, &idx, prio, arb);
+        AnalyzeCANTraffic(arb, count, &candidates, NULL);
+        run->seconds[PH_ANALYZE] += NowSec() - t;
+        t = NowSec();
+        MarkAttackable(candidates, run->cands);
+        SortInstances(candidates, run->cands);
+        run->seconds[PH_SORT] += NowSec() - t;
+        t = NowSec();
+        run->swaps += ApplyObfuscationPolicies(candidates, run->cands, skipLimits, &idx, prio);
+        run->seconds[PH_POLICY] += NowSec() - t;
+    }
+    SetAnalysisPriority(NULL, NULL);
+    for (i = PH_INDEX; i <= PH_POLICY; i++)
+        run->bytes[i] = (double)count * sizeof(struct TraceRecord) * (i == PH_INDEX ? 1 : passes);
+    for (i = 0; i < run->cands; i++)
+        for (j = 0; j < candidates[i].count; j++)
+            run->attackable += candidates[i].instances[j].attackable;
+
+    t = NowSec();
+    SaveFinalCandidatesCSV(candidates, run->cands);
+    run->seconds[PH_OUTPUT] = NowSec() - t;
+    run->outBytes = run->bytes[PH_OUTPUT] = FileBytes("final_candidates.csv");
+
+    FreeBusyPeriodIndex(&idx);
+    FreeCandidates(candidates, run->cands);
+    free(traffic);
+    free(arb);
+    free(prio);
+    free(skipLimits);
+    return 0;
+}
+
+// Frames per second of a phase; the analysis phases see the trace once per pass
+static double PhaseRate(const struct BenchRun *run, int phase, int passes)
+{
+    return run->frames * (phase >= PH_ANALYZE && phase <= PH_POLICY ? passes : 1) / run->seconds[phase];
+}
+
+static void WriteJson(const char *path, struct BenchRun *runs, int n, uint64_t seed, int passes)
+{
+    FILE *fp = fopen(path, "w");
+    int r = 0, p = 0, first = 0;
+
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    fprintf(fp, "{\n  \"benchmark\": \"analyzer_bench\",\n  \"seed\": %llu,\n  \"passes\": %d,\n"
+            "  \"bus_speed_kbps\": %.0f,\n  \"exact_frame_bits\": %d,\n  \"event_mask\": %u,\n  \"runs\": [\n",
+            (unsigned long long)seed, passes, busSpeed, exactFrameBits, eventMask);
+    for (r = 0; r < n; r++)
+    {
+        fprintf(fp, "    {\"frames\": %ld, \"candidates\": %d, \"skip\": %.3f, \"ids\": %d, \"instances\": %ld, "
+                "\"attackable\": %ld, \"swaps\": %ld, \"trace_bytes\": %.0f, \"output_bytes\": %.0f,\n"
+                "     \"phases\": {", runs[r].frames, runs[r].cands, runs[r].skip, runs[r].ids, runs[r].instances,
+                runs[r].attackable, runs[r].swaps, runs[r].traceBytes, runs[r].outBytes);
+        for (p = 0, first = 1; p < PH_COUNT; p++)
+        {
+            if (runs[r].seconds[p] <= 0)
+                continue;
+            fprintf(fp, "%s\n       \"%s\": {\"seconds\": %.6f, \"frames_per_s\": %.1f, \"bytes_per_s\": %.1f}",
+                    first ? "" : ",", phaseNames[p], runs[r].seconds[p],
+                    PhaseRate(&runs[r], p, passes),
+                    runs[r].bytes[p] / runs[r].seconds[p]);
+            first = 0;
+        }
+        fprintf(fp, "}}%s\n", r < n - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    printf("Results saved to %s\n", path);
+}
+
+int RunAnalyzerBench(int argc, char **argv)
+{
+    double frames[BENCH_MAX_LIST] = {1e4, 1e5, 1e6}, cands[BENCH_MAX_LIST] = {4, 16, 64, 256};
+    double skips[BENCH_MAX_LIST] = {0, 0.2};
+    int nFrames = 3, nCands = 4, nSkips = 2, passes = 3, withCsv = 0, a = 0, f = 0, c = 0, k = 0, n = 0, p = 0;
+    const char *jsonPath = NULL, *dir = "bench_work";
+    uint64_t seed = 1;
+    struct BenchRun *runs;
+    char cwd[4096];
+
+    for (a = 2; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-csv") == 0)
+            withCsv = 1;
+        else if (a + 1 >= argc)
+            break;
+        else if (strcmp(argv[a], "-frames") == 0)
+            nFrames = ParseList(argv[++a], frames);
+        else if (strcmp(argv[a], "-cands") == 0)
+            nCands = ParseList(argv[++a], cands);
+        else if (strcmp(argv[a], "-skip") == 0)
+            nSkips = ParseList(argv[++a], skips);
+        else if (strcmp(argv[a], "-passes") == 0)
+            passes = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-seed") == 0)
+            seed = strtoull(argv[++a], NULL, 10);
+        else if (strcmp(argv[a], "-events") == 0)
+            eventMask = ParseEventMask(argv[++a]);
+        else if (strcmp(argv[a], "-dir") == 0)
+            dir = argv[++a];
+        else if (strcmp(argv[a], "-json") == 0)
+            jsonPath = argv[++a];
+    }
+    // Results are written relative to where the benchmark was started
+    if (!getcwd(cwd, sizeof(cwd)))
+        cwd[0] = 0;
+    if (MakeDir(dir) != 0) {
+        perror(dir);
+        return 1;
+    }
+    if (chdir(dir) != 0) {
+        perror(dir);
+        return 1;
+    }
+
+    runs = (struct BenchRun *)calloc(nFrames * nCands * nSkips, sizeof(struct BenchRun));
+    for (f = 0; f < nFrames; f++)
+        for (c = 0; c < nCands; c++)
+            for (k = 0; k < nSkips; k++)
+            {
+                struct BenchRun *run = &runs[n];
+                run->frames = (long)frames[f];
+                run->cands = (int)cands[c];
+                run->skip = (float)skips[k];
+                if (RunBench(run, seed, passes, withCsv) != 0) {
+                    printf("run %ld frames, %d candidates failed\n", run->frames, run->cands);
+                    memset(run, 0, sizeof(*run));
+                    continue;
+                }
+                n++;
+            }
+
+    // The analysis prints as it goes, so the table comes after all runs
+    printf("\n%10s %5s %5s %5s |", "frames", "cands", "skip", "IDs");
+    for (p = 0; p < PH_COUNT; p++)
+        if (p != PH_PARSE_CSV || withCsv)
+            printf(" %10s", phaseNames[p]);
+    printf("   (frames/s, output bytes/s)\n");
+    for (a = 0; a < n; a++)
+    {
+        printf("%10ld %5d %5.2f %5d |", runs[a].frames, runs[a].cands, runs[a].skip, runs[a].ids);
+        for (p = 0; p < PH_COUNT; p++)
+        {
+            if (p == PH_PARSE_CSV && !withCsv)
+                continue;
+            if (p == PH_OUTPUT)
+                printf(" %9.3gB", runs[a].bytes[p] / runs[a].seconds[p]);
+            else
+                printf(" %10.3g", PhaseRate(&runs[a], p, passes));
+        }
+        printf("\n");
+    }
+    if (cwd[0] && chdir(cwd) != 0)
+        perror(cwd);
+    if (jsonPath)
+        WriteJson(jsonPath, runs, n, seed, passes);
+    free(runs);
+    return 0;
+}
@@ -0,0 +1,314 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include "obfuscation.h"
+
+/** Bus load and per-ID statistics, collected frame by frame during the
+analysis pass so the trace is not scanned again.
+The load is the busy bus time (FrameBits of every frame) over a sliding window
+of loadWindow s. The window is a ring of loadStep s buckets with a running
+sum; a frame that crosses a bucket boundary is split between the two. At the
+end of every step the load of the window is appended to the time series.
+Per ID an open addressing table keeps the frame count, bus time and the
+inter-arrival mean and variance (Welford), so every frame costs O(1).
+A frame whose time stamp is not finite, goes back, or lies more than a window
+after the previous frame is left out (rejected), so one bad time stamp can't
+make the series run to it. A longer pause is taken once a second frame
+confirms it, and the series never goes beyond BUS_STATS_MAX_STEPS.
+**/
+
+float loadWindow = 1.0; // s
+float loadStep = 0.1; // s, resolution of bus_load.csv
+
+// Thresholds between the LOW/MEDIUM/HIGH captures of CANlog (measured load)
+static const double loadLevels[] = {0.45, 0.78};
+
+#define ID_SLOT_FREE (-1)
+#define BUS_STATS_MAX_STEPS (1L << 24) // about 19 days of 0.1 s steps, 64 MB of series
+
+const char *BusLoadLevel(double load)
+{
+    if (load < loadLevels[0])
+        return "LOW";
+    if (load < loadLevels[1])
+        return "MEDIUM";
+    return "HIGH";
+}
+
+int BusStatsInit(struct BusStats *stats)
+{
+    int i = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->buckets = (int)lround(loadWindow / loadStep);
+    if (stats->buckets < 1)
+        stats->buckets = 1;
+    stats->idCap = 256;
+    stats->jump = NAN;
+    stats->busy = (double *)calloc(stats->buckets, sizeof(double));
+    stats->ids = (struct IDStats *)malloc(sizeof(struct IDStats) * stats->idCap);
+    stats->seriesCap = 1024;
+    stats->series = (float *)malloc(sizeof(float) * stats->seriesCap);
+    if (!stats->busy || !stats->ids || !stats->series) {
+        FreeBusStats(stats);
+        return -1;
+    }
+    for (i = 0; i < stats->idCap; i++)
+        stats->ids[i].ID = ID_SLOT_FREE;
+    return 0;
+}
+
+void FreeBusStats(struct BusStats *stats)
+{
+    free(stats->busy);
+    free(stats->ids);
+    free(stats->series);
+    memset(stats, 0, sizeof(*stats));
+}
+
+static struct IDStats *FindID(struct IDStats *ids, int cap, int ID)
+{
+    unsigned int slot = ((unsigned int)ID * 2654435761u) & (cap - 1);
+
+    while (ids[slot].ID != ID && ids[slot].ID != ID_SLOT_FREE)
+        slot = (slot + 1) & (cap - 1);
+    return &ids[slot];
+}
+
+// Doubles the ID table, keeps it at most half full
+static int GrowIDs(struct BusStats *stats)
+{
+    struct IDStats *ids = (struct IDStats *)malloc(sizeof(struct IDStats) * stats->idCap * 2);
+    int i = 0;
+
+    if (!ids)
+        return -1;
+    for (i = 0; i < stats->idCap * 2; i++)
+        ids[i].ID = ID_SLOT_FREE;
+    for (i = 0; i < stats->idCap; i++)
+        if (stats->ids[i].ID != ID_SLOT_FREE)
+            *FindID(ids, stats->idCap * 2, stats->ids[i].ID) = stats->ids[i];
+    free(stats->ids);
+    stats->ids = ids;
+    stats->idCap *= 2;
+    return 0;
+}
+
+// Closes the current step: records the window load and drops the oldest bucket
+static void NextStep(struct BusStats *stats)
+{
+    long covered = stats->step + 1 < stats->buckets ? stats->step + 1 : stats->buckets;
+    float load = (float)(stats->windowBusy / (covered * loadStep));
+
+    if (stats->step == stats->seriesCap)
+    {
+        float *series = (float *)realloc(stats->series, sizeof(float) * stats->seriesCap * 2);
+        if (series) {
+            stats->series = series;
+            stats->seriesCap *= 2;
+        }
+    }
+    if (stats->step < stats->seriesCap)
+        stats->series[stats->step] = load;
+    if (load > stats->peak)
+        stats->peak = load;
+    stats->step++;
+    stats->windowBusy -= stats->busy[stats->step % stats->buckets];
+    stats->busy[stats->step % stats->buckets] = 0;
+}
+
+// 0 if the frame starting at start can't go into the series, see above
+static int AcceptTime(struct BusStats *stats, double start, double len)
+{
+    double jump = stats->jump;
+
+    stats->jump = NAN;
+    if (!isfinite(start))
+        return 0;
+    if (stats->frames == 0)
+        return 1;
+    if (start < stats->last)
+        return 0;
+    if (start > stats->last + loadWindow && !(start >= jump && start <= jump + loadWindow))
+    {
+        stats->jump = start;
+        return 0;
+    }
+    return (start + len - stats->origin) / loadStep < BUS_STATS_MAX_STEPS;
+}
+
+void BusStatsFrame(struct BusStats *stats, const struct Message *frame)
+{
+    double start = frame->txTime, len = FrameBits(frame) / (busSpeed * 1000), stepEnd = 0, part = 0;
+    struct IDStats *id;
+    double gap = 0, delta = 0;
+
+    if (!AcceptTime(stats, start, len)) {
+        stats->rejected++;
+        return;
+    }
+    if (stats->frames == 0)
+        stats->origin = floor(start / loadStep) * loadStep;
+    // A frame starting before the end of the previous one counts in the current step
+    stepEnd = stats->origin + (stats->step + 1) * (double)loadStep;
+    if (start < stepEnd - loadStep)
+        start = stepEnd - loadStep;
+    while (start + len > stepEnd)
+    {
+        part = stepEnd > start ? stepEnd - start : 0;
+        stats->busy[stats->step % stats->buckets] += part;
+        stats->windowBusy += part;
+        len -= part;
+        start += part;
+        NextStep(stats);
+        stepEnd = stats->origin + (stats->step + 1) * (double)loadStep;
+    }
+    stats->busy[stats->step % stats->buckets] += len;
+    stats->windowBusy += len;
+    stats->totalBusy += FrameBits(frame) / (busSpeed * 1000);
+    if (stats->frames == 0)
+        stats->first = frame->txTime;
+    stats->last = frame->txTime;
+    stats->frames++;
+
+    if (2 * (stats->idCount + 1) > stats->idCap && GrowIDs(stats) != 0)
+        return;
+    id = FindID(stats->ids, stats->idCap, frame->ID);
+    if (id->ID == ID_SLOT_FREE)
+    {
+        memset(id, 0, sizeof(*id));
+        id->ID = frame->ID;
+        stats->idCount++;
+    }
+    else if ((gap = frame->txTime - id->last) > 0)
+    {
+        id->gaps++;
+        delta = gap - id->gapMean;
+        id->gapMean += delta / id->gaps;
+        id->gapM2 += delta * (gap - id->gapMean);
+        if (gap > id->gapMax)
+            id->gapMax = gap;
+    }
+    id->frames++;
+    id->busy += FrameBits(frame) / (busSpeed * 1000);
+    id->last = frame->txTime;
+}
+
+static int CompareIDStats(const void *a, const void *b)
+{
+    return ((const struct IDStats *)a)->ID - ((const struct IDStats *)b)->ID;
+}
+
+/** Writes the load time series to loadPath (Time,Load,Level: end of the step
+and load of the window ending there) and the per-ID table to idPath. Rows of the
+target ECU's candidates also get their attackable instances, so load and
+attackability can be read side by side.
+**/
+int SaveBusStats(const struct BusStats *stats, struct Message *candidates, int candCount,
+                 const char *loadPath, const char *idPath)
+{
+    struct IDStats *ids;
+    double duration = stats->last - stats->first, mean = 0;
+    long s = 0;
+    int i = 0, n = 0, c = 0, attackable = 0, j = 0;
+    FILE *fp = fopen(loadPath, "w");
+
+    if (!fp) {
+        perror(loadPath);
+        return -1;
+    }
+    fprintf(fp, "Time,Load,Level\n");
+    for (s = 0; s < stats->step && s < stats->seriesCap; s++)
+        fprintf(fp, "%.3f,%.4f,%s\n", stats->origin + (s + 1) * (double)loadStep, stats->series[s],
+                BusLoadLevel(stats->series[s]));
+    fclose(fp);
+
+    fp = fopen(idPath, "w");
+    if (!fp) {
+        perror(idPath);
+        return -1;
+    }
+    ids = (struct IDStats *)malloc(sizeof(struct IDStats) * (stats->idCount + 1));
+    for (i = 0; i < stats->idCap; i++)
+        if (stats->ids[i].ID != ID_SLOT_FREE)
+            ids[n++] = stats->ids[i];
+    qsort(ids, n, sizeof(struct IDStats), CompareIDStats);
+    fprintf(fp, "ID,Frames,Share,Load,MeanPeriod,Jitter,MaxGap,Candidate,Attackable\n");
+    for (i = 0; i < n; i++)
+    {
+        fprintf(fp, "%d,%ld,%.4f,%.4f,%.6f,%.6f,%.6f,", ids[i].ID, ids[i].frames,
+                stats->totalBusy > 0 ? ids[i].busy / stats->totalBusy : 0.0,
+                duration > 0 ? ids[i].busy / duration : 0.0, ids[i].gapMean,
+                ids[i].gaps > 1 ? sqrt(ids[i].gapM2 / (ids[i].gaps - 1)) : 0.0, ids[i].gapMax);
+        for (c = 0; c < candCount && candidates[c].ID != ids[i].ID; c++)
+            ;
+        if (c < candCount)
+        {
+            attackable = 0;
+            for (j = 0; j < candidates[c].count; j++)
+                attackable += candidates[c].instances[j].attackable;
+            fprintf(fp, "1,%d/%d\n", attackable, candidates[c].count);
+        }
+        else
+            fprintf(fp, "0,\n");
+    }
+    fclose(fp);
+    free(ids);
+
+    mean = duration > 0 ? stats->totalBusy / duration : 0;
+    printf("\nBus load %.3f (%s), peak %.3f over %.1f s windows, %d IDs in %ld frames",
+           mean, BusLoadLevel(mean), stats->peak, loadWindow, stats->idCount, stats->frames);
+    if (stats->rejected)
+        printf("\n%ld frames left out for their time stamps", stats->rejected);
+    printf("\nBus load saved to %s, per-ID statistics to %s\n", loadPath, idPath);
+    return 0;
+}
+
+/** Feeds frames with bad time stamps (obfuscation -check): non-finite, the
+4.7e24 s of an uninitialised txTime, going back, and a lone jump ahead. They
+must be left out without growing the series; a pause confirmed by a second
+frame must be taken. Returns the number of failed checks.
+**/
+int BusStatsCheck(void)
+{
+    static const double bad[] = {4.7e24, NAN, INFINITY, -INFINITY, 0.05, 60.0};
+    struct BusStats stats;
+    struct Message frame;
+    int i = 0, failed = 0;
+
+    if (BusStatsInit(&stats) != 0)
+        return 1;
+    memset(&frame, 0, sizeof(frame));
+    frame.ID = 0x121;
+    frame.DLC = 8;
+    for (i = 0; i < 100; i++)
+    {
+        frame.txTime = i * 0.01;
+        BusStatsFrame(&stats, &frame);
+    }
+    for (i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++)
+    {
+        frame.txTime = bad[i];
+        BusStatsFrame(&stats, &frame);
+        frame.txTime = 1.0 + i * 0.01;
+        BusStatsFrame(&stats, &frame);
+    }
+    if (stats.rejected != 6 || stats.frames != 106 || stats.step > 11) {
+        printf("check: bad time stamps gave %ld rejected, %ld frames, %ld steps\n", stats.rejected, stats.frames,
+               stats.step);
+        failed++;
+    }
+    // 10 s without frames: the first frame after it waits for the second
+    frame.txTime = 11.06;
+    BusStatsFrame(&stats, &frame);
+    frame.txTime = 11.07;
+    BusStatsFrame(&stats, &frame);
+    if (stats.rejected != 7 || stats.frames != 107 || stats.step != 110) {
+        printf("check: a 10 s pause gave %ld rejected, %ld frames, %ld steps\n", stats.rejected, stats.frames,
+               stats.step);
+        failed++;
+    }
+    FreeBusStats(&stats);
+    return failed;
+}
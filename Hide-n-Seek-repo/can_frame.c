@@ -0,0 +1,201 @@
+#include<stdio.h>
+#include<string.h>
+#include "can_frame.h"
+#include "can_trace.h"
+
+int CANNominalBits(int flags, int DLC)
+{
+    if (DLC > 8)
+        DLC = 8;
+    if (flags & TRACE_FLAG_RTR)
+        DLC = 0;
+    return (flags & TRACE_FLAG_EFF ? 67 : 47) + DLC * 8;
+}
+
+struct BitStream
+{
+    uint16_t crc;
+    int bits; // bits on the wire so far, stuff bits included
+    int run; // length of the current run of equal bits
+    int last;
+};
+
+// Sends one bit: updates the CRC-15 and inserts a stuff bit after 5 equal bits
+static void PutBit(struct BitStream *s, int bit, int crc)
+{
+    if (crc)
+    {
+        int next = bit ^ ((s->crc >> 14) & 1);
+        s->crc = (uint16_t)((s->crc << 1) & 0x7FFF);
+        if (next)
+            s->crc ^= 0x4599;
+    }
+    s->bits++;
+    if (bit == s->last)
+        s->run++;
+    else {
+        s->last = bit;
+        s->run = 1;
+    }
+    if (s->run == 5)
+    {
+        // The stuff bit starts a new run of its own
+        s->bits++;
+        s->last = !bit;
+        s->run = 1;
+    }
+}
+
+static void PutBits(struct BitStream *s, uint32_t value, int n, int crc)
+{
+    while (n-- > 0)
+        PutBit(s, (value >> n) & 1, crc);
+}
+
+/** Bit by bit reference of CANFrameBits, straight from the frame layout **/
+int CANFrameBitsReference(uint32_t ID, int flags, int DLC, const uint8_t *data)
+{
+    struct BitStream s = {0, 0, 0, -1};
+    int rtr = (flags & TRACE_FLAG_RTR) != 0, i = 0, bytes = DLC > 8 ? 8 : DLC;
+
+    PutBit(&s, 0, 1); // SOF
+    if (flags & TRACE_FLAG_EFF)
+    {
+        PutBits(&s, (ID >> 18) & 0x7FF, 11, 1);
+        PutBits(&s, 3, 2, 1); // SRR, IDE
+        PutBits(&s, ID & 0x3FFFF, 18, 1);
+        PutBit(&s, rtr, 1);
+        PutBits(&s, 0, 2, 1); // r1, r0
+    }
+    else
+    {
+        PutBits(&s, ID & 0x7FF, 11, 1);
+        PutBit(&s, rtr, 1);
+        PutBits(&s, 0, 2, 1); // IDE, r0
+    }
+    PutBits(&s, DLC & 0xF, 4, 1);
+    for (i = 0; !rtr && i < bytes; i++)
+        PutBits(&s, data ? data[i] : 0, 8, 1);
+    PutBits(&s, s.crc, 15, 0);
+    return s.bits + CAN_TAIL_BITS;
+}
+
+/** Table driven version.
+The unstuffed frame from SOF to the end of the CRC is packed into bytes. The
+CRC-15 goes a byte per lookup in crcTable, plus the 3 (7 extended) bits of the
+last partial byte. Stuffing is a state machine over (last bit, run length
+1-4): stuffNext gives for every state and byte the state after the byte and
+the stuff bits inserted in it. The tail is padded with alternating bits,
+which can't complete a run of 5, so the whole frame goes a byte per lookup.
+**/
+static uint16_t crcTable[256];
+static uint8_t stuffNext[8][256]; // next state | stuff bits << 3
+static int tablesReady = 0;
+
+#define STUFF_IDLE (1 << 2) // recessive bus before the SOF
+
+// State = last bit * 4 + run length - 1
+static int StuffBit(int state, int bit, int *stuffs)
+{
+    int last = state >> 2, run = (state & 3) + 1;
+
+    if (bit != last)
+        return bit << 2;
+    if (++run == 5) {
+        (*stuffs)++;
+        return (!bit) << 2;
+    }
+    return (bit << 2) | (run - 1);
+}
+
+static void BuildTables(void)
+{
+    int i = 0, b = 0, state = 0, next = 0, stuffs = 0;
+    uint16_t c = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = (uint16_t)(i << 7);
+        for (b = 0; b < 8; b++)
+            c = (uint16_t)(((c << 1) ^ (c & 0x4000 ? 0x4599 : 0)) & 0x7FFF);
+        crcTable[i] = c;
+    }
+    for (state = 0; state < 8; state++)
+        for (i = 0; i < 256; i++)
+        {
+            stuffs = 0;
+            next = state;
+            for (b = 7; b >= 0; b--)
+                next = StuffBit(next, (i >> b) & 1, &stuffs);
+            stuffNext[state][i] = (uint8_t)(next | stuffs << 3);
+        }
+    tablesReady = 1;
+}
+
+/** Packs SOF..CRC into buf from the MSB of buf[0], padded to whole bytes.
+Returns the number of bytes, *bits gets the unpadded length.
+**/
+static int PackFrame(uint32_t ID, int flags, int DLC, const uint8_t *data, uint8_t *buf, int *bits)
+{
+    uint64_t acc = 0;
+    uint16_t crc = 0;
+    int rtr = (flags & TRACE_FLAG_RTR) != 0, bytes = rtr ? 0 : (DLC > 8 ? 8 : DLC);
+    int accBits = 0, len = 0, i = 0, pad = 0;
+
+    // SOF to DLC: 19 bits standard, 39 extended
+    if (flags & TRACE_FLAG_EFF) {
+        accBits = 39;
+        acc = (uint64_t)((ID >> 18) & 0x7FF) << 27 | 3ull << 25 | (uint64_t)(ID & 0x3FFFF) << 7 | rtr << 6 | (DLC & 0xF);
+    } else {
+        accBits = 19;
+        acc = (uint64_t)(ID & 0x7FF) << 7 | rtr << 6 | (DLC & 0xF);
+    }
+    *bits = accBits + 8 * bytes + 15;
+    for (; accBits >= 8; accBits -= 8)
+        buf[len++] = (uint8_t)(acc >> (accBits - 8));
+    for (i = 0; i < bytes; i++) {
+        acc = acc << 8 | (data ? data[i] : 0);
+        buf[len++] = (uint8_t)(acc >> accBits);
+    }
+
+    for (i = 0; i < len; i++)
+        crc = (uint16_t)(((crc << 8) & 0x7FFF) ^ crcTable[((crc >> 7) ^ buf[i]) & 0xFF]);
+    for (i = accBits - 1; i >= 0; i--)
+        crc = (uint16_t)(((crc << 1) & 0x7FFF) ^ (-(((acc >> i) ^ (crc >> 14)) & 1) & 0x4599));
+
+    acc = acc << 15 | crc;
+    for (accBits += 15; accBits >= 8; accBits -= 8)
+        buf[len++] = (uint8_t)(acc >> (accBits - 8));
+    if (accBits > 0)
+    {
+        // 0101.. after a 1, 1010.. after a 0
+        pad = ((acc & 1) ? 0x55 : 0xAA) >> accBits;
+        buf[len++] = (uint8_t)(acc << (8 - accBits) | pad);
+    }
+    return len;
+}
+
+int CANFrameBits(uint32_t ID, int flags, int DLC, const uint8_t *data)
+{
+    uint8_t buf[20];
+    int len = 0, bits = 0, i = 0, state = STUFF_IDLE, body = 0, stuffs = 0;
+
+    if (!tablesReady)
+        BuildTables();
+    len = PackFrame(ID, flags, DLC, data, buf, &bits);
+    for (i = 0; i < len; i++) {
+        body = stuffNext[state][buf[i]];
+        state = body & 7;
+        stuffs += body >> 3;
+    }
+    return bits + stuffs + CAN_TAIL_BITS;
+}
+
+uint32_t CANArbitrationKey(uint32_t ID, int flags)
+{
+    uint32_t rtr = (flags & TRACE_FLAG_RTR) != 0;
+
+    if (flags & TRACE_FLAG_EFF)
+        return ((ID >> 18) & 0x7FF) << 21 | 1u << 20 | 1u << 19 | (ID & 0x3FFFF) << 1 | rtr;
+    return (ID & 0x7FF) << 21 | rtr << 20;
+}
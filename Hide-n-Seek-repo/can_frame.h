@@ -0,0 +1,26 @@
+#ifndef CAN_FRAME_H
+#define CAN_FRAME_H
+
+#include<stdint.h>
+
+/** Bus time of classic CAN frames.
+The analyzer counts DLC*8+47 bits per standard frame: SOF, identifier, control,
+data, CRC, CRC delimiter, ACK, EOF and the 3 bit intermission. On the wire the
+transmitter also stuffs a complementary bit after 5 equal bits from SOF to the
+end of the CRC, so the real length depends on the ID and the payload.
+flags are the TRACE_FLAG_* bits of can_trace.h.
+**/
+
+#define CAN_TAIL_BITS 13 // CRC delimiter, ACK slot and delimiter, EOF, intermission: never stuffed
+
+int CANNominalBits(int flags, int DLC);
+int CANFrameBits(uint32_t ID, int flags, int DLC, const uint8_t *data);
+int CANFrameBitsReference(uint32_t ID, int flags, int DLC, const uint8_t *data);
+
+/** Arbitration field as an unsigned key: SOF, base ID, RTR/SRR, IDE, ID extension,
+RTR. Dominant bits are 0, so the frame with the smallest key wins the bitwise
+arbitration and equal keys transmit together.
+**/
+uint32_t CANArbitrationKey(uint32_t ID, int flags);
+
+#endif // CAN_FRAME_H
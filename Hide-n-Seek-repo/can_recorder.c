@@ -0,0 +1,219 @@
+#define _GNU_SOURCE // recvmmsg
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "can_trace.h"
+
+/** Capture recorder: SocketCAN -> binary trace (.hnst)
+    can_recorder <interface> <out.hnst> [ring frames, power of 2] [bitrate kbps]
+The capture thread only moves frames from recvmmsg batches into a large
+single-producer/single-consumer ring; a separate writer thread drains the
+ring with large fwrite calls, so a slow disk shows up as ring occupancy
+(backpressure) instead of kernel drops. Every loss is counted and stored in
+the trace header, where TraceOpen warns about it.
+**/
+
+#ifdef __linux__
+
+#include<signal.h>
+#include<time.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<sys/socket.h>
+#include<linux/can.h>
+
+#define REC_BATCH 64
+#define WRITE_CHUNK 4096 // records per fwrite
+#define DEFAULT_RING (1 << 20) // 24 MB, ~2 minutes of a saturated 1 Mbps bus
+
+struct Recorder
+{
+    struct TraceRecord *ring;
+    size_t mask;
+    _Atomic size_t head; // written by the capture thread
+    _Atomic size_t tail; // written by the writer thread
+    _Atomic int done;
+    FILE *fp;
+    // counters
+    uint64_t captured;
+    uint64_t droppedRing;
+    uint64_t droppedKernel;
+    uint64_t droppedWrite; // lost to a failed or short fwrite, writer thread only
+    uint64_t backpressure; // batches that found the ring more than 3/4 full
+    size_t maxFill;
+    _Atomic uint64_t written;
+    uint64_t writeCalls;
+};
+
+static volatile sig_atomic_t recStop = 0;
+
+static void RecStop(int sig)
+{
+    (void)sig;
+    recStop = 1;
+}
+
+static void *WriterThread(void *arg)
+{
+    struct Recorder *rec = (struct Recorder *)arg;
+    struct timespec nap = {0, 1000000};
+    size_t head = 0, tail = 0, n = 0, first = 0, w = 0;
+
+    while (1)
+    {
+        head = atomic_load_explicit(&rec->head, memory_order_acquire);
+        tail = atomic_load_explicit(&rec->tail, memory_order_relaxed);
+        if (head == tail) {
+            if (atomic_load(&rec->done))
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        // Write up to WRITE_CHUNK records, without wrapping inside one call
+        n = head - tail;
+        if (n > WRITE_CHUNK)
+            n = WRITE_CHUNK;
+        first = tail & rec->mask;
+        if (first + n > rec->mask + 1)
+            n = rec->mask + 1 - first;
+        // After a failed write the file is not extended any more, the header only counts what reached it
+        w = 0;
+        if (!rec->droppedWrite) {
+            w = fwrite(&rec->ring[first], sizeof(struct TraceRecord), n, rec->fp);
+            rec->writeCalls++;
+            if (w < n)
+                perror("can_recorder: write");
+        }
+        rec->droppedWrite += n - w;
+        atomic_fetch_add(&rec->written, w);
+        atomic_store_explicit(&rec->tail, tail + n, memory_order_release);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct Recorder rec;
+    struct mmsghdr msgs[REC_BATCH];
+    struct iovec iovs[REC_BATCH];
+    struct can_frame frames[REC_BATCH];
+    char ctrl[REC_BATCH][CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+    pthread_t writer;
+    struct TraceRecord *r;
+    uint64_t startNs = 0;
+    uint32_t kernelDrops = 0, kernelDrops0 = 0;
+    size_t ringSize = DEFAULT_RING, head = 0, tail = 0, fill = 0;
+    uint64_t t = 0;
+    int s = 0, n = 0, b = 0, bitrate = 500, haveDrops0 = 0;
+
+    if (argc < 3) {
+        printf("usage: %s <interface> <out.hnst> [ring frames] [bitrate kbps]\n", argv[0]);
+        return 1;
+    }
+    if (argc >= 4)
+        ringSize = strtoul(argv[3], NULL, 0);
+    if (argc >= 5)
+        bitrate = atoi(argv[4]);
+    if (ringSize < REC_BATCH || (ringSize & (ringSize - 1))) {
+        printf("ring size must be a power of 2 >= %d\n", REC_BATCH);
+        return 1;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.ring = (struct TraceRecord *)calloc(ringSize, sizeof(struct TraceRecord));
+    rec.mask = ringSize - 1;
+    s = OpenCANSocket(argv[1]);
+    if (!rec.ring || s < 0)
+        return 1;
+    rec.fp = TraceCreate(argv[2], bitrate, 0);
+    if (!rec.fp)
+        return 1;
+    setvbuf(rec.fp, NULL, _IOFBF, WRITE_CHUNK * sizeof(struct TraceRecord));
+    signal(SIGINT, RecStop);
+    signal(SIGTERM, RecStop);
+    pthread_create(&writer, NULL, WriterThread, &rec);
+    printf("Recording %s to %s (ring of %zu frames), Ctrl-C to stop\n", argv[1], argv[2], ringSize);
+
+    while (!recStop)
+    {
+        for (b = 0; b < REC_BATCH; b++)
+        {
+            iovs[b].iov_base = &frames[b];
+            iovs[b].iov_len = sizeof(struct can_frame);
+            memset(&msgs[b].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[b].msg_hdr.msg_iov = &iovs[b];
+            msgs[b].msg_hdr.msg_iovlen = 1;
+            msgs[b].msg_hdr.msg_control = ctrl[b];
+            msgs[b].msg_hdr.msg_controllen = sizeof(ctrl[b]);
+        }
+        n = recvmmsg(s, msgs, REC_BATCH, MSG_WAITFORONE, NULL);
+        if (n <= 0)
+            continue;
+
+        head = atomic_load_explicit(&rec.head, memory_order_relaxed);
+        tail = atomic_load_explicit(&rec.tail, memory_order_acquire);
+        fill = head - tail;
+        if (fill > rec.maxFill)
+            rec.maxFill = fill;
+        if (fill > ringSize / 4 * 3)
+            rec.backpressure++;
+        for (b = 0; b < n; b++)
+        {
+            t = CANRxTimestamp(&msgs[b].msg_hdr, &kernelDrops);
+            if (!haveDrops0) {
+                // the counter is cumulative over the socket's life
+                kernelDrops0 = kernelDrops;
+                haveDrops0 = 1;
+            }
+            if (startNs == 0)
+                startNs = t;
+            rec.captured++;
+            if (head - tail >= ringSize) {
+                rec.droppedRing++;
+                continue;
+            }
+            r = &rec.ring[head & rec.mask];
+            r->tNs = t - startNs;
+            r->flags = 0;
+            if (frames[b].can_id & CAN_EFF_FLAG) {
+                r->ID = frames[b].can_id & CAN_EFF_MASK;
+                r->flags |= TRACE_FLAG_EFF;
+            }
+            else
+                r->ID = frames[b].can_id & CAN_SFF_MASK;
+            if (frames[b].can_id & CAN_RTR_FLAG)
+                r->flags |= TRACE_FLAG_RTR;
+            r->DLC = frames[b].can_dlc;
+            r->reserved = 0;
+            memcpy(r->data, frames[b].data, 8);
+            head++;
+        }
+        atomic_store_explicit(&rec.head, head, memory_order_release);
+    }
+
+    atomic_store(&rec.done, 1);
+    pthread_join(writer, NULL);
+    rec.droppedKernel = kernelDrops - kernelDrops0;
+    // The header has no field of its own for write losses, they are lost in the recorder like ring drops
+    if (TraceFinish(rec.fp, startNs, atomic_load(&rec.written), rec.droppedRing + rec.droppedWrite, rec.droppedKernel) != 0)
+        perror(argv[2]);
+
+    printf("\nCaptured %llu frames, written %llu in %llu writes\n", (unsigned long long)rec.captured,
+           (unsigned long long)atomic_load(&rec.written), (unsigned long long)rec.writeCalls);
+    printf("Dropped: %llu ring full, %llu in kernel, %llu not written\n", (unsigned long long)rec.droppedRing,
+           (unsigned long long)rec.droppedKernel, (unsigned long long)rec.droppedWrite);
+    printf("Backpressure: %llu batches over 3/4 ring, max fill %zu of %zu\n",
+           (unsigned long long)rec.backpressure, rec.maxFill, ringSize);
+    free(rec.ring);
+    return rec.droppedRing || rec.droppedKernel || rec.droppedWrite ? 2 : 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    printf("can_recorder needs Linux SocketCAN\n");
+    return 1;
+}
+
+#endif // __linux__
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE // clock_nanosleep, sched_setscheduler
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "can_trace.h"
+
+/** Trace replayer: CANlog text logs, SampleTwo.csv or .hnst captures -> SocketCAN
+    can_replay <interface> <trace> [speedup] [loops]
+Every frame is sent at its original offset from the first frame divided by
+speedup (10 replays ten times faster than real time). The schedule is absolute
+on CLOCK_MONOTONIC so errors don't accumulate: the thread sleeps until
+SPIN_NS before the deadline and busy-polls the clock for the rest, since
+nanosleep alone overshoots by tens of microseconds. The lateness of every
+write (achieved - intended) is kept in a histogram and reported at the end,
+so a replay whose jitter is not small against a frame time can be discarded
+before its attack windows are trusted.
+**/
+
+#ifdef __linux__
+
+#include<errno.h>
+#include<signal.h>
+#include<time.h>
+#include<sched.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<linux/can.h>
+#include<linux/can/raw.h>
+
+#define SPIN_NS 100000 // busy-poll the last 100 us before a deadline
+#define ERR_BUCKET_NS 100 // histogram resolution
+#define ERR_BUCKETS 100000 // up to 10 ms, the rest goes to the last bucket
+#define MIN_FRAME_NS_1M 47000 // shortest standard frame (DLC 0, no stuffing) at 1 Mbps
+#define RETRY_NS 20000 // wait before writing again into a full socket queue
+
+static volatile sig_atomic_t replayStop = 0;
+
+static void ReplayStop(int sig)
+{
+    (void)sig;
+    replayStop = 1;
+}
+
+static uint64_t MonotonicNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void SleepUntilNs(uint64_t deadline)
+{
+    struct timespec ts;
+    uint64_t now = MonotonicNs();
+
+    if (deadline > now + SPIN_NS)
+    {
+        ts.tv_sec = (deadline - SPIN_NS) / 1000000000ull;
+        ts.tv_nsec = (deadline - SPIN_NS) % 1000000000ull;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !replayStop)
+            ;
+    }
+    while (MonotonicNs() < deadline)
+        ;
+}
+
+static double ErrorPercentile(const unsigned long *hist, unsigned long n, double p)
+{
+    unsigned long target = (unsigned long)(p * n), acc = 0;
+    int b = 0;
+
+    for (b = 0; b < ERR_BUCKETS; b++)
+    {
+        acc += hist[b];
+        if (acc > target)
+            return (b + 1) * ERR_BUCKET_NS * 1e-3;
+    }
+    return ERR_BUCKETS * ERR_BUCKET_NS * 1e-3;
+}
+
+int main(int argc, char **argv)
+{
+    struct TraceRecord *records = NULL;
+    struct can_frame frame;
+    struct sched_param sp;
+    unsigned long *hist;
+    uint64_t start = 0, intended = 0, achieved = 0, err = 0, maxErr = 0;
+    double speedup = 1, sumErr = 0;
+    long count = 0, i = 0, sent = 0, retries = 0, failed = 0, late = 0;
+    struct timespec retry;
+    int s = 0, loops = 1, loop = 0, ok = 0;
+
+    if (argc < 3) {
+        printf("usage: %s <interface> <trace> [speedup] [loops]\n", argv[0]);
+        return 1;
+    }
+    if (argc >= 4)
+        speedup = atof(argv[3]);
+    if (argc >= 5)
+        loops = atoi(argv[4]);
+    if (speedup <= 0 || loops < 1) {
+        printf("speedup must be > 0 and loops >= 1\n");
+        return 1;
+    }
+    count = TraceLoad(argv[2], &records);
+    if (count <= 0) {
+        printf("No frames in %s\n", argv[2]);
+        return 1;
+    }
+    s = OpenCANSocket(argv[1]);
+    if (s < 0)
+        return 1;
+    // Send only: don't let the bus traffic pile up in the receive queue
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+
+    // Best effort: page faults and preemption are the main sources of late frames
+    sp.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+        printf("Running without SCHED_FIFO (needs CAP_SYS_NICE), expect a longer tail\n");
+    mlockall(MCL_CURRENT | MCL_FUTURE);
+    hist = (unsigned long *)calloc(ERR_BUCKETS, sizeof(unsigned long));
+    signal(SIGINT, ReplayStop);
+    printf("Replaying %ld frames (%.3f s) from %s on %s at %gx, %d time(s)\n", count,
+           records[count - 1].tNs * 1e-9, argv[2], argv[1], speedup, loops);
+
+    for (loop = 0; loop < loops && !replayStop; loop++)
+    {
+        start = MonotonicNs() + 1000000; // 1 ms to get on the first deadline
+        for (i = 0; i < count && !replayStop; i++)
+        {
+            memset(&frame, 0, sizeof(frame));
+            frame.can_id = records[i].ID;
+            if (records[i].flags & TRACE_FLAG_EFF)
+                frame.can_id |= CAN_EFF_FLAG;
+            if (records[i].flags & TRACE_FLAG_RTR)
+                frame.can_id |= CAN_RTR_FLAG;
+            frame.can_dlc = records[i].DLC;
+            memcpy(frame.data, records[i].data, 8);
+
+            intended = start + (uint64_t)(records[i].tNs / speedup);
+            SleepUntilNs(intended);
+            // The socket queue is full (slow real interface), retry instead of dropping. CAN sockets report
+            // POLLOUT while the device queue is still full, so wait a fixed time rather than spin under SCHED_FIFO.
+            ok = 1;
+            while (write(s, &frame, sizeof(frame)) != sizeof(frame))
+            {
+                if ((errno != ENOBUFS && errno != EAGAIN) || replayStop) {
+                    ok = 0;
+                    break;
+                }
+                retries++;
+                retry.tv_sec = 0;
+                retry.tv_nsec = RETRY_NS;
+                nanosleep(&retry, NULL);
+            }
+            // Only frames that went out count in the total and the timing statistics
+            if (!ok) {
+                failed += !replayStop;
+                continue;
+            }
+            achieved = MonotonicNs();
+            sent++;
+
+            err = achieved - intended;
+            sumErr += err;
+            if (err > maxErr)
+                maxErr = err;
+            // Later than a minimal frame at 1 Mbps would reorder arbitration
+            if (err > MIN_FRAME_NS_1M)
+                late++;
+            hist[err / ERR_BUCKET_NS < ERR_BUCKETS ? err / ERR_BUCKET_NS : ERR_BUCKETS - 1]++;
+        }
+    }
+    close(s);
+
+    printf("\nSent %ld frames, %ld write failures, %ld ENOBUFS retries\n", sent, failed, retries);
+    if (sent > 0)
+    {
+        printf("Timestamp error (achieved - intended): mean %.2f us, p50 %.1f us, p99 %.1f us, max %.2f us\n",
+               sumErr / sent * 1e-3, ErrorPercentile(hist, sent, 0.50), ErrorPercentile(hist, sent, 0.99),
+               maxErr * 1e-3);
+        printf("%ld frames (%.3f%%) later than one minimal frame (%d us at 1 Mbps)\n", late,
+               100.0 * late / sent, MIN_FRAME_NS_1M / 1000);
+    }
+    free(hist);
+    free(records);
+    return failed ? 2 : 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    printf("can_replay needs Linux SocketCAN\n");
+    return 1;
+}
+
+#endif // __linux__
@@ -0,0 +1,768 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include<limits.h>
+#include "can_trace.h"
+#include "can_frame.h"
+
+/** Discrete-event CAN bus simulator: ground truth for the analyzer.
+    can_sim (-log <trace> | -schedule <file>) [options]
+Every message is released periodically (offset + k*period + uniform jitter)
+into a single transmit mailbox of its ECU; a release that finds the previous
+instance still waiting replaces it (overrun). Whenever the bus is idle the
+pending frames arbitrate bitwise on CANArbitrationKey and the winner occupies
+the bus for its exact stuffed length (CANFrameBits); frames released during a
+transmission wait for the end of its intermission.
+
+For every instance of every message (index = release number mod instances
+per hyper period, like obfuscation.c) the simulator records the true attack
+window: the higher priority frames sent back to back right before it, in
+stuffed and in nominal bits, and how long it was blocked after its release.
+
+The attacker goes after one message: for every planned instance it waits for
+the nominal release (offset + k*period, the jitter is unknown to it), then
+for the start of a higher priority frame, and queues a frame with the target
+ID react bits later. If that frame and the target instance start together
+the attack succeeds (the corrupted frame is followed by a 20 bit error frame
+and the victim retransmits); if the attack frame goes out alone (the instance
+was skipped or released late) it is detected; if the target starts first the
+attempt is missed.
+
+Options:
+    -time <s>          simulated time, default 60
+    -hp <s>            hyper period, default 5 (h in obfuscation.c)
+    -bitrate <kbps>    default 500, or the bitrate of a .hnst capture
+    -jitter <ms>       release jitter of messages taken from -log, default 0
+    -seed <n>          jitter and payload randomness, default 1
+    -skip <ID>:<0/1..> transmission pattern of a message over the hyper period
+    -attack <ID>[:<0/1..>]  target and planned instances, default all
+    -react <bits>      attacker reaction time, default 111 (minAtkWinLen)
+    -trace <out.hnst>  the simulated traffic, for obfuscation -trace
+    -truth <out.csv>   per instance ground truth, default sim_truth.csv
+    -check <final_candidates.csv>  compare the analyzer's windows with the truth
+Schedule files have one message per line: ID period_ms offset_ms jitter_ms DLC
+[data bytes in hex]; IDs are read with strtol base 0 (0x1A1 or 417), IDs above
+0x7FF are extended.
+**/
+
+#define SIM_MAX_MSGS 2048
+#define SIM_HISTORY 1024 // frames kept of the current busy period
+#define SIM_ERROR_FRAME_BITS 20 // error flag, echo and delimiter after a collision
+
+struct SimInstance
+{
+    long released;
+    long sent;
+    long skipped;
+    long overruns;
+    int minWinBits; // stuffed bits of the shortest attack window seen
+    int minWinNominal; // the same frames counted with DLC*8+47
+    int minWinCount;
+    double sumWinBits;
+    int minBlockedBits;
+    long attempts;
+    long successes;
+    long detected;
+    long missed;
+};
+
+struct SimMessage
+{
+    uint32_t ID;
+    int flags;
+    int DLC;
+    uint8_t data[8];
+    double period, offset, jitter; // s
+    int bits; // stuffed length of the frame
+    uint32_t key;
+    int count; // instances per hyper period
+    char *pattern; // 1 = sent, 0 = skipped, NULL = always sent
+    long k; // release number of the next release
+    double release; // time of the next release
+    int pending;
+    int retransmit; // the pending instance lost a collision, its window is already recorded
+    long pendingK;
+    double releasedAt;
+    struct SimInstance *ins;
+};
+
+struct SimFrame
+{
+    uint32_t key;
+    int bits;
+    int nominal;
+};
+
+struct Simulator
+{
+    struct SimMessage *msgs;
+    int msgCount;
+    double bitTime;
+    double hp;
+    uint64_t rng;
+    int *events; // binary heap of messages by next release (plus the attacker)
+    int eventCount;
+    int *pending; // binary heap of pending messages by arbitration key
+    int pendingCount;
+    struct SimFrame history[SIM_HISTORY];
+    int historyCount;
+    double busFree;
+    // attacker, message index msgCount in the heaps
+    int target;
+    char *plan;
+    int react;
+    long armedK; // planned instance being attacked, -1 when none is left
+    double armedAt; // its nominal release
+    int queued; // the attack frame is released or waiting in the event heap
+    double attackRelease;
+    long frames, collisions;
+    FILE *trace;
+};
+
+static uint64_t SimRandom(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double SimUniform(uint64_t *s)
+{
+    return (SimRandom(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double EventTime(struct Simulator *sim, int m)
+{
+    return m == sim->msgCount ? sim->attackRelease : sim->msgs[m].release;
+}
+
+static uint32_t PendingKey(struct Simulator *sim, int m)
+{
+    return sim->msgs[m == sim->msgCount ? sim->target : m].key;
+}
+
+// Min-heaps of message indices, ordered by release time or arbitration key
+static int HeapLess(struct Simulator *sim, int *heap, int a, int b)
+{
+    if (heap == sim->events)
+        return EventTime(sim, heap[a]) < EventTime(sim, heap[b]);
+    // The attacker sorts after the target so ties show up together
+    if (PendingKey(sim, heap[a]) != PendingKey(sim, heap[b]))
+        return PendingKey(sim, heap[a]) < PendingKey(sim, heap[b]);
+    return heap[a] < heap[b];
+}
+
+static void HeapPush(struct Simulator *sim, int *heap, int *count, int m)
+{
+    int i = (*count)++, parent = 0, tmp = 0;
+
+    heap[i] = m;
+    while (i > 0 && HeapLess(sim, heap, i, parent = (i - 1) / 2))
+    {
+        tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static int HeapPop(struct Simulator *sim, int *heap, int *count)
+{
+    int top = heap[0], i = 0, child = 0, tmp = 0;
+
+    heap[0] = heap[--(*count)];
+    while ((child = 2 * i + 1) < *count)
+    {
+        if (child + 1 < *count && HeapLess(sim, heap, child + 1, child))
+            child++;
+        if (!HeapLess(sim, heap, child, i))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+    return top;
+}
+
+// Removes message m wherever it sits in the heap
+static void HeapRemove(struct Simulator *sim, int *heap, int *count, int m)
+{
+    int i = 0, parent = 0, tmp = 0;
+
+    for (i = 0; i < *count && heap[i] != m; i++)
+        ;
+    if (i == *count)
+        return;
+    // Float it to the top unconditionally, then pop it
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+    HeapPop(sim, heap, count);
+}
+
+static struct SimInstance *Instance(struct SimMessage *m, long k)
+{
+    return &m->ins[k % m->count];
+}
+
+// Next planned instance of the target after release number k
+static void ArmAttacker(struct Simulator *sim, long k)
+{
+    struct SimMessage *t = &sim->msgs[sim->target];
+    int n = 0;
+
+    for (n = 0; n < t->count; n++, k++)
+        if (!sim->plan || sim->plan[k % t->count] == '1')
+            break;
+    sim->armedK = n < t->count ? k : -1;
+    sim->armedAt = t->offset + k * t->period;
+}
+
+static void Release(struct Simulator *sim, int m, double now)
+{
+    struct SimMessage *msg = &sim->msgs[m];
+    struct SimInstance *ins = Instance(msg, msg->k);
+
+    ins->released++;
+    if (msg->pattern && msg->pattern[msg->k % msg->count] == '0')
+        ins->skipped++;
+    else if (msg->pending)
+    {
+        // Single mailbox: the waiting instance is lost
+        Instance(msg, msg->pendingK)->overruns++;
+        msg->pendingK = msg->k;
+        msg->retransmit = 0;
+        msg->releasedAt = now;
+    }
+    else
+    {
+        msg->pending = 1;
+        msg->pendingK = msg->k;
+        msg->releasedAt = now;
+        HeapPush(sim, sim->pending, &sim->pendingCount, m);
+    }
+    msg->k++;
+    msg->release = msg->offset + msg->k * msg->period + SimUniform(&sim->rng) * msg->jitter;
+    HeapPush(sim, sim->events, &sim->eventCount, m);
+}
+
+static void WriteFrame(struct Simulator *sim, const struct SimMessage *msg, double start, int attack)
+{
+    struct TraceRecord r;
+
+    if (!sim->trace)
+        return;
+    memset(&r, 0, sizeof(r));
+    r.tNs = (uint64_t)llround(start * 1e9);
+    r.ID = msg->ID;
+    r.DLC = (uint8_t)msg->DLC;
+    r.flags = (uint8_t)msg->flags;
+    memcpy(r.data, msg->data, 8);
+    if (attack)
+        r.data[0] ^= 0x80; // the attacker's dominant bit
+    fwrite(&r, sizeof(r), 1, sim->trace);
+}
+
+// Attack window of a frame of key starting now: frames of higher priority sent back to back before it
+static void RecordWindow(struct Simulator *sim, struct SimMessage *msg, double start)
+{
+    struct SimInstance *ins = Instance(msg, msg->pendingK);
+    int bits = 0, nominal = 0, count = 0, blocked = (int)llround((start - msg->releasedAt) / sim->bitTime), j = 0;
+
+    for (j = sim->historyCount - 1; j >= 0 && sim->history[j].key < msg->key; j--, count++)
+    {
+        bits += sim->history[j].bits;
+        nominal += sim->history[j].nominal;
+    }
+    if (ins->sent == 0 || bits < ins->minWinBits)
+    {
+        ins->minWinBits = bits;
+        ins->minWinNominal = nominal;
+        ins->minWinCount = count;
+    }
+    if (ins->sent == 0 || blocked < ins->minBlockedBits)
+        ins->minBlockedBits = blocked;
+    ins->sumWinBits += bits;
+    ins->sent++;
+}
+
+static void PushHistory(struct Simulator *sim, uint32_t key, int bits, int nominal)
+{
+    if (sim->historyCount == SIM_HISTORY)
+    {
+        memmove(sim->history, sim->history + SIM_HISTORY / 2, sizeof(struct SimFrame) * (SIM_HISTORY / 2));
+        sim->historyCount = SIM_HISTORY / 2;
+    }
+    sim->history[sim->historyCount].key = key;
+    sim->history[sim->historyCount].bits = bits;
+    sim->history[sim->historyCount].nominal = nominal;
+    sim->historyCount++;
+}
+
+static void Simulate(struct Simulator *sim, double end)
+{
+    struct SimMessage *msg, *t = sim->target >= 0 ? &sim->msgs[sim->target] : NULL;
+    double now = 0, start = 0;
+    int m = 0, attackPending = 0, targetPending = 0, bits = 0;
+
+    while (1)
+    {
+        // Everything released up to now joins the arbitration
+        while (sim->eventCount > 0 && EventTime(sim, sim->events[0]) <= now)
+        {
+            m = HeapPop(sim, sim->events, &sim->eventCount);
+            if (m == sim->msgCount)
+                HeapPush(sim, sim->pending, &sim->pendingCount, m);
+            else
+                Release(sim, m, EventTime(sim, m));
+        }
+        if (t && sim->armedK >= 0 && !sim->queued && now > sim->armedAt + t->period)
+        {
+            // Nothing of higher priority came before the next instance
+            Instance(t, sim->armedK)->attempts++;
+            Instance(t, sim->armedK)->missed++;
+            ArmAttacker(sim, sim->armedK + 1);
+        }
+        if (sim->pendingCount == 0)
+        {
+            if (sim->eventCount == 0 || EventTime(sim, sim->events[0]) >= end)
+                break;
+            // Bus idle until the next release
+            now = EventTime(sim, sim->events[0]);
+            continue;
+        }
+        // A window ends with the first idle bit; a frame ready within the intermission follows back to back
+        if (now >= sim->busFree + sim->bitTime)
+            sim->historyCount = 0;
+        start = now;
+        m = HeapPop(sim, sim->pending, &sim->pendingCount);
+        attackPending = m == sim->msgCount;
+        targetPending = t && m == sim->target;
+        if (sim->pendingCount > 0 && PendingKey(sim, sim->pending[0]) == PendingKey(sim, m) &&
+            (sim->pending[0] == sim->msgCount || (t && sim->pending[0] == sim->target)))
+        {
+            // Target and attack frame won together
+            HeapPop(sim, sim->pending, &sim->pendingCount);
+            attackPending = targetPending = 1;
+        }
+
+        if (t && sim->armedK >= 0 && !sim->queued && start >= sim->armedAt && PendingKey(sim, m) < t->key)
+        {
+            // A higher priority frame starts after the nominal release: the attacker triggers
+            sim->queued = 1;
+            sim->attackRelease = start + sim->react * sim->bitTime;
+            HeapPush(sim, sim->events, &sim->eventCount, sim->msgCount);
+        }
+
+        msg = &sim->msgs[attackPending && !targetPending ? sim->target : m];
+        if (attackPending && targetPending)
+        {
+            // Collision: the victim sees a bit error and retransmits
+            RecordWindow(sim, t, start);
+            Instance(t, sim->armedK)->attempts++;
+            Instance(t, sim->armedK)->successes++;
+            sim->collisions++;
+            WriteFrame(sim, t, start, 1);
+            bits = t->bits + SIM_ERROR_FRAME_BITS;
+            HeapPush(sim, sim->pending, &sim->pendingCount, sim->target);
+            t->retransmit = 1;
+            sim->queued = 0;
+            ArmAttacker(sim, sim->armedK + 1);
+        }
+        else if (attackPending)
+        {
+            // The attack frame goes out alone
+            Instance(t, sim->armedK)->attempts++;
+            Instance(t, sim->armedK)->detected++;
+            WriteFrame(sim, t, start, 1);
+            bits = t->bits;
+            sim->queued = 0;
+            ArmAttacker(sim, sim->armedK + 1);
+        }
+        else
+        {
+            if (!msg->retransmit)
+                RecordWindow(sim, msg, start);
+            msg->retransmit = 0;
+            msg->pending = 0;
+            WriteFrame(sim, msg, start, 0);
+            bits = msg->bits;
+            if (targetPending && sim->armedK >= 0 && msg->pendingK >= sim->armedK)
+            {
+                // The target went first, the attack frame is withdrawn
+                Instance(t, sim->armedK)->attempts++;
+                Instance(t, sim->armedK)->missed++;
+                if (sim->queued)
+                {
+                    HeapRemove(sim, sim->events, &sim->eventCount, sim->msgCount);
+                    HeapRemove(sim, sim->pending, &sim->pendingCount, sim->msgCount);
+                    sim->queued = 0;
+                }
+                ArmAttacker(sim, msg->pendingK + 1);
+            }
+        }
+        PushHistory(sim, msg->key, bits, CANNominalBits(msg->flags, msg->DLC));
+        sim->frames++;
+        now = start + bits * sim->bitTime;
+        sim->busFree = now;
+        if (now >= end)
+            break;
+    }
+}
+
+static struct SimMessage *FindMessage(struct Simulator *sim, uint32_t ID)
+{
+    int i = 0;
+
+    for (i = 0; i < sim->msgCount; i++)
+        if (sim->msgs[i].ID == ID)
+            return &sim->msgs[i];
+    return NULL;
+}
+
+static struct SimMessage *AddMessage(struct Simulator *sim, uint32_t ID)
+{
+    struct SimMessage *msg;
+
+    if (sim->msgCount == SIM_MAX_MSGS || FindMessage(sim, ID))
+        return NULL;
+    msg = &sim->msgs[sim->msgCount++];
+    memset(msg, 0, sizeof(*msg));
+    msg->ID = ID;
+    if (ID > 0x7FF)
+        msg->flags = TRACE_FLAG_EFF;
+    return msg;
+}
+
+// ID period_ms offset_ms jitter_ms DLC [data bytes], '#' starts a comment
+static int LoadSchedule(struct Simulator *sim, const char *path)
+{
+    char buffer[512], *tok, *end;
+    struct SimMessage *msg;
+    double v[4];
+    int n = 0, b = 0, line = 0;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        line++;
+        if ((tok = strchr(buffer, '#')))
+            *tok = 0;
+        if (!(tok = strtok(buffer, " \t\r\n,")))
+            continue;
+        msg = AddMessage(sim, (uint32_t)strtoul(tok, &end, 0));
+        for (n = 0; n < 4 && (tok = strtok(NULL, " \t\r\n,")); n++)
+            v[n] = strtod(tok, NULL);
+        if (!msg || *end || n < 4 || v[0] <= 0) {
+            printf("%s:%d: bad or duplicate message\n", path, line);
+            fclose(fp);
+            return -1;
+        }
+        msg->period = v[0] * 1e-3;
+        msg->offset = v[1] * 1e-3;
+        msg->jitter = v[2] * 1e-3;
+        msg->DLC = (int)v[3];
+        for (b = 0; b < 8 && (tok = strtok(NULL, " \t\r\n,")); b++)
+            msg->data[b] = (uint8_t)strtoul(tok, NULL, 16);
+    }
+    fclose(fp);
+    return sim->msgCount;
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/** Derives the schedule from a recorded trace: the period of every ID is the
+median gap between its frames (to 0.1 ms), the offset its first frame, DLC
+and payload those of the first frame. IDs seen less than 3 times are left out.
+**/
+static int ScheduleFromTrace(struct Simulator *sim, const char *path, double jitter, uint32_t *bitrate)
+{
+    struct TraceRecord *records = NULL;
+    struct TraceHeader hdr;
+    struct SimMessage *msg;
+    double *gaps;
+    long n = TraceLoad(path, &records), i = 0, j = 0, count = 0, last = 0;
+    FILE *fp;
+
+    if (n < 0)
+        return -1;
+    // A .hnst capture knows its bitrate, a text log doesn't
+    if ((fp = fopen(path, "rb")) != NULL)
+    {
+        if (fread(&hdr, sizeof(hdr), 1, fp) == 1 && memcmp(hdr.magic, TRACE_MAGIC, 4) == 0 && hdr.bitrate)
+            *bitrate = hdr.bitrate;
+        fclose(fp);
+    }
+    gaps = (double *)malloc(sizeof(double) * (n + 1));
+    for (i = 0; i < n; i++)
+    {
+        if (FindMessage(sim, records[i].ID))
+            continue;
+        count = 0;
+        for (j = i; j < n; j++)
+            if (records[j].ID == records[i].ID)
+            {
+                if (count > 0)
+                    gaps[count - 1] = (records[j].tNs - records[last].tNs) * 1e-9;
+                last = j;
+                count++;
+            }
+        if (count < 3 || !(msg = AddMessage(sim, records[i].ID)))
+            continue;
+        qsort(gaps, count - 1, sizeof(double), CompareDouble);
+        msg->flags = records[i].flags & (TRACE_FLAG_EFF | TRACE_FLAG_RTR);
+        msg->period = round(gaps[(count - 1) / 2] * 1e4) * 1e-4;
+        msg->offset = records[i].tNs * 1e-9;
+        msg->jitter = jitter;
+        msg->DLC = records[i].DLC;
+        memcpy(msg->data, records[i].data, 8);
+        if (msg->period <= 0)
+            sim->msgCount--;
+    }
+    free(gaps);
+    free(records);
+    return sim->msgCount;
+}
+
+// <ID>:<pattern> option, the pattern must cover the hyper period of the message
+static int ParsePattern(struct Simulator *sim, char *arg, struct SimMessage **msg, char **pattern)
+{
+    char *colon = strchr(arg, ':');
+
+    *pattern = NULL;
+    if (colon)
+        *colon = 0;
+    *msg = FindMessage(sim, (uint32_t)strtoul(arg, NULL, 0));
+    if (!*msg) {
+        printf("ID %s is not in the schedule\n", arg);
+        return -1;
+    }
+    if (colon)
+    {
+        *pattern = colon + 1;
+        if ((int)strlen(*pattern) != (*msg)->count || strspn(*pattern, "01") != strlen(*pattern)) {
+            printf("Pattern of %s needs %d digits 0/1\n", arg, (*msg)->count);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void SaveTruthCSV(struct Simulator *sim, const char *path)
+{
+    struct SimInstance *ins;
+    int i = 0, j = 0;
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    fprintf(fp, "ID,InstanceIndex,Released,Sent,Skipped,Overruns,MinAtkWinBits,MinAtkWinNominal,MinAtkWinCount,"
+                "MeanAtkWinBits,MinBlockedBits,Attempts,Successes,Detected,Missed\n");
+    for (i = 0; i < sim->msgCount; i++)
+        for (j = 0; j < sim->msgs[i].count; j++)
+        {
+            ins = &sim->msgs[i].ins[j];
+            fprintf(fp, "%u,%d,%ld,%ld,%ld,%ld,%d,%d,%d,%.1f,%d,%ld,%ld,%ld,%ld\n", sim->msgs[i].ID, j,
+                    ins->released, ins->sent, ins->skipped, ins->overruns, ins->minWinBits, ins->minWinNominal,
+                    ins->minWinCount, ins->sent ? ins->sumWinBits / ins->sent : 0.0, ins->minBlockedBits,
+                    ins->attempts, ins->successes, ins->detected, ins->missed);
+        }
+    fclose(fp);
+    printf("Ground truth saved to %s\n", path);
+}
+
+/** Compares final_candidates.csv of an analyzer run on the simulated trace with
+the truth: attackable there against a true window of at least react bits in
+every hyper period, and the window length the analyzer inferred from the
+timestamps against the true one.
+**/
+static void CheckAnalyzer(struct Simulator *sim, const char *path)
+{
+    char buffer[4096];
+    int ID = 0, index = 0, attackable = 0, atkWinLen = 0, truth = 0, rows = 0, falsePos = 0, falseNeg = 0;
+    double per = 0, errNominal = 0, errStuffed = 0;
+    struct SimMessage *msg;
+    struct SimInstance *ins;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        if (sscanf(buffer, "%d,%lf,%d,%d,%d", &ID, &per, &index, &attackable, &atkWinLen) != 5)
+            continue;
+        msg = FindMessage(sim, (uint32_t)ID);
+        if (!msg || index >= msg->count || msg->ins[index].sent == 0)
+            continue;
+        ins = &msg->ins[index];
+        truth = ins->minWinBits >= sim->react;
+        rows++;
+        falsePos += attackable && !truth;
+        falseNeg += !attackable && truth;
+        errNominal += abs(atkWinLen - ins->minWinNominal);
+        errStuffed += abs(atkWinLen - ins->minWinBits);
+    }
+    fclose(fp);
+    if (rows == 0) {
+        printf("No instance of %s is in the simulation\n", path);
+        return;
+    }
+    printf("Analyzer vs truth: %d/%d instances agree (%d falsely attackable, %d missed)\n", rows - falsePos - falseNeg,
+           rows, falsePos, falseNeg);
+    printf("Mean |AtkWinLen - true window|: %.1f bits nominal, %.1f bits with stuffing\n", errNominal / rows,
+           errStuffed / rows);
+}
+
+int main(int argc, char **argv)
+{
+    struct Simulator sim;
+    struct SimMessage *msg;
+    const char *logPath = NULL, *schedPath = NULL, *tracePath = NULL, *truthPath = "sim_truth.csv", *checkPath = NULL;
+    double simTime = 60, jitter = 0, wall = 0, load = 0;
+    uint32_t bitrate = 0;
+    long attempts = 0, successes = 0, detected = 0, missed = 0, skipped = 0;
+    char *pattern = NULL;
+    int i = 0, j = 0;
+    struct timespec t0, t1;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.hp = 5;
+    sim.rng = 1;
+    sim.react = 111;
+    sim.target = -1;
+    sim.armedK = -1;
+    sim.msgs = (struct SimMessage *)calloc(SIM_MAX_MSGS, sizeof(struct SimMessage));
+    for (i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-log") == 0)
+            logPath = argv[i + 1];
+        else if (strcmp(argv[i], "-schedule") == 0)
+            schedPath = argv[i + 1];
+        else if (strcmp(argv[i], "-time") == 0)
+            simTime = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-hp") == 0)
+            sim.hp = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-bitrate") == 0)
+            bitrate = (uint32_t)atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-jitter") == 0)
+            jitter = atof(argv[i + 1]) * 1e-3;
+        else if (strcmp(argv[i], "-seed") == 0)
+            sim.rng = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "-react") == 0)
+            sim.react = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-trace") == 0)
+            tracePath = argv[i + 1];
+        else if (strcmp(argv[i], "-truth") == 0)
+            truthPath = argv[i + 1];
+        else if (strcmp(argv[i], "-check") == 0)
+            checkPath = argv[i + 1];
+        else if (strcmp(argv[i], "-skip") != 0 && strcmp(argv[i], "-attack") != 0)
+            break;
+    }
+    if (i + 1 < argc || argc < 3 || (!logPath) == (!schedPath))
+    {
+        printf("Usage: %s (-log <trace> | -schedule <file>) [-time s] [-hp s] [-bitrate kbps] [-jitter ms]\n"
+               "       [-seed n] [-skip ID:pattern] [-attack ID[:plan]] [-react bits] [-trace out.hnst]\n"
+               "       [-truth out.csv] [-check final_candidates.csv]\n", argv[0]);
+        return 1;
+    }
+    if ((logPath ? ScheduleFromTrace(&sim, logPath, jitter, &bitrate) : LoadSchedule(&sim, schedPath)) <= 0)
+    {
+        printf("No messages to simulate\n");
+        return 1;
+    }
+    if (bitrate == 0)
+        bitrate = 500;
+    sim.bitTime = 1.0 / (bitrate * 1000.0);
+
+    sim.events = (int *)malloc(sizeof(int) * (sim.msgCount + 1));
+    sim.pending = (int *)malloc(sizeof(int) * (sim.msgCount + 2));
+    for (i = 0; i < sim.msgCount; i++)
+    {
+        msg = &sim.msgs[i];
+        msg->key = CANArbitrationKey(msg->ID, msg->flags);
+        msg->bits = CANFrameBits(msg->ID, msg->flags, msg->DLC, msg->data);
+        msg->count = (int)ceil(sim.hp / msg->period - 1e-6);
+        msg->ins = (struct SimInstance *)calloc(msg->count, sizeof(struct SimInstance));
+        msg->release = msg->offset;
+        load += msg->bits * sim.bitTime / msg->period;
+    }
+    for (i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-skip") == 0)
+        {
+            if (ParsePattern(&sim, argv[i + 1], &msg, &pattern) != 0)
+                return 1;
+            msg->pattern = pattern;
+        }
+        if (strcmp(argv[i], "-attack") == 0)
+        {
+            if (ParsePattern(&sim, argv[i + 1], &msg, &sim.plan) != 0)
+                return 1;
+            sim.target = (int)(msg - sim.msgs);
+        }
+    }
+    for (i = 0; i < sim.msgCount; i++)
+        HeapPush(&sim, sim.events, &sim.eventCount, i);
+    if (sim.target >= 0)
+        ArmAttacker(&sim, 0);
+    if (tracePath && !(sim.trace = TraceCreate(tracePath, bitrate, 0)))
+        return 1;
+
+    printf("Simulating %d messages (%.1f%% bus load with stuffing) for %.0f s at %u kbps\n", sim.msgCount,
+           load * 100, simTime, bitrate);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Simulate(&sim, simTime);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%ld frames in %.3f s, %.0fx real time\n", sim.frames, wall, simTime / wall);
+
+    if (sim.trace)
+        TraceFinish(sim.trace, 0, sim.frames, 0, 0);
+    if (sim.target >= 0)
+    {
+        msg = &sim.msgs[sim.target];
+        for (j = 0; j < msg->count; j++)
+        {
+            attempts += msg->ins[j].attempts;
+            successes += msg->ins[j].successes;
+            detected += msg->ins[j].detected;
+            missed += msg->ins[j].missed;
+            skipped += msg->ins[j].skipped;
+        }
+        printf("Attack on %u: %ld attempts, %ld succeeded (ASP %.3f), %ld detected, %ld missed; %ld instances skipped\n",
+               msg->ID, attempts, successes, attempts ? (double)successes / attempts : 0.0, detected, missed, skipped);
+    }
+    SaveTruthCSV(&sim, truthPath);
+    if (checkPath)
+        CheckAnalyzer(&sim, checkPath);
+
+    for (i = 0; i < sim.msgCount; i++)
+        free(sim.msgs[i].ins);
+    free(sim.msgs);
+    free(sim.events);
+    free(sim.pending);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include<stdio.h>
+#include<string.h>
+#include "can_trace.h"
+
+/** SocketCAN helpers shared by the live analyzer, the recorder and the replayer **/
+
+#ifdef __linux__
+
+#include<time.h>
+#include<unistd.h>
+#include<net/if.h>
+#include<sys/ioctl.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<linux/can.h>
+#include<linux/can/raw.h>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+/** Opens a raw CAN socket on ifname with nanosecond kernel receive timestamps
+and the socket drop counter enabled. Returns the socket or -1.
+**/
+int OpenCANSocket(const char *ifname)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    struct timeval tv;
+    int s = 0, on = 1, rcvbuf = 8 << 20;
+
+    s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket(PF_CAN)");
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        perror("SIOCGIFINDEX");
+        close(s);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    // A large receive buffer absorbs bursts while a batch is being processed
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    // Wake up regularly so Ctrl-C is noticed on a silent bus
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/** Kernel receive timestamp (CLOCK_REALTIME nanoseconds) of a received
+message, or the current time if there is none. Kept as an integer: a double
+in seconds only resolves about 240 ns at today's CLOCK_REALTIME values. If kernelDrops is given it receives the
+socket's cumulative drop counter when the kernel attached one.
+**/
+uint64_t CANRxTimestamp(struct msghdr *msg, uint32_t *kernelDrops)
+{
+    struct cmsghdr *cmsg;
+    struct timespec ts;
+    int found = 0;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+        if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            found = 1;
+        }
+        else if (cmsg->cmsg_type == SO_RXQ_OVFL && kernelDrops)
+            memcpy(kernelDrops, CMSG_DATA(cmsg), sizeof(uint32_t));
+    }
+    if (!found)
+        clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#endif // __linux__
@@ -0,0 +1,168 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "can_trace.h"
+
+/** Reader/writer of the binary trace format described in can_trace.h **/
+
+static void FillHeader(struct TraceHeader *hdr, uint32_t bitrate, uint64_t startNs)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TRACE_MAGIC, 4);
+    hdr->version = TRACE_VERSION;
+    hdr->recordSize = sizeof(struct TraceRecord);
+    hdr->bitrate = bitrate;
+    hdr->startNs = startNs;
+}
+
+FILE *TraceCreate(const char *path, uint32_t bitrate, uint64_t startNs)
+{
+    struct TraceHeader hdr;
+    FILE *fp = fopen(path, "w+b");
+
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    // Placeholder, rewritten by TraceFinish once the counters are known
+    FillHeader(&hdr, bitrate, startNs);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    return fp;
+}
+
+int TraceFinish(FILE *fp, uint64_t startNs, uint64_t frameCount, uint64_t droppedRing, uint64_t droppedKernel)
+{
+    struct TraceHeader hdr;
+
+    fflush(fp);
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(&hdr, sizeof(hdr), 1, fp) != 1)
+        FillHeader(&hdr, 0, startNs);
+    hdr.startNs = startNs;
+    hdr.frameCount = frameCount;
+    hdr.droppedRing = droppedRing;
+    hdr.droppedKernel = droppedKernel;
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    return fclose(fp);
+}
+
+FILE *TraceOpen(const char *path, struct TraceHeader *hdr)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    if (fread(hdr, sizeof(*hdr), 1, fp) != 1 || memcmp(hdr->magic, TRACE_MAGIC, 4) != 0 ||
+        hdr->recordSize != sizeof(struct TraceRecord)) {
+        printf("%s is not a binary CAN trace\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    if (hdr->droppedRing || hdr->droppedKernel)
+        printf("Warning: %s lost %llu frames in the recorder and %llu in the kernel\n", path,
+               (unsigned long long)hdr->droppedRing, (unsigned long long)hdr->droppedKernel);
+    return fp;
+}
+
+size_t TraceRead(FILE *fp, struct TraceRecord *records, size_t maxRecords)
+{
+    return fread(records, sizeof(struct TraceRecord), maxRecords, fp);
+}
+
+/** Parses one frame of a text CAN log into r, returns 0 for headers and other lines.
+Handles the CANlog layouts (whitespace or comma separated, with or without a
+leading empty column or Flg column) and SampleTwo.csv: fields are
+Chn, Identifier (hex), DLC, DLC data bytes (hex), Time (s), Dir.
+**/
+static int ParseLogLine(char *buffer, struct TraceRecord *r, double *t)
+{
+    char *tok[32], *end;
+    int n = 0, dlc = 0, i = 0;
+    long chn = 0;
+
+    for (char *value = strtok(buffer, ", \t\r\n"); value && n < 32; value = strtok(NULL, ", \t\r\n"))
+        tok[n++] = value;
+    if (n < 4)
+        return 0;
+    chn = strtol(tok[0], &end, 10);
+    if (*end || chn < 0)
+        return 0;
+    dlc = (int)strtol(tok[2], &end, 10);
+    if (*end || dlc < 0 || dlc > 8 || n < 4 + dlc)
+        return 0;
+    *t = strtod(tok[3 + dlc], &end);
+    if (*end)
+        return 0;
+    memset(r, 0, sizeof(*r));
+    r->ID = (uint32_t)strtoul(tok[1], &end, 16);
+    if (*end)
+        return 0;
+    if (r->ID > 0x7FF)
+        r->flags |= TRACE_FLAG_EFF;
+    r->DLC = (uint8_t)dlc;
+    for (i = 0; i < dlc; i++)
+        r->data[i] = (uint8_t)strtoul(tok[3 + i], NULL, 16);
+    return 1;
+}
+
+/** Loads a whole trace into memory, either a .hnst capture or a text log.
+Timestamps become nanoseconds since the first frame. Returns the number of
+frames (*records is malloc'd), or -1 if the file can't be read.
+**/
+long TraceLoad(const char *path, struct TraceRecord **records)
+{
+    struct TraceHeader hdr;
+    struct TraceRecord r;
+    char buffer[1024], magic[4] = {0};
+    double t = 0, t0 = 0;
+    long count = 0, capacity = 0;
+    size_t n = 0;
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    *records = NULL;
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, TRACE_MAGIC, 4) == 0)
+    {
+        fclose(fp);
+        fp = TraceOpen(path, &hdr);
+        if (!fp)
+            return -1;
+        capacity = hdr.frameCount > 0 ? (long)hdr.frameCount : 4096;
+        *records = (struct TraceRecord *)malloc(sizeof(struct TraceRecord) * capacity);
+        while ((n = TraceRead(fp, *records + count, capacity - count)) > 0)
+        {
+            count += n;
+            if (count == capacity) {
+                capacity *= 2;
+                *records = (struct TraceRecord *)realloc(*records, sizeof(struct TraceRecord) * capacity);
+            }
+        }
+        fclose(fp);
+        return count;
+    }
+
+    rewind(fp);
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        if (!ParseLogLine(buffer, &r, &t))
+            continue;
+        if (count == 0)
+            t0 = t;
+        // Logs are in time order, a step back would make the replay wait forever
+        r.tNs = t > t0 ? (uint64_t)((t - t0) * 1e9 + 0.5) : 0;
+        if (count > 0 && r.tNs < (*records)[count - 1].tNs)
+            r.tNs = (*records)[count - 1].tNs;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            *records = (struct TraceRecord *)realloc(*records, sizeof(struct TraceRecord) * capacity);
+        }
+        (*records)[count++] = r;
+    }
+    fclose(fp);
+    return count;
+}
@@ -0,0 +1,55 @@
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+
+#include<stdio.h>
+#include<stdint.h>
+
+/** Compact binary CAN trace (.hnst), little endian.
+A 48 byte header followed by fixed size 24 byte records in capture order.
+Timestamps are nanoseconds since startNs (CLOCK_REALTIME of the first frame).
+frameCount and the loss counters are filled in when the recorder stops, so a
+trace with droppedRing/droppedKernel > 0 is known to have holes.
+**/
+
+#define TRACE_MAGIC "HNST"
+#define TRACE_VERSION 1
+
+#define TRACE_FLAG_EFF 0x01 // 29-bit identifier
+#define TRACE_FLAG_RTR 0x02 // remote frame
+
+struct TraceHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t bitrate; // in kbps
+    uint32_t reserved;
+    uint64_t startNs;
+    uint64_t frameCount;
+    uint64_t droppedRing; // frames lost because the ring buffer was full
+    uint64_t droppedKernel; // frames lost in the socket queue (SO_RXQ_OVFL)
+};
+
+struct TraceRecord
+{
+    uint64_t tNs;
+    uint32_t ID;
+    uint8_t DLC;
+    uint8_t flags;
+    uint16_t reserved;
+    uint8_t data[8];
+};
+
+FILE *TraceCreate(const char *path, uint32_t bitrate, uint64_t startNs);
+int TraceFinish(FILE *fp, uint64_t startNs, uint64_t frameCount, uint64_t droppedRing, uint64_t droppedKernel);
+FILE *TraceOpen(const char *path, struct TraceHeader *hdr);
+size_t TraceRead(FILE *fp, struct TraceRecord *records, size_t maxRecords);
+long TraceLoad(const char *path, struct TraceRecord **records);
+
+#ifdef __linux__
+#include<sys/socket.h>
+int OpenCANSocket(const char *ifname);
+uint64_t CANRxTimestamp(struct msghdr *msg, uint32_t *kernelDrops);
+#endif
+
+#endif // CAN_TRACE_H
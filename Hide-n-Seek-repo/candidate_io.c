@@ -0,0 +1,214 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include "obfuscation.h"
+
+/** Writers of the final candidates.
+Rows are formatted into a large buffer with a hand-rolled integer formatter and
+written with one fwrite per buffer, instead of an fprintf per field. The CSV is
+byte for byte the one classifier.ipynb and export_model.py read; Periodicity is
+formatted once per candidate with %.3f, so its rounding is printf's own.
+The binary file (.hnsc) has the same columns, little endian:
+    header   "HNSC", uint16 version, uint16 record size, uint32 candidates,
+             uint32 rows, uint64 window entries
+    per row  struct CandidateRecord, then idCount int32 IDs (AtkWinMessages)
+             and insCount int32 instance numbers (InsWinMessages)
+Periodicity is kept unrounded there.
+**/
+
+#define OUT_BUF_SIZE (1 << 20)
+#define OUT_MAX_FIELD 32 // longest field appended without a capacity check
+
+struct OutBuf
+{
+    FILE *fp;
+    char *buf;
+    size_t len;
+    int err;
+};
+
+static void OutFlush(struct OutBuf *out)
+{
+    if (out->len > 0 && fwrite(out->buf, 1, out->len, out->fp) != out->len)
+        out->err = 1;
+    out->len = 0;
+}
+
+// Room for n more bytes
+static void OutReserve(struct OutBuf *out, size_t n)
+{
+    if (out->len + n > OUT_BUF_SIZE)
+        OutFlush(out);
+}
+
+static void OutBytes(struct OutBuf *out, const char *s, size_t n)
+{
+    if (n > OUT_BUF_SIZE) {
+        OutFlush(out);
+        if (fwrite(s, 1, n, out->fp) != n)
+            out->err = 1;
+        return;
+    }
+    OutReserve(out, n);
+    memcpy(out->buf + out->len, s, n);
+    out->len += n;
+}
+
+// Same digits as printf("%d")
+static void OutInt(struct OutBuf *out, int value)
+{
+    char digits[12];
+    char *p = digits + sizeof(digits), *dst;
+    unsigned int v = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0)
+        *--p = '-';
+    OutReserve(out, OUT_MAX_FIELD);
+    dst = out->buf + out->len;
+    out->len += digits + sizeof(digits) - p;
+    memcpy(dst, p, digits + sizeof(digits) - p);
+}
+
+static void OutChar(struct OutBuf *out, char c)
+{
+    OutReserve(out, 1);
+    out->buf[out->len++] = c;
+}
+
+// "a;b;c" or "" like the original writer (list is NULL or count is 0 for an empty window)
+static void OutList(struct OutBuf *out, const int *list, int count)
+{
+    int k = 0;
+
+    OutChar(out, '"');
+    for (k = 0; list && k < count; k++)
+    {
+        if (k > 0)
+            OutChar(out, ';');
+        OutInt(out, list[k]);
+    }
+    OutChar(out, '"');
+}
+
+static int OutOpen(struct OutBuf *out, const char *path, const char *mode)
+{
+    memset(out, 0, sizeof(*out));
+    out->fp = fopen(path, mode);
+    if (!out->fp)
+        return -1;
+    out->buf = (char *)malloc(OUT_BUF_SIZE);
+    if (!out->buf) {
+        fclose(out->fp);
+        return -1;
+    }
+    return 0;
+}
+
+static int OutClose(struct OutBuf *out)
+{
+    OutFlush(out);
+    free(out->buf);
+    if (fclose(out->fp) != 0)
+        out->err = 1;
+    return out->err ? -1 : 0;
+}
+
+// Writes the final candidate information to a CSV file.
+void SaveFinalCandidatesCSV(struct Message *candidates, int ECUCount)
+{
+    static const char header[] =
+        "CandidateID,Periodicity,InstanceIndex,Attackable,AtkWinLen,AtkWinCount,AtkWinMessages,InsWinMessages\n";
+    struct OutBuf out;
+    char prefix[64];
+    int i = 0, j = 0, n = 0;
+
+    if (OutOpen(&out, "final_candidates.csv", "w") != 0) {
+        perror("Error opening final_candidates.csv");
+        return;
+    }
+    OutBytes(&out, header, sizeof(header) - 1);
+    for (i = 0; i < ECUCount; i++)
+    {
+        // ID and periodicity are the same on every row of the candidate
+        n = snprintf(prefix, sizeof(prefix), "%d,%.3f,", candidates[i].ID, candidates[i].periodicity);
+        for (j = 0; j < candidates[i].count; j++)
+        {
+            struct Instance *inst = &candidates[i].instances[j];
+
+            OutBytes(&out, prefix, n);
+            OutInt(&out, inst->index);
+            OutChar(&out, ',');
+            OutInt(&out, inst->attackable);
+            OutChar(&out, ',');
+            OutInt(&out, inst->atkWinLen);
+            OutChar(&out, ',');
+            OutInt(&out, inst->atkWinCount);
+            OutChar(&out, ',');
+            OutList(&out, inst->atkWin, inst->atkWinCount);
+            OutChar(&out, ',');
+            OutList(&out, inst->insWin, inst->atkWinCount);
+            OutChar(&out, '\n');
+        }
+    }
+    if (OutClose(&out) != 0)
+        perror("Error writing final_candidates.csv");
+    else
+        printf("\nFinal candidates saved to final_candidates.csv\n");
+}
+
+int SaveFinalCandidatesBinary(struct Message *candidates, int candCount, const char *path)
+{
+    struct CandidateFileHeader hdr;
+    struct CandidateRecord rec;
+    struct OutBuf out;
+    int i = 0, j = 0;
+
+    if (OutOpen(&out, path, "wb") != 0) {
+        perror(path);
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CANDIDATE_MAGIC, 4);
+    hdr.version = CANDIDATE_VERSION;
+    hdr.recordSize = sizeof(struct CandidateRecord);
+    hdr.candCount = candCount;
+    for (i = 0; i < candCount; i++)
+        for (j = 0; j < candidates[i].count; j++)
+        {
+            struct Instance *inst = &candidates[i].instances[j];
+            hdr.rowCount++;
+            hdr.entryCount += (inst->atkWin ? inst->atkWinCount : 0) + (inst->insWin ? inst->atkWinCount : 0);
+        }
+    OutBytes(&out, (const char *)&hdr, sizeof(hdr));
+
+    for (i = 0; i < candCount; i++)
+        for (j = 0; j < candidates[i].count; j++)
+        {
+            struct Instance *inst = &candidates[i].instances[j];
+
+            rec.ID = candidates[i].ID;
+            rec.periodicity = candidates[i].periodicity;
+            rec.index = inst->index;
+            rec.attackable = inst->attackable;
+            rec.atkWinLen = inst->atkWinLen;
+            rec.atkWinCount = inst->atkWinCount;
+            rec.idCount = inst->atkWin ? inst->atkWinCount : 0;
+            rec.insCount = inst->insWin ? inst->atkWinCount : 0;
+            OutBytes(&out, (const char *)&rec, sizeof(rec));
+            if (rec.idCount > 0)
+                OutBytes(&out, (const char *)inst->atkWin, sizeof(int32_t) * rec.idCount);
+            if (rec.insCount > 0)
+                OutBytes(&out, (const char *)inst->insWin, sizeof(int32_t) * rec.insCount);
+        }
+    if (OutClose(&out) != 0) {
+        perror(path);
+        return -1;
+    }
+    printf("Final candidates saved to %s\n", path);
+    return 0;
+}
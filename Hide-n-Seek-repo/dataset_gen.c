@@ -0,0 +1,360 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<stdint.h>
+#include<unistd.h>
+#ifdef __linux__
+#include<sys/wait.h>
+#endif
+#include "obfuscation.h"
+#include "can_trace.h"
+
+/** Synthetic training data (obfuscation -generate <dir> [shards] [seed]).
+Every shard is one synthetic bus: a target ECU with 2-6 control messages plus
+background IDs until the bus load of its level is reached. The traffic is
+scheduled like a CAN bus (lowest pending ID wins when the bus goes idle) and
+run through AnalyzeCANTraffic; the labelled instances are written with
+SaveFeatureTensors to <dir>/shard_<n>/ together with shard.txt.
+Shard n sweeps level n % 3, bitrate (n / 3) % 2 and DLC mix (n / 6) % 2; the
+rest is drawn from its own generator seeded from (seed, n), so a shard is the
+same whatever the number of cores. Shards run in forked processes because the
+analysis works on the global ECU configuration; without fork (Windows) they run
+one after the other in this process.
+**/
+
+struct GenLevel
+{
+    const char *name;
+    float load; // nominal bus load (DLC*8+47 bits per frame)
+};
+
+// Bus loads of the CANlog captures, counted the same way
+static const struct GenLevel genLevels[] = {{"LOW", 0.30}, {"MEDIUM", 0.55}, {"HIGH", 0.80}};
+static const float genBitrates[] = {250, 500}; // kbps
+static const float genDlc8Share[] = {0.9, 0.5}; // DLC mixes: share of 8 byte frames, the rest is 0-7
+
+// Periods in ms, all divide the 1 s hyper period. Repeats weight the draw towards
+// fast messages, the captures carry 12-33 IDs at these loads.
+static const int genECUPeriods[] = {10, 20, 25, 50, 100};
+static const int genBusPeriods[] = {10, 10, 10, 20, 20, 25, 50, 100, 200, 500, 1000};
+#define GEN_HP_MS 1000
+
+int genHyperPeriods = 10; // length of every synthetic trace
+int genECUMin = 2, genECUMax = 6; // control messages of the target ECU
+float genJitter = 0.02; // release jitter, fraction of the period
+int genSaveTrace = 0; // also keep the traffic of each shard as trace.hnst
+int genWorkers = 0; // parallel shards, 0 = all online cores
+
+#define GEN_MAX_IDS 128
+
+struct GenID
+{
+    int ID;
+    int periodMs;
+    int DLC;
+    double offset; // first release (s)
+    double release; // next release (s)
+    long k; // instance of the next release
+};
+
+// splitmix64, also used to derive the shard seeds
+static uint64_t GenNext(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double GenUniform(uint64_t *s)
+{
+    return (GenNext(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int GenPick(uint64_t *s, int n)
+{
+    return (int)(GenUniform(s) * n);
+}
+
+static int CompareGenID(const void *a, const void *b)
+{
+    const struct GenID *x = (const struct GenID *)a, *y = (const struct GenID *)b;
+
+    if (x->periodMs != y->periodMs)
+        return x->periodMs - y->periodMs;
+    return x->ID - y->ID;
+}
+
+// Adds a message with a fresh 11 bit ID, returns its nominal bus load
+static double GenAddID(uint64_t *s, struct GenID *ids, int n, const int *periods, int periodCount,
+                       float dlc8Share, float bitrate)
+{
+    int j = 0, ID = 0;
+
+    do {
+        ID = 0x10 + GenPick(s, 0x7F0 - 0x10);
+        for (j = 0; j < n && ids[j].ID != ID; j++)
+            ;
+    } while (j < n);
+    ids[n].ID = ID;
+    ids[n].periodMs = periods[GenPick(s, periodCount)];
+    ids[n].DLC = GenUniform(s) < dlc8Share ? 8 : GenPick(s, 8);
+    ids[n].offset = GenUniform(s) * ids[n].periodMs * 1e-3;
+    ids[n].release = ids[n].offset;
+    ids[n].k = 0;
+    return (ids[n].DLC * 8 + 47) / (bitrate * 1000) / (ids[n].periodMs * 1e-3);
+}
+
+/** Non-preemptive fixed priority bus: whenever it goes idle the lowest pending
+ID is sent. Every message is released once per period with a jitter, a late
+message stays pending until it wins. Returns the number of frames.
+**/
+static int GenTraffic(uint64_t *s, struct GenID *ids, int n, float bitrate, struct Message **can)
+{
+    double now = 0, end = genHyperPeriods * GEN_HP_MS * 1e-3, next = 0;
+    int j = 0, win = 0, count = 0, cap = 1024;
+
+    *can = (struct Message *)realloc(*can, sizeof(struct Message) * cap);
+    while (1)
+    {
+        win = -1;
+        next = end;
+        for (j = 0; j < n; j++)
+        {
+            if (ids[j].release <= now && (win < 0 || ids[j].ID < ids[win].ID))
+                win = j;
+            if (ids[j].release < next)
+                next = ids[j].release;
+        }
+        if (win < 0)
+        {
+            // Bus idle until the next release
+            if (next >= end)
+                break;
+            now = next;
+            continue;
+        }
+        if (count == cap)
+        {
+            cap *= 2;
+            *can = (struct Message *)realloc(*can, sizeof(struct Message) * cap);
+        }
+        memset(&(*can)[count], 0, sizeof(struct Message));
+        (*can)[count].ID = ids[win].ID;
+        (*can)[count].DLC = ids[win].DLC;
+        (*can)[count].txTime = now;
+        for (j = 0; j < ids[win].DLC; j++)
+            (*can)[count].data[j] = (unsigned char)GenNext(s);
+        // Stuff bits of the payload count like in a parsed trace, and the bus is busy for as long
+        SetFrameBits(&(*can)[count], 0);
+        now += FrameBits(&(*can)[count]) / (bitrate * 1000);
+        count++;
+        ids[win].k++;
+        ids[win].release = ids[win].offset + ids[win].k * ids[win].periodMs * 1e-3
+                           + GenUniform(s) * genJitter * ids[win].periodMs * 1e-3;
+    }
+    return count;
+}
+
+static void GenSaveTrace(const char *path, struct Message *can, int count, float bitrate)
+{
+    struct TraceRecord r;
+    FILE *fp = TraceCreate(path, (uint32_t)bitrate, 0);
+    int i = 0;
+
+    if (!fp)
+        return;
+    for (i = 0; i < count; i++)
+    {
+        memset(&r, 0, sizeof(r));
+        r.tNs = (uint64_t)llround(can[i].txTime * 1e9);
+        r.ID = can[i].ID;
+        r.DLC = can[i].DLC;
+        memcpy(r.data, can[i].data, sizeof(r.data));
+        fwrite(&r, sizeof(r), 1, fp);
+    }
+    TraceFinish(fp, 0, count, 0, 0);
+}
+
+static void GenFreeShard(struct Message *candidates, int ecu, struct Message *can)
+{
+    int i = 0;
+
+    ResetCandidateWindows(candidates, ecu);
+    for (i = 0; i < ecu; i++)
+    {
+        free(candidates[i].instances);
+        free(candidates[i].sortedASP);
+        free(candidates[i].pattern);
+    }
+    free(candidates);
+    free(can);
+}
+
+// One shard, run in its own process (or in turn in this one without fork)
+static int GenerateShard(const char *dir, int shard, uint64_t seed)
+{
+    char path[512];
+    uint64_t s = seed;
+    struct GenID ids[GEN_MAX_IDS];
+    struct Message *can = NULL, *candidates;
+    const struct GenLevel *level = &genLevels[shard % 3];
+    float bitrate = genBitrates[(shard / 3) % 2], dlc8Share = genDlc8Share[(shard / 6) % 2];
+    double load = 0, target = level->load + (GenUniform(&s) - 0.5) * 0.1;
+    int i = 0, j = 0, n = 0, ecu = 0, count = 0, attackable = 0, instances = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/shard_%05d", dir, shard);
+    if (MakeDir(path) != 0) {
+        perror(path);
+        return 1;
+    }
+    if (chdir(path) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    ecu = genECUMin + GenPick(&s, genECUMax - genECUMin + 1);
+    for (n = 0; n < ecu; n++)
+        load += GenAddID(&s, ids, n, genECUPeriods, sizeof(genECUPeriods) / sizeof(int), dlc8Share, bitrate);
+    // The target ECU is the first ecu entries, in ascending order of periodicity like ECUIDs
+    qsort(ids, ecu, sizeof(struct GenID), CompareGenID);
+    while (load < target && n < GEN_MAX_IDS)
+    {
+        load += GenAddID(&s, ids, n, genBusPeriods, sizeof(genBusPeriods) / sizeof(int), dlc8Share, bitrate);
+        n++;
+    }
+
+    // The analysis reads the ECU configuration from globals, this process owns them
+    ECUCount = ecu;
+    busSpeed = bitrate;
+    testID = -1;
+    candidates = (struct Message *)calloc(ecu, sizeof(struct Message));
+    for (i = 0; i < ecu; i++)
+    {
+        candidates[i].ID = ids[i].ID;
+        candidates[i].periodicity = ids[i].periodMs * 1e-3;
+        candidates[i].count = GEN_HP_MS / ids[i].periodMs;
+        candidates[i].instances = (struct Instance *)calloc(candidates[i].count, sizeof(struct Instance));
+        candidates[i].sortedASP = (int *)calloc(candidates[i].count, sizeof(int));
+        candidates[i].pattern = (int *)calloc(candidates[i].count, sizeof(int));
+        candidates[i].skipLimit = 1;
+        for (j = 0; j < candidates[i].count; j++)
+        {
+            candidates[i].instances[j].index = j;
+            candidates[i].pattern[j] = 1;
+        }
+    }
+
+    count = GenTraffic(&s, ids, n, bitrate, &can);
+    AnalyzeCANTraffic(can, count, &candidates, NULL);
+    for (i = 0; i < ecu; i++)
+        for (j = 0; j < candidates[i].count; j++, instances++)
+        {
+            candidates[i].instances[j].attackable = candidates[i].instances[j].atkWinLen >= minAtkWinLen;
+            attackable += candidates[i].instances[j].attackable;
+        }
+    if (SaveFeatureTensors(candidates, ecu, ".") != 0)
+        return 1;
+    if (genSaveTrace)
+        GenSaveTrace("trace.hnst", can, count, bitrate);
+
+    fp = fopen("shard.txt", "w");
+    if (!fp) {
+        perror("shard.txt");
+        return 1;
+    }
+    fprintf(fp, "seed=%llu\nlevel=%s\nbitrate=%.0f\ndlc8share=%.2f\nload=%.3f\nframes=%d\nids=%d\necu=",
+            (unsigned long long)seed, level->name, bitrate, dlc8Share, load, count, n);
+    for (i = 0; i < ecu; i++)
+        fprintf(fp, "%d:%d%s", ids[i].ID, ids[i].periodMs, i < ecu - 1 ? ";" : "\n");
+    fclose(fp);
+    printf("shard %d: %s %.0f kbps load %.2f, %d IDs, %d frames, %d/%d attackable\n", shard, level->name,
+           bitrate, load, n, count, attackable, instances);
+    GenFreeShard(candidates, ecu, can);
+    return 0;
+}
+
+/** Generates shards 0..shards-1 in dir, as many at a time as there are cores.
+Returns the number of shards that failed.
+**/
+#ifdef __linux__
+int GenerateDataset(const char *dir, int shards, unsigned long long seed)
+{
+    int shard = 0, running = 0, failed = 0, status = 0, workers = genWorkers;
+    uint64_t s = 0;
+    pid_t pid;
+
+    if (MakeDir(dir) != 0) {
+        perror(dir);
+        return shards;
+    }
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0)
+        workers = 1;
+    printf("Generating %d shards in %s with %d workers (seed %llu)\n", shards, dir, workers,
+           (unsigned long long)seed);
+    while (shard < shards || running > 0)
+    {
+        if (shard < shards && running < workers)
+        {
+            s = seed ^ ((uint64_t)shard << 32);
+            s = GenNext(&s);
+            fflush(stdout);
+            pid = fork();
+            if (pid == 0)
+                exit(GenerateShard(dir, shard, s));
+            if (pid < 0) {
+                perror("fork");
+                failed += shards - shard;
+                shard = shards;
+                continue;
+            }
+            shard++;
+            running++;
+            continue;
+        }
+        if (wait(&status) < 0)
+            break;
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    printf("%d shards written, %d failed\n", shards - failed, failed);
+    return failed;
+}
+#else
+// No fork: the shards run in turn, each leaves the working directory in its shard
+int GenerateDataset(const char *dir, int shards, unsigned long long seed)
+{
+    int shard = 0, failed = 0;
+    uint64_t s = 0;
+    char cwd[512];
+
+    if (MakeDir(dir) != 0) {
+        perror(dir);
+        return shards;
+    }
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return shards;
+    }
+    printf("Generating %d shards in %s with 1 worker (seed %llu)\n", shards, dir, (unsigned long long)seed);
+    for (shard = 0; shard < shards; shard++)
+    {
+        s = seed ^ ((uint64_t)shard << 32);
+        s = GenNext(&s);
+        if (GenerateShard(dir, shard, s) != 0)
+            failed++;
+        if (chdir(cwd) != 0) {
+            perror(cwd);
+            failed += shards - shard - 1;
+            break;
+        }
+    }
+    printf("%d shards written, %d failed\n", shards - failed, failed);
+    return failed;
+}
+#endif // __linux__
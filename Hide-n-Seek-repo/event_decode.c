@@ -0,0 +1,99 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "event_ring.h"
+
+/** Offline decoder of the analyzer's event rings.
+    event_decode events.hnse [-cat <list>] [-csv]
+Prints the events of all threads merged in time order, as
+    <time us> <thread> <event>: <text>
+with the text of the event's format, or the raw arguments with -csv.
+-cat keeps the given categories (the list of obfuscation -events).
+**/
+
+#define EVENT_NAME(name, cat, fmt) #name,
+#define EVENT_CAT(name, cat, fmt) cat,
+#define EVENT_FMT(name, cat, fmt) fmt,
+static const char *eventNames[] = { EVENT_LIST(EVENT_NAME) };
+static const unsigned int eventCats[] = { EVENT_LIST(EVENT_CAT) };
+static const char *eventFormats[] = { EVENT_LIST(EVENT_FMT) };
+
+static int CompareTicks(const void *a, const void *b)
+{
+    const struct EventRecord *x = (const struct EventRecord *)a, *y = (const struct EventRecord *)b;
+
+    if (x->ticks != y->ticks)
+        return x->ticks < y->ticks ? -1 : 1;
+    return x->thread - y->thread;
+}
+
+int main(int argc, char **argv)
+{
+    struct EventFileHeader hdr;
+    struct EventRecord *events = NULL;
+    unsigned int mask = EVCAT_ALL, t = 0, count = 0;
+    long n = 0, cap = 0, i = 0, shown = 0;
+    int csv = 0, a = 0;
+    uint64_t zero = 0;
+    FILE *fp;
+
+    if (argc < 2) {
+        printf("usage: %s events.hnse [-cat <list>] [-csv]\n", argv[0]);
+        return 1;
+    }
+    for (a = 2; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-csv") == 0)
+            csv = 1;
+        else if (strcmp(argv[a], "-cat") == 0 && a + 1 < argc)
+            mask = ParseEventMask(argv[++a]);
+    }
+    fp = fopen(argv[1], "rb");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, EVENT_MAGIC, 4) != 0 ||
+        hdr.recordSize != sizeof(struct EventRecord)) {
+        printf("%s is not an event file of this version\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    for (t = 0; t < hdr.ringCount; t++)
+    {
+        if (fread(&count, sizeof(uint32_t), 1, fp) != 1)
+            break;
+        if (n + count > cap) {
+            cap = (n + count) * 2;
+            events = (struct EventRecord *)realloc(events, sizeof(struct EventRecord) * cap);
+        }
+        n += fread(events + n, sizeof(struct EventRecord), count, fp);
+    }
+    fclose(fp);
+    qsort(events, n, sizeof(struct EventRecord), CompareTicks);
+    if (n > 0)
+        zero = events[0].ticks;
+
+    if (csv)
+        printf("TimeUs,Thread,Event,A0,A1,A2,A3,A4\n");
+    for (i = 0; i < n; i++)
+    {
+        struct EventRecord *e = &events[i];
+
+        if (e->event >= EV_COUNT || !(eventCats[e->event] & mask))
+            continue;
+        if (csv)
+            printf("%.3f,%d,%s,%d,%d,%d,%d,%d\n", (e->ticks - zero) / hdr.ticksPerSec * 1e6, e->thread,
+                   eventNames[e->event], e->args[0], e->args[1], e->args[2], e->args[3], e->args[4]);
+        else {
+            printf("%12.3f %2d %-18s ", (e->ticks - zero) / hdr.ticksPerSec * 1e6, e->thread, eventNames[e->event]);
+            printf(eventFormats[e->event], e->args[0], e->args[1], e->args[2], e->args[3], e->args[4]);
+            printf("\n");
+        }
+        shown++;
+    }
+    fprintf(stderr, "%ld of %ld events, %u threads, mask 0x%x, %llu overwritten\n", shown, n, hdr.threadCount,
+            hdr.mask, (unsigned long long)hdr.overwritten);
+    free(events);
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include "event_ring.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
+
+unsigned int eventMask = EVCAT_PHASE | EVCAT_INSTANCE | EVCAT_POLICY | EVCAT_OPT;
+int eventRingSize = 1 << 16;
+
+struct EventRing
+{
+    struct EventRing *next; // list of all rings, pushed with a CAS
+    int inUse; // owned by a running thread; a thread that exits leaves its ring to the next one
+    uint32_t thread; // current owner
+    uint64_t head; // events ever recorded, the ring holds the last size of them
+    uint64_t mask;
+    struct EventRecord *records;
+};
+
+static struct EventRing *rings = NULL;
+static uint32_t threadCount = 0, ringCount = 0;
+static __thread struct EventRing *ownRing = NULL;
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static uint64_t startTicks = 0;
+static double startSec = 0;
+
+static double MonotonicSec(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// The TSC where there is one, a few ns instead of a clock_gettime call
+static inline uint64_t EventTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+#endif
+}
+
+// Thread exit: the ring keeps its events and goes to the next new thread
+static void ReleaseRing(void *ring)
+{
+    __atomic_store_n(&((struct EventRing *)ring)->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void CreateRingKey(void)
+{
+    pthread_key_create(&ringKey, ReleaseRing);
+}
+
+/** First event of a thread: takes over the ring of a thread that has exited, or
+allocates one and links it into the list. Short-lived workers (priority_opt.c
+starts new ones for every level) thus share a few rings.
+**/
+static struct EventRing *NewRing(void)
+{
+    struct EventRing *r;
+    int size = 1, idle = 0;
+
+    pthread_once(&ringKeyOnce, CreateRingKey);
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        idle = 0;
+        if (__atomic_compare_exchange_n(&r->inUse, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            r->thread = __atomic_fetch_add(&threadCount, 1, __ATOMIC_RELAXED);
+            pthread_setspecific(ringKey, r);
+            return r;
+        }
+    }
+    r = (struct EventRing *)calloc(1, sizeof(struct EventRing));
+    if (!r)
+        return NULL;
+    while (size < eventRingSize)
+        size <<= 1;
+    r->records = (struct EventRecord *)malloc(sizeof(struct EventRecord) * size);
+    if (!r->records) {
+        free(r);
+        return NULL;
+    }
+    r->mask = size - 1;
+    r->inUse = 1;
+    r->thread = __atomic_fetch_add(&threadCount, 1, __ATOMIC_RELAXED);
+    if (r->thread == 0) {
+        startTicks = EventTicks();
+        startSec = MonotonicSec();
+    }
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_add(&ringCount, 1, __ATOMIC_RELAXED);
+    pthread_setspecific(ringKey, r);
+    return r;
+}
+
+void EventRecord5(int event, int a0, int a1, int a2, int a3, int a4)
+{
+    struct EventRing *r = ownRing;
+    struct EventRecord *e;
+
+    if (!r && !(r = ownRing = NewRing()))
+        return;
+    e = &r->records[r->head & r->mask];
+    e->ticks = EventTicks();
+    e->event = (uint16_t)event;
+    e->thread = (uint16_t)r->thread;
+    e->args[0] = a0;
+    e->args[1] = a1;
+    e->args[2] = a2;
+    e->args[3] = a3;
+    e->args[4] = a4;
+    // Only the owner writes head; EventRingSave reads it after the threads are done
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/** "all", "none" or a comma separated list of phase, frame, instance, policy, opt.
+A number is taken as the mask itself.
+**/
+unsigned int ParseEventMask(const char *list)
+{
+    static const struct { const char *name; unsigned int cat; } names[] = {
+        {"phase", EVCAT_PHASE}, {"frame", EVCAT_FRAME}, {"instance", EVCAT_INSTANCE},
+        {"policy", EVCAT_POLICY}, {"opt", EVCAT_OPT}, {"all", EVCAT_ALL}, {"none", 0}};
+    char buf[256], *tok;
+    unsigned int mask = 0, i = 0;
+
+    if (list[0] >= '0' && list[0] <= '9')
+        return (unsigned int)strtoul(list, NULL, 0);
+    snprintf(buf, sizeof(buf), "%s", list);
+    for (tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        for (i = 0; i < sizeof(names) / sizeof(names[0]) && strcmp(names[i].name, tok) != 0; i++)
+            ;
+        if (i < sizeof(names) / sizeof(names[0]))
+            mask |= names[i].cat;
+        else
+            printf("Unknown event category %s\n", tok);
+    }
+    return mask;
+}
+
+/** Writes the rings to path. Call it when no other thread records events.
+Returns the number of events written, -1 on error.
+**/
+int EventRingSave(const char *path)
+{
+    struct EventFileHeader hdr;
+    struct EventRing *r;
+    uint64_t first = 0, k = 0;
+    uint32_t count = 0;
+    long total = 0;
+    double elapsed = MonotonicSec() - startSec;
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EVENT_MAGIC, 4);
+    hdr.version = EVENT_VERSION;
+    hdr.recordSize = sizeof(struct EventRecord);
+    hdr.threadCount = __atomic_load_n(&threadCount, __ATOMIC_ACQUIRE);
+    hdr.ringCount = __atomic_load_n(&ringCount, __ATOMIC_ACQUIRE);
+    hdr.mask = eventMask;
+#if defined(__x86_64__) || defined(__i386__)
+    hdr.ticksPerSec = elapsed > 0 ? (EventTicks() - startTicks) / elapsed : 1e9;
+#else
+    hdr.ticksPerSec = 1e9;
+#endif
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+        if (r->head > r->mask + 1)
+            hdr.overwritten += r->head - (r->mask + 1);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        first = r->head > r->mask + 1 ? r->head - (r->mask + 1) : 0;
+        count = (uint32_t)(r->head - first);
+        fwrite(&count, sizeof(uint32_t), 1, fp);
+        // Oldest first: the part after the write position, then the part before it
+        k = first & r->mask;
+        if (k + count > r->mask + 1) {
+            fwrite(&r->records[k], sizeof(struct EventRecord), r->mask + 1 - k, fp);
+            fwrite(r->records, sizeof(struct EventRecord), count - (r->mask + 1 - k), fp);
+        } else
+            fwrite(&r->records[k], sizeof(struct EventRecord), count, fp);
+        total += count;
+    }
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    printf("%ld events (%llu overwritten) saved to %s\n", total, (unsigned long long)hdr.overwritten, path);
+    return (int)total;
+}
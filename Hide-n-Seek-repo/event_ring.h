@@ -0,0 +1,79 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include<stdint.h>
+
+/** Always-on diagnostics of the analyzer.
+Every thread writes fixed size events (event id + 5 integer arguments) into its
+own ring, so recording is a few stores and needs no lock. A ring keeps the most
+recent eventRingSize events; when its thread exits it goes to the next new
+thread. EventRingSave writes the rings to a .hnse file, which event_decode
+turns back into text. Categories are selected at run time with eventMask
+(obfuscation -events <list>).
+**/
+
+#define EVENT_MAGIC "HNSE"
+#define EVENT_VERSION 1
+
+#define EVCAT_PHASE    0x01 // analysis passes
+#define EVCAT_FRAME    0x02 // per-frame state machine (testID)
+#define EVCAT_INSTANCE 0x04 // instance table after every pass
+#define EVCAT_POLICY   0x08 // obfuscation policy decisions
+#define EVCAT_OPT      0x10 // priority assignment search
+#define EVCAT_ALL      0x1F
+
+/** X(name, category, format): the format gets the 5 arguments as ints and is
+only used by the decoder.
+**/
+#define EVENT_LIST(X) \
+    X(EV_PASS, EVCAT_PHASE, "pass %d: %d frames") \
+    X(EV_GAP, EVCAT_FRAME, "candidate %d, frame %d: gap = %d ns, max idle time = %d ns") \
+    X(EV_INSTANCE, EVCAT_INSTANCE, "candidate %d, %d: Instance = %d: attack win len = %d, attack win count = %d") \
+    X(EV_ATKWIN, EVCAT_INSTANCE, "candidate %d, instance %d: attack window %d: %d(instance=%d)") \
+    X(EV_PATTERN, EVCAT_INSTANCE, "candidate %d, instances %d+%d: pattern bits 0x%x") \
+    X(EV_OBF1, EVCAT_POLICY, "candidate %d: obfuscation 1, sorted order = %d, instance %d, skip = %d") \
+    X(EV_OBF2, EVCAT_POLICY, "candidate %d: obfuscation 2, instance %d of %d belongs to atk win, skip = %d") \
+    X(EV_OBF3, EVCAT_POLICY, "candidate %d: obfuscation 3, swapping priority with %d: %d attackable instances") \
+    X(EV_AUDSLEY_EVAL, EVCAT_OPT, "Audsley: ID %d for message %d: feasible = %d, %d attackable") \
+    X(EV_AUDSLEY_ASSIGN, EVCAT_OPT, "Audsley: ID %d -> message %d (%d attackable)")
+
+#define EVENT_ENUM(name, cat, fmt) name,
+enum EventID { EVENT_LIST(EVENT_ENUM) EV_COUNT };
+#undef EVENT_ENUM
+
+#define EVENT_ARGS 5
+
+struct EventRecord
+{
+    uint64_t ticks; // EventTicks() when the event was recorded
+    uint16_t event;
+    uint16_t thread; // order of the thread's first event, 0 = first thread
+    int32_t args[EVENT_ARGS];
+};
+
+struct EventFileHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t threadCount; // threads that recorded events
+    uint32_t ringCount;
+    uint32_t mask; // eventMask of the run
+    uint32_t reserved;
+    double ticksPerSec;
+    uint64_t overwritten; // events lost because a ring wrapped
+};
+// Then for every ring: uint32 count and count records, oldest first
+
+extern unsigned int eventMask;
+extern int eventRingSize; // events per thread, a power of two
+
+void EventRecord5(int event, int a0, int a1, int a2, int a3, int a4);
+unsigned int ParseEventMask(const char *list);
+int EventRingSave(const char *path);
+
+// Records an event if its category is enabled, the arguments are not evaluated otherwise
+#define EVENT(cat, event, a0, a1, a2, a3, a4) \
+    do { if (eventMask & (cat)) EventRecord5((event), (a0), (a1), (a2), (a3), (a4)); } while (0)
+
+#endif // EVENT_RING_H
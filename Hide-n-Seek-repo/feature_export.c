@@ -0,0 +1,210 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<sys/stat.h>
+#ifdef _WIN32
+#include<direct.h>
+#endif
+#include "obfuscation.h"
+
+/** Training tensors written next to final_candidates.csv.
+Every array is a plain .npy file, so numpy maps it without parsing:
+    np.load("features/features.npy", mmap_mode="r")
+Rows are instances, candidate by candidate and in instance index order, so the
+rows of candidate c are seq_offsets[c]:seq_offsets[c+1].
+    features.npy     float32 [N, 6]  Periodicity, InstanceIndex, AtkWinLen,
+                                     AtkWinCount, AtkWinMsgCnt, InsWinMsgCnt
+    candidate.npy    int32   [N]     CandidateID
+    attackable.npy   uint8   [N]
+    seq_offsets.npy  int64   [C+1]   CSR offsets of the candidates
+    atkwin_offsets.npy int64 [N+1]   CSR offsets of the attack windows
+    atkwin_ids.npy   int32   [M]     IDs in the attack window of each instance
+    atkwin_ins.npy   int32   [M]     their instance numbers
+A padded [N, max window] array is atkwin_ids split at atkwin_offsets.
+**/
+
+#define FEATURE_COUNT 6
+#define NPY_ALIGN 64
+
+/** Row order of the models: instances of every candidate by index. rows gets one
+pointer per instance, lens (optional) the instance count of every candidate.
+Returns the number of rows.
+**/
+int InstancesByIndex(struct Message *candidates, int candCount, struct Instance **rows, int *lens)
+{
+    int i = 0, j = 0, row = 0;
+
+    for (i = 0; i < candCount; i++)
+    {
+        // Instances are sorted by attack window length by now, index is a permutation of 0..count-1
+        for (j = 0; j < candidates[i].count; j++)
+            rows[row + candidates[i].instances[j].index] = &candidates[i].instances[j];
+        if (lens)
+            lens[i] = candidates[i].count;
+        row += candidates[i].count;
+    }
+    return row;
+}
+
+/** Feature row of one instance as classifier.ipynb defines it. Without
+withIndex it is the 5 sequence features (no InstanceIndex).
+**/
+void InstanceFeatures(const struct Message *cand, const struct Instance *ins, int withIndex, float *x)
+{
+    float atkMsg = 0, insMsg = 0;
+    int k = 0, f = 0;
+
+    // Only valid IDs are counted, like _msg_count in the notebook
+    for (k = 0; k < ins->atkWinCount; k++)
+    {
+        atkMsg += ins->atkWin && ins->atkWin[k] != -1;
+        insMsg += ins->insWin && ins->insWin[k] != -1;
+    }
+    x[f++] = cand->periodicity;
+    if (withIndex)
+        x[f++] = ins->index;
+    x[f++] = ins->atkWinLen;
+    x[f++] = ins->atkWinCount;
+    x[f++] = atkMsg;
+    x[f++] = insMsg;
+}
+
+/** Creates the directory path, an existing one is fine. Returns 0, or -1 with
+errno set. mkdir has no mode argument on Windows.
+**/
+int MakeDir(const char *path)
+{
+#ifdef _WIN32
+    if (_mkdir(path) == 0 || errno == EEXIST)
+#else
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+#endif
+        return 0;
+    return -1;
+}
+
+/** Writes one .npy array of rows x cols elements (cols 0: a vector). Returns 0,
+or -1 if the file can't be written completely.
+**/
+static int WriteNpy(const char *dir, const char *name, const char *descr, int64_t rows, int cols,
+                    const void *data, int elemSize)
+{
+    char path[512], header[128];
+    unsigned short headerLen = 0;
+    size_t count = (size_t)rows * (cols > 0 ? cols : 1);
+    int n = 0, ok = 1;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s.npy", dir, name);
+    fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    if (cols > 0)
+        n = snprintf(header, sizeof(header), "{'descr': '%s', 'fortran_order': False, 'shape': (%lld, %d), }",
+                     descr, (long long)rows, cols);
+    else
+        n = snprintf(header, sizeof(header), "{'descr': '%s', 'fortran_order': False, 'shape': (%lld,), }",
+                     descr, (long long)rows);
+    // Magic, version 1.0 and the header length take 10 bytes; pad so the data starts aligned
+    headerLen = (unsigned short)((10 + n + 1 + NPY_ALIGN - 1) / NPY_ALIGN * NPY_ALIGN - 10);
+    memset(header + n, ' ', headerLen - n - 1);
+    header[headerLen - 1] = '\n';
+    ok = fwrite("\x93NUMPY\x01\x00", 1, 8, fp) == 8 &&
+         fwrite(&headerLen, sizeof(headerLen), 1, fp) == 1 &&
+         fwrite(header, 1, headerLen, fp) == headerLen &&
+         fwrite(data, elemSize, count, fp) == count;
+    if (fclose(fp) != 0 || !ok) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/** Writes the training tensors of the final candidates into dir (created if needed) **/
+int SaveFeatureTensors(struct Message *candidates, int candCount, const char *dir)
+{
+    struct Instance **rows;
+    float *features;
+    int *candidate, *ids, *ins;
+    unsigned char *attackable;
+    int64_t *seqOffsets, *winOffsets, windows = 0; // <i8 in the .npy files, long is 32 bit on Windows
+    int i = 0, j = 0, k = 0, n = 0, row = 0, err = 0;
+
+    if (MakeDir(dir) != 0) {
+        perror(dir);
+        return -1;
+    }
+    for (i = 0; i < candCount; i++)
+        n += candidates[i].count;
+    rows = (struct Instance **)malloc(sizeof(struct Instance *) * (n + 1));
+    if (!rows) {
+        printf("Out of memory for the training tensors\n");
+        return -1;
+    }
+    InstancesByIndex(candidates, candCount, rows, NULL);
+    for (j = 0; j < n; j++)
+        windows += rows[j]->atkWin ? rows[j]->atkWinCount : 0;
+
+    features = (float *)malloc(sizeof(float) * (n + 1) * FEATURE_COUNT);
+    candidate = (int *)malloc(sizeof(int) * (n + 1));
+    attackable = (unsigned char *)malloc(n + 1);
+    seqOffsets = (int64_t *)malloc(sizeof(int64_t) * (candCount + 1));
+    winOffsets = (int64_t *)malloc(sizeof(int64_t) * (n + 1));
+    ids = (int *)malloc(sizeof(int) * (windows + 1));
+    ins = (int *)malloc(sizeof(int) * (windows + 1));
+    if (!features || !candidate || !attackable || !seqOffsets || !winOffsets || !ids || !ins) {
+        printf("Out of memory for the training tensors\n");
+        free(rows);
+        free(features);
+        free(candidate);
+        free(attackable);
+        free(seqOffsets);
+        free(winOffsets);
+        free(ids);
+        free(ins);
+        return -1;
+    }
+
+    seqOffsets[0] = 0;
+    winOffsets[0] = 0;
+    for (i = 0, row = 0; i < candCount; i++)
+    {
+        for (j = 0; j < candidates[i].count; j++, row++)
+        {
+            InstanceFeatures(&candidates[i], rows[row], 1, features + (long)row * FEATURE_COUNT);
+            candidate[row] = candidates[i].ID;
+            attackable[row] = (unsigned char)rows[row]->attackable;
+            winOffsets[row + 1] = winOffsets[row];
+            for (k = 0; rows[row]->atkWin && k < rows[row]->atkWinCount; k++)
+            {
+                ids[winOffsets[row + 1]] = rows[row]->atkWin[k];
+                ins[winOffsets[row + 1]] = rows[row]->insWin ? rows[row]->insWin[k] : -1;
+                winOffsets[row + 1]++;
+            }
+        }
+        seqOffsets[i + 1] = row;
+    }
+
+    err |= WriteNpy(dir, "features", "<f4", n, FEATURE_COUNT, features, sizeof(float));
+    err |= WriteNpy(dir, "candidate", "<i4", n, 0, candidate, sizeof(int));
+    err |= WriteNpy(dir, "attackable", "|u1", n, 0, attackable, 1);
+    err |= WriteNpy(dir, "seq_offsets", "<i8", candCount + 1, 0, seqOffsets, sizeof(int64_t));
+    err |= WriteNpy(dir, "atkwin_offsets", "<i8", n + 1, 0, winOffsets, sizeof(int64_t));
+    err |= WriteNpy(dir, "atkwin_ids", "<i4", windows, 0, ids, sizeof(int));
+    err |= WriteNpy(dir, "atkwin_ins", "<i4", windows, 0, ins, sizeof(int));
+    if (!err)
+        printf("Training tensors (%d instances, %lld window entries) saved to %s/\n", n, (long long)windows, dir);
+
+    free(rows);
+    free(features);
+    free(candidate);
+    free(attackable);
+    free(seqOffsets);
+    free(winOffsets);
+    free(ids);
+    free(ins);
+    return err ? -1 : 0;
+}
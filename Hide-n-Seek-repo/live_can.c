@@ -0,0 +1,197 @@
+#define _GNU_SOURCE // recvmmsg
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "obfuscation.h"
+
+/** Live reconnaissance on a SocketCAN interface (can0, or vcan0 fed by a replay).
+Frames are read in batches with recvmmsg together with their kernel receive
+timestamps, taken at the end of the frame and moved back by its length to its
+start of transmission, and pushed through AnalyzeCANFrame one frame late, since the idle
+test of a frame needs the start time of the next one. At every hyper period
+boundary the attackable flags of all candidate instances are published on
+stdout as
+    HP <n> <ID> <attackable>/<count> <flag of instance 0..count-1>
+The time spent per frame is kept in a histogram and reported at the end.
+**/
+
+#ifdef __linux__
+
+#include<signal.h>
+#include<time.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<linux/can.h>
+#include "can_trace.h"
+
+#define LIVE_BATCH 64
+#define LAT_BUCKET_NS 100 // histogram resolution
+#define LAT_BUCKETS 20000 // up to 2 ms, the rest goes to the last bucket
+#define MIN_FRAME_US_1M 47 // shortest standard frame (DLC 0, no stuffing) at 1 Mbps
+
+static volatile sig_atomic_t liveStop = 0;
+
+static void LiveStop(int sig)
+{
+    (void)sig;
+    liveStop = 1;
+}
+
+static void PublishAttackable(int hpNo, struct Message *candidates)
+{
+    int i = 0, j = 0, sum = 0;
+
+    for (i = 0; i < ECUCount; i++)
+    {
+        sum = 0;
+        for (j = 0; j < candidates[i].count; j++)
+        {
+            candidates[i].instances[j].attackable = candidates[i].instances[j].atkWinLen >= minAtkWinLen;
+            sum += candidates[i].instances[j].attackable;
+        }
+        printf("HP %d %d %d/%d ", hpNo, candidates[i].ID, sum, candidates[i].count);
+        for (j = 0; j < candidates[i].count; j++)
+            putchar('0' + candidates[i].instances[j].attackable);
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+static double LatencyPercentile(const unsigned long *hist, unsigned long n, double p)
+{
+    unsigned long target = (unsigned long)(p * n), acc = 0;
+    int b = 0;
+
+    for (b = 0; b < LAT_BUCKETS; b++)
+    {
+        acc += hist[b];
+        if (acc > target)
+            return (b + 1) * LAT_BUCKET_NS * 1e-3;
+    }
+    return LAT_BUCKETS * LAT_BUCKET_NS * 1e-3;
+}
+
+/** Runs the analysis on a live interface until Ctrl-C or maxFrames frames
+(maxFrames <= 0 means no limit). candidates must come from InitializeECU,
+stats (may be NULL) gets every frame with its time since the first one.
+Returns the number of frames analyzed, -1 if the interface can't be opened.
+**/
+long LiveAnalyzeCAN(const char *ifname, struct Message *candidates, long maxFrames, struct BusStats *stats)
+{
+    struct mmsghdr msgs[LIVE_BATCH];
+    struct iovec iovs[LIVE_BATCH];
+    struct can_frame frames[LIVE_BATCH];
+    char ctrl[LIVE_BATCH][CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+    struct Message prev, cur;
+    struct timespec t0, t1;
+    unsigned long *hist, *e2eHist;
+    uint64_t rxNs = 0, baseNs = 0;
+    double prevAbs = 0, curAbs = 0, hpBase = 0, startAbs = 0, sumNs = 0, maxNs = 0, ns = 0, e2e = 0;
+    long frameCount = 0, batches = 0;
+    int s = 0, n = 0, b = 0, hpNo = 0, havePrev = 0;
+
+    s = OpenCANSocket(ifname);
+    if (s < 0)
+        return -1;
+    hist = (unsigned long *)calloc(LAT_BUCKETS, sizeof(unsigned long));
+    e2eHist = (unsigned long *)calloc(LAT_BUCKETS, sizeof(unsigned long));
+    signal(SIGINT, LiveStop);
+    memset(&prev, 0, sizeof(prev));
+    memset(&cur, 0, sizeof(cur));
+    printf("Listening on %s, hyper period %d s\n", ifname, h);
+
+    while (!liveStop && (maxFrames <= 0 || frameCount < maxFrames))
+    {
+        for (b = 0; b < LIVE_BATCH; b++)
+        {
+            iovs[b].iov_base = &frames[b];
+            iovs[b].iov_len = sizeof(struct can_frame);
+            memset(&msgs[b].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[b].msg_hdr.msg_iov = &iovs[b];
+            msgs[b].msg_hdr.msg_iovlen = 1;
+            msgs[b].msg_hdr.msg_control = ctrl[b];
+            msgs[b].msg_hdr.msg_controllen = sizeof(ctrl[b]);
+        }
+        n = recvmmsg(s, msgs, LIVE_BATCH, MSG_WAITFORONE, NULL);
+        if (n <= 0)
+            continue;
+        batches++;
+        for (b = 0; b < n; b++)
+        {
+            if (frames[b].can_id & CAN_ERR_FLAG)
+                continue;
+            rxNs = CANRxTimestamp(&msgs[b].msg_hdr, NULL);
+            if (!havePrev)
+                baseNs = rxNs;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            cur.ID = frames[b].can_id & (frames[b].can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK);
+            cur.DLC = frames[b].can_dlc;
+            memcpy(cur.data, frames[b].data, 8);
+            SetFrameBits(&cur, (frames[b].can_id & CAN_EFF_FLAG ? TRACE_FLAG_EFF : 0)
+                               | (frames[b].can_id & CAN_RTR_FLAG ? TRACE_FLAG_RTR : 0));
+            // Seconds since the first frame; the kernel stamps the end of the frame, the analysis wants its start
+            curAbs = (int64_t)(rxNs - baseNs) * 1e-9 - FrameBits(&cur) / (busSpeed * 1000);
+            if (!havePrev)
+                hpBase = startAbs = curAbs;
+            if (stats)
+            {
+                cur.txTime = (float)(curAbs - startAbs);
+                BusStatsFrame(stats, &cur);
+            }
+            // Times are passed relative to the current hyper period so float keeps µs resolution
+            if (havePrev)
+            {
+                prev.txTime = (float)(prevAbs - hpBase);
+                AnalyzeCANFrame(prev, (float)(curAbs - hpBase), &candidates);
+            }
+            if (curAbs - hpBase >= h)
+            {
+                PublishAttackable(hpNo++, candidates);
+                hpBase += h * (long)((curAbs - hpBase) / h);
+            }
+            prev = cur;
+            prevAbs = curAbs;
+            havePrev = 1;
+            frameCount++;
+
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+            sumNs += ns;
+            if (ns > maxNs)
+                maxNs = ns;
+            hist[(long)(ns / LAT_BUCKET_NS) < LAT_BUCKETS ? (long)(ns / LAT_BUCKET_NS) : LAT_BUCKETS - 1]++;
+            // Kernel receive timestamp to end of processing, includes time queued in the socket
+            clock_gettime(CLOCK_REALTIME, &t1);
+            e2e = (double)(int64_t)((uint64_t)t1.tv_sec * 1000000000u + (uint64_t)t1.tv_nsec - rxNs);
+            if (e2e < 0)
+                e2e = 0;
+            e2eHist[(long)(e2e / LAT_BUCKET_NS) < LAT_BUCKETS ? (long)(e2e / LAT_BUCKET_NS) : LAT_BUCKETS - 1]++;
+        }
+    }
+    close(s);
+
+    printf("\nLive analysis stopped: %ld frames in %ld batches (%.1f frames/batch)\n",
+           frameCount, batches, batches ? (double)frameCount / batches : 0.0);
+    if (frameCount > 0)
+    {
+        printf("Per-frame processing: mean %.2f us, p50 %.1f us, p99 %.1f us, max %.2f us\n",
+               sumNs / frameCount * 1e-3, LatencyPercentile(hist, frameCount, 0.50),
+               LatencyPercentile(hist, frameCount, 0.99), maxNs * 1e-3);
+        printf("Kernel timestamp to processed: p50 %.1f us, p99 %.1f us\n",
+               LatencyPercentile(e2eHist, frameCount, 0.50), LatencyPercentile(e2eHist, frameCount, 0.99));
+        printf("Budget: %d us per frame at 1 Mbps\n", MIN_FRAME_US_1M);
+    }
+    free(hist);
+    free(e2eHist);
+    return frameCount;
+}
+
+#else
+
+long LiveAnalyzeCAN(const char *ifname, struct Message *candidates, long maxFrames, struct BusStats *stats)
+{
+    printf("Live mode needs Linux SocketCAN, %s can't be opened here\n", ifname);
+    return -1;
+}
+
+#endif // __linux__
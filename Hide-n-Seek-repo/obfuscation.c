@@ -3,13 +3,11 @@
 #include<time.h>
 #include<math.h>
 #include <string.h>
-
-#undef DEBUG
-#ifdef DEBUG
-#define PRINT printf
-#else
-#define PRINT
-#endif // DEBUG
+#include "obfuscation.h"
+#include "can_trace.h"
+#include "predictor.h"
+#include "can_frame.h"
+#include "event_ring.h"
 
 
 // CAN hyper-period
@@ -40,38 +38,16 @@ float busSpeed = 500; // in kbps
 // CLF criteria
 
 
+// Worker threads for the priority assignment optimizer
+int optThreads = 4;
+
+// Frame lengths with the stuff bits of each frame (1) or the nominal DLC*8+47 (0)
+int exactFrameBits = 1;
+
 // This is for verification
 // If we want to check the analysis for a specific control task
 int testID = 461;
 
-struct Instance{
-    int index;
-    int atkWinLen; // Length of attackwindow = total packet length of the high priority preceeding messages
-    int atkWinCount; // count of high priority messages preceding the target one
-    int attackable; //  if the attack window is sufficient for attacking
-    int *atkWin; // List of high priority messages preceeding the target instance
-    int *insWin;
-};
-
-struct Message
-{
-    int ID;
-    float periodicity;
-    int count; // no of instances per CAN hyper period
-    int DLC; // Data field length in terms of byte
-    float txTime; // Transmission time of a message
-    int atkWinLen; // Total length of attack window in bits
-    int tAtkWinLen; // temporary variable
-    int tAtkWinCount; // temporary variable
-    int readCount; // no. of times it is read from CAN traffic
-    int *tAtkWin; // temporary variable
-    int *tInsWin; // temporary variable
-    struct Instance *instances; // pointer to an instance array
-    int *sortedASP; // sorted list of the instance numbers wrt attack success probability (attack window length)
-    int *pattern; // execution pattern of the control task
-    int skipLimit; // instance number from when the first skip starts. 0 indicates first instance
-};
-
 /** *ID_set= list of structure of type ID,
 n = no. of items in ID_set
 IDs = list of IDs transmitted to CAN from victim
@@ -107,12 +83,45 @@ void InitializeECU(struct Message **IDSet)
     PRINT("\n Init ecu ended");
 }
 
+/** Parses one row of SampleTwo.csv into frame, returns 0 for the header and the
+"Logging stopped." line. Fields are taken by position, Chn,Identifier,DLC,
+D0..D7,Time,Dir: a frame with DLC below 8 leaves D<DLC>..D7 empty, which
+strtok would merge and so shift the Time column.
+**/
+int ParseSampleRow(char *buffer, struct Message *frame)
+{
+    char *field[13], *end;
+    int n = 0, i = 0;
+
+    field[n++] = buffer;
+    for (; *buffer && n < 13; buffer++)
+        if (*buffer == ',') {
+            *buffer = 0;
+            field[n++] = buffer + 1;
+        }
+    if (n < 12)
+        return 0;
+    strtol(field[0], &end, 10);
+    if (end == field[0] || *end)
+        return 0;
+    memset(frame, 0, sizeof(*frame));
+    frame->ID = (int)strtol(field[1], NULL, 16);
+    frame->DLC = atoi(field[2]);
+    if (frame->DLC < 0 || frame->DLC > 8)
+        return 0;
+    for (i = 0; i < frame->DLC; i++)
+        frame->data[i] = (unsigned char)strtol(field[3 + i], NULL, 16);
+    frame->txTime = strtod(field[11], &end);
+    return end != field[11];
+}
+
 /** *This function parse the CAN trraffic from sampleOne.csv
 We retrieve ID, DLC, and transmission start time
 **/
 int InitializeCANTraffic(struct Message **can)
 {
-    int row = 0, column = 0, line = 0;
+    int line = 0;
+    struct Message frame;
     FILE* fp = fopen("SampleTwo.csv", "r");
 
     if (!fp)
@@ -121,37 +130,69 @@ int InitializeCANTraffic(struct Message **can)
     {
         char buffer[1024];
 
-        while (fgets(buffer,3000, fp))
+        while (fgets(buffer, sizeof(buffer), fp))
         {
-            column = 0;
-            row++;
-            // Splitting the data
-            char* value = strtok(buffer, ",");
-            if(value!="Chn" || value!="Logging" || row>1)
-            {
-                line++;
-                *can = (struct Message *)realloc(*can,sizeof(struct Message)*line);
-                while (value) {
-                    // This is for our ECU-setup and CAN log
-                    if (column == 1 && line>1) {
-                        (*can)[line-2].ID = (int)strtol(value, NULL, 16);//atoi(value);
-                    }
-                    if (column == 2 && line>1) {
-                        (*can)[line-2].DLC = atoi(value);
-                    }
-                    if (column == 11 && line>1) {
-                        (*can)[line-2].txTime = atof(value);
-                    }
-                    value = strtok(NULL, ",");
-                    column++;
-                }
-            }
+            if (!ParseSampleRow(buffer, &frame))
+                continue;
+            line++;
+            *can = (struct Message *)realloc(*can,sizeof(struct Message)*line);
+            SetFrameBits(&frame, 0);
+            (*can)[line-1] = frame;
         }
         fclose(fp);
+    }
+    return line;
+}
+
+/** Loads a binary trace written by can_recorder instead of SampleTwo.csv.
+Same fields as InitializeCANTraffic: ID, DLC and transmission start time (s).
+**/
+int InitializeCANTrafficBinary(const char *path, struct Message **can)
+{
+    struct TraceHeader hdr;
+    struct TraceRecord records[4096];
+    size_t n = 0, j = 0;
+    int line = 0;
+    FILE *fp = TraceOpen(path, &hdr);
+
+    if (!fp)
+        return 0;
+    if (hdr.frameCount > 0)
+        *can = (struct Message *)realloc(*can, sizeof(struct Message)*hdr.frameCount);
+    while ((n = TraceRead(fp, records, 4096)) > 0)
+    {
+        if (line + n > hdr.frameCount)
+            *can = (struct Message *)realloc(*can, sizeof(struct Message)*(line + n));
+        for (j = 0; j < n; j++, line++)
+        {
+            memset(&(*can)[line], 0, sizeof(struct Message));
+            (*can)[line].ID = records[j].ID;
+            (*can)[line].DLC = records[j].DLC;
+            (*can)[line].txTime = records[j].tNs * 1e-9;
+            memcpy((*can)[line].data, records[j].data, 8);
+            SetFrameBits(&(*can)[line], records[j].flags);
         }
-        line = line-2;
-        *can = (struct Message *)realloc(*can,sizeof(struct Message)*line);
-        return line;
+    }
+    fclose(fp);
+    return line;
+}
+
+/** Fills the bus length of a parsed frame once at ingest: CANFrameBits over
+its ID and payload, or the nominal length when exactFrameBits is 0.
+flags are the TRACE_FLAG_* bits (0 for the 11 bit data frames of the CSV logs).
+**/
+void SetFrameBits(struct Message *frame, int flags)
+{
+    if (exactFrameBits)
+        frame->bits = CANFrameBits((uint32_t)frame->ID, flags, frame->DLC, frame->data);
+    else
+        frame->bits = CANNominalBits(flags, frame->DLC);
+}
+
+// Bus length of a frame in bits, nominal for frames that never went through SetFrameBits
+int FrameBits(const struct Message *frame)
+{
+    return frame->bits > 0 ? frame->bits : frame->DLC*8 + 47;
 }
 
 // merge two sorted arrays
@@ -440,6 +481,9 @@ void CommonMessages(int *a, int *x, int n_a, int *b, int *y, int n_b, struct Ins
     free((*ins).atkWin);
     PRINT("\n In common: freeing insWin");
     free((*ins).insWin);
+    // An empty intersection keeps the window length, so this instance comes back here
+    (*ins).atkWin = NULL;
+    (*ins).insWin = NULL;
     (*ins).atkWinCount = atkWinCount;
     PRINT("\n In Common: atkWinCount = %d",atkWinCount);
     if(atkWinCount>0)
@@ -473,119 +517,315 @@ int GetCurrentInstance(struct Message **candidates, int canDataID)
     return -1;
 }
 
-void AnalyzeCANTraffic(struct Message *CANTraffic, int CANCount, struct Message **candidates)
+// Priority map of the analysis, see SetAnalysisPriority (NULL = the logged IDs)
+static const struct BusyPeriodIndex *analysisIdx = NULL;
+static const int *analysisPrio = NULL;
+
+/** Makes AnalyzeCANFrame arbitrate with the priority map prio (prio[rank] over
+idx->ids, as in whatif.c) instead of the logged IDs. prio is read at every
+frame, so a swap of obfuscation 3 applies from the next pass on. The attack
+windows still list the logged IDs. NULL for both restores the logged IDs.
+**/
+void SetAnalysisPriority(const struct BusyPeriodIndex *idx, const int *prio)
+{
+    analysisIdx = idx;
+    analysisPrio = prio;
+}
+
+// The ID whose priority ID has under the analysis priority map
+int PriorityKey(int ID)
 {
-    int j=0,i=0,k=0,l=0,insNo = 0;
-    float txStart = 0, txEnds = 0, nextTxStart = 0;
+    int r = 0;
+
+    if(!analysisPrio)
+        return ID;
+    r = IDToRank(analysisIdx, ID);
+    return r < 0 ? ID : analysisIdx->ids[analysisPrio[r]];
+}
+
+/** Streaming step of the attack window state machine.
+Processes one CAN frame; nextTxStart is the start time of the frame that
+followed it on the bus, which tells whether the bus went idle in between.
+**/
+void AnalyzeCANFrame(struct Message CANPacket, float nextTxStart, struct Message **candidates)
+{
+    int i=0,k=0,l=0,insNo = 0,key = 0,candKey = 0;
+    float txStart = 0, txEnds = 0;
+    // Stuffing only makes frames longer, so a gap shorter than the nominal smallest frame still can't hold one
     float maxIdle = (minDlc*8+47)/(busSpeed*1000);
-    struct Message CANPacket, candidate;
-    while(j<CANCount-1)
+
+    txStart = CANPacket.txTime;
+    txEnds = FrameBits(&CANPacket)/(busSpeed*1000);
+    key = PriorityKey(CANPacket.ID);
+    PRINT("\n Checking for CAN ID:%d ***********************",CANPacket.ID);
+    for(i=0;i<ECUCount;i++)
     {
-        CANPacket = CANTraffic[j];
-        txStart = CANPacket.txTime;
-        txEnds = ((CANPacket.DLC)*8 + 47)/(busSpeed*1000);
-        nextTxStart = CANTraffic[j+1].txTime;
-        PRINT("\n Checking for CAN ID (%d):%d ***********************",j,CANPacket.ID);
-        for(i=0;i<ECUCount;i++)
+        PRINT("\n Checinkg for ECU ID:%d ***********************",(*candidates)[i].ID);
+        candKey = PriorityKey((*candidates)[i].ID);
+        k = 0;
+        for (l = (*candidates)[i].readCount; l < (*candidates)[i].count; l++)
+        {
+            if((*candidates)[i].pattern[l]==0)
+                k++;
+        }
+        if((*candidates)[i].ID == testID)
+            EVENT(EVCAT_FRAME, EV_GAP, testID, CANPacket.ID, (int)((nextTxStart - (txStart + txEnds))*1e9), (int)(maxIdle*1e9), 0);
+        if((key > candKey) || ((nextTxStart - (txStart + txEnds))>maxIdle && (key != candKey))) // If CAN packet is of lower priority or there is an idle period in between
         {
-            PRINT("\n Checinkg for ECU ID:%d ***********************",(*candidates)[i].ID);
-            k = 0;
-            for (l = (*candidates)[i].readCount; l < (*candidates)[i].count; l++)
+            if((*candidates)[i].tAtkWinLen>0)
             {
-                if((*candidates)[i].pattern[l]==0)
-                    k++;
+                PRINT("\n freeing tAtkWin in low priority case");
+                free((*candidates)[i].tAtkWin);
+                PRINT("\n freeing tInsWin in low priority case");
+                free((*candidates)[i].tInsWin);
+                (*candidates)[i].tAtkWinLen = 0;
+                (*candidates)[i].tAtkWinCount = 0;
             }
-            if((*candidates)[i].ID == testID)
+        }
+        else if((key < candKey)) // If CAN packet belongs to attack window
+        {
+            insNo = GetCurrentInstance(candidates,CANPacket.ID);
+            // what is instance no. of the CANPacket if it is coming from target ECU
+            (*candidates)[i].tAtkWinCount = (*candidates)[i].tAtkWinCount + 1;
+            (*candidates)[i].tAtkWinLen = (*candidates)[i].tAtkWinLen + FrameBits(&CANPacket);
+            if((*candidates)[i].tAtkWinCount == 1)
             {
-                printf("\n max idle time=%f",maxIdle);
-                printf("\n gap = %f",(nextTxStart - (txStart + txEnds)));
+                (*candidates)[i].tAtkWin = (int *)calloc((*candidates)[i].tAtkWinCount,sizeof(int));
+                (*candidates)[i].tInsWin = (int *)calloc((*candidates)[i].tAtkWinCount,sizeof(int));
             }
-            if((CANPacket.ID > (*candidates)[i].ID) || ((nextTxStart - (txStart + txEnds))>maxIdle && (CANPacket.ID != (*candidates)[i].ID))) // If CAN packet is of lower priority or there is an idle period in between
+            else
             {
-                if((*candidates)[i].tAtkWinLen>0)
-                {
-                    PRINT("\n freeing tAtkWin in low priority case");
-                    free((*candidates)[i].tAtkWin);
-                    PRINT("\n freeing tInsWin in low priority case");
-                    free((*candidates)[i].tInsWin);
-                    (*candidates)[i].tAtkWinLen = 0;
-                    (*candidates)[i].tAtkWinCount = 0;
-                }
+                (*candidates)[i].tAtkWin = (int *)realloc((*candidates)[i].tAtkWin,sizeof(int)*(*candidates)[i].tAtkWinCount);
+                (*candidates)[i].tInsWin = (int *)realloc((*candidates)[i].tInsWin,sizeof(int)*(*candidates)[i].tAtkWinCount);
             }
-            else if((CANPacket.ID < (*candidates)[i].ID)) // If CAN packet belongs to attack window
+            (*candidates)[i].tAtkWin[(*candidates)[i].tAtkWinCount-1] = CANPacket.ID;
+            (*candidates)[i].tInsWin[(*candidates)[i].tAtkWinCount-1] = insNo;
+        }
+        else
+        {
+            if((*candidates)[i].readCount>=(*candidates)[i].count) // 2nd hyper period onwards
             {
-                insNo = GetCurrentInstance(candidates,CANPacket.ID);
-                // what is instance no. of the CANPacket if it is coming from target ECU
-                (*candidates)[i].tAtkWinCount = (*candidates)[i].tAtkWinCount + 1;
-                (*candidates)[i].tAtkWinLen = (*candidates)[i].tAtkWinLen + (CANPacket.DLC)*8 + 47;
-                if((*candidates)[i].tAtkWinCount == 1)
+
+                (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen
+                            = (int)fmin((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen, (*candidates)[i].tAtkWinLen);
+                if((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen == 0)
                 {
-                    (*candidates)[i].tAtkWin = (int *)calloc((*candidates)[i].tAtkWinCount,sizeof(int));
-                    (*candidates)[i].tInsWin = (int *)calloc((*candidates)[i].tAtkWinCount,sizeof(int));
+                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount = 0;
+                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin =
+                                                        (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
+                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin =
+                                                        (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
+                }
+                else{
+                CommonMessages((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin,
+                               (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin,
+                               (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,
+                               (*candidates)[i].tAtkWin,
+                               (*candidates)[i].tInsWin,
+                               (*candidates)[i].tAtkWinCount,
+                               &(*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count]);
                 }
-                else
+            }
+            else // 1st hyper period
+            {
+
+                (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen = (*candidates)[i].tAtkWinLen;
+                (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount = (*candidates)[i].tAtkWinCount;
+                (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin =
+                                                        (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
+                (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin =
+                                                        (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
+                for(l=0;l<(*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount;l++)
                 {
-                    (*candidates)[i].tAtkWin = (int *)realloc((*candidates)[i].tAtkWin,sizeof(int)*(*candidates)[i].tAtkWinCount);
-                    (*candidates)[i].tInsWin = (int *)realloc((*candidates)[i].tInsWin,sizeof(int)*(*candidates)[i].tAtkWinCount);
+                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin[l] = (*candidates)[i].tAtkWin[l];
+                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin[l] = (*candidates)[i].tInsWin[l];
                 }
-                (*candidates)[i].tAtkWin[(*candidates)[i].tAtkWinCount-1] = CANPacket.ID;
-                (*candidates)[i].tInsWin[(*candidates)[i].tAtkWinCount-1] = insNo;
             }
+
+            if((*candidates)[i].tAtkWinLen>0)
+            {
+                PRINT("\n freeing tAtkWin at end");
+                free((*candidates)[i].tAtkWin);
+                PRINT("\n freeing tInsWin at end");
+                free((*candidates)[i].tInsWin);
+                (*candidates)[i].tAtkWinLen = 0;
+                (*candidates)[i].tAtkWinCount = 0;
+            }
+            (*candidates)[i].readCount=(*candidates)[i].readCount+k+1;
+        }
+    }
+}
+
+// stats (may be NULL) gets every frame of the trace in the same pass
+void AnalyzeCANTraffic(struct Message *CANTraffic, int CANCount, struct Message **candidates, struct BusStats *stats)
+{
+    int j=0;
+    while(j<CANCount-1)
+    {
+        AnalyzeCANFrame(CANTraffic[j], CANTraffic[j+1].txTime, candidates);
+        if(stats)
+            BusStatsFrame(stats, &CANTraffic[j]);
+        j++;
+    }
+    if(stats && CANCount > 0)
+        BusStatsFrame(stats, &CANTraffic[CANCount-1]);
+}
+
+/** Forgets the attack windows of every candidate, so that the next
+AnalyzeCANTraffic pass starts from the first hyper period again. The
+instances go back to instance order; the execution patterns are kept.
+**/
+void ResetCandidateWindows(struct Message *candidates, int candCount)
+{
+    int i = 0, j = 0;
+    struct Instance *byIndex;
+
+    for(i = 0; i < candCount; i++)
+    {
+        if(candidates[i].tAtkWinLen > 0)
+        {
+            free(candidates[i].tAtkWin);
+            free(candidates[i].tInsWin);
+        }
+        candidates[i].tAtkWinLen = 0;
+        candidates[i].tAtkWinCount = 0;
+        candidates[i].readCount = 0;
+        candidates[i].atkWinLen = 0;
+        byIndex = (struct Instance *)calloc(candidates[i].count, sizeof(struct Instance));
+        if(!byIndex)
+            continue;
+        for(j = 0; j < candidates[i].count; j++)
+        {
+            free(candidates[i].instances[j].atkWin);
+            free(candidates[i].instances[j].insWin);
+            byIndex[candidates[i].instances[j].index].index = candidates[i].instances[j].index;
+        }
+        free(candidates[i].instances);
+        candidates[i].instances = byIndex;
+    }
+}
+
+// Marks the instances whose attack window reaches minAtkWinLen, and the mean window of every candidate
+void MarkAttackable(struct Message *candidates, int candCount)
+{
+    int i = 0, j = 0, sum = 0;
+
+    for(i = 0; i < candCount; i++)
+    {
+        sum = 0;
+        for(j = 0; j < candidates[i].count; j++)
+        {
+            if(candidates[i].instances[j].atkWinLen >= minAtkWinLen)
+                candidates[i].instances[j].attackable = 1;
             else
+                candidates[i].instances[j].attackable = 0;
+            sum += candidates[i].instances[j].atkWinLen;
+        }
+        candidates[i].atkWinLen = sum / candidates[i].count;
+    }
+}
+
+// Sorts the instances of each candidate by attack window length and records them (EVCAT_INSTANCE)
+void SortInstances(struct Message *candidates, int candCount)
+{
+    int i = 0, j = 0, k = 0, bits = 0;
+
+    for(i = 0; i < candCount; i++)
+    {
+        InsSortByAtkWinLen(&candidates[i].instances, 0, candidates[i].count - 1);
+        // Status of each candidate before applying obfuscation policies, see event_decode
+        if(eventMask & EVCAT_INSTANCE)
+        {
+            for(j = 0; j < candidates[i].count; j++)
             {
-                if((*candidates)[i].readCount>=(*candidates)[i].count) // 2nd hyper period onwards
+                EVENT(EVCAT_INSTANCE, EV_INSTANCE, candidates[i].ID, j, candidates[i].instances[j].index,
+                      candidates[i].instances[j].atkWinLen, candidates[i].instances[j].atkWinCount);
+                for(k = 0; k < candidates[i].instances[j].atkWinCount; k++)
+                    EVENT(EVCAT_INSTANCE, EV_ATKWIN, candidates[i].ID, candidates[i].instances[j].index, k,
+                          candidates[i].instances[j].atkWin[k], candidates[i].instances[j].insWin[k]);
+            }
+            // 31 pattern bits per event, instance j in bit j % 31
+            for(j = 0, bits = 0; j < candidates[i].count; j++)
+            {
+                bits |= (candidates[i].pattern[j] != 0) << (j % 31);
+                if(j % 31 == 30 || j == candidates[i].count - 1)
                 {
-
-                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen
-                                = (int)fmin((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen, (*candidates)[i].tAtkWinLen);
-                    if((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen == 0)
-                    {
-                        (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount = 0;
-                        (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin =
-                                                            (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
-                        (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin =
-                                                            (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
-                    }
-                    else{
-                    CommonMessages((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin,
-                                   (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin,
-                                   (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,
-                                   (*candidates)[i].tAtkWin,
-                                   (*candidates)[i].tInsWin,
-                                   (*candidates)[i].tAtkWinCount,
-                                   &(*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count]);
-                    }
+                    EVENT(EVCAT_INSTANCE, EV_PATTERN, candidates[i].ID, j - j % 31, j % 31 + 1, bits, 0);
+                    bits = 0;
                 }
-                else // 1st hyper period
-                {
+            }
+        }
+    }
+}
 
-                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinLen = (*candidates)[i].tAtkWinLen;
-                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount = (*candidates)[i].tAtkWinCount;
-                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin =
-                                                            (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
-                    (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin =
-                                                            (int *)calloc((*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount,sizeof(int));
-                    for(l=0;l<(*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWinCount;l++)
-                    {
-                        (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].atkWin[l] = (*candidates)[i].tAtkWin[l];
-                        (*candidates)[i].instances[((*candidates)[i].readCount+k)%(*candidates)[i].count].insWin[l] = (*candidates)[i].tInsWin[l];
-                    }
-                }
+/** One round of the obfuscation policies over candidates sorted by SortInstances:
+skip the most attackable instance (1), else an instance of a higher priority
+candidate in its attack window (2), else swap priorities with the best equal
+period candidate (3). skipLimits[j] bounds the consecutive skips of candidate j
+in policy 2. A swap only updates prio: the next pass analyzes the trace
+arbitrated again under it (ArbitrateTrace, SetAnalysisPriority); candidates
+keep their order. Returns the number of swaps.
+**/
+int ApplyObfuscationPolicies(struct Message *candidates, int candCount, const int *skipLimits,
+                             const struct BusyPeriodIndex *busyIdx, int *prio)
+{
+    int i = 0, j = 0, k = 0, sum = 0, score = 0, swaps = 0, ifSkip = 0, insToSkipObf1 = 0, insToSkipObf2 = 0;
 
-                if((*candidates)[i].tAtkWinLen>0)
+    for(i = 0; i < candCount; i++)
+    {
+        ifSkip = 0;
+        insToSkipObf1 = 0;
+        insToSkipObf2 = 0;
+        j = 0;
+        while(j < candidates[i].count)
+        {
+            if(!candidates[i].instances[j].attackable || !candidates[i].pattern[candidates[i].instances[j].index])
+                j++;
+            else break;
+        }
+        if(j < candidates[i].count)
+        {
+            insToSkipObf1 = candidates[i].instances[j].index;
+            ifSkip = IfSkipPossible(candidates[i].pattern, candidates[i].count, candidates[i].skipLimit, insToSkipObf1);
+        }
+        EVENT(EVCAT_POLICY, EV_OBF1, candidates[i].ID, j, insToSkipObf1, ifSkip, 0);
+        if(ifSkip) // Obfuscation 1 is possible
+            continue;
+        else // Checking obfuscation 2
+        {
+            // Only higher priority IDs are in the window, whatever the swaps made of the ID order
+            for(j = 0; j < candCount; j++)
+            {
+                if(j == i)
+                    continue;
+                insToSkipObf2 = CheckMembership(candidates[i].instances[insToSkipObf1].atkWin, candidates[i].instances[insToSkipObf1].atkWinCount, candidates[j].ID);
+                if(insToSkipObf2 >= 0)
                 {
-                    PRINT("\n freeing tAtkWin at end");
-                    free((*candidates)[i].tAtkWin);
-                    PRINT("\n freeing tInsWin at end");
-                    free((*candidates)[i].tInsWin);
-                    (*candidates)[i].tAtkWinLen = 0;
-                    (*candidates)[i].tAtkWinCount = 0;
+                    ifSkip = IfSkipPossible(candidates[j].pattern, candidates[j].count, skipLimits[j], insToSkipObf2);
+                    EVENT(EVCAT_POLICY, EV_OBF2, candidates[i].ID, insToSkipObf2, candidates[j].ID, ifSkip, 0);
+                    if(ifSkip)
+                        break;
+                }
+            }
+            if(!ifSkip)
+            { // Checking obfuscation 3
+                // Score every equal-period swap on the busy period index and keep the best one
+                k = WhatIfBestSwap(busyIdx, prio, candidates, candCount, i, &score);
+                if(k >= 0)
+                {
+                    PRINT("\n Swapping priority of %d and %d: %d attackable instances", candidates[i].ID, candidates[k].ID, score);
+                    EVENT(EVCAT_POLICY, EV_OBF3, candidates[i].ID, candidates[k].ID, score, 0, 0);
+                    j = IDToRank(busyIdx, candidates[i].ID);
+                    insToSkipObf2 = IDToRank(busyIdx, candidates[k].ID);
+                    sum = prio[j];
+                    prio[j] = prio[insToSkipObf2];
+                    prio[insToSkipObf2] = sum;
+                    swaps++;
                 }
-                (*candidates)[i].readCount=(*candidates)[i].readCount+k+1;
             }
         }
-        j++;
     }
+    return swaps;
 }
 
 // This function checks if a new skip is introduced in the existing pattern
@@ -626,192 +866,344 @@ int CheckMembership(int *atkWin, int atkWinLen, int item)
     return -1;
 }
 
+/** Predicts the attackability of every candidate instance with a model exported
+from classifier.ipynb and stores it in instances[].predicted. The features are
+the final_candidates.csv columns the notebook trains on; sequence models see
+the instances of a candidate in index order. Returns -1 if the model fails.
+**/
+int PredictCandidates(struct Predictor *p, struct Message *candidates, int candCount)
+{
+    int i = 0, j = 0, total = 0, row = 0, ret = 0;
+    int *lens = (int *)calloc(candCount, sizeof(int));
+    struct Instance **rows;
+    float *x, *prob;
+
+    for (i = 0; i < candCount; i++)
+        total += candidates[i].count;
+    rows = (struct Instance **)malloc(sizeof(struct Instance *) * total);
+    x = (float *)malloc(sizeof(float) * total * p->inDim);
+    prob = (float *)malloc(sizeof(float) * total);
+
+    InstancesByIndex(candidates, candCount, rows, lens);
+    for (i = 0; i < candCount; i++)
+        for (j = 0; j < lens[i]; j++, row++)
+            InstanceFeatures(&candidates[i], rows[row], p->kind == MODEL_FF, x + row * p->inDim);
+
+    if (p->kind == MODEL_FF)
+        ret = PredictRows(p, x, total, prob);
+    else
+        ret = PredictSequences(p, x, lens, candCount, prob);
+    for (row = 0; row < total && ret == 0; row++)
+        rows[row]->predicted = prob[row];
+
+    free(rows);
+    free(lens);
+    free(x);
+    free(prob);
+    return ret;
+}
+
+// Writes the model predictions next to final_candidates.csv, one row per instance
+void SavePredictionsCSV(struct Message *candidates, int candCount, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    int i = 0, j = 0;
 
-// Writes the final candidate information to a CSV file.
-void SaveFinalCandidatesCSV(struct Message *candidates, int ECUCount) {
-    FILE *fp = fopen("final_candidates.csv", "w");
     if (!fp) {
-        perror("Error opening final_candidates.csv");
+        perror(path);
         return;
     }
-    
-    // Write CSV header
-    fprintf(fp, "CandidateID,Periodicity,InstanceIndex,Attackable,AtkWinLen,AtkWinCount,AtkWinMessages,InsWinMessages\n");
-
-    for (int i = 0; i < ECUCount; i++) {
-        // Loop over each instance for candidate i
-        for (int j = 0; j < candidates[i].count; j++) {
-            struct Instance *inst = &candidates[i].instances[j];
-            // Write candidate and instance basic info.
-            fprintf(fp, "%d,%.3f,%d,%d,%d,%d,", 
-                    candidates[i].ID,
-                    candidates[i].periodicity,
-                    inst->index,
-                    inst->attackable,
-                    inst->atkWinLen,
-                    inst->atkWinCount);
-            
-            // Write the attack window message IDs (if any)
-            if (inst->atkWinCount > 0 && inst->atkWin != NULL) {
-                // Open quotes to encapsulate list in case it contains commas
-                fprintf(fp, "\"");
-                for (int k = 0; k < inst->atkWinCount; k++) {
-                    fprintf(fp, "%d", inst->atkWin[k]);
-                    if (k < inst->atkWinCount - 1)
-                        fprintf(fp, ";");
-                }
-                fprintf(fp, "\",");
-            } else {
-                fprintf(fp, "\"\",");
+    fprintf(fp, "CandidateID,InstanceIndex,Probability\n");
+    for (i = 0; i < candCount; i++)
+        for (j = 0; j < candidates[i].count; j++)
+            fprintf(fp, "%d,%d,%.6f\n", candidates[i].ID, candidates[i].instances[j].index,
+                    candidates[i].instances[j].predicted);
+    fclose(fp);
+    printf("Predictions saved to %s\n", path);
+}
+
+/** The what-if engine against the full analyzer on the trace arbitrated again:
+under the logged priorities, and under random priority maps of the candidates
+and of the whole bus. Returns the number of maps on which they differ.
+**/
+static int CheckWhatIf(struct Message *can, int count)
+{
+    struct BusyPeriodIndex idx;
+    struct Message *arb = (struct Message *)calloc(count + 1, sizeof(struct Message));
+    struct Message *candidates = (struct Message *)calloc(ECUCount, sizeof(struct Message));
+    int *prio = NULL, *lens = NULL, *ranks = NULL;
+    int trial = 0, i = 0, j = 0, sum = 0, whatIf = 0, full = 0, failed = 0, tmp = 0;
+    unsigned int s = 12345;
+
+    if (!arb || !candidates || BuildBusyPeriodIndex(can, count, &idx) != 0) {
+        free(arb);
+        free(candidates);
+        return 1;
+    }
+    InitializeECU(&candidates);
+    for (i = 0; i < ECUCount; i++)
+        sum += candidates[i].count;
+    prio = (int *)calloc(idx.idCount + 1, sizeof(int));
+    lens = (int *)calloc(sum + 1, sizeof(int));
+    ranks = (int *)calloc(ECUCount + 1, sizeof(int));
+    for (trial = 0; prio && lens && ranks && trial < 41; trial++)
+    {
+        IdentityPriority(&idx, prio);
+        // 1-20: the candidates among their own priorities, 21-40: every ID
+        for (i = 0; i < ECUCount; i++)
+            ranks[i] = IDToRank(&idx, candidates[i].ID);
+        for (i = (trial <= 20 ? ECUCount : idx.idCount) - 1; trial > 0 && i > 0; i--)
+        {
+            s = s * 1103515245u + 12345u;
+            j = (int)((s >> 8) % (unsigned int)(i + 1));
+            if (trial <= 20 && ranks[i] >= 0 && ranks[j] >= 0) {
+                tmp = prio[ranks[i]]; prio[ranks[i]] = prio[ranks[j]]; prio[ranks[j]] = tmp;
             }
-            
-            // Write the corresponding instance numbers (if any)
-            if (inst->atkWinCount > 0 && inst->insWin != NULL) {
-                fprintf(fp, "\"");
-                for (int k = 0; k < inst->atkWinCount; k++) {
-                    fprintf(fp, "%d", inst->insWin[k]);
-                    if (k < inst->atkWinCount - 1)
-                        fprintf(fp, ";");
-                }
-                fprintf(fp, "\"");
-            } else {
-                fprintf(fp, "\"\"");
+            else if (trial > 20) {
+                tmp = prio[i]; prio[i] = prio[j]; prio[j] = tmp;
             }
-            
-            // End line for this instance.
-            fprintf(fp, "\n");
+        }
+        whatIf = WhatIfAttackWindows(&idx, prio, candidates, ECUCount, lens);
+        ResetCandidateWindows(candidates, ECUCount);
+        SetAnalysisPriority(&idx, prio);
+        ArbitrateTrace(can, count, &idx, prio, arb);
+        AnalyzeCANTraffic(arb, count, &candidates, NULL);
+        SetAnalysisPriority(NULL, NULL);
+        for (i = 0, full = 0; i < ECUCount; i++)
+            for (j = 0; j < candidates[i].count; j++)
+                full += candidates[i].instances[j].atkWinLen >= minAtkWinLen;
+        if (whatIf != full) {
+            printf("check: priority map %d, the what-if engine has %d attackable instances, the analyzer %d\n", trial,
+                   whatIf, full);
+            failed++;
         }
     }
-    
-    fclose(fp);
-    printf("\nFinal candidates saved to final_candidates.csv\n");
+    ResetCandidateWindows(candidates, ECUCount);
+    for (i = 0; i < ECUCount; i++) {
+        free(candidates[i].instances);
+        free(candidates[i].sortedASP);
+        free(candidates[i].pattern);
+    }
+    free(candidates);
+    free(arb);
+    free(prio);
+    free(lens);
+    free(ranks);
+    FreeBusyPeriodIndex(&idx);
+    return failed;
 }
 
-int main()
+/** Checks on hand-made input and on SampleTwo.csv (obfuscation -check).
+Returns the number of failed checks.
+**/
+static int RunChecks(void)
 {
-    int i = 0, sum = 0, j = 0, k = 0, l = 0, CANCount = 0, ifSkip = 0, insToSkipObf1 = 0, insToSkipObf2 = 0, initDectec = 0;
+    char row[] = "0,121,4,2,0,0,0,,,,,0.01186,R\n", header[] = "Chn,Identifier,DLC,D0,D1,D2,D3,D4,D5,D6,D7,Time,Dir\n";
+    char footer[] = "Logging stopped.,,,,,,,,,,,,\n";
+    struct Message frame, *can = NULL;
+    int failed = 0, count = 0, i = 0;
+
+    if (!ParseSampleRow(row, &frame) || frame.ID != 0x121 || frame.DLC != 4 || frame.data[0] != 2 ||
+        frame.data[4] != 0 || fabsf(frame.txTime - 0.01186f) > 1e-7f) {
+        printf("check: row with empty D4-D7 parsed as ID %X, DLC %d, time %g\n", frame.ID, frame.DLC, frame.txTime);
+        failed++;
+    }
+    if (ParseSampleRow(header, &frame) || ParseSampleRow(footer, &frame)) {
+        printf("check: header or footer of SampleTwo.csv parsed as a frame\n");
+        failed++;
+    }
+    count = InitializeCANTraffic(&can);
+    for (i = 0; i < count; i++)
+        if (!isfinite(can[i].txTime) || (i > 0 && can[i].txTime < can[i-1].txTime)) {
+            printf("check: frame %d of SampleTwo.csv (ID %X) at %g after %g\n", i, can[i].ID, can[i].txTime,
+                   i > 0 ? can[i-1].txTime : 0.0);
+            failed++;
+            break;
+        }
+    if (count > 0)
+        failed += CheckWhatIf(can, count);
+    free(can);
+    failed += BusStatsCheck();
+    printf("checks: %d failed\n", failed);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int i = 0, sum = 0, j = 0, l = 0, CANCount = 0, initDectec = 0;
+    int score = 0, mismatch = 0;
     float smallestPeriod = 0;
+    struct BusyPeriodIndex busyIdx;
+    int *prio = NULL, *newID = NULL, *whatIfLens = NULL;
+    const char *tracePath = NULL, *modelPath = NULL, *binPath = NULL, *eventPath = "events.hnse";
+    struct Predictor *model = NULL;
+    struct timespec t0, t1;
+    struct BusStats busStats;
+    int statsReady = 0;
 
     srand(time(0));
 
+    // obfuscation -live <can interface> [frames]: reconnaissance on a live bus instead of SampleTwo.csv
+    if(argc >= 3 && strcmp(argv[1], "-live") == 0)
+    {
+        struct Message *liveCandidates = (struct Message *)calloc(ECUCount, sizeof(struct Message));
+        InitializeECU(&liveCandidates);
+        statsReady = BusStatsInit(&busStats) == 0;
+        if(LiveAnalyzeCAN(argv[2], liveCandidates, argc >= 4 ? atol(argv[3]) : 0, statsReady ? &busStats : NULL) < 0)
+            return 1;
+        SaveFinalCandidatesCSV(liveCandidates, ECUCount);
+        SaveFeatureTensors(liveCandidates, ECUCount, "features");
+        if(statsReady)
+            SaveBusStats(&busStats, liveCandidates, ECUCount, "bus_load.csv", "id_stats.csv");
+        free(liveCandidates);
+        return 0;
+    }
+
+    // obfuscation -generate <dir> [shards] [seed]: labelled synthetic shards for training
+    if(argc >= 3 && strcmp(argv[1], "-generate") == 0)
+        return GenerateDataset(argv[2], argc >= 4 ? atoi(argv[3]) : 64, argc >= 5 ? strtoull(argv[4], NULL, 10) : 1) ? 1 : 0;
+
+    // obfuscation -bench [options]: phase timings on synthetic traces
+    if(argc >= 2 && strcmp(argv[1], "-bench") == 0)
+        return RunAnalyzerBench(argc, argv);
+
+    // obfuscation -check: parser and statistics checks, non-zero exit if one fails
+    if(argc >= 2 && strcmp(argv[1], "-check") == 0)
+        return RunChecks() ? 1 : 0;
+
     struct Message *CANTraffic = (struct Message *)calloc(CANCount+1, sizeof(struct Message));
+    struct Message *arbTraffic = NULL;
     struct Message *candidates = (struct Message *)calloc(ECUCount, sizeof(struct Message));
     struct Message *sortecCandidates = (struct Message *)calloc(1, sizeof(struct Message));
 
-    CANCount = InitializeCANTraffic(&CANTraffic);
+    // obfuscation [-trace <file.hnst>] [-model <file.hnsm>] [-candidates <file.hnsc>] [-events <categories>] [-event-file <file.hnse>]
+    for(i = 1; i + 1 < argc; i++)
+    {
+        if(strcmp(argv[i], "-trace") == 0)
+            tracePath = argv[++i];
+        else if(strcmp(argv[i], "-model") == 0)
+            modelPath = argv[++i];
+        else if(strcmp(argv[i], "-candidates") == 0)
+            binPath = argv[++i];
+        else if(strcmp(argv[i], "-events") == 0)
+            eventMask = ParseEventMask(argv[++i]);
+        else if(strcmp(argv[i], "-event-file") == 0)
+            eventPath = argv[++i];
+    }
+    i = 0;
+    // Load the model first so a bad file is reported before the long analysis
+    if(modelPath && !(model = LoadPredictor(modelPath)))
+        return 1;
+
+    // A binary capture instead of SampleTwo.csv
+    if(tracePath)
+        CANCount = InitializeCANTrafficBinary(tracePath, &CANTraffic);
+    else
+        CANCount = InitializeCANTraffic(&CANTraffic);
     InitializeECU(&candidates);
-    
-    while(l <= 10)
+    statsReady = BusStatsInit(&busStats) == 0;
+
+    // The trace does not change between iterations, index it once for the what-if engine
+    if(BuildBusyPeriodIndex(CANTraffic, CANCount, &busyIdx) != 0)
     {
-        printf("\nAnalyzing the CAN traffic.......................");
-        AnalyzeCANTraffic(CANTraffic, CANCount, &candidates);
-        for(i = 0; i < ECUCount; i++)
-        {
-            sum = 0;
-            for(j = 0; j < candidates[i].count; j++)
-            {
-                if(candidates[i].instances[j].atkWinLen >= minAtkWinLen)
-                    candidates[i].instances[j].attackable = 1;
-                else
-                    candidates[i].instances[j].attackable = 0;
-                sum += candidates[i].instances[j].atkWinLen;
-            }
-            candidates[i].atkWinLen = sum / candidates[i].count;
-        }
+        printf("\nCan't build busy period index\n");
+        return 1;
+    }
+    prio = (int *)calloc(busyIdx.idCount + 1, sizeof(int));
+    arbTraffic = (struct Message *)calloc(CANCount + 1, sizeof(struct Message));
+    if(!prio || !arbTraffic)
+    {
+        printf("\nOut of memory for the arbitrated trace\n");
+        return 1;
+    }
+    IdentityPriority(&busyIdx, prio);
 
-        // Sort the attack window of each instance of each candidate
+    // Proposal only: a schedulable complete ID assignment for the ECU (greedy per level), for comparison with the policies below
+    newID = (int *)calloc(ECUCount, sizeof(int));
+    score = OptimizePriorityAssignment(&busyIdx, CANTraffic, CANCount, candidates, ECUCount, optThreads, newID);
+    if(score >= 0)
+    {
+        printf("\nProposed ID assignment (%d attackable instances):", score);
         for(i = 0; i < ECUCount; i++)
-        {
-            InsSortByAtkWinLen(&candidates[i].instances, 0, candidates[i].count - 1);
-            // Printing the status of each candidate before applying obfuscation policies
-            printf("\n Candidate ID = %d", candidates[i].ID);
-            printf("\n--------------------------------------------------");
-            for(j = 0; j < candidates[i].count; j++)
-            {
-                printf("\n %d: Instance = %d: attack win len = %d, attack win count = %d", 
-                       j, candidates[i].instances[j].index, 
-                       candidates[i].instances[j].atkWinLen, 
-                       candidates[i].instances[j].atkWinCount);
-                printf("\n Attack window:");
-                for(k = 0; k < candidates[i].instances[j].atkWinCount; k++)
-                    printf("%d(instance=%d)  ", candidates[i].instances[j].atkWin[k],
-                                             candidates[i].instances[j].insWin[k]);
-            }
-            printf("\n Pattern: ");
-            for(j = 0; j < candidates[i].count; j++)
-                printf("%d ", candidates[i].pattern[j]);
-            printf("\n===========================================================================================");
-        }
+            printf("\n %d -> %d", candidates[i].ID, newID[i]);
+    }
+    free(newID);
 
-        // Apply obfuscation policies (your existing code here)
+    // Swaps of obfuscation 3 change prio, the analysis follows them
+    SetAnalysisPriority(&busyIdx, prio);
+    while(l <= 10)
+    {
+        printf("\nAnalyzing the CAN traffic.......................");
+        EVENT(EVCAT_PHASE, EV_PASS, l, CANCount, 0, 0, 0);
+        // The bus under the swaps so far; in the first pass the trace as logged, whose statistics are collected
+        ArbitrateTrace(CANTraffic, CANCount, &busyIdx, prio, arbTraffic);
+        AnalyzeCANTraffic(arbTraffic, CANCount, &candidates, l == 0 && statsReady ? &busStats : NULL);
+        MarkAttackable(candidates, ECUCount);
+        SortInstances(candidates, ECUCount);
         printf("\n Obfuscation policy initiated....................");
-        for(i = 0; i < ECUCount; i++)
-        {
-            ifSkip = 0;
-            insToSkipObf1 = 0;
-            insToSkipObf2 = 0;
-            j = 0;
-            printf("\nCandidate ID = %d", candidates[i].ID);
-            printf("\n Checking obfuscation 1");
-            while(j < candidates[i].count)
-            {
-                if(!candidates[i].instances[j].attackable || !candidates[i].pattern[candidates[i].instances[j].index])
-                    j++;
-                else break;
-            }
-            printf("\n sorted order = %d", j);
-
-            if(j < candidates[i].count)
-            {
-                insToSkipObf1 = candidates[i].instances[j].index;
-                ifSkip = IfSkipPossible(candidates[i].pattern, candidates[i].count, candidates[i].skipLimit, insToSkipObf1);
-            }
-            if(ifSkip) // Obfuscation 1 is possible
-                continue;
-            else // Checking obfuscation 2
-            {
-                printf("\n Checking obfuscation 2");
-                for(j = 0; j < i; j++)
-                {
-                    printf("\n Checking if higher priority task %d belongs to atk window", candidates[j].ID);
-                    insToSkipObf2 = CheckMembership(candidates[i].instances[insToSkipObf1].atkWin, candidates[i].instances[insToSkipObf1].atkWinCount, candidates[j].ID);
-                    if(insToSkipObf2 >= 0)
-                    {
-                        printf("\n Instance %d of %d belongs to atk win", insToSkipObf2, candidates[j].ID);
-                        ifSkip = IfSkipPossible(candidates[j].pattern, candidates[j].count, ctrlSkipLimit[j], insToSkipObf2);
-                        if(ifSkip)
-                            break;
-                    }
-                }
-                if(!ifSkip)
-                { // Checking obfuscation 3
-                    printf("\n Checking obfuscation 3");
-                    for(k = i - 1; k >= 0; k--)
-                    {
-                        if(candidates[i].periodicity != candidates[k].periodicity)
-                            break;
-                    }
-                    if(k != i - 1)
-                    {
-                        k++;
-                        if(candidates[i].periodicity == candidates[k].periodicity && 
-                           CheckMembership(candidates[i].instances[insToSkipObf1].atkWin, candidates[i].instances[insToSkipObf1].atkWinCount, candidates[k].ID) >= 0)
-                        {
-                            struct Message temp = candidates[k];
-                            candidates[k] = candidates[i];
-                            candidates[i] = temp;
-                        }
-                    }
-                }
-            }
-        }
+        ApplyObfuscationPolicies(candidates, ECUCount, ctrlSkipLimit, &busyIdx, prio);
         l++;
     }
 
-    // Save the final candidates to a CSV file.
+    // The passes above keep the smallest window of every instance over all of them. The CSV is for the priorities and
+    // patterns the policies settled on: one more pass from scratch over the trace arbitrated under them, which the
+    // what-if engine (arbitrating its index on its own) must agree with.
+    ResetCandidateWindows(candidates, ECUCount);
+    ArbitrateTrace(CANTraffic, CANCount, &busyIdx, prio, arbTraffic);
+    AnalyzeCANTraffic(arbTraffic, CANCount, &candidates, NULL);
+    MarkAttackable(candidates, ECUCount);
+    SortInstances(candidates, ECUCount);
+    SetAnalysisPriority(NULL, NULL);
+    for(i = 0, sum = 0, score = 0; i < ECUCount; i++)
+    {
+        sum += candidates[i].count;
+        for(j = 0; j < candidates[i].count; j++)
+            score += candidates[i].instances[j].attackable;
+    }
+    printf("\n Final priorities: %d attackable instances", score);
+    whatIfLens = (int *)calloc(sum + 1, sizeof(int));
+    if(whatIfLens && (j = WhatIfAttackWindows(&busyIdx, prio, candidates, ECUCount, whatIfLens)) != score)
+    {
+        printf("\n The what-if engine expects %d attackable instances, the CSV has %d\n", j, score);
+        mismatch = 1;
+    }
+    free(whatIfLens);
+
+    // Save the final candidates to a CSV file, and as tensors for training.
     SaveFinalCandidatesCSV(candidates, ECUCount);
+    if(binPath)
+        SaveFinalCandidatesBinary(candidates, ECUCount, binPath);
+    SaveFeatureTensors(candidates, ECUCount, "features");
+    if(statsReady)
+    {
+        SaveBusStats(&busStats, candidates, ECUCount, "bus_load.csv", "id_stats.csv");
+        FreeBusStats(&busStats);
+    }
+    if(eventMask)
+        EventRingSave(eventPath);
+
+    if(model)
+    {
+        for(i = 0, sum = 0, score = 0; i < ECUCount; i++)
+            sum += candidates[i].count;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if(PredictCandidates(model, candidates, ECUCount) == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            for(i = 0; i < ECUCount; i++)
+                for(j = 0; j < candidates[i].count; j++)
+                    score += (candidates[i].instances[j].predicted >= 0.5f) == candidates[i].instances[j].attackable;
+            printf("Model %s: %d/%d instances agree with the analysis, %.2f us per instance\n", modelPath, score, sum,
+                   ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) * 1e-3 / sum);
+            SavePredictionsCSV(candidates, ECUCount, "predictions.csv");
+        }
+        FreePredictor(model);
+    }
 
+    free(prio);
+    FreeBusyPeriodIndex(&busyIdx);
     free(candidates);
     free(CANTraffic);
-    return 0;
+    free(arbTraffic);
+    return mismatch;
 }
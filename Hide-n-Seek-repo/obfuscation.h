@@ -0,0 +1,208 @@
+#ifndef OBFUSCATION_H
+#define OBFUSCATION_H
+
+#include<stdint.h>
+
+#undef DEBUG
+#ifdef DEBUG
+#define PRINT printf
+#else
+#define PRINT
+#endif // DEBUG
+
+// Shared configuration of the target ECU (defined in obfuscation.c)
+extern int h;
+extern int ECUIDs[];
+extern float ECUIDPeriodicities[];
+extern int ctrlSkipLimit[];
+extern int ECUCount;
+extern int minAtkWinLen;
+extern int minDlc;
+extern float busSpeed;
+extern int testID;
+extern int optThreads;
+extern int exactFrameBits;
+extern float loadWindow;
+extern float loadStep;
+
+struct Instance{
+    int index;
+    int atkWinLen; // Length of attackwindow = total packet length of the high priority preceeding messages
+    int atkWinCount; // count of high priority messages preceding the target one
+    int attackable; //  if the attack window is sufficient for attacking
+    int *atkWin; // List of high priority messages preceeding the target instance
+    int *insWin;
+    float predicted; // model estimate of P(attackable), see PredictCandidates
+};
+
+struct Message
+{
+    int ID;
+    float periodicity;
+    int count; // no of instances per CAN hyper period
+    int DLC; // Data field length in terms of byte
+    float txTime; // Transmission time of a message
+    unsigned char data[8]; // D0..D7
+    int bits; // frame length on the bus in bits, stuff bits included (0 = nominal DLC*8+47)
+    int atkWinLen; // Total length of attack window in bits
+    int tAtkWinLen; // temporary variable
+    int tAtkWinCount; // temporary variable
+    int readCount; // no. of times it is read from CAN traffic
+    int *tAtkWin; // temporary variable
+    int *tInsWin; // temporary variable
+    struct Instance *instances; // pointer to an instance array
+    int *sortedASP; // sorted list of the instance numbers wrt attack success probability (attack window length)
+    int *pattern; // execution pattern of the control task
+    int skipLimit; // instance number from when the first skip starts. 0 indicates first instance
+};
+
+void InitializeECU(struct Message **IDSet);
+int ParseSampleRow(char *buffer, struct Message *frame);
+int InitializeCANTraffic(struct Message **can);
+int InitializeCANTrafficBinary(const char *path, struct Message **can);
+struct BusyPeriodIndex;
+void SetAnalysisPriority(const struct BusyPeriodIndex *idx, const int *prio);
+int PriorityKey(int ID);
+void AnalyzeCANFrame(struct Message CANPacket, float nextTxStart, struct Message **candidates);
+struct BusStats;
+void AnalyzeCANTraffic(struct Message *CANTraffic, int CANCount, struct Message **candidates, struct BusStats *stats);
+void ResetCandidateWindows(struct Message *candidates, int candCount);
+void MarkAttackable(struct Message *candidates, int candCount);
+void SortInstances(struct Message *candidates, int candCount);
+int ApplyObfuscationPolicies(struct Message *candidates, int candCount, const int *skipLimits,
+                             const struct BusyPeriodIndex *busyIdx, int *prio);
+int IfSkipPossible(int *patternList, int patternLen, int skipLimit, int newSkipPosition);
+int CheckMembership(int *atkWin, int atkWinLen, int item);
+void SetFrameBits(struct Message *frame, int flags);
+int FrameBits(const struct Message *frame);
+
+/** Busy-period index over a parsed CAN trace (whatif.c).
+Frames are kept in trace order with their ID compressed to a dense rank
+(0 = numerically smallest ID in the trace), so a priority remapping is just
+a permutation of ranks. busyStart[j] is the first frame of the busy period
+containing frame j, i.e. the frame after the last idle gap > maxIdle.
+ready[j] is the first position of its busy period at which frame j can have
+been pending: right after the last lower priority (larger ID) frame logged
+before it, which it would have beaten otherwise.
+**/
+struct BusyPeriodIndex
+{
+    int frameCount;
+    int idCount; // no. of distinct IDs in the trace
+    int *ids; // distinct IDs in ascending order, ids[rank] = ID
+    unsigned short *rank; // per frame: dense rank of its ID
+    unsigned short *bits; // per frame: frame length in bits (FrameBits)
+    int *busyStart; // per frame: index of the first frame of its busy period
+    int *ready; // per frame: first position it can take when its busy period is arbitrated again
+    int *byReady; // frame positions ordered by ready, each busy period in its own range
+    int maxBusyLen; // frames in the longest busy period
+    int *occStart; // per rank: offset of its first occurrence in occ (CSR)
+    int *occ; // frame positions grouped by rank, in trace order
+};
+
+int CompareInt(const void *a, const void *b);
+int BuildBusyPeriodIndex(struct Message *CANTraffic, int CANCount, struct BusyPeriodIndex *idx);
+void FreeBusyPeriodIndex(struct BusyPeriodIndex *idx);
+int IDToRank(const struct BusyPeriodIndex *idx, int ID);
+void IdentityPriority(const struct BusyPeriodIndex *idx, int *prio);
+int WhatIfAttackWindows(const struct BusyPeriodIndex *idx, const int *prio,
+                        struct Message *candidates, int candCount, int *atkWinLen);
+int ArbitrateTrace(const struct Message *CANTraffic, int CANCount, const struct BusyPeriodIndex *idx,
+                   const int *prio, struct Message *out);
+int WhatIfBestSwap(const struct BusyPeriodIndex *idx, const int *prio,
+                   struct Message *candidates, int candCount, int target, int *bestScore);
+
+// Audsley-style CAN ID assignment (priority_opt.c)
+int OptimizePriorityAssignment(const struct BusyPeriodIndex *idx, struct Message *CANTraffic, int CANCount,
+                               struct Message *candidates, int candCount, int threads, int *newID);
+
+// Attackability model on the analyzer's features (predictor.c engine)
+struct Predictor;
+int PredictCandidates(struct Predictor *p, struct Message *candidates, int candCount);
+void SavePredictionsCSV(struct Message *candidates, int candCount, const char *path);
+
+// final_candidates.csv and its binary twin (candidate_io.c)
+#define CANDIDATE_MAGIC "HNSC"
+#define CANDIDATE_VERSION 1
+
+struct CandidateFileHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t candCount;
+    uint32_t rowCount;
+    uint64_t entryCount; // int32 window entries after the records, IDs and instance numbers
+};
+
+// One row of final_candidates.csv
+struct CandidateRecord
+{
+    int32_t ID;
+    float periodicity;
+    int32_t index;
+    int32_t attackable;
+    int32_t atkWinLen;
+    int32_t atkWinCount;
+    int32_t idCount; // AtkWinMessages entries that follow
+    int32_t insCount; // InsWinMessages entries after them
+};
+
+void SaveFinalCandidatesCSV(struct Message *candidates, int ECUCount);
+int SaveFinalCandidatesBinary(struct Message *candidates, int candCount, const char *path);
+
+// Training tensors, .npy files numpy can memory-map (feature_export.c)
+int InstancesByIndex(struct Message *candidates, int candCount, struct Instance **rows, int *lens);
+void InstanceFeatures(const struct Message *cand, const struct Instance *ins, int withIndex, float *x);
+int SaveFeatureTensors(struct Message *candidates, int candCount, const char *dir);
+int MakeDir(const char *path);
+
+// Synthetic labelled shards, one process per shard (dataset_gen.c)
+int GenerateDataset(const char *dir, int shards, unsigned long long seed);
+
+// Phase timings on synthetic traces (analyzer_bench.c), argv as given to obfuscation -bench
+int RunAnalyzerBench(int argc, char **argv);
+
+/** Sliding-window bus load and per-ID statistics (bus_stats.c).
+busy is a ring of loadStep buckets covering loadWindow s, windowBusy its sum.
+**/
+struct IDStats
+{
+    int ID;
+    long frames;
+    double busy; // bus time of its frames (s)
+    double last; // start of its last frame (s)
+    long gaps; // inter-arrival times seen
+    double gapMean, gapM2, gapMax; // their mean, sum of squared deviations and maximum (s)
+};
+
+struct BusStats
+{
+    int buckets; // loadWindow / loadStep
+    double *busy; // busy bus time per bucket (s)
+    double windowBusy;
+    double origin; // start of step 0 (s)
+    long step; // current step, also the length of series
+    float *series; // load of the window at the end of every step
+    long seriesCap;
+    double peak;
+    double totalBusy, first, last;
+    long frames;
+    long rejected; // frames left out for their time stamp
+    double jump; // time stamp of the frame before, if it was left out as too far ahead
+    int idCount, idCap;
+    struct IDStats *ids; // open addressing on ID
+};
+
+int BusStatsInit(struct BusStats *stats);
+void BusStatsFrame(struct BusStats *stats, const struct Message *frame);
+const char *BusLoadLevel(double load);
+int SaveBusStats(const struct BusStats *stats, struct Message *candidates, int candCount,
+                 const char *loadPath, const char *idPath);
+void FreeBusStats(struct BusStats *stats);
+int BusStatsCheck(void);
+
+// Live SocketCAN mode (live_can.c)
+long LiveAnalyzeCAN(const char *ifname, struct Message *candidates, long maxFrames, struct BusStats *stats);
+
+#endif // OBFUSCATION_H
@@ -0,0 +1,664 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<math.h>
+#include "predictor.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include<immintrin.h>
+#endif
+
+/** CPU inference engine for the attackability models, see predictor.h.
+.hnsm layout (little endian, written by export_model.py):
+    "HNSM", u32 version, u32 kind, u32 inDim, u32 heads, u32 tensorCount,
+    f32 mean[inDim], f32 scale[inDim],
+    tensorCount x { u16 nameLen, name, u32 ndim, u32 dims[ndim], f32 data[] }
+Tensor names and layouts are the PyTorch state_dict ones.
+**/
+
+#define HNSM_MAGIC "HNSM"
+#define HNSM_VERSION 1
+#define ROW_CHUNK 256 // rows per batch of the FF model, keeps the activations in L2
+#define LN_EPS 1e-5f
+
+struct Tensor
+{
+    char name[96];
+    int ndim;
+    int dims[4];
+    long numel;
+    float *data;
+};
+
+static struct Tensor *FindTensor(struct Tensor *t, int count, const char *name)
+{
+    int i = 0;
+
+    for (i = 0; i < count; i++)
+        if (strcmp(t[i].name, name) == 0)
+            return &t[i];
+    printf("Model has no tensor %s\n", name);
+    return NULL;
+}
+
+static float *CopyVector(struct Tensor *t)
+{
+    float *v = NULL;
+
+    if (!t)
+        return NULL;
+    v = (float *)malloc(sizeof(float) * t->numel);
+    memcpy(v, t->data, sizeof(float) * t->numel);
+    return v;
+}
+
+/** nn.Linear weight (out x in) and bias into a Dense with the weight transposed **/
+static int MakeDense(struct Dense *d, struct Tensor *w, struct Tensor *b)
+{
+    int i = 0, o = 0;
+
+    if (!w || w->ndim != 2)
+        return -1;
+    d->out = w->dims[0];
+    d->in = w->dims[1];
+    d->wt = (float *)malloc(sizeof(float) * d->in * d->out);
+    for (o = 0; o < d->out; o++)
+        for (i = 0; i < d->in; i++)
+            d->wt[i * d->out + o] = w->data[o * d->in + i];
+    d->b = b ? CopyVector(b) : NULL;
+    return 0;
+}
+
+static int MakeNamedDense(struct Dense *d, struct Tensor *t, int count, const char *prefix)
+{
+    char w[128], b[128];
+
+    snprintf(w, sizeof(w), "%s.weight", prefix);
+    snprintf(b, sizeof(b), "%s.bias", prefix);
+    return MakeDense(d, FindTensor(t, count, w), FindTensor(t, count, b));
+}
+
+static void FreeDense(struct Dense *d)
+{
+    free(d->wt);
+    free(d->b);
+}
+
+static int BuildModel(struct Predictor *p, struct Tensor *t, int count)
+{
+    char name[128];
+    struct Tensor *bih, *bhh;
+    int l = 0, j = 0, err = 0;
+
+    switch (p->kind)
+    {
+    case MODEL_FF:
+        err |= MakeNamedDense(&p->ff[0], t, count, "net.0");
+        err |= MakeNamedDense(&p->ff[1], t, count, "net.2");
+        err |= MakeNamedDense(&p->ff[2], t, count, "net.4");
+        break;
+    case MODEL_RNN:
+    case MODEL_LSTM:
+        err |= MakeDense(&p->ih, FindTensor(t, count, "rnn.weight_ih_l0"), NULL);
+        err |= MakeDense(&p->hh, FindTensor(t, count, "rnn.weight_hh_l0"), NULL);
+        bih = FindTensor(t, count, "rnn.bias_ih_l0");
+        bhh = FindTensor(t, count, "rnn.bias_hh_l0");
+        if (err || !bih || !bhh)
+            return -1;
+        // Both biases are added once per step, fold them into the input projection
+        p->ih.b = (float *)malloc(sizeof(float) * p->ih.out);
+        for (j = 0; j < p->ih.out; j++)
+            p->ih.b[j] = bih->data[j] + bhh->data[j];
+        p->hidden = p->hh.in;
+        err |= MakeNamedDense(&p->fc, t, count, "fc");
+        break;
+    case MODEL_TFM:
+        err |= MakeNamedDense(&p->proj, t, count, "proj");
+        p->hidden = p->proj.out;
+        for (l = 0; l < MODEL_MAX_LAYERS && !err; l++)
+        {
+            snprintf(name, sizeof(name), "enc.layers.%d.norm1.weight", l);
+            for (j = 0; j < count && strcmp(t[j].name, name) != 0; j++)
+                ;
+            if (j == count)
+                break;
+            snprintf(name, sizeof(name), "enc.layers.%d.self_attn.in_proj_weight", l);
+            err |= MakeDense(&p->enc[l].inProj, FindTensor(t, count, name), NULL);
+            snprintf(name, sizeof(name), "enc.layers.%d.self_attn.in_proj_bias", l);
+            p->enc[l].inProj.b = CopyVector(FindTensor(t, count, name));
+            snprintf(name, sizeof(name), "enc.layers.%d.self_attn.out_proj", l);
+            err |= MakeNamedDense(&p->enc[l].outProj, t, count, name);
+            snprintf(name, sizeof(name), "enc.layers.%d.linear1", l);
+            err |= MakeNamedDense(&p->enc[l].lin1, t, count, name);
+            snprintf(name, sizeof(name), "enc.layers.%d.linear2", l);
+            err |= MakeNamedDense(&p->enc[l].lin2, t, count, name);
+            snprintf(name, sizeof(name), "enc.layers.%d.norm1.weight", l);
+            p->enc[l].norm1W = CopyVector(FindTensor(t, count, name));
+            snprintf(name, sizeof(name), "enc.layers.%d.norm1.bias", l);
+            p->enc[l].norm1B = CopyVector(FindTensor(t, count, name));
+            snprintf(name, sizeof(name), "enc.layers.%d.norm2.weight", l);
+            p->enc[l].norm2W = CopyVector(FindTensor(t, count, name));
+            snprintf(name, sizeof(name), "enc.layers.%d.norm2.bias", l);
+            p->enc[l].norm2B = CopyVector(FindTensor(t, count, name));
+            if (!p->enc[l].inProj.b || !p->enc[l].norm1W || !p->enc[l].norm1B || !p->enc[l].norm2W || !p->enc[l].norm2B)
+                err = -1;
+        }
+        p->layers = l;
+        if (p->layers == 0 || p->heads <= 0 || p->hidden % p->heads != 0)
+            err = -1;
+        err |= MakeNamedDense(&p->fc, t, count, "fc");
+        break;
+    default:
+        return -1;
+    }
+    return err ? -1 : 0;
+}
+
+/** Loads a .hnsm model. Returns NULL (with a message) on any mismatch. **/
+struct Predictor *LoadPredictor(const char *path)
+{
+    struct Predictor *p = NULL;
+    struct Tensor *tensors = NULL;
+    char magic[4];
+    uint32_t hdr[5], dim = 0;
+    uint16_t nameLen = 0;
+    int i = 0, j = 0, count = 0, ok = 1;
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, HNSM_MAGIC, 4) != 0 ||
+        fread(hdr, sizeof(uint32_t), 5, fp) != 5 || hdr[0] != HNSM_VERSION) {
+        printf("%s is not a model exported by export_model.py\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    p = (struct Predictor *)calloc(1, sizeof(struct Predictor));
+    p->kind = hdr[1];
+    p->inDim = hdr[2];
+    p->heads = hdr[3];
+    count = hdr[4];
+    p->mean = (float *)malloc(sizeof(float) * p->inDim);
+    p->scale = (float *)malloc(sizeof(float) * p->inDim);
+    ok = fread(p->mean, sizeof(float), p->inDim, fp) == (size_t)p->inDim &&
+         fread(p->scale, sizeof(float), p->inDim, fp) == (size_t)p->inDim;
+
+    tensors = (struct Tensor *)calloc(count, sizeof(struct Tensor));
+    for (i = 0; i < count && ok; i++)
+    {
+        ok = fread(&nameLen, sizeof(nameLen), 1, fp) == 1 && nameLen < sizeof(tensors[i].name) &&
+             fread(tensors[i].name, 1, nameLen, fp) == nameLen &&
+             fread(&dim, sizeof(dim), 1, fp) == 1 && dim >= 1 && dim <= 4;
+        if (!ok)
+            break;
+        tensors[i].ndim = dim;
+        tensors[i].numel = 1;
+        for (j = 0; j < tensors[i].ndim && ok; j++)
+        {
+            ok = fread(&dim, sizeof(dim), 1, fp) == 1;
+            tensors[i].dims[j] = dim;
+            tensors[i].numel *= dim;
+        }
+        tensors[i].data = (float *)malloc(sizeof(float) * tensors[i].numel);
+        ok = ok && fread(tensors[i].data, sizeof(float), tensors[i].numel, fp) == (size_t)tensors[i].numel;
+    }
+    fclose(fp);
+
+    if (!ok || BuildModel(p, tensors, count) != 0) {
+        printf("%s: truncated file or unexpected model layout\n", path);
+        FreePredictor(p);
+        p = NULL;
+    }
+    else if ((p->kind == MODEL_FF ? p->ff[0].in : p->kind == MODEL_TFM ? p->proj.in : p->ih.in) != p->inDim) {
+        printf("%s: scaler has %d features, the first layer expects another count\n", path, p->inDim);
+        FreePredictor(p);
+        p = NULL;
+    }
+    for (i = 0; i < count; i++)
+        free(tensors[i].data);
+    free(tensors);
+    return p;
+}
+
+void FreePredictor(struct Predictor *p)
+{
+    int l = 0;
+
+    if (!p)
+        return;
+    FreeDense(&p->ff[0]);
+    FreeDense(&p->ff[1]);
+    FreeDense(&p->ff[2]);
+    FreeDense(&p->ih);
+    FreeDense(&p->hh);
+    FreeDense(&p->proj);
+    FreeDense(&p->fc);
+    for (l = 0; l < MODEL_MAX_LAYERS; l++)
+    {
+        FreeDense(&p->enc[l].inProj);
+        FreeDense(&p->enc[l].outProj);
+        FreeDense(&p->enc[l].lin1);
+        FreeDense(&p->enc[l].lin2);
+        free(p->enc[l].norm1W);
+        free(p->enc[l].norm1B);
+        free(p->enc[l].norm2W);
+        free(p->enc[l].norm2B);
+    }
+    free(p->mean);
+    free(p->scale);
+    free(p->work);
+    free(p);
+}
+
+/** y (rows x d->out) = x (rows x d->in) * wt + b **/
+void Gemm(const float *x, int rows, const struct Dense *d, float *y)
+{
+    const int in = d->in, out = d->out;
+    int r = 0, k = 0, n = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    // 4 rows x 8 outputs per register block, every weight load is used 4 times
+    for (r = 0; r + 4 <= rows; r += 4)
+    {
+        const float *x0 = x + (long)r * in, *x1 = x0 + in, *x2 = x1 + in, *x3 = x2 + in;
+        float *y0 = y + (long)r * out, *y1 = y0 + out, *y2 = y1 + out, *y3 = y2 + out;
+        for (n = 0; n + 8 <= out; n += 8)
+        {
+            __m256 a0 = d->b ? _mm256_loadu_ps(d->b + n) : _mm256_setzero_ps();
+            __m256 a1 = a0, a2 = a0, a3 = a0, w;
+            for (k = 0; k < in; k++)
+            {
+                w = _mm256_loadu_ps(d->wt + (long)k * out + n);
+                a0 = _mm256_fmadd_ps(_mm256_set1_ps(x0[k]), w, a0);
+                a1 = _mm256_fmadd_ps(_mm256_set1_ps(x1[k]), w, a1);
+                a2 = _mm256_fmadd_ps(_mm256_set1_ps(x2[k]), w, a2);
+                a3 = _mm256_fmadd_ps(_mm256_set1_ps(x3[k]), w, a3);
+            }
+            _mm256_storeu_ps(y0 + n, a0);
+            _mm256_storeu_ps(y1 + n, a1);
+            _mm256_storeu_ps(y2 + n, a2);
+            _mm256_storeu_ps(y3 + n, a3);
+        }
+        for (; n < out; n++)
+        {
+            float s0 = d->b ? d->b[n] : 0, s1 = s0, s2 = s0, s3 = s0;
+            for (k = 0; k < in; k++)
+            {
+                s0 += x0[k] * d->wt[(long)k * out + n];
+                s1 += x1[k] * d->wt[(long)k * out + n];
+                s2 += x2[k] * d->wt[(long)k * out + n];
+                s3 += x3[k] * d->wt[(long)k * out + n];
+            }
+            y0[n] = s0;
+            y1[n] = s1;
+            y2[n] = s2;
+            y3[n] = s3;
+        }
+    }
+#endif
+    // Remaining rows (all of them without AVX2): rank-1 updates the compiler vectorizes
+    for (; r < rows; r++)
+    {
+        const float *xr = x + (long)r * in;
+        float *yr = y + (long)r * out;
+        if (d->b)
+            memcpy(yr, d->b, sizeof(float) * out);
+        else
+            memset(yr, 0, sizeof(float) * out);
+        for (k = 0; k < in; k++)
+        {
+            const float xv = xr[k], *w = d->wt + (long)k * out;
+            for (n = 0; n < out; n++)
+                yr[n] += xv * w[n];
+        }
+    }
+}
+
+/** Bytes of parameters the float model keeps, for comparison with the int8 one **/
+long PredictorWeightBytes(const struct Predictor *p)
+{
+    const struct Dense *all[7 + 4 * MODEL_MAX_LAYERS];
+    long bytes = sizeof(float) * 2 * p->inDim;
+    int n = 0, i = 0, l = 0;
+
+    all[n++] = &p->ff[0];
+    all[n++] = &p->ff[1];
+    all[n++] = &p->ff[2];
+    all[n++] = &p->ih;
+    all[n++] = &p->hh;
+    all[n++] = &p->proj;
+    all[n++] = &p->fc;
+    for (l = 0; l < p->layers; l++)
+    {
+        all[n++] = &p->enc[l].inProj;
+        all[n++] = &p->enc[l].outProj;
+        all[n++] = &p->enc[l].lin1;
+        all[n++] = &p->enc[l].lin2;
+        bytes += sizeof(float) * 4 * p->hidden; // LayerNorm weights and biases
+    }
+    for (i = 0; i < n; i++)
+        if (all[i]->wt)
+            bytes += sizeof(float) * ((long)all[i]->in * all[i]->out + (all[i]->b ? all[i]->out : 0));
+    return bytes;
+}
+
+static float *EnsureWork(struct Predictor *p, long floats)
+{
+    if (floats > p->workSize)
+    {
+        free(p->work);
+        p->work = (float *)malloc(sizeof(float) * floats);
+        p->workSize = p->work ? floats : 0;
+    }
+    return p->work;
+}
+
+static float Sigmoid(float v)
+{
+    return 1.0f / (1.0f + expf(-v));
+}
+
+static void Relu(float *v, long n)
+{
+    long i = 0;
+
+    for (i = 0; i < n; i++)
+        v[i] = v[i] > 0 ? v[i] : 0;
+}
+
+static void Standardize(const struct Predictor *p, const float *x, long rows, float *out)
+{
+    long r = 0;
+    int f = 0;
+
+    for (r = 0; r < rows; r++)
+        for (f = 0; f < p->inDim; f++)
+            out[r * p->inDim + f] = (x[r * p->inDim + f] - p->mean[f]) / p->scale[f];
+}
+
+/** x = LayerNorm(x + y) row by row **/
+void AddLayerNorm(float *x, const float *y, long rows, int dim, const float *g, const float *b)
+{
+    long r = 0;
+    int i = 0;
+    float mean = 0, var = 0, inv = 0, *xr;
+
+    for (r = 0; r < rows; r++)
+    {
+        xr = x + r * dim;
+        mean = 0;
+        for (i = 0; i < dim; i++)
+        {
+            xr[i] += y[r * dim + i];
+            mean += xr[i];
+        }
+        mean /= dim;
+        var = 0;
+        for (i = 0; i < dim; i++)
+            var += (xr[i] - mean) * (xr[i] - mean);
+        inv = 1.0f / sqrtf(var / dim + LN_EPS);
+        for (i = 0; i < dim; i++)
+            xr[i] = (xr[i] - mean) * inv * g[i] + b[i];
+    }
+}
+
+/** Batched FF forward over rows feature rows, prob[r] = P(attackable) **/
+int PredictRows(struct Predictor *p, const float *x, int rows, float *prob)
+{
+    int r = 0, n = 0, i = 0;
+    float *a, *h1, *h2, *logit;
+
+    if (p->kind != MODEL_FF)
+        return -1;
+    a = EnsureWork(p, (long)ROW_CHUNK * (p->inDim + p->ff[0].out + p->ff[1].out + p->ff[2].out));
+    if (!a)
+        return -1;
+    h1 = a + ROW_CHUNK * p->inDim;
+    h2 = h1 + ROW_CHUNK * p->ff[0].out;
+    logit = h2 + ROW_CHUNK * p->ff[1].out;
+    for (r = 0; r < rows; r += ROW_CHUNK)
+    {
+        n = rows - r < ROW_CHUNK ? rows - r : ROW_CHUNK;
+        Standardize(p, x + (long)r * p->inDim, n, a);
+        Gemm(a, n, &p->ff[0], h1);
+        Relu(h1, (long)n * p->ff[0].out);
+        Gemm(h1, n, &p->ff[1], h2);
+        Relu(h2, (long)n * p->ff[1].out);
+        Gemm(h2, n, &p->ff[2], logit);
+        for (i = 0; i < n; i++)
+            prob[r + i] = Sigmoid(logit[i]);
+    }
+    return 0;
+}
+
+/** Recurrent models: the input projection of all timesteps is one GEMM, then the
+sequences still running at step t are advanced together with one GEMM on the
+hidden state.
+**/
+static void RecurrentForward(struct Predictor *p, const float *xn, const int *lens, int seqCount,
+                             long total, float *work, float *logit)
+{
+    const int hid = p->hidden, gates = p->ih.out, lstm = p->kind == MODEL_LSTM;
+    float *a = work; // total x gates
+    float *hOut = a + total * gates; // total x hid
+    float *hb = hOut + total * hid; // seqCount x hid, hidden state of the active batch
+    float *cs = hb + (long)seqCount * hid; // seqCount x hid, LSTM cell state per sequence
+    float *g = cs + (long)seqCount * hid; // seqCount x gates
+    long *off = (long *)malloc(sizeof(long) * (seqCount + 1));
+    int *act = (int *)malloc(sizeof(int) * seqCount);
+    int s = 0, t = 0, b = 0, j = 0, B = 0, maxLen = 0;
+    float *z, *h, *c, ig, fg, gg, og;
+
+    off[0] = 0;
+    for (s = 0; s < seqCount; s++)
+    {
+        off[s + 1] = off[s] + lens[s];
+        if (lens[s] > maxLen)
+            maxLen = lens[s];
+    }
+    Gemm(xn, total, &p->ih, a);
+    memset(cs, 0, sizeof(float) * seqCount * hid);
+
+    for (t = 0; t < maxLen; t++)
+    {
+        // Gather the previous hidden state of the sequences still running
+        B = 0;
+        for (s = 0; s < seqCount; s++)
+        {
+            if (lens[s] <= t)
+                continue;
+            if (t == 0)
+                memset(hb + (long)B * hid, 0, sizeof(float) * hid);
+            else
+                memcpy(hb + (long)B * hid, hOut + (off[s] + t - 1) * hid, sizeof(float) * hid);
+            act[B++] = s;
+        }
+        Gemm(hb, B, &p->hh, g);
+        for (b = 0; b < B; b++)
+        {
+            s = act[b];
+            z = g + (long)b * gates;
+            for (j = 0; j < gates; j++)
+                z[j] += a[(off[s] + t) * gates + j];
+            h = hOut + (off[s] + t) * hid;
+            c = cs + (long)s * hid;
+            if (lstm)
+            {
+                // PyTorch gate order: input, forget, cell, output
+                for (j = 0; j < hid; j++)
+                {
+                    ig = Sigmoid(z[j]);
+                    fg = Sigmoid(z[hid + j]);
+                    gg = tanhf(z[2 * hid + j]);
+                    og = Sigmoid(z[3 * hid + j]);
+                    c[j] = fg * c[j] + ig * gg;
+                    h[j] = og * tanhf(c[j]);
+                }
+            }
+            else
+            {
+                for (j = 0; j < hid; j++)
+                    h[j] = tanhf(z[j]);
+            }
+        }
+    }
+    Gemm(hOut, total, &p->fc, logit);
+    free(off);
+    free(act);
+}
+
+/** Scaled dot-product self-attention of one sequence of L tokens.
+qkv holds q, k, v of every token (L x 3d), out gets the concatenated heads
+(L x d), score is scratch for L floats.
+**/
+void SelfAttention(const float *qkv, int L, int d, int heads, float *out, float *score)
+{
+    const int hd = d / heads;
+    const float invSqrt = 1.0f / sqrtf((float)hd);
+    int hh = 0, t = 0, u = 0, i = 0;
+    float m = 0, sum = 0, w = 0, dot = 0, *o;
+    const float *q, *k, *v;
+
+    for (t = 0; t < L; t++)
+    {
+        o = out + (long)t * d;
+        memset(o, 0, sizeof(float) * d);
+        for (hh = 0; hh < heads; hh++)
+        {
+            q = qkv + (long)t * 3 * d + hh * hd;
+            m = -INFINITY;
+            for (u = 0; u < L; u++)
+            {
+                k = qkv + (long)u * 3 * d + d + hh * hd;
+                dot = 0;
+                for (i = 0; i < hd; i++)
+                    dot += q[i] * k[i];
+                score[u] = dot * invSqrt;
+                if (score[u] > m)
+                    m = score[u];
+            }
+            sum = 0;
+            for (u = 0; u < L; u++)
+            {
+                score[u] = expf(score[u] - m);
+                sum += score[u];
+            }
+            for (u = 0; u < L; u++)
+            {
+                v = qkv + (long)u * 3 * d + 2 * d + hh * hd;
+                w = score[u] / sum;
+                for (i = 0; i < hd; i++)
+                    o[hh * hd + i] += w * v[i];
+            }
+        }
+    }
+}
+
+/** Post-norm transformer encoder (nn.TransformerEncoderLayer, ReLU, eval mode).
+Every sequence attends only to itself, which is what the padding mask does.
+**/
+static void TransformerForward(struct Predictor *p, const float *xn, const int *lens, int seqCount,
+                               long total, float *work, float *logit)
+{
+    const int d = p->hidden, ffDim = p->enc[0].lin1.out;
+    float *z = work; // total x d
+    float *qkv = z + total * d; // total x 3d
+    float *att = qkv + total * 3 * d; // total x d
+    float *tmp = att + total * d; // total x d
+    float *ff = tmp + total * d; // total x ffDim
+    float *score = ff + total * ffDim; // longest sequence
+    long base = 0;
+    int l = 0, s = 0;
+
+    Gemm(xn, total, &p->proj, z);
+    for (l = 0; l < p->layers; l++)
+    {
+        Gemm(z, total, &p->enc[l].inProj, qkv);
+        for (s = 0, base = 0; s < seqCount; base += lens[s], s++)
+            SelfAttention(qkv + base * 3 * d, lens[s], d, p->heads, att + base * d, score);
+        Gemm(att, total, &p->enc[l].outProj, tmp);
+        AddLayerNorm(z, tmp, total, d, p->enc[l].norm1W, p->enc[l].norm1B);
+        Gemm(z, total, &p->enc[l].lin1, ff);
+        Relu(ff, total * ffDim);
+        Gemm(ff, total, &p->enc[l].lin2, tmp);
+        AddLayerNorm(z, tmp, total, d, p->enc[l].norm2W, p->enc[l].norm2B);
+    }
+    Gemm(z, total, &p->fc, logit);
+}
+
+/** Sequence models: x holds seqCount sequences back to back (lens[s] rows of
+inDim features each), prob gets one probability per row in the same order.
+**/
+int PredictSequences(struct Predictor *p, const float *x, const int *lens, int seqCount, float *prob)
+{
+    long total = 0, need = 0, i = 0;
+    int s = 0, maxLen = 0;
+    float *xn, *logit, *work;
+
+    if (p->kind != MODEL_RNN && p->kind != MODEL_LSTM && p->kind != MODEL_TFM)
+        return -1;
+    for (s = 0; s < seqCount; s++)
+    {
+        total += lens[s];
+        if (lens[s] > maxLen)
+            maxLen = lens[s];
+    }
+    if (total == 0)
+        return 0;
+    need = total * (p->inDim + 1);
+    if (p->kind == MODEL_TFM)
+        need += total * (6 * p->hidden + p->enc[0].lin1.out) + maxLen;
+    else
+        need += total * (p->ih.out + p->hidden) + (long)seqCount * (2 * p->hidden + p->ih.out);
+    xn = EnsureWork(p, need);
+    if (!xn)
+        return -1;
+    logit = xn + total * p->inDim;
+    work = logit + total;
+    Standardize(p, x, total, xn);
+    if (p->kind == MODEL_TFM)
+        TransformerForward(p, xn, lens, seqCount, total, work, logit);
+    else
+        RecurrentForward(p, xn, lens, seqCount, total, work, logit);
+    for (i = 0; i < total; i++)
+        prob[i] = Sigmoid(logit[i]);
+    return 0;
+}
+
+/** One step of a recurrent model for streaming use: x is the raw feature row of
+the next instance, h and c (hidden floats each, zero at the start of a
+sequence) are updated in place. Returns P(attackable) of the instance.
+**/
+float StepSequence(struct Predictor *p, const float *x, float *h, float *c)
+{
+    const int hid = p->hidden, gates = p->ih.out;
+    float *xn, *z, *zh, logit = 0;
+    int j = 0;
+
+    xn = EnsureWork(p, p->inDim + 2 * gates);
+    z = xn + p->inDim;
+    zh = z + gates;
+    Standardize(p, x, 1, xn);
+    Gemm(xn, 1, &p->ih, z);
+    Gemm(h, 1, &p->hh, zh);
+    for (j = 0; j < gates; j++)
+        z[j] += zh[j];
+    if (p->kind == MODEL_LSTM)
+    {
+        for (j = 0; j < hid; j++)
+        {
+            c[j] = Sigmoid(z[hid + j]) * c[j] + Sigmoid(z[j]) * tanhf(z[2 * hid + j]);
+            h[j] = Sigmoid(z[3 * hid + j]) * tanhf(c[j]);
+        }
+    }
+    else
+    {
+        for (j = 0; j < hid; j++)
+            h[j] = tanhf(z[j]);
+    }
+    Gemm(h, 1, &p->fc, &logit);
+    return Sigmoid(logit);
+}
@@ -0,0 +1,139 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include<stdint.h>
+
+/** Attackability predictor: CPU inference of the classifier.ipynb models
+(best_ff/rnn/lstm/tfm.pt) from the .hnsm weight files written by
+export_model.py. No dependencies; the dense layers run on a GEMM kernel
+that uses AVX2/FMA when the compiler targets it (-march=native).
+
+Inputs are raw (unscaled) feature rows, the model's StandardScaler is
+applied here:
+    FF:            Periodicity, InstanceIndex, AtkWinLen, AtkWinCount, AtkWinMsgCnt, InsWinMsgCnt
+    RNN/LSTM/TFM:  the same without InstanceIndex, one sequence per candidate
+                   ordered by instance index
+**/
+
+#define MODEL_FF 0
+#define MODEL_RNN 1
+#define MODEL_LSTM 2
+#define MODEL_TFM 3
+
+#define MODEL_MAX_LAYERS 4
+
+// Fully connected layer, weight stored transposed (in x out) for the GEMM
+struct Dense
+{
+    int in;
+    int out;
+    float *wt;
+    float *b;
+};
+
+struct EncoderLayer
+{
+    struct Dense inProj; // q, k, v stacked
+    struct Dense outProj;
+    struct Dense lin1;
+    struct Dense lin2;
+    float *norm1W, *norm1B;
+    float *norm2W, *norm2B;
+};
+
+struct Predictor
+{
+    int kind;
+    int inDim;
+    int hidden;
+    int heads;
+    int layers;
+    float *mean;
+    float *scale;
+    struct Dense ff[3]; // MODEL_FF
+    struct Dense ih; // MODEL_RNN/LSTM: input to gates, bias_ih + bias_hh
+    struct Dense hh; // MODEL_RNN/LSTM: hidden to gates, no bias
+    struct Dense proj; // MODEL_TFM
+    struct EncoderLayer enc[MODEL_MAX_LAYERS]; // MODEL_TFM
+    struct Dense fc; // sequence models: hidden -> logit
+    float *work; // scratch, grown on demand
+    long workSize;
+};
+
+struct Predictor *LoadPredictor(const char *path);
+void FreePredictor(struct Predictor *p);
+void Gemm(const float *x, int rows, const struct Dense *d, float *y);
+int PredictRows(struct Predictor *p, const float *x, int rows, float *prob);
+int PredictSequences(struct Predictor *p, const float *x, const int *lens, int seqCount, float *prob);
+float StepSequence(struct Predictor *p, const float *x, float *h, float *c);
+void SelfAttention(const float *qkv, int L, int d, int heads, float *out, float *score);
+void AddLayerNorm(float *x, const float *y, long rows, int dim, const float *g, const float *b);
+long PredictorWeightBytes(const struct Predictor *p);
+
+/** INT8 post-training quantization (predictor_q8.c).
+Weights are symmetric int8 per output channel, activations are quantized per
+row when they enter a layer and the products accumulate in int32; one float
+multiply per output rescales them (the TC3xx has a single precision FPU).
+The LSTM/RNN cell runs in fixed point: Q12 pre-activations, Q15 sigmoid/tanh
+tables, Q12 cell state, int8 hidden state with a fixed 1/127 scale. The
+attention scores, softmax and weighted sum are integer too. Residuals and
+LayerNorm stay in float.
+**/
+
+#define Q8_MAX_HIDDEN 128
+
+struct QDense
+{
+    int in;
+    int out;
+    int8_t *w; // out x in, one row per output channel
+    float *wScale; // per output channel
+    float *b;
+};
+
+struct QEncoderLayer
+{
+    struct QDense inProj;
+    struct QDense outProj;
+    struct QDense lin1;
+    struct QDense lin2;
+    const float *norm1W, *norm1B; // borrowed from the float model
+    const float *norm2W, *norm2B;
+};
+
+struct QPredictor
+{
+    int kind;
+    int inDim;
+    int hidden;
+    int heads;
+    int layers;
+    const float *mean; // borrowed from the float model
+    const float *scale;
+    struct QDense ff[3];
+    struct QDense ih;
+    struct QDense hh;
+    struct QDense proj;
+    struct QEncoderLayer enc[MODEL_MAX_LAYERS];
+    struct QDense fc;
+    long weightBytes; // int8 weights + scales + biases
+    float *work;
+    long workSize;
+};
+
+// Streaming state of one sequence for StepSequenceQ8, all zero at the start
+struct QRecurrentState
+{
+    int8_t h[Q8_MAX_HIDDEN];
+    int32_t c[Q8_MAX_HIDDEN]; // Q12
+};
+
+struct QPredictor *QuantizePredictor(const struct Predictor *p);
+void FreeQPredictor(struct QPredictor *q);
+void QGemm(const float *x, int rows, const struct QDense *d, float *y, int8_t *xq);
+int PredictRowsQ8(struct QPredictor *q, const float *x, int rows, float *prob);
+int PredictSequencesQ8(struct QPredictor *q, const float *x, const int *lens, int seqCount, float *prob);
+float StepSequenceQ8(struct QPredictor *q, const float *x, struct QRecurrentState *st);
+void SelfAttentionQ8(const float *qkv, int L, int d, int heads, float *out, int8_t *scratch, int32_t *score);
+
+#endif // PREDICTOR_H
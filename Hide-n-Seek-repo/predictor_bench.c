@@ -0,0 +1,327 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include "predictor.h"
+
+/** Host benchmark of the float and int8 predictor kernels
+    predictor_bench <model.hnsm> [final_candidates.csv] [reps] [ECU slowdown]
+For every dense layer, the recurrent cell step and the self-attention block,
+and for the whole model, it prints the float and int8 latency, the parameter
+memory and the accuracy lost by quantization on the instances of the CSV.
+The per-instance cost is also put against the period of the TOM interrupt of
+ecu_code.c (TOM_FREQ = 100 Hz), multiplied by the given slowdown of the ECU
+core relative to this host (1 by default).
+**/
+
+#define TOM_PERIOD_US 10000.0 // 1 / TOM_FREQ
+#define MAX_CANDIDATES 64
+
+struct Dataset
+{
+    int rows;
+    int seqCount;
+    int lens[MAX_CANDIDATES];
+    float *x; // rows x inDim, grouped by candidate and in instance order
+    int *label;
+};
+
+static double NowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static int CountIDs(const char *s)
+{
+    int n = 0, inTok = 0, neg = 0;
+
+    for (; *s && *s != '"'; s++)
+    {
+        if (*s == ';') {
+            n += inTok && !neg;
+            inTok = neg = 0;
+        }
+        else if (*s == '-')
+            neg = 1;
+        else if (*s >= '0' && *s <= '9')
+            inTok = 1;
+    }
+    return n + (inTok && !neg);
+}
+
+/** Reads final_candidates.csv into the feature layout of the model kind **/
+static int LoadDataset(const char *path, int kind, int inDim, struct Dataset *ds)
+{
+    char buffer[1 << 16], *q1, *q2;
+    int id[MAX_CANDIDATES], cap = 1024, n = 0, i = 0, j = 0, c = 0, f = 0, cand = 0, index = 0, atk = 0;
+    float per = 0, len = 0, cnt = 0;
+    float *raw = (float *)malloc(sizeof(float) * cap * 8);
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    memset(ds, 0, sizeof(*ds));
+    fgets(buffer, sizeof(buffer), fp);
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        if (sscanf(buffer, "%d,%f,%d,%d,%f,%f", &cand, &per, &index, &atk, &len, &cnt) != 6)
+            continue;
+        q1 = strchr(buffer, '"');
+        q2 = q1 ? strchr(strchr(q1 + 1, '"') + 1, '"') : NULL;
+        if (n == cap) {
+            cap *= 2;
+            raw = (float *)realloc(raw, sizeof(float) * cap * 8);
+        }
+        raw[n * 8 + 0] = cand;
+        raw[n * 8 + 1] = per;
+        raw[n * 8 + 2] = index;
+        raw[n * 8 + 3] = len;
+        raw[n * 8 + 4] = cnt;
+        raw[n * 8 + 5] = q1 ? CountIDs(q1 + 1) : 0;
+        raw[n * 8 + 6] = q2 ? CountIDs(q2 + 1) : 0;
+        raw[n * 8 + 7] = atk;
+        n++;
+    }
+    fclose(fp);
+
+    // Group by candidate in order of appearance, instances by index
+    ds->x = (float *)malloc(sizeof(float) * n * inDim);
+    ds->label = (int *)malloc(sizeof(int) * n);
+    for (i = 0; i < n; i++)
+    {
+        for (c = 0; c < ds->seqCount && id[c] != (int)raw[i * 8]; c++)
+            ;
+        if (c == ds->seqCount && c < MAX_CANDIDATES)
+            id[ds->seqCount++] = (int)raw[i * 8];
+    }
+    for (c = 0; c < ds->seqCount; c++)
+    {
+        for (index = 0;; index++)
+        {
+            for (i = 0; i < n && !((int)raw[i * 8] == id[c] && (int)raw[i * 8 + 2] == index); i++)
+                ;
+            if (i == n)
+                break;
+            f = 0;
+            ds->x[j * inDim + f++] = raw[i * 8 + 1];
+            if (kind == MODEL_FF)
+                ds->x[j * inDim + f++] = raw[i * 8 + 2];
+            ds->x[j * inDim + f++] = raw[i * 8 + 3];
+            ds->x[j * inDim + f++] = raw[i * 8 + 4];
+            ds->x[j * inDim + f++] = raw[i * 8 + 5];
+            ds->x[j * inDim + f++] = raw[i * 8 + 6];
+            ds->label[j++] = (int)raw[i * 8 + 7];
+            ds->lens[c]++;
+        }
+    }
+    ds->rows = j;
+    free(raw);
+    return ds->rows > 0 ? 0 : -1;
+}
+
+static void BenchDense(const char *name, const struct Dense *d, const struct QDense *qd, int reps)
+{
+    float *x = (float *)malloc(sizeof(float) * d->in), *yf = (float *)malloc(sizeof(float) * d->out);
+    float *yq = (float *)malloc(sizeof(float) * d->out), num = 0, den = 0;
+    int8_t xq[512];
+    double t0 = 0, tf = 0, tq = 0;
+    int i = 0, r = 0;
+
+    if (!d->wt || d->in > 512) {
+        free(x), free(yf), free(yq);
+        return;
+    }
+    for (i = 0; i < d->in; i++)
+        x[i] = (float)rand() / RAND_MAX * 4 - 2; // standardized range
+    t0 = NowUs();
+    for (r = 0; r < reps * 100; r++)
+        Gemm(x, 1, d, yf);
+    tf = (NowUs() - t0) / (reps * 100);
+    t0 = NowUs();
+    for (r = 0; r < reps * 100; r++)
+        QGemm(x, 1, qd, yq, xq);
+    tq = (NowUs() - t0) / (reps * 100);
+    for (i = 0; i < d->out; i++)
+    {
+        num += (yf[i] - yq[i]) * (yf[i] - yq[i]);
+        den += yf[i] * yf[i];
+    }
+    printf("  %-28s %4dx%-4d %9.3f %9.3f %8.2f%%\n", name, d->in, d->out, tf, tq,
+           den > 0 ? 100 * sqrtf(num / den) : 0.0f);
+    free(x);
+    free(yf);
+    free(yq);
+}
+
+int main(int argc, char **argv)
+{
+    struct Predictor *p;
+    struct QPredictor *q;
+    struct Dataset ds;
+    struct QRecurrentState st;
+    char name[64];
+    const char *csv = argc >= 3 ? argv[2] : "final_candidates.csv";
+    int reps = argc >= 4 ? atoi(argv[3]) : 20;
+    double slowdown = argc >= 5 ? atof(argv[4]) : 1, t0 = 0, tf = 0, tq = 0;
+    float *pf, *pq, *qkv, *af, *aq, *score, *h, *c, diff = 0, maxDiff = 0, sumDiff = 0, ref = 0;
+    int8_t *scratch;
+    int32_t *iscore;
+    int r = 0, i = 0, l = 0, s = 0, t = 0, L = 0, flips = 0, accF = 0, accQ = 0;
+    long base = 0;
+
+    if (argc < 2) {
+        printf("usage: %s <model.hnsm> [final_candidates.csv] [reps] [ECU slowdown]\n", argv[0]);
+        return 1;
+    }
+    if (reps < 1)
+        reps = 1;
+    p = LoadPredictor(argv[1]);
+    if (!p)
+        return 1;
+    q = QuantizePredictor(p);
+    if (!q || LoadDataset(csv, p->kind, p->inDim, &ds) != 0) {
+        printf("Nothing to benchmark\n");
+        return 1;
+    }
+    srand(1);
+    printf("Model %s: %d instances in %d candidates, %d reps\n", argv[1], ds.rows, ds.seqCount, reps);
+    printf("Parameters: float %ld bytes, int8 %ld bytes (%.1fx smaller)\n", PredictorWeightBytes(p),
+           q->weightBytes, (double)PredictorWeightBytes(p) / q->weightBytes);
+
+    printf("\nDense layers, one row     in x out    float us   int8 us  rel. error\n");
+    BenchDense("net.0", &p->ff[0], &q->ff[0], reps);
+    BenchDense("net.2", &p->ff[1], &q->ff[1], reps);
+    BenchDense("net.4", &p->ff[2], &q->ff[2], reps);
+    BenchDense("rnn.weight_ih_l0", &p->ih, &q->ih, reps);
+    BenchDense("rnn.weight_hh_l0", &p->hh, &q->hh, reps);
+    BenchDense("proj", &p->proj, &q->proj, reps);
+    for (l = 0; l < p->layers; l++)
+    {
+        snprintf(name, sizeof(name), "enc.layers.%d.in_proj", l);
+        BenchDense(name, &p->enc[l].inProj, &q->enc[l].inProj, reps);
+        snprintf(name, sizeof(name), "enc.layers.%d.out_proj", l);
+        BenchDense(name, &p->enc[l].outProj, &q->enc[l].outProj, reps);
+        snprintf(name, sizeof(name), "enc.layers.%d.linear1", l);
+        BenchDense(name, &p->enc[l].lin1, &q->enc[l].lin1, reps);
+        snprintf(name, sizeof(name), "enc.layers.%d.linear2", l);
+        BenchDense(name, &p->enc[l].lin2, &q->enc[l].lin2, reps);
+    }
+    BenchDense("fc", &p->fc, &q->fc, reps);
+
+    if (p->kind == MODEL_RNN || p->kind == MODEL_LSTM)
+    {
+        // The streaming step is what an ECU task would run once per instance
+        h = (float *)calloc(2 * p->hidden, sizeof(float));
+        c = h + p->hidden;
+        t0 = NowUs();
+        for (r = 0; r < reps; r++)
+            for (s = 0, base = 0; s < ds.seqCount; base += ds.lens[s], s++)
+            {
+                memset(h, 0, sizeof(float) * 2 * p->hidden);
+                for (t = 0; t < ds.lens[s]; t++)
+                    StepSequence(p, ds.x + (base + t) * p->inDim, h, c);
+            }
+        tf = (NowUs() - t0) / reps / ds.rows;
+        t0 = NowUs();
+        for (r = 0; r < reps; r++)
+            for (s = 0, base = 0; s < ds.seqCount; base += ds.lens[s], s++)
+            {
+                memset(&st, 0, sizeof(st));
+                for (t = 0; t < ds.lens[s]; t++)
+                    StepSequenceQ8(q, ds.x + (base + t) * p->inDim, &st);
+            }
+        tq = (NowUs() - t0) / reps / ds.rows;
+        printf("\n%s cell step: float %.3f us, int8 fixed point %.3f us (%.2fx)\n",
+               p->kind == MODEL_LSTM ? "LSTM" : "RNN", tf, tq, tf / tq);
+        printf("State per sequence: float %zu bytes, fixed point %d bytes\n", sizeof(float) * 2 * p->hidden,
+               p->kind == MODEL_LSTM ? p->hidden * 5 : p->hidden);
+        free(h);
+    }
+    if (p->kind == MODEL_TFM)
+    {
+        for (s = 0; s < ds.seqCount; s++)
+            if (ds.lens[s] > L)
+                L = ds.lens[s];
+        qkv = (float *)malloc(sizeof(float) * L * 3 * p->hidden);
+        af = (float *)malloc(sizeof(float) * L * p->hidden);
+        aq = (float *)malloc(sizeof(float) * L * p->hidden);
+        score = (float *)malloc(sizeof(float) * L);
+        iscore = (int32_t *)malloc(sizeof(int32_t) * L);
+        scratch = (int8_t *)malloc(2 * L * p->hidden);
+        // q, k, v of the longest candidate as the first layer sees them
+        for (base = 0, s = 0; ds.lens[s] != L; base += ds.lens[s], s++)
+            ;
+        for (t = 0; t < L; t++)
+        {
+            float xn[16], z[Q8_MAX_HIDDEN];
+            for (i = 0; i < p->inDim; i++)
+                xn[i] = (ds.x[(base + t) * p->inDim + i] - p->mean[i]) / p->scale[i];
+            Gemm(xn, 1, &p->proj, z);
+            Gemm(z, 1, &p->enc[0].inProj, qkv + (long)t * 3 * p->hidden);
+        }
+        t0 = NowUs();
+        for (r = 0; r < reps; r++)
+            SelfAttention(qkv, L, p->hidden, p->heads, af, score);
+        tf = (NowUs() - t0) / reps;
+        t0 = NowUs();
+        for (r = 0; r < reps; r++)
+            SelfAttentionQ8(qkv, L, p->hidden, p->heads, aq, scratch, iscore);
+        tq = (NowUs() - t0) / reps;
+        maxDiff = ref = 0;
+        for (i = 0; i < L * p->hidden; i++)
+        {
+            maxDiff = fmaxf(maxDiff, fabsf(af[i] - aq[i]));
+            ref = fmaxf(ref, fabsf(af[i]));
+        }
+        printf("\nSelf-attention, %d tokens x %d heads: float %.1f us, fixed point %.1f us (%.2fx), "
+               "max error %.4f of %.4f\n", L, p->heads, tf, tq, tf / tq, maxDiff, ref);
+        free(qkv), free(af), free(aq), free(score), free(iscore), free(scratch);
+    }
+
+    // Whole model over the dataset
+    pf = (float *)malloc(sizeof(float) * ds.rows);
+    pq = (float *)malloc(sizeof(float) * ds.rows);
+    t0 = NowUs();
+    for (r = 0; r < reps; r++)
+        if (p->kind == MODEL_FF)
+            PredictRows(p, ds.x, ds.rows, pf);
+        else
+            PredictSequences(p, ds.x, ds.lens, ds.seqCount, pf);
+    tf = (NowUs() - t0) / reps / ds.rows;
+    t0 = NowUs();
+    for (r = 0; r < reps; r++)
+        if (p->kind == MODEL_FF)
+            PredictRowsQ8(q, ds.x, ds.rows, pq);
+        else
+            PredictSequencesQ8(q, ds.x, ds.lens, ds.seqCount, pq);
+    tq = (NowUs() - t0) / reps / ds.rows;
+    for (i = 0; i < ds.rows; i++)
+    {
+        diff = fabsf(pf[i] - pq[i]);
+        sumDiff += diff;
+        maxDiff = i == 0 || diff > maxDiff ? diff : maxDiff;
+        flips += (pf[i] >= 0.5f) != (pq[i] >= 0.5f);
+        accF += (pf[i] >= 0.5f) == ds.label[i];
+        accQ += (pq[i] >= 0.5f) == ds.label[i];
+    }
+    printf("\nWhole model per instance: float %.3f us, int8 %.3f us (%.2fx)\n", tf, tq, tf / tq);
+    printf("Accuracy drop: mean |dp| %.5f, max |dp| %.5f, %d/%d decisions flipped, "
+           "agreement with Attackable %.2f%% -> %.2f%%\n", sumDiff / ds.rows, maxDiff, flips, ds.rows,
+           100.0 * accF / ds.rows, 100.0 * accQ / ds.rows);
+    printf("TOM ISR budget (%.0f us, x%.1f ECU slowdown): float %.2f%%, int8 %.2f%% per instance\n",
+           TOM_PERIOD_US, slowdown, 100 * tf * slowdown / TOM_PERIOD_US, 100 * tq * slowdown / TOM_PERIOD_US);
+
+    free(pf);
+    free(pq);
+    free(ds.x);
+    free(ds.label);
+    FreeQPredictor(q);
+    FreePredictor(p);
+    return 0;
+}
@@ -0,0 +1,466 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include "predictor.h"
+
+#if defined(__AVX2__)
+#include<immintrin.h>
+#endif
+
+/** INT8 post-training quantization of a loaded float model, see predictor.h.
+Nothing is calibrated: weights get a per-channel scale from their own range
+and activations a per-row scale when they are quantized, so any .hnsm model
+can be quantized at load time.
+**/
+
+#define Q8_MAX_IN 256 // widest layer input, sizes the stack buffers
+#define Q12_ONE 4096
+#define LUT_SHIFT 6 // table step 1/64 in Q12
+#define LUT_SIZE 1025 // sigmoid/tanh over [-8, 8], exp(-x) over [0, 16]
+#define LUT_HALF 512
+
+// Q15 tables, built once; on the ECU they would be const data
+static int16_t sigmoidLUT[LUT_SIZE], tanhLUT[LUT_SIZE], expLUT[LUT_SIZE];
+static int tablesReady = 0;
+
+static void InitTables(void)
+{
+    int i = 0;
+    double x = 0;
+
+    for (i = 0; i < LUT_SIZE; i++)
+    {
+        x = (double)(i - LUT_HALF) / (1 << LUT_SHIFT);
+        sigmoidLUT[i] = (int16_t)lrint(32767.0 / (1.0 + exp(-x)));
+        tanhLUT[i] = (int16_t)lrint(32767.0 * tanh(x));
+        expLUT[i] = (int16_t)lrint(32767.0 * exp(-(double)i / (1 << LUT_SHIFT)));
+    }
+    tablesReady = 1;
+}
+
+/** f(v) in Q15 for v in Q12, linear interpolation between table entries **/
+static int32_t LutQ15(const int16_t *lut, int32_t v)
+{
+    int32_t i = 0, frac = 0;
+
+    if (v < -8 * Q12_ONE)
+        v = -8 * Q12_ONE;
+    if (v >= 8 * Q12_ONE)
+        v = 8 * Q12_ONE - 1;
+    v += 8 * Q12_ONE;
+    i = v >> LUT_SHIFT;
+    frac = v & ((1 << LUT_SHIFT) - 1);
+    return lut[i] + (((lut[i + 1] - lut[i]) * frac) >> LUT_SHIFT);
+}
+
+/** exp(-x) in Q15 for x >= 0 in Q12 **/
+static int32_t ExpNegQ15(int32_t x)
+{
+    int32_t i = 0, frac = 0;
+
+    if (x >= 16 * Q12_ONE)
+        return 0;
+    i = x >> LUT_SHIFT;
+    frac = x & ((1 << LUT_SHIFT) - 1);
+    return expLUT[i] + (((expLUT[i + 1] - expLUT[i]) * frac) >> LUT_SHIFT);
+}
+
+static int32_t DotI8(const int8_t *a, const int8_t *b, int n)
+{
+    int32_t sum = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    __m128i s;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a16 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i b16 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a16, b16));
+    }
+    s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    sum = _mm_cvtsi128_si32(s);
+#endif
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/** Symmetric int8 quantization of n floats, returns the scale (0 for an all zero row) **/
+static float QuantizeRow(const float *x, int n, int8_t *xq)
+{
+    float m = 0, inv = 0;
+    int i = 0;
+
+    for (i = 0; i < n; i++)
+        if (fabsf(x[i]) > m)
+            m = fabsf(x[i]);
+    if (m == 0) {
+        memset(xq, 0, n);
+        return 0;
+    }
+    inv = 127.0f / m;
+    for (i = 0; i < n; i++)
+        xq[i] = (int8_t)lrintf(x[i] * inv);
+    return m / 127.0f;
+}
+
+static int QuantizeDense(const struct Dense *d, struct QDense *q, long *bytes)
+{
+    float m = 0;
+    int i = 0, o = 0;
+
+    if (!d->wt)
+        return 0;
+    if (d->in > Q8_MAX_IN)
+        return -1;
+    q->in = d->in;
+    q->out = d->out;
+    q->w = (int8_t *)malloc(d->in * d->out);
+    q->wScale = (float *)malloc(sizeof(float) * d->out);
+    for (o = 0; o < d->out; o++)
+    {
+        m = 0;
+        for (i = 0; i < d->in; i++)
+            if (fabsf(d->wt[i * d->out + o]) > m)
+                m = fabsf(d->wt[i * d->out + o]);
+        q->wScale[o] = m > 0 ? m / 127.0f : 1.0f;
+        for (i = 0; i < d->in; i++)
+            q->w[o * d->in + i] = (int8_t)lrintf(d->wt[i * d->out + o] / q->wScale[o]);
+    }
+    *bytes += d->in * d->out + sizeof(float) * d->out;
+    if (d->b)
+    {
+        q->b = (float *)malloc(sizeof(float) * d->out);
+        memcpy(q->b, d->b, sizeof(float) * d->out);
+        *bytes += sizeof(float) * d->out;
+    }
+    return 0;
+}
+
+static void FreeQDense(struct QDense *q)
+{
+    free(q->w);
+    free(q->wScale);
+    free(q->b);
+}
+
+/** Quantizes a loaded float model. The float model must outlive the result,
+whose scaler and LayerNorm parameters point into it.
+**/
+struct QPredictor *QuantizePredictor(const struct Predictor *p)
+{
+    struct QPredictor *q = (struct QPredictor *)calloc(1, sizeof(struct QPredictor));
+    int l = 0, err = 0;
+
+    if (!tablesReady)
+        InitTables();
+    q->kind = p->kind;
+    q->inDim = p->inDim;
+    q->hidden = p->hidden;
+    q->heads = p->heads;
+    q->layers = p->layers;
+    q->mean = p->mean;
+    q->scale = p->scale;
+    q->weightBytes = sizeof(float) * 2 * p->inDim;
+    err |= QuantizeDense(&p->ff[0], &q->ff[0], &q->weightBytes);
+    err |= QuantizeDense(&p->ff[1], &q->ff[1], &q->weightBytes);
+    err |= QuantizeDense(&p->ff[2], &q->ff[2], &q->weightBytes);
+    err |= QuantizeDense(&p->ih, &q->ih, &q->weightBytes);
+    err |= QuantizeDense(&p->hh, &q->hh, &q->weightBytes);
+    err |= QuantizeDense(&p->proj, &q->proj, &q->weightBytes);
+    err |= QuantizeDense(&p->fc, &q->fc, &q->weightBytes);
+    for (l = 0; l < p->layers; l++)
+    {
+        err |= QuantizeDense(&p->enc[l].inProj, &q->enc[l].inProj, &q->weightBytes);
+        err |= QuantizeDense(&p->enc[l].outProj, &q->enc[l].outProj, &q->weightBytes);
+        err |= QuantizeDense(&p->enc[l].lin1, &q->enc[l].lin1, &q->weightBytes);
+        err |= QuantizeDense(&p->enc[l].lin2, &q->enc[l].lin2, &q->weightBytes);
+        q->enc[l].norm1W = p->enc[l].norm1W;
+        q->enc[l].norm1B = p->enc[l].norm1B;
+        q->enc[l].norm2W = p->enc[l].norm2W;
+        q->enc[l].norm2B = p->enc[l].norm2B;
+        q->weightBytes += sizeof(float) * 4 * p->hidden;
+    }
+    if (p->kind == MODEL_RNN || p->kind == MODEL_LSTM)
+        q->weightBytes += sizeof(sigmoidLUT) + sizeof(tanhLUT);
+    if (p->kind == MODEL_TFM)
+        q->weightBytes += sizeof(expLUT);
+    if (err || q->hidden > Q8_MAX_HIDDEN) {
+        printf("Model layers are too wide for the int8 kernels\n");
+        FreeQPredictor(q);
+        return NULL;
+    }
+    return q;
+}
+
+void FreeQPredictor(struct QPredictor *q)
+{
+    int l = 0;
+
+    if (!q)
+        return;
+    FreeQDense(&q->ff[0]);
+    FreeQDense(&q->ff[1]);
+    FreeQDense(&q->ff[2]);
+    FreeQDense(&q->ih);
+    FreeQDense(&q->hh);
+    FreeQDense(&q->proj);
+    FreeQDense(&q->fc);
+    for (l = 0; l < MODEL_MAX_LAYERS; l++)
+    {
+        FreeQDense(&q->enc[l].inProj);
+        FreeQDense(&q->enc[l].outProj);
+        FreeQDense(&q->enc[l].lin1);
+        FreeQDense(&q->enc[l].lin2);
+    }
+    free(q->work);
+    free(q);
+}
+
+/** y (rows x d->out) = x (rows x d->in) * W + b with int8 operands; xq is
+scratch for one quantized row (d->in bytes).
+**/
+void QGemm(const float *x, int rows, const struct QDense *d, float *y, int8_t *xq)
+{
+    int r = 0, o = 0;
+    float sx = 0;
+
+    for (r = 0; r < rows; r++)
+    {
+        sx = QuantizeRow(x + (long)r * d->in, d->in, xq);
+        for (o = 0; o < d->out; o++)
+            y[(long)r * d->out + o] = DotI8(d->w + (long)o * d->in, xq, d->in) * sx * d->wScale[o] +
+                                      (d->b ? d->b[o] : 0);
+    }
+}
+
+static float *EnsureWorkQ8(struct QPredictor *q, long floats)
+{
+    if (floats > q->workSize)
+    {
+        free(q->work);
+        q->work = (float *)malloc(sizeof(float) * floats);
+        q->workSize = q->work ? floats : 0;
+    }
+    return q->work;
+}
+
+static float SigmoidQ8(float v)
+{
+    return 1.0f / (1.0f + expf(-v));
+}
+
+static void StandardizeQ8(const struct QPredictor *q, const float *x, long rows, float *out)
+{
+    long r = 0;
+    int f = 0;
+
+    for (r = 0; r < rows; r++)
+        for (f = 0; f < q->inDim; f++)
+            out[r * q->inDim + f] = (x[r * q->inDim + f] - q->mean[f]) / q->scale[f];
+}
+
+int PredictRowsQ8(struct QPredictor *q, const float *x, int rows, float *prob)
+{
+    int8_t xq[Q8_MAX_IN];
+    float xn[Q8_MAX_IN], h1[Q8_MAX_IN], h2[Q8_MAX_IN], logit = 0;
+    int r = 0, j = 0;
+
+    if (q->kind != MODEL_FF || q->ff[0].out > Q8_MAX_IN || q->ff[1].out > Q8_MAX_IN)
+        return -1;
+    for (r = 0; r < rows; r++)
+    {
+        StandardizeQ8(q, x + (long)r * q->inDim, 1, xn);
+        QGemm(xn, 1, &q->ff[0], h1, xq);
+        for (j = 0; j < q->ff[0].out; j++)
+            h1[j] = h1[j] > 0 ? h1[j] : 0;
+        QGemm(h1, 1, &q->ff[1], h2, xq);
+        for (j = 0; j < q->ff[1].out; j++)
+            h2[j] = h2[j] > 0 ? h2[j] : 0;
+        QGemm(h2, 1, &q->ff[2], &logit, xq);
+        prob[r] = SigmoidQ8(logit);
+    }
+    return 0;
+}
+
+/** One instance of a recurrent model in fixed point, the kernel meant for the
+ECU: x is the raw feature row, st the state of the running sequence.
+**/
+float StepSequenceQ8(struct QPredictor *q, const float *x, struct QRecurrentState *st)
+{
+    const int hid = q->hidden, gates = q->ih.out;
+    int8_t xq[Q8_MAX_IN];
+    float xn[Q8_MAX_IN], z[4 * Q8_MAX_HIDDEN], logit = 0;
+    int32_t zq[4 * Q8_MAX_HIDDEN], ig = 0, fg = 0, gg = 0, og = 0, hq = 0;
+    int j = 0;
+
+    StandardizeQ8(q, x, 1, xn);
+    QGemm(xn, 1, &q->ih, z, xq);
+    for (j = 0; j < gates; j++)
+    {
+        // h is int8 with scale 1/127
+        z[j] += DotI8(q->hh.w + (long)j * hid, st->h, hid) * q->hh.wScale[j] * (1.0f / 127);
+        zq[j] = (int32_t)lrintf(fmaxf(fminf(z[j], 16.0f), -16.0f) * Q12_ONE);
+    }
+    for (j = 0; j < hid; j++)
+    {
+        if (q->kind == MODEL_LSTM)
+        {
+            ig = LutQ15(sigmoidLUT, zq[j]);
+            fg = LutQ15(sigmoidLUT, zq[hid + j]);
+            gg = LutQ15(tanhLUT, zq[2 * hid + j]);
+            og = LutQ15(sigmoidLUT, zq[3 * hid + j]);
+            // c (Q12) = f*c + i*g, Q15*Q12 >> 15 and Q15*Q15 >> 18
+            st->c[j] = (int32_t)(((int64_t)fg * st->c[j]) >> 15) + ((ig * gg) >> 18);
+            if (st->c[j] > 64 * Q12_ONE)
+                st->c[j] = 64 * Q12_ONE;
+            if (st->c[j] < -64 * Q12_ONE)
+                st->c[j] = -64 * Q12_ONE;
+            hq = (og * LutQ15(tanhLUT, st->c[j])) >> 15;
+        }
+        else
+            hq = LutQ15(tanhLUT, zq[j]);
+        st->h[j] = (int8_t)((hq * 127 + (1 << 14)) >> 15);
+    }
+    logit = DotI8(q->fc.w, st->h, hid) * q->fc.wScale[0] * (1.0f / 127) + q->fc.b[0];
+    return SigmoidQ8(logit);
+}
+
+/** Integer self-attention of one sequence (see SelfAttention for the layout).
+k and v get one scale per head over the sequence so the weighted sum stays in
+int32, and k is kept transposed (hd x L); q is quantized per token. scratch holds 2*L*d/heads bytes, score L ints.
+**/
+void SelfAttentionQ8(const float *qkv, int L, int d, int heads, float *out, int8_t *scratch, int32_t *score)
+{
+    const int hd = d / heads;
+    const float invSqrt = 1.0f / sqrtf((float)hd);
+    int8_t *kq = scratch, *vq = scratch + (long)L * hd, qq[Q8_MAX_HIDDEN];
+    float kmax = 0, vmax = 0, sk = 0, sv = 0, sq = 0;
+    int64_t mult = 0;
+    int32_t maxDot = 0, sum = 0, inv = 0, w = 0, acc[Q8_MAX_HIDDEN];
+    int hh = 0, t = 0, u = 0, i = 0;
+
+    for (hh = 0; hh < heads; hh++)
+    {
+        kmax = vmax = 0;
+        for (u = 0; u < L; u++)
+            for (i = 0; i < hd; i++)
+            {
+                kmax = fmaxf(kmax, fabsf(qkv[(long)u * 3 * d + d + hh * hd + i]));
+                vmax = fmaxf(vmax, fabsf(qkv[(long)u * 3 * d + 2 * d + hh * hd + i]));
+            }
+        sk = kmax > 0 ? kmax / 127 : 1;
+        sv = vmax > 0 ? vmax / 127 : 1;
+        for (u = 0; u < L; u++)
+            for (i = 0; i < hd; i++)
+            {
+                kq[i * L + u] = (int8_t)lrintf(qkv[(long)u * 3 * d + d + hh * hd + i] / sk);
+                vq[u * hd + i] = (int8_t)lrintf(qkv[(long)u * 3 * d + 2 * d + hh * hd + i] / sv);
+            }
+
+        for (t = 0; t < L; t++)
+        {
+            sq = QuantizeRow(qkv + (long)t * 3 * d + hh * hd, hd, qq);
+            // k is stored transposed so every score is built with unit stride over the tokens
+            memset(score, 0, sizeof(int32_t) * L);
+            for (i = 0; i < hd; i++)
+                for (u = 0; u < L; u++)
+                    score[u] += qq[i] * kq[i * L + u];
+            maxDot = INT32_MIN;
+            for (u = 0; u < L; u++)
+                if (score[u] > maxDot)
+                    maxDot = score[u];
+            // Distance to the maximum score in Q12, through a Q16 multiplier
+            mult = (int64_t)llrintf(sq * sk * invSqrt * Q12_ONE * 65536.0f);
+            sum = 0;
+            for (u = 0; u < L; u++)
+            {
+                score[u] = ExpNegQ15((int32_t)(((int64_t)(maxDot - score[u]) * mult) >> 16));
+                sum += score[u];
+            }
+            // Normalized weights in Q15 sum to 1, so the weighted sum fits int32
+            inv = (1 << 30) / sum;
+            memset(acc, 0, sizeof(int32_t) * hd);
+            for (u = 0; u < L; u++)
+            {
+                w = (score[u] * inv) >> 15;
+                for (i = 0; i < hd; i++)
+                    acc[i] += w * vq[u * hd + i];
+            }
+            for (i = 0; i < hd; i++)
+                out[(long)t * d + hh * hd + i] = acc[i] * sv * (1.0f / 32768);
+        }
+    }
+}
+
+static void TransformerSequenceQ8(struct QPredictor *q, const float *xn, int L, float *work, float *logit)
+{
+    const int d = q->hidden, ffDim = q->enc[0].lin1.out;
+    float *z = work, *qkv = z + (long)L * d, *att = qkv + (long)L * 3 * d, *tmp = att + (long)L * d;
+    float *ff = tmp + (long)L * d;
+    int8_t *scratch = (int8_t *)(ff + (long)L * ffDim), xq[Q8_MAX_IN];
+    int32_t *score = (int32_t *)(scratch + 2 * (long)L * d); // 2*L*d bytes keep it 4-aligned
+    long i = 0;
+    int l = 0;
+
+    QGemm(xn, L, &q->proj, z, xq);
+    for (l = 0; l < q->layers; l++)
+    {
+        QGemm(z, L, &q->enc[l].inProj, qkv, xq);
+        SelfAttentionQ8(qkv, L, d, q->heads, att, scratch, score);
+        QGemm(att, L, &q->enc[l].outProj, tmp, xq);
+        AddLayerNorm(z, tmp, L, d, q->enc[l].norm1W, q->enc[l].norm1B);
+        QGemm(z, L, &q->enc[l].lin1, ff, xq);
+        for (i = 0; i < (long)L * ffDim; i++)
+            ff[i] = ff[i] > 0 ? ff[i] : 0;
+        QGemm(ff, L, &q->enc[l].lin2, tmp, xq);
+        AddLayerNorm(z, tmp, L, d, q->enc[l].norm2W, q->enc[l].norm2B);
+    }
+    QGemm(z, L, &q->fc, logit, xq);
+}
+
+/** Same contract as PredictSequences **/
+int PredictSequencesQ8(struct QPredictor *q, const float *x, const int *lens, int seqCount, float *prob)
+{
+    struct QRecurrentState st;
+    long base = 0;
+    int s = 0, t = 0, maxLen = 0;
+    float *xn, *logit, *work;
+
+    if (q->kind == MODEL_RNN || q->kind == MODEL_LSTM)
+    {
+        for (s = 0, base = 0; s < seqCount; base += lens[s], s++)
+        {
+            memset(&st, 0, sizeof(st));
+            for (t = 0; t < lens[s]; t++)
+                prob[base + t] = StepSequenceQ8(q, x + (base + t) * q->inDim, &st);
+        }
+        return 0;
+    }
+    if (q->kind != MODEL_TFM)
+        return -1;
+    for (s = 0; s < seqCount; s++)
+        if (lens[s] > maxLen)
+            maxLen = lens[s];
+    xn = EnsureWorkQ8(q, (long)maxLen * (q->inDim + 1 + 6 * q->hidden + q->enc[0].lin1.out) +
+                             (2 * (long)maxLen * q->hidden + 4 * (long)maxLen) / sizeof(float) + 1);
+    if (!xn)
+        return -1;
+    logit = xn + (long)maxLen * q->inDim;
+    work = logit + maxLen;
+    for (s = 0, base = 0; s < seqCount; base += lens[s], s++)
+    {
+        if (lens[s] == 0)
+            continue;
+        StandardizeQ8(q, x + base * q->inDim, lens[s], xn);
+        TransformerSequenceQ8(q, xn, lens[s], work, logit);
+        for (t = 0; t < lens[s]; t++)
+            prob[base + t] = SigmoidQ8(logit[t]);
+    }
+    return 0;
+}
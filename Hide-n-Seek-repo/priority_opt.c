@@ -0,0 +1,393 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<pthread.h>
+#include "obfuscation.h"
+#include "event_ring.h"
+
+/** Audsley-style CAN ID assignment for the messages of the target ECU.
+The IDs currently used by the ECU are the available priority levels. Levels
+are filled from the lowest priority (largest ID) upwards: at each level every
+still unassigned message is tried, the ones that keep themselves and the
+other bus frames at that level schedulable are scored with the what-if
+engine, and the one with the fewest attackable instances takes the level.
+Scoring at a level is independent per message, so it is spread over threads.
+The choice is greedy per level and the counts are those of the what-if
+engine, whose re-arbitration only approximates the bus (see whatif.c); the
+proposal is schedulable, not optimal, and can score worse than the IDs the
+ECU uses today.
+**/
+
+struct BusTiming
+{
+    double period; // mean inter-arrival time in seconds
+    double C; // worst-case transmission time in seconds
+};
+
+struct AudsleyState
+{
+    const struct BusyPeriodIndex *idx;
+    struct Message *candidates;
+    int candCount;
+    struct BusTiming *bus; // per rank
+    int *isECU; // per rank: 1 if the ID belongs to the target ECU
+    int *slotID; // available IDs in ascending order
+    int *ownRank; // per candidate: rank of its original ID, -1 if not in the trace
+    double *ownC; // per candidate: worst-case transmission time
+    int *assigned; // per candidate: level it got, -1 if unassigned
+    int *wasSchedulable; // per rank: bus frame schedulable under the current IDs
+    int level;
+    // per level results, one entry per candidate
+    int *cost;
+    int *feasible;
+};
+
+struct AudsleyWorker
+{
+    struct AudsleyState *st;
+    int first, step;
+    int failed; // out of memory, the level can't be decided
+};
+
+// Worst-case frame length with bit stuffing (Davis et al., standard 11-bit ID)
+static double WorstCaseTxTime(int DLC)
+{
+    int bits = 8*DLC + 47 + (34 + 8*DLC - 1)/4;
+    return bits/(busSpeed*1000);
+}
+
+// Integer-key position of an ID among the ranks of the trace, 2*rank if present.
+static int KeyOfID(const struct BusyPeriodIndex *idx, int ID)
+{
+    int l = 0, r = idx->idCount;
+    while (l < r) {
+        int m = l + (r - l) / 2;
+        if (idx->ids[m] < ID)
+            l = m + 1;
+        else
+            r = m;
+    }
+    if (l < idx->idCount && idx->ids[l] == ID)
+        return 2*l;
+    return 2*l - 1;
+}
+
+/** Response time test for one frame (Davis et al. sufficient form):
+hp holds the periods/transmission times of all higher priority frames,
+B the longest lower (or own) priority frame. Deadline = period.
+**/
+static int Schedulable(double C, double T, double B, const double *hpT, const double *hpC, int hpCount)
+{
+    double tau = 1/(busSpeed*1000), w = B, next = 0;
+    int k = 0, iter = 0;
+
+    while (iter++ < 1000)
+    {
+        next = B;
+        for (k = 0; k < hpCount; k++)
+            next += ceil((w + tau)/hpT[k]) * hpC[k];
+        if (next + C > T)
+            return 0;
+        if (next == w)
+            return 1;
+        w = next;
+    }
+    return 0;
+}
+
+// Checks frame (C, T) at priority key 'key' given which ECU messages sit above it.
+// above[c] = 1 for candidates above, below[c] = 1 for candidates below.
+static int FrameSchedulable(struct AudsleyState *st, double C, double T, int key,
+                            const int *above, const int *below, double *hpT, double *hpC)
+{
+    int r = 0, c = 0, n = 0;
+    double B = C;
+
+    for (r = 0; r < st->idx->idCount; r++)
+    {
+        if (st->isECU[r] || 2*r == key)
+            continue;
+        if (2*r < key) {
+            hpT[n] = st->bus[r].period;
+            hpC[n++] = st->bus[r].C;
+        }
+        else if (st->bus[r].C > B)
+            B = st->bus[r].C;
+    }
+    for (c = 0; c < st->candCount; c++)
+    {
+        if (above[c]) {
+            hpT[n] = st->candidates[c].periodicity;
+            hpC[n++] = st->ownC[c];
+        }
+        else if (below[c] && st->ownC[c] > B)
+            B = st->ownC[c];
+    }
+    return Schedulable(C, T, B, hpT, hpC, n);
+}
+
+// Fills prio with m at the current level, the other unassigned messages in the free levels above it
+static void TrialPriority(struct AudsleyState *st, int m, int *prio)
+{
+    int c = 0, spare = 0, lvl = 0;
+
+    for (c = 0; c < st->idx->idCount; c++)
+        prio[c] = 2*c;
+    for (c = 0; c < st->candCount; c++)
+    {
+        if (st->ownRank[c] < 0)
+            continue;
+        if (c == m)
+            lvl = st->level;
+        else if (st->assigned[c] >= 0)
+            lvl = st->assigned[c];
+        else
+            lvl = spare++;
+        prio[st->ownRank[c]] = KeyOfID(st->idx, st->slotID[lvl]);
+    }
+}
+
+// Returns -1 if the what-if engine ran out of memory, 0 otherwise
+static int EvaluateCandidate(struct AudsleyState *st, int m, int *prio, int *lens,
+                             int *above, int *below, double *hpT, double *hpC)
+{
+    int c = 0, r = 0, key = KeyOfID(st->idx, st->slotID[st->level]);
+    int upper = st->level > 0 ? KeyOfID(st->idx, st->slotID[st->level - 1]) : -1;
+
+    for (c = 0; c < st->candCount; c++)
+    {
+        above[c] = (c != m && st->assigned[c] < 0);
+        below[c] = (c == m || st->assigned[c] >= 0);
+    }
+    st->feasible[m] = 0;
+    // m itself, with its own frame counted as blocking
+    below[m] = 0;
+    if (!FrameSchedulable(st, st->ownC[m], st->candidates[m].periodicity, key, above, below, hpT, hpC)) {
+        EVENT(EVCAT_OPT, EV_AUDSLEY_EVAL, st->slotID[st->level], st->candidates[m].ID, 0, 0, 0);
+        return 0;
+    }
+    below[m] = 1;
+    // bus frames between this level and the next one up see m as blocking,
+    // the rest of the bus does not depend on which message takes this level
+    for (r = 0; r < st->idx->idCount; r++)
+    {
+        if (st->isECU[r] || !st->wasSchedulable[r] || 2*r <= upper || 2*r >= key)
+            continue;
+        if (!FrameSchedulable(st, st->bus[r].C, st->bus[r].period, 2*r, above, below, hpT, hpC)) {
+            EVENT(EVCAT_OPT, EV_AUDSLEY_EVAL, st->slotID[st->level], st->candidates[m].ID, 0, 0, 0);
+            return 0;
+        }
+    }
+    TrialPriority(st, m, prio);
+    st->cost[m] = WhatIfAttackWindows(st->idx, prio, &st->candidates[m], 1, lens);
+    st->feasible[m] = st->cost[m] >= 0;
+    EVENT(EVCAT_OPT, EV_AUDSLEY_EVAL, st->slotID[st->level], st->candidates[m].ID, 1, st->cost[m], 0);
+    return st->feasible[m] ? 0 : -1;
+}
+
+static void *AudsleyWorkerRun(void *arg)
+{
+    struct AudsleyWorker *w = (struct AudsleyWorker *)arg;
+    struct AudsleyState *st = w->st;
+    int m = 0, n = st->idx->idCount + st->candCount + 1;
+    int *prio = (int *)calloc(st->idx->idCount + 1, sizeof(int));
+    int *lens = (int *)calloc(1, sizeof(int));
+    int *above = (int *)calloc(st->candCount, sizeof(int));
+    int *below = (int *)calloc(st->candCount, sizeof(int));
+    double *hpT = (double *)calloc(n, sizeof(double));
+    double *hpC = (double *)calloc(n, sizeof(double));
+    int *grown = NULL;
+
+    w->failed = !prio || !lens || !above || !below || !hpT || !hpC;
+    for (m = w->first; m < st->candCount && !w->failed; m += w->step)
+    {
+        if (st->assigned[m] >= 0)
+            continue;
+        grown = (int *)realloc(lens, sizeof(int) * (st->candidates[m].count + 1));
+        if (!grown) {
+            w->failed = 1;
+            break;
+        }
+        lens = grown;
+        if (EvaluateCandidate(st, m, prio, lens, above, below, hpT, hpC) < 0)
+            w->failed = 1;
+    }
+    free(prio);
+    free(lens);
+    free(above);
+    free(below);
+    free(hpT);
+    free(hpC);
+    return NULL;
+}
+
+/** Proposes a complete ID assignment for candidates[0..candCount-1] using
+the IDs they currently hold. newID[c] receives the ID proposed for candidate c.
+Returns the total number of attackable instances under the proposal, or -1
+if no schedulable assignment was found.
+**/
+int OptimizePriorityAssignment(const struct BusyPeriodIndex *idx, struct Message *CANTraffic, int CANCount,
+                               struct Message *candidates, int candCount, int threads, int *newID)
+{
+    struct AudsleyState st;
+    struct AudsleyWorker *workers;
+    pthread_t *tids;
+    double *first, *last;
+    int *seen, *maxDlc, *prio, *lens, *above, *below;
+    double *hpT, *hpC;
+    int c = 0, r = 0, t = 0, best = 0, total = 0, cnt = 0;
+
+    if (threads < 1)
+        threads = 1;
+    memset(&st, 0, sizeof(st));
+    st.idx = idx;
+    st.candidates = candidates;
+    st.candCount = candCount;
+    st.bus = (struct BusTiming *)calloc(idx->idCount + 1, sizeof(struct BusTiming));
+    st.isECU = (int *)calloc(idx->idCount + 1, sizeof(int));
+    st.slotID = (int *)calloc(candCount, sizeof(int));
+    st.ownRank = (int *)calloc(candCount, sizeof(int));
+    st.ownC = (double *)calloc(candCount, sizeof(double));
+    st.assigned = (int *)calloc(candCount, sizeof(int));
+    st.cost = (int *)calloc(candCount, sizeof(int));
+    st.feasible = (int *)calloc(candCount, sizeof(int));
+    first = (double *)calloc(idx->idCount + 1, sizeof(double));
+    last = (double *)calloc(idx->idCount + 1, sizeof(double));
+    seen = (int *)calloc(idx->idCount + 1, sizeof(int));
+    maxDlc = (int *)calloc(idx->idCount + 1, sizeof(int));
+
+    // Periods and worst-case lengths of everything seen on the bus
+    for (c = 0; c < idx->frameCount; c++)
+    {
+        r = idx->rank[c];
+        if (seen[r]++ == 0)
+            first[r] = CANTraffic[c].txTime;
+        last[r] = CANTraffic[c].txTime;
+        if (CANTraffic[c].DLC > maxDlc[r])
+            maxDlc[r] = CANTraffic[c].DLC;
+    }
+    for (r = 0; r < idx->idCount; r++)
+    {
+        st.bus[r].C = WorstCaseTxTime(maxDlc[r]);
+        if (seen[r] > 1)
+            st.bus[r].period = (last[r] - first[r])/(seen[r] - 1);
+        else // sporadic, assume once per trace
+            st.bus[r].period = CANCount > 1 ? CANTraffic[CANCount-1].txTime - CANTraffic[0].txTime : 1;
+        if (st.bus[r].period <= 0)
+            st.bus[r].period = 1;
+    }
+    for (c = 0; c < candCount; c++)
+    {
+        st.slotID[c] = candidates[c].ID;
+        st.ownRank[c] = IDToRank(idx, candidates[c].ID);
+        st.ownC[c] = WorstCaseTxTime(st.ownRank[c] >= 0 ? maxDlc[st.ownRank[c]] : 8);
+        st.assigned[c] = -1;
+        if (st.ownRank[c] >= 0)
+            st.isECU[st.ownRank[c]] = 1;
+    }
+    qsort(st.slotID, candCount, sizeof(int), CompareInt);
+
+    // Frames already unschedulable with the current IDs are reported and not held against any proposal
+    st.wasSchedulable = (int *)calloc(idx->idCount + 1, sizeof(int));
+    above = (int *)calloc(candCount, sizeof(int));
+    below = (int *)calloc(candCount, sizeof(int));
+    hpT = (double *)calloc(idx->idCount + candCount + 1, sizeof(double));
+    hpC = (double *)calloc(idx->idCount + candCount + 1, sizeof(double));
+    for (r = 0; r < idx->idCount; r++)
+    {
+        if (st.isECU[r])
+            continue;
+        for (c = 0; c < candCount; c++)
+        {
+            above[c] = KeyOfID(idx, candidates[c].ID) < 2*r;
+            below[c] = !above[c];
+        }
+        st.wasSchedulable[r] = FrameSchedulable(&st, st.bus[r].C, st.bus[r].period, 2*r, above, below, hpT, hpC);
+        if (!st.wasSchedulable[r])
+            printf("\n Audsley: ID %d is already unschedulable on this bus", idx->ids[r]);
+    }
+    free(above);
+    free(below);
+    free(hpT);
+    free(hpC);
+
+    workers = (struct AudsleyWorker *)calloc(threads, sizeof(struct AudsleyWorker));
+    tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    for (st.level = candCount - 1; st.level >= 0; st.level--)
+    {
+        for (t = 0; t < threads; t++)
+        {
+            workers[t].st = &st;
+            workers[t].first = t;
+            workers[t].step = threads;
+            pthread_create(&tids[t], NULL, AudsleyWorkerRun, &workers[t]);
+        }
+        for (t = 0; t < threads; t++)
+            pthread_join(tids[t], NULL);
+        for (t = 0; t < threads; t++)
+            if (workers[t].failed)
+                total = -1;
+        if (total < 0)
+        {
+            printf("\n Audsley: out of memory at ID %d", st.slotID[st.level]);
+            break;
+        }
+
+        // Fewest attackable instances first, then the longest period goes lowest (deadline monotonic)
+        best = -1;
+        for (c = 0; c < candCount; c++)
+        {
+            if (st.assigned[c] >= 0 || !st.feasible[c])
+                continue;
+            if (best < 0 || st.cost[c] < st.cost[best] ||
+                (st.cost[c] == st.cost[best] && candidates[c].periodicity > candidates[best].periodicity))
+                best = c;
+        }
+        if (best < 0)
+        {
+            printf("\n Audsley: no message is schedulable at ID %d", st.slotID[st.level]);
+            total = -1;
+            break;
+        }
+        EVENT(EVCAT_OPT, EV_AUDSLEY_ASSIGN, st.slotID[st.level], candidates[best].ID, st.cost[best], 0, 0);
+        st.assigned[best] = st.level;
+    }
+
+    if (total == 0)
+    {
+        prio = (int *)calloc(idx->idCount + 1, sizeof(int));
+        for (c = 0; c < candCount; c++)
+        {
+            newID[c] = st.slotID[st.assigned[c]];
+            cnt += candidates[c].count;
+        }
+        // Score the whole assignment at once
+        for (r = 0; r < idx->idCount; r++)
+            prio[r] = 2*r;
+        for (c = 0; c < candCount; c++)
+            if (st.ownRank[c] >= 0)
+                prio[st.ownRank[c]] = KeyOfID(idx, newID[c]);
+        lens = (int *)calloc(cnt + 1, sizeof(int));
+        total = WhatIfAttackWindows(idx, prio, candidates, candCount, lens);
+        free(lens);
+        free(prio);
+    }
+
+    free(workers);
+    free(tids);
+    free(first);
+    free(last);
+    free(seen);
+    free(maxDlc);
+    free(st.bus);
+    free(st.isECU);
+    free(st.slotID);
+    free(st.ownRank);
+    free(st.ownC);
+    free(st.assigned);
+    free(st.wasSchedulable);
+    free(st.cost);
+    free(st.feasible);
+    return total;
+}
@@ -0,0 +1,367 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "obfuscation.h"
+
+/** What-if engine for obfuscation 3.
+The attack window of a candidate instance only depends on the run of
+back-to-back higher priority frames right before it inside the same busy
+period. Once the trace is indexed by busy period and by ID, the windows for
+any priority remapping can be re-derived by walking those runs backwards,
+without re-parsing the trace or re-running AnalyzeCANTraffic.
+Under new priorities the frames of a busy period no longer go out in the
+logged order, so every busy period is arbitrated again first. The release
+times are not in the log; a frame is taken as pending from ready[j] on, the
+earliest the logged order allows, and at every position of the busy period
+the highest priority pending frame wins. Positions stand for time: the frames
+keep the start positions, not the start times, of the log. ArbitrateTrace
+writes the same order as a trace for the full analyzer.
+**/
+
+int CompareInt(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+int IDToRank(const struct BusyPeriodIndex *idx, int ID)
+{
+    int l = 0, r = idx->idCount - 1;
+    while (l <= r) {
+        int m = l + (r - l) / 2;
+        if (idx->ids[m] == ID)
+            return m;
+        if (idx->ids[m] < ID)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return -1;
+}
+
+// Builds the index in one pass over the parsed trace.
+// Returns 0 on success, -1 if memory could not be allocated.
+int BuildBusyPeriodIndex(struct Message *CANTraffic, int CANCount, struct BusyPeriodIndex *idx)
+{
+    int j = 0, n = 0, r = 0;
+    float txEnds = 0, maxIdle = (minDlc*8+47)/(busSpeed*1000);
+    int *sorted, *fill;
+
+    memset(idx, 0, sizeof(*idx));
+    // AnalyzeCANTraffic never looks at the last frame, neither do we
+    n = CANCount > 0 ? CANCount - 1 : 0;
+    idx->frameCount = n;
+    idx->rank = (unsigned short *)calloc(n + 1, sizeof(unsigned short));
+    idx->bits = (unsigned short *)calloc(n + 1, sizeof(unsigned short));
+    idx->busyStart = (int *)calloc(n + 1, sizeof(int));
+    idx->ready = (int *)calloc(n + 1, sizeof(int));
+    idx->byReady = (int *)calloc(n + 1, sizeof(int));
+    sorted = (int *)calloc(n + 1, sizeof(int));
+    if (!idx->rank || !idx->bits || !idx->busyStart || !idx->ready || !idx->byReady || !sorted) {
+        free(sorted);
+        FreeBusyPeriodIndex(idx);
+        return -1;
+    }
+
+    // Distinct IDs in ascending order give the identity priority ranks
+    for (j = 0; j < n; j++)
+        sorted[j] = CANTraffic[j].ID;
+    qsort(sorted, n, sizeof(int), CompareInt);
+    for (j = 0; j < n; j++)
+        if (j == 0 || sorted[j] != sorted[j-1])
+            sorted[idx->idCount++] = sorted[j];
+    idx->ids = (int *)realloc(sorted, sizeof(int) * (idx->idCount + 1));
+
+    idx->occStart = (int *)calloc(idx->idCount + 1, sizeof(int));
+    idx->occ = (int *)calloc(n + 1, sizeof(int));
+    fill = (int *)calloc(n + 1, sizeof(int));
+    if (!idx->ids || !idx->occStart || !idx->occ || !fill) {
+        free(fill);
+        FreeBusyPeriodIndex(idx);
+        return -1;
+    }
+
+    for (j = 0; j < n; j++) {
+        idx->rank[j] = (unsigned short)IDToRank(idx, CANTraffic[j].ID);
+        idx->bits[j] = (unsigned short)FrameBits(&CANTraffic[j]);
+        // Same idle test as AnalyzeCANTraffic: a gap after frame j-1 starts a new busy period
+        if (j == 0)
+            idx->busyStart[j] = 0;
+        else {
+            txEnds = FrameBits(&CANTraffic[j-1])/(busSpeed*1000);
+            if ((CANTraffic[j].txTime - (CANTraffic[j-1].txTime + txEnds)) > maxIdle)
+                idx->busyStart[j] = j;
+            else
+                idx->busyStart[j] = idx->busyStart[j-1];
+        }
+        idx->occStart[idx->rank[j] + 1]++;
+    }
+    for (r = 0; r < idx->idCount; r++)
+        idx->occStart[r + 1] += idx->occStart[r];
+    memset(fill, 0, sizeof(int) * (idx->idCount + 1));
+    for (j = 0; j < n; j++) {
+        r = idx->rank[j];
+        idx->occ[idx->occStart[r] + fill[r]++] = j;
+    }
+
+    // ready: after the nearest larger rank logged before j in its busy period, kept on a stack (fill)
+    for (j = 0, r = 0; j < n; j++) {
+        if (idx->busyStart[j] == j)
+            r = 0;
+        while (r > 0 && idx->rank[fill[r - 1]] <= idx->rank[j])
+            r--;
+        idx->ready[j] = r > 0 ? fill[r - 1] + 1 : idx->busyStart[j];
+        fill[r++] = j;
+        if (j - idx->busyStart[j] + 1 > idx->maxBusyLen)
+            idx->maxBusyLen = j - idx->busyStart[j] + 1;
+    }
+    // byReady: counting sort on ready, which stays inside the busy period
+    memset(fill, 0, sizeof(int) * (n + 1));
+    for (j = 0; j < n; j++)
+        fill[idx->ready[j] + 1]++;
+    for (j = 0; j < n; j++)
+        fill[j + 1] += fill[j];
+    for (j = 0; j < n; j++)
+        idx->byReady[fill[idx->ready[j]]++] = j;
+    free(fill);
+    PRINT("\n Busy period index: %d frames, %d IDs", n, idx->idCount);
+    return 0;
+}
+
+void FreeBusyPeriodIndex(struct BusyPeriodIndex *idx)
+{
+    free(idx->ids);
+    free(idx->rank);
+    free(idx->bits);
+    free(idx->busyStart);
+    free(idx->ready);
+    free(idx->byReady);
+    free(idx->occStart);
+    free(idx->occ);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// prio[rank] = rank, i.e. the priorities as logged
+void IdentityPriority(const struct BusyPeriodIndex *idx, int *prio)
+{
+    int r = 0;
+    for (r = 0; r < idx->idCount; r++)
+        prio[r] = r;
+}
+
+// Pending frames of a busy period, highest priority (then first logged) on top
+static int HeapBefore(const struct BusyPeriodIndex *idx, const int *prio, int a, int b)
+{
+    int pa = prio[idx->rank[a]], pb = prio[idx->rank[b]];
+    return pa < pb || (pa == pb && a < b);
+}
+
+static void HeapPush(const struct BusyPeriodIndex *idx, const int *prio, int *heap, int *len, int f)
+{
+    int c = (*len)++, p = 0;
+
+    while (c > 0 && HeapBefore(idx, prio, f, heap[p = (c - 1) / 2])) {
+        heap[c] = heap[p];
+        c = p;
+    }
+    heap[c] = f;
+}
+
+static int HeapPop(const struct BusyPeriodIndex *idx, const int *prio, int *heap, int *len)
+{
+    int top = heap[0], f = heap[--(*len)], c = 0, k = 0;
+
+    while ((k = 2 * c + 1) < *len) {
+        if (k + 1 < *len && HeapBefore(idx, prio, heap[k + 1], heap[k]))
+            k++;
+        if (!HeapBefore(idx, prio, heap[k], f))
+            break;
+        heap[c] = heap[k];
+        c = k;
+    }
+    heap[c] = f;
+    return top;
+}
+
+/** Arbitrates the busy period starting at frame bs under prio: order[m] is the
+frame going out at position m, pos[j - bs] the position of frame j. heap needs
+maxBusyLen ints. Returns the number of frames of the busy period.
+**/
+static int ArbitrateBusyPeriod(const struct BusyPeriodIndex *idx, const int *prio, int bs,
+                               int *heap, int *order, int *pos)
+{
+    int end = bs, c = bs, m = 0, len = 0;
+
+    while (end < idx->frameCount && idx->busyStart[end] == bs)
+        end++;
+    for (m = 0; m < end - bs; m++)
+    {
+        while (c < end && idx->ready[idx->byReady[c]] <= bs + m)
+            HeapPush(idx, prio, heap, &len, idx->byReady[c++]);
+        order[m] = HeapPop(idx, prio, heap, &len);
+        pos[order[m] - bs] = m;
+    }
+    return end - bs;
+}
+
+/** Re-derives the attack window length of every instance of every candidate
+under the priority map prio (prio[rank], smaller value = higher priority).
+atkWinLen must hold sum(candidates[i].count) ints; the instances of candidate i
+start right after those of candidate i-1. Instances are slotted exactly like a
+single AnalyzeCANTraffic pass (execution pattern included) and reduced with
+min over hyper periods, on the busy periods arbitrated again under prio.
+Returns the total number of attackable instances, -1 if out of memory.
+**/
+int WhatIfAttackWindows(const struct BusyPeriodIndex *idx, const int *prio,
+                        struct Message *candidates, int candCount, int *atkWinLen)
+{
+    int i = 0, o = 0, q = 0, l = 0, k = 0, slot = 0, attackable = 0, bs = -1;
+    int *lens = atkWinLen;
+    int *heap = (int *)malloc(sizeof(int) * (idx->maxBusyLen + 1));
+    int *order = (int *)malloc(sizeof(int) * (idx->maxBusyLen + 1));
+    int *pos = (int *)malloc(sizeof(int) * (idx->maxBusyLen + 1));
+
+    if (!heap || !order || !pos) {
+        free(heap);
+        free(order);
+        free(pos);
+        return -1;
+    }
+
+    for (i = 0; i < candCount; i++)
+    {
+        int count = candidates[i].count;
+        int r = IDToRank(idx, candidates[i].ID);
+        int readCount = 0;
+
+        memset(lens, 0, sizeof(int) * count);
+        if (r < 0) {
+            lens += count;
+            continue;
+        }
+        for (o = idx->occStart[r]; o < idx->occStart[r + 1]; o++)
+        {
+            int p = idx->occ[o], len = 0;
+            // The order of a busy period does not depend on the candidate, it is kept for the next occurrences
+            if (idx->busyStart[p] != bs) {
+                bs = idx->busyStart[p];
+                ArbitrateBusyPeriod(idx, prio, bs, heap, order, pos);
+            }
+            // Walk back over the run of higher priority frames preceding p
+            for (q = pos[p - bs] - 1; q >= 0 && prio[idx->rank[order[q]]] < prio[r]; q--)
+                len += idx->bits[order[q]];
+
+            k = 0;
+            for (l = readCount; l < count; l++)
+                if (candidates[i].pattern[l] == 0)
+                    k++;
+            slot = (readCount + k) % count;
+            if (readCount >= count)
+                lens[slot] = len < lens[slot] ? len : lens[slot];
+            else
+                lens[slot] = len;
+            readCount = readCount + k + 1;
+        }
+        for (l = 0; l < count; l++)
+            if (lens[l] >= minAtkWinLen)
+                attackable++;
+        lens += count;
+    }
+    free(heap);
+    free(order);
+    free(pos);
+    return attackable;
+}
+
+/** The trace as the bus would carry it under prio, for the full analyzer:
+every busy period of idx is arbitrated again like in WhatIfAttackWindows, but
+here straight from the IDs of the frames and without the heap, as a check on
+the index. A frame is pending after the last larger ID logged before it in its
+busy period; at every position the pending frame with the smallest prio goes
+out. Positions keep the gaps of the log, so a busy period keeps its start and
+end. out gets CANCount frames, the last one (not in idx) as it is.
+Returns 0, or -1 if out of memory.
+**/
+int ArbitrateTrace(const struct Message *CANTraffic, int CANCount, const struct BusyPeriodIndex *idx,
+                   const int *prio, struct Message *out)
+{
+    int bs = 0, end = 0, m = 0, j = 0, k = 0, best = 0;
+    int *from = (int *)malloc(sizeof(int) * (idx->maxBusyLen + 1));
+    double rate = busSpeed * 1000, t = 0;
+
+    if (!from)
+        return -1;
+    memcpy(out, CANTraffic, sizeof(struct Message) * CANCount);
+    for (bs = 0; bs < idx->frameCount; bs = end)
+    {
+        // from: first position at which the frame can be pending, -1 once it is out
+        for (end = bs; end < idx->frameCount && idx->busyStart[end] == bs; end++)
+        {
+            for (k = end - 1; k >= bs && CANTraffic[k].ID <= CANTraffic[end].ID; k--)
+                ;
+            from[end - bs] = k + 1;
+        }
+        t = CANTraffic[bs].txTime;
+        for (m = bs; m < end; m++)
+        {
+            best = -1;
+            for (j = bs; j < end; j++)
+                if (from[j - bs] >= 0 && from[j - bs] <= m && (best < 0 || prio[idx->rank[j]] < prio[idx->rank[best]]))
+                    best = j;
+            from[best - bs] = -1;
+            if (m > bs)
+                t += FrameBits(&out[m - 1]) / rate
+                     + (CANTraffic[m].txTime - CANTraffic[m - 1].txTime - FrameBits(&CANTraffic[m - 1]) / rate);
+            out[m] = CANTraffic[best];
+            out[m].txTime = (float)t;
+        }
+    }
+    free(from);
+    return 0;
+}
+
+/** Scores swapping the priority of candidate 'target' with every other
+candidate of equal periodicity (obfuscation 3).
+Returns the index of the candidate giving the fewest attackable instances,
+or -1 if no swap beats the current assignment. *bestScore gets that count.
+**/
+int WhatIfBestSwap(const struct BusyPeriodIndex *idx, const int *prio,
+                   struct Message *candidates, int candCount, int target, int *bestScore)
+{
+    int i = 0, total = 0, best = -1, score = 0, rt = 0, rk = 0, tmp = 0;
+    int *lens, *trial;
+
+    for (i = 0; i < candCount; i++)
+        total += candidates[i].count;
+    lens = (int *)calloc(total + 1, sizeof(int));
+    trial = (int *)calloc(idx->idCount + 1, sizeof(int));
+    if (!lens || !trial) {
+        free(lens);
+        free(trial);
+        return -1;
+    }
+    memcpy(trial, prio, sizeof(int) * idx->idCount);
+
+    *bestScore = WhatIfAttackWindows(idx, trial, candidates, candCount, lens);
+    // Out of memory: no swap
+    rt = *bestScore >= 0 ? IDToRank(idx, candidates[target].ID) : -1;
+    for (i = 0; i < candCount && rt >= 0; i++)
+    {
+        if (i == target || candidates[i].periodicity != candidates[target].periodicity)
+            continue;
+        rk = IDToRank(idx, candidates[i].ID);
+        if (rk < 0)
+            continue;
+        tmp = trial[rt]; trial[rt] = trial[rk]; trial[rk] = tmp;
+        score = WhatIfAttackWindows(idx, trial, candidates, candCount, lens);
+        PRINT("\n What-if swap %d <-> %d: %d attackable", candidates[target].ID, candidates[i].ID, score);
+        if (score >= 0 && score < *bestScore) {
+            *bestScore = score;
+            best = i;
+        }
+        tmp = trial[rt]; trial[rt] = trial[rk]; trial[rk] = tmp;
+    }
+    free(lens);
+    free(trial);
+    return best;
+}
@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+"""
+export_model.py
+Converts a best_*.pt state_dict saved by classifier.ipynb into the flat
+.hnsm weight file read by Hide-n-Seek-repo/predictor.c. Needs neither
+torch nor numpy: the .pt zip is unpickled with a stub tensor rebuild.
+
+    python export_model.py best_lstm.pt [out.hnsm] [--scaler best_lstm_scaler.json]
+                           [--csv Hide-n-Seek-repo/final_candidates.csv] [--check]
+
+The StandardScaler is part of the model. classifier.ipynb saves it next to
+the weights (best_<model>_scaler.json); for older checkpoints without it the
+scaler is refitted on the whole --csv (by default Hide-n-Seek-repo/final_candidates.csv
+next to this script), which only approximates the training split. --check prints a pure-Python forward pass over --csv in the format of
+the analyzer's predictions.csv, to cross-check the C engine.
+"""
+import os, sys, json, math, struct, pickle, zipfile, collections, csv
+
+MAGIC, VERSION = b"HNSM", 1
+# Next to this script, so that the default works from any directory
+DEFAULT_CSV = os.path.join(os.path.dirname(os.path.abspath(__file__)), "Hide-n-Seek-repo", "final_candidates.csv")
+KINDS = dict(ff=0, rnn=1, lstm=2, tfm=3)
+TABULAR_FEATURES = ["Periodicity", "InstanceIndex", "AtkWinLen", "AtkWinCount",
+                    "AtkWinMsgCnt", "InsWinMsgCnt"]
+SEQ_FEATURES = ["Periodicity", "AtkWinLen", "AtkWinCount",
+                "AtkWinMsgCnt", "InsWinMsgCnt"]
+
+# ------------------------------ loading ----------------------------------
+class _Tensor:
+    def __init__(self, storage, offset, size, stride):
+        self.storage, self.offset, self.size, self.stride = storage, offset, tuple(size), tuple(stride)
+
+class _Unpickler(pickle.Unpickler):
+    def __init__(self, f, zf, prefix):
+        super().__init__(f)
+        self.zf, self.prefix, self.cache = zf, prefix, {}
+    def find_class(self, module, name):
+        if name == "_rebuild_tensor_v2":
+            return lambda st, off, size, stride, *a: _Tensor(st, off, size, stride)
+        if name == "OrderedDict":
+            return collections.OrderedDict
+        if name == "FloatStorage":
+            return "f"
+        return lambda *a, **k: None
+    def persistent_load(self, pid):
+        _, dtype, key, _, numel = pid
+        if dtype != "f":
+            raise ValueError("only float32 checkpoints are supported")
+        if key not in self.cache:
+            raw = self.zf.read(f"{self.prefix}/data/{key}")
+            self.cache[key] = struct.unpack(f"<{numel}f", raw[:4 * numel])
+        return self.cache[key]
+
+def load_state_dict(path):
+    """state_dict of a .pt file as {name: (shape, flat row-major list)}"""
+    zf = zipfile.ZipFile(path)
+    pkl = [n for n in zf.namelist() if n.endswith("data.pkl")][0]
+    prefix = pkl.rsplit("/", 1)[0]
+    sd = _Unpickler(zf.open(pkl), zf, prefix).load()
+    out = collections.OrderedDict()
+    for name, t in sd.items():
+        n = 1
+        for d in t.size:
+            n *= d
+        # contiguous row-major in every checkpoint of the notebook
+        out[name] = (t.size, list(t.storage[t.offset:t.offset + n]))
+    return out
+
+def model_kind(sd):
+    if "net.0.weight" in sd:
+        return "ff"
+    if "proj.weight" in sd:
+        return "tfm"
+    # LSTM stacks 4 gates in weight_ih
+    return "lstm" if sd["rnn.weight_ih_l0"][0][0] == 4 * sd["rnn.weight_hh_l0"][0][1] else "rnn"
+
+# ------------------------------- data ------------------------------------
+def _msg_count(cell):
+    toks = cell.replace(",", ";").split(";")
+    return len([t for t in toks if t.strip() and t.strip() != "-1"])
+
+def load_rows(path):
+    rows = []
+    with open(path, newline="") as f:
+        for r in csv.DictReader(f):
+            rows.append(dict(CandidateID=int(r["CandidateID"]), Periodicity=float(r["Periodicity"]),
+                             InstanceIndex=int(r["InstanceIndex"]), AtkWinLen=float(r["AtkWinLen"]),
+                             AtkWinCount=float(r["AtkWinCount"]),
+                             AtkWinMsgCnt=_msg_count(r["AtkWinMessages"]),
+                             InsWinMsgCnt=_msg_count(r["InsWinMessages"])))
+    return rows
+
+def fit_scaler(rows, features):
+    """StandardScaler.fit: population std, zero std -> 1"""
+    n = len(rows)
+    mean = [sum(r[f] for r in rows) / n for f in features]
+    scale = []
+    for f, m in zip(features, mean):
+        s = math.sqrt(sum((r[f] - m) ** 2 for r in rows) / n)
+        scale.append(s if s > 0 else 1.0)
+    return mean, scale
+
+# ------------------------------ writing ----------------------------------
+def write_model(path, kind, sd, mean, scale, heads):
+    with open(path, "wb") as f:
+        f.write(MAGIC)
+        f.write(struct.pack("<5I", VERSION, KINDS[kind], len(mean), heads, len(sd)))
+        f.write(struct.pack(f"<{len(mean)}f", *mean))
+        f.write(struct.pack(f"<{len(scale)}f", *scale))
+        for name, (shape, data) in sd.items():
+            b = name.encode()
+            f.write(struct.pack("<H", len(b)) + b)
+            f.write(struct.pack(f"<I{len(shape)}I", len(shape), *shape))
+            f.write(struct.pack(f"<{len(data)}f", *data))
+
+# ------------------------ reference forward pass -------------------------
+def _linear(sd, name, x):
+    (out_dim, in_dim), w = sd[name + ".weight"]
+    b = sd[name + ".bias"][1]
+    return [b[o] + sum(w[o * in_dim + i] * x[i] for i in range(in_dim)) for o in range(out_dim)]
+
+def _mat(sd, name, x, rows, cols, row0=0):
+    w = sd[name][1]
+    return [sum(w[(row0 + o) * cols + i] * x[i] for i in range(cols)) for o in range(rows)]
+
+def _sigmoid(v):
+    return 1.0 / (1.0 + math.exp(-v))
+
+def _layer_norm(x, g, b, eps=1e-5):
+    m = sum(x) / len(x)
+    v = sum((a - m) ** 2 for a in x) / len(x)
+    return [(a - m) / math.sqrt(v + eps) * g[i] + b[i] for i, a in enumerate(x)]
+
+def _rnn(sd, seq, lstm):
+    hid = sd["rnn.weight_hh_l0"][0][1]
+    gates = 4 * hid if lstm else hid
+    bih, bhh = sd["rnn.bias_ih_l0"][1], sd["rnn.bias_hh_l0"][1]
+    h, c, out = [0.0] * hid, [0.0] * hid, []
+    for x in seq:
+        a = _mat(sd, "rnn.weight_ih_l0", x, gates, len(x))
+        r = _mat(sd, "rnn.weight_hh_l0", h, gates, hid)
+        z = [a[i] + r[i] + bih[i] + bhh[i] for i in range(gates)]
+        if lstm:  # gate order i, f, g, o
+            c = [_sigmoid(z[hid + j]) * c[j] + _sigmoid(z[j]) * math.tanh(z[2 * hid + j]) for j in range(hid)]
+            h = [_sigmoid(z[3 * hid + j]) * math.tanh(c[j]) for j in range(hid)]
+        else:
+            h = [math.tanh(v) for v in z]
+        out.append(_sigmoid(_linear(sd, "fc", h)[0]))
+    return out
+
+def _tfm(sd, seq, heads):
+    x = [_linear(sd, "proj", v) for v in seq]
+    d = len(x[0]); hd = d // heads; L = len(x)
+    l = 0
+    while f"enc.layers.{l}.norm1.weight" in sd:
+        p = f"enc.layers.{l}."
+        w, b = sd[p + "self_attn.in_proj_weight"][1], sd[p + "self_attn.in_proj_bias"][1]
+        qkv = [[b[o] + sum(w[o * d + i] * t[i] for i in range(d)) for o in range(3 * d)] for t in x]
+        att = []
+        for t in range(L):
+            o = [0.0] * d
+            for hh in range(heads):
+                q = qkv[t][hh * hd:(hh + 1) * hd]
+                s = [sum(q[i] * qkv[u][d + hh * hd + i] for i in range(hd)) / math.sqrt(hd) for u in range(L)]
+                m = max(s); e = [math.exp(v - m) for v in s]; z = sum(e)
+                for i in range(hd):
+                    o[hh * hd + i] = sum(e[u] / z * qkv[u][2 * d + hh * hd + i] for u in range(L))
+            att.append(_linear(sd, p + "self_attn.out_proj", o))
+        x = [_layer_norm([a + c for a, c in zip(x[t], att[t])], sd[p + "norm1.weight"][1], sd[p + "norm1.bias"][1])
+             for t in range(L)]
+        ff = [_linear(sd, p + "linear2", [max(0.0, v) for v in _linear(sd, p + "linear1", t)]) for t in x]
+        x = [_layer_norm([a + c for a, c in zip(x[t], ff[t])], sd[p + "norm2.weight"][1], sd[p + "norm2.bias"][1])
+             for t in range(L)]
+        l += 1
+    return [_sigmoid(_linear(sd, "fc", t)[0]) for t in x]
+
+def reference(sd, kind, rows, mean, scale, heads):
+    feats = TABULAR_FEATURES if kind == "ff" else SEQ_FEATURES
+    norm = lambda r: [(r[f] - m) / s for f, m, s in zip(feats, mean, scale)]
+    pred = []
+    if kind == "ff":
+        for r in rows:
+            h = [max(0.0, v) for v in _linear(sd, "net.0", norm(r))]
+            h = [max(0.0, v) for v in _linear(sd, "net.2", h)]
+            pred.append((r["CandidateID"], r["InstanceIndex"], _sigmoid(_linear(sd, "net.4", h)[0])))
+        return pred
+    ids = []
+    for r in rows:
+        if r["CandidateID"] not in ids:
+            ids.append(r["CandidateID"])
+    for cid in ids:
+        g = sorted([r for r in rows if r["CandidateID"] == cid], key=lambda r: r["InstanceIndex"])
+        seq = [norm(r) for r in g]
+        p = _tfm(sd, seq, heads) if kind == "tfm" else _rnn(sd, seq, kind == "lstm")
+        pred += [(cid, r["InstanceIndex"], v) for r, v in zip(g, p)]
+    return pred
+
+# -------------------------------- main -----------------------------------
+def main(argv):
+    args, opts, i = [], dict(scaler=None, csv=DEFAULT_CSV, heads="4"), 0
+    check = False
+    while i < len(argv):
+        if argv[i] == "--check":
+            check = True
+        elif argv[i].startswith("--"):
+            opts[argv[i][2:]] = argv[i + 1]; i += 1
+        else:
+            args.append(argv[i])
+        i += 1
+    if not args:
+        print(__doc__); return 1
+    src = args[0]
+    dst = args[1] if len(args) > 1 else src.rsplit(".", 1)[0] + ".hnsm"
+    sd = load_state_dict(src)
+    kind = model_kind(sd)
+    feats = TABULAR_FEATURES if kind == "ff" else SEQ_FEATURES
+    rows = None
+    if opts["scaler"] is None:
+        guess = src.rsplit(".", 1)[0] + "_scaler.json"
+        try:
+            open(guess).close(); opts["scaler"] = guess
+        except OSError:
+            pass
+    if opts["scaler"]:
+        sc = json.load(open(opts["scaler"]))
+        mean, scale = sc["mean"], sc["scale"]
+    else:
+        rows = load_rows(opts["csv"])
+        mean, scale = fit_scaler(rows, feats)
+        print(f"warning: no scaler saved with {src}, refitted on {opts['csv']}", file=sys.stderr)
+    if len(mean) != len(feats):
+        print(f"scaler has {len(mean)} features, {kind} expects {len(feats)}", file=sys.stderr); return 1
+    write_model(dst, kind, sd, mean, scale, int(opts["heads"]))
+    print(f"{src} ({kind}, {len(sd)} tensors) -> {dst}", file=sys.stderr)
+    if check:
+        rows = rows or load_rows(opts["csv"])
+        print("CandidateID,InstanceIndex,Probability")
+        for cid, idx, p in reference(sd, kind, rows, mean, scale, int(opts["heads"])):
+            print(f"{cid},{idx},{p:.6f}")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))